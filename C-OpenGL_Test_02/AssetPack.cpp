@@ -0,0 +1,661 @@
+#include "AssetPack.h"
+#include<qdiriterator.h>
+#include<qfileinfo.h>
+#include<qdebug.h>
+#include<assimp/IOStream.hpp>
+#include<assimp/IOSystem.hpp>
+#include<algorithm>
+#include<chrono>
+#include<cstring>
+#include<fstream>
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::duration;
+
+namespace
+{
+    double elapsedMs(steady_clock::time_point begin)
+    {
+        return duration_cast<duration<double, std::milli>>(steady_clock::now() - begin).count();
+    }
+
+    bool readLoose(const std::string& path, std::vector<unsigned char>& bytes)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+            return false;
+        bytes.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+        return static_cast<bool>(file);
+    }
+
+    //a get area over bytes in memory, seekable so the KTX2 and cache readers can jump between levels
+    class MemoryBuffer :public std::streambuf
+    {
+    public:
+        MemoryBuffer(const unsigned char* data, size_t size)
+        {
+            char* begin = const_cast<char*>(reinterpret_cast<const char*>(data));
+            setg(begin, begin, begin + size);
+        }
+
+    protected:
+        pos_type seekoff(off_type offset, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+        {
+            char* from = dir == std::ios_base::beg ? eback() : dir == std::ios_base::cur ? gptr() : egptr();
+            if (offset < eback() - from || offset > egptr() - from)
+                return pos_type(off_type(-1));
+            setg(eback(), from + offset, egptr());
+            return pos_type(gptr() - eback());
+        }
+
+        pos_type seekpos(pos_type position, std::ios_base::openmode which) override
+        {
+            return seekoff(off_type(position), std::ios_base::beg, which);
+        }
+    };
+
+    //owns the bytes of a decompressed entry, or only looks at the mapping for a raw one
+    class MemoryStream :public std::istream
+    {
+    public:
+        MemoryStream(const unsigned char* data, size_t size)
+            :std::istream(nullptr), buffer(data, size)
+        {
+            rdbuf(&buffer);
+        }
+
+        explicit MemoryStream(std::vector<unsigned char> bytes)
+            :std::istream(nullptr), owned(std::move(bytes)), buffer(owned.data(), owned.size())
+        {
+            rdbuf(&buffer);
+        }
+
+    private:
+        std::vector<unsigned char> owned;
+        MemoryBuffer buffer;
+    };
+
+    class PackStream :public Assimp::IOStream
+    {
+    public:
+        PackStream(const unsigned char* data, size_t size)
+            :data(data), size(size)
+        {
+        }
+
+        explicit PackStream(std::vector<unsigned char> bytes)
+            :owned(std::move(bytes)), data(owned.data()), size(owned.size())
+        {
+        }
+
+        size_t Read(void* buffer, size_t elementSize, size_t count) override
+        {
+            if (elementSize == 0)
+                return 0;
+            size_t num = std::min(count, (size - position) / elementSize);
+            if (num > 0)
+                std::memcpy(buffer, data + position, num * elementSize);
+            position += num * elementSize;
+            return num;
+        }
+
+        size_t Write(const void*, size_t, size_t) override
+        {
+            return 0;
+        }
+
+        aiReturn Seek(size_t offset, aiOrigin origin) override
+        {
+            //the same meaning Assimp's own memory stream gives the origins, from the end counts backwards
+            size_t target;
+            if (origin == aiOrigin_SET)
+                target = offset;
+            else if (origin == aiOrigin_CUR)
+                target = position + offset;
+            else if (offset <= size)
+                target = size - offset;
+            else
+                return aiReturn_FAILURE;
+            if (target > size)
+                return aiReturn_FAILURE;
+            position = target;
+            return aiReturn_SUCCESS;
+        }
+
+        size_t Tell() const override
+        {
+            return position;
+        }
+
+        size_t FileSize() const override
+        {
+            return size;
+        }
+
+        void Flush() override
+        {
+        }
+
+    private:
+        std::vector<unsigned char> owned;
+        const unsigned char* data;
+        size_t size;
+        size_t position = 0;
+    };
+
+    class PackIOSystem :public Assimp::IOSystem
+    {
+    public:
+        bool Exists(const char* file) const override
+        {
+            return AssetPack::instance().exists(file);
+        }
+
+        char getOsSeparator() const override
+        {
+            return '/';
+        }
+
+        Assimp::IOStream* Open(const char* file, const char* mode) override
+        {
+            //the importers only ever read
+            if (std::strchr(mode, 'w') || std::strchr(mode, 'a'))
+                return nullptr;
+            AssetPack& pack = AssetPack::instance();
+            size_t size = 0;
+            if (const unsigned char* data = pack.mappedBytes(file, size))
+                return new PackStream(data, size);
+            std::vector<unsigned char> bytes;
+            if (!pack.read(file, bytes))
+                return nullptr;
+            return new PackStream(std::move(bytes));
+        }
+
+        void Close(Assimp::IOStream* stream) override
+        {
+            delete stream;
+        }
+    };
+}
+
+AssetPack::~AssetPack()
+{
+    unmount();
+}
+
+AssetPack& AssetPack::instance()
+{
+    static AssetPack pack;
+    return pack;
+}
+
+bool AssetPack::mount(const std::string& packPath)
+{
+    unmount();
+    file.setFileName(QString::fromStdString(packPath));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    mappedSize = static_cast<uint64_t>(file.size());
+    if (mappedSize >= sizeof(Header))
+        mapped = file.map(0, file.size());
+    Header header{};
+    if (mapped)
+        std::memcpy(&header, mapped, sizeof(Header));
+    bool valid = mapped && header.magic == magic && header.version == version && header.indexOffset % alignof(Entry) == 0
+        && header.indexOffset + static_cast<uint64_t>(header.entryNum) * sizeof(Entry) <= header.namesOffset && header.namesOffset <= mappedSize;
+    if (valid)
+    {
+        const Entry* index = reinterpret_cast<const Entry*>(mapped + header.indexOffset);
+        uint64_t namesSize = mappedSize - header.namesOffset;
+        for (uint32_t i = 0; i < header.entryNum && valid; ++i)
+        {
+            valid = index[i].offset + index[i].storedSize <= header.indexOffset
+                && static_cast<uint64_t>(index[i].nameOffset) + index[i].nameLength <= namesSize;
+        }
+    }
+    if (!valid)
+    {
+        qWarning() << "not an asset pack of this version" << QString::fromStdString(packPath);
+        unmount();
+        return false;
+    }
+    entries = reinterpret_cast<const Entry*>(mapped + header.indexOffset);
+    entryNum = header.entryNum;
+    names = reinterpret_cast<const char*>(mapped + header.namesOffset);
+    return true;
+}
+
+bool AssetPack::mounted() const
+{
+    return mapped != nullptr;
+}
+
+bool AssetPack::contains(const std::string& path) const
+{
+    return find(path) != nullptr;
+}
+
+bool AssetPack::exists(const std::string& path) const
+{
+    return contains(path) || QFileInfo(QString::fromStdString(path)).exists();
+}
+
+bool AssetPack::read(const std::string& path, std::vector<unsigned char>& bytes)
+{
+    if (const Entry* entry = find(path))
+        return readEntry(*entry, bytes);
+    auto begin = steady_clock::now();
+    if (!readLoose(path, bytes))
+        return false;
+    count(false, bytes.size(), elapsedMs(begin), 0.0);
+    return true;
+}
+
+const unsigned char* AssetPack::mappedBytes(const std::string& path, size_t& size)
+{
+    const Entry* entry = find(path);
+    if (!entry || entry->flags & compressedFlag)
+        return nullptr;
+    size = static_cast<size_t>(entry->size);
+    count(true, size, 0.0, 0.0);
+    return mapped + entry->offset;
+}
+
+std::unique_ptr<std::istream> AssetPack::open(const std::string& path)
+{
+    size_t size = 0;
+    if (const unsigned char* data = mappedBytes(path, size))
+        return std::unique_ptr<std::istream>(new MemoryStream(data, size));
+    if (const Entry* entry = find(path))
+    {
+        std::vector<unsigned char> bytes;
+        if (!readEntry(*entry, bytes))
+            return nullptr;
+        return std::unique_ptr<std::istream>(new MemoryStream(std::move(bytes)));
+    }
+    //loose files are streamed as before, only what is read of them is fetched
+    std::unique_ptr<std::istream> loose(new std::ifstream(path, std::ios::binary));
+    if (!*loose)
+        return nullptr;
+    count(false, 0, 0.0, 0.0);
+    return loose;
+}
+
+bool AssetPack::generated(const std::string& path)
+{
+    //texture and environment caches are rebuilt loose whenever they go stale, a packed copy would shadow the rebuilt one
+    for (const std::string suffix : { ".ktx2", ".cache" })
+    {
+        if (path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0)
+            return true;
+    }
+    return false;
+}
+
+AssetPack::Stats AssetPack::stats() const
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return statistics;
+}
+
+bool AssetPack::build(const std::string& packPath, const std::vector<std::string>& directories)
+{
+    auto begin = steady_clock::now();
+    std::string packName = normalize(packPath);
+    std::vector<std::string> paths;
+    for (auto& i : directories)
+    {
+        QDirIterator it(QString::fromStdString(i), QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext())
+        {
+            std::string path = normalize(it.next().toStdString());
+            if (path != packName && !generated(path))
+                paths.push_back(path);
+        }
+    }
+
+    std::ofstream out(packPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        qWarning() << "cannot write" << QString::fromStdString(packPath);
+        return false;
+    }
+    //the header is written last, the data starts on the first aligned offset after it
+    std::vector<char> padding(alignment, 0);
+    out.write(padding.data(), alignment);
+
+    //the data goes in directory order so files that are loaded together stay close, only the index is sorted
+    std::vector<Entry> index;
+    std::string nameBlob;
+    uint64_t offset = alignment;
+    size_t rawBytes = 0, storedBytes = 0, compressedNum = 0;
+    for (auto& i : paths)
+    {
+        std::vector<unsigned char> bytes;
+        if (!readLoose(i, bytes))
+        {
+            qWarning() << "cannot read" << QString::fromStdString(i) << ", left out of the pack";
+            continue;
+        }
+        Entry entry{};
+        entry.hash = hashPath(i);
+        entry.offset = offset;
+        entry.size = bytes.size();
+        entry.nameOffset = static_cast<uint32_t>(nameBlob.size());
+        entry.nameLength = static_cast<uint32_t>(i.size());
+        nameBlob += i;
+
+        //images are compressed already and mostly stay raw, shaders and model text shrink a lot
+        std::vector<unsigned char> compressed = lz4Compress(bytes.data(), bytes.size());
+        if (compressed.size() <= bytes.size() * (1.0 - minSaving))
+        {
+            entry.flags |= compressedFlag;
+            bytes.swap(compressed);
+            ++compressedNum;
+        }
+        entry.storedSize = bytes.size();
+        out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        uint64_t padded = (entry.storedSize + alignment - 1) / alignment * alignment;
+        out.write(padding.data(), padded - entry.storedSize);
+        offset += padded;
+        rawBytes += static_cast<size_t>(entry.size);
+        storedBytes += static_cast<size_t>(entry.storedSize);
+        index.push_back(entry);
+    }
+
+    std::sort(index.begin(), index.end(), [](const Entry& a, const Entry& b) {
+        return a.hash < b.hash;
+    });
+    Header header{ magic, version, static_cast<uint32_t>(index.size()), 0, offset, offset + index.size() * sizeof(Entry) };
+    out.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(Entry));
+    out.write(nameBlob.data(), nameBlob.size());
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!out)
+    {
+        qWarning() << "failed writing" << QString::fromStdString(packPath);
+        return false;
+    }
+    qDebug() << "packed" << index.size() << "files into" << QString::fromStdString(packPath) << "in" << elapsedMs(begin) << "ms," << rawBytes / 1048576.0
+        << "MB stored as" << storedBytes / 1048576.0 << "MB," << compressedNum << "entries LZ4 compressed";
+    return true;
+}
+
+void AssetPack::benchmark(const std::string& packPath)
+{
+    AssetPack pack;
+    auto begin = steady_clock::now();
+    if (!pack.mount(packPath))
+    {
+        qWarning() << "cannot mount" << QString::fromStdString(packPath) << ", build it with --build-pack first";
+        return;
+    }
+    double mountMs = elapsedMs(begin);
+    std::vector<std::string> paths;
+    for (uint32_t i = 0; i < pack.entryNum; ++i)
+        paths.emplace_back(pack.names + pack.entries[i].nameOffset, pack.entries[i].nameLength);
+    qDebug() << "asset I/O," << paths.size() << "files, mapping the pack took" << mountMs << "ms";
+    qDebug() << "  the first pass is only cold if the OS file cache does not hold the files yet, e.g. right after a reboot";
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        begin = steady_clock::now();
+        size_t looseBytes = 0;
+        int missing = 0;
+        for (auto& i : paths)
+        {
+            std::vector<unsigned char> bytes;
+            if (readLoose(i, bytes))
+                looseBytes += bytes.size();
+            else
+                ++missing;
+        }
+        double looseMs = elapsedMs(begin);
+
+        Stats before = pack.stats();
+        begin = steady_clock::now();
+        size_t packBytes = 0;
+        for (auto& i : paths)
+        {
+            std::vector<unsigned char> bytes;
+            if (pack.read(i, bytes))
+                packBytes += bytes.size();
+        }
+        double packMs = elapsedMs(begin);
+        double decompressMs = pack.stats().decompressMs - before.decompressMs;
+
+        qDebug() << "  " << (pass == 0 ? "first " : "second") << "pass: loose files" << looseMs << "ms for" << looseBytes / 1048576.0 << "MB," << missing << "missing, pack"
+            << packMs << "ms for" << packBytes / 1048576.0 << "MB of which decompressing" << decompressMs << "ms";
+    }
+}
+
+std::string AssetPack::normalize(const std::string& path)
+{
+    std::string unified = path;
+    std::replace(unified.begin(), unified.end(), '\\', '/');
+    std::vector<std::string> parts;
+    size_t begin = 0;
+    while (begin <= unified.size())
+    {
+        size_t end = std::min(unified.find('/', begin), unified.size());
+        std::string part = unified.substr(begin, end - begin);
+        if (part == ".." && !parts.empty() && parts.back() != "..")
+            parts.pop_back();
+        else if (!part.empty() && part != ".")
+            parts.push_back(part);
+        begin = end + 1;
+    }
+    std::string result = !unified.empty() && unified[0] == '/' ? "/" : "";
+    for (size_t i = 0; i < parts.size(); ++i)
+        result += (i == 0 ? "" : "/") + parts[i];
+    return result;
+}
+
+bool AssetPack::addShader(QOpenGLShaderProgram& program, QOpenGLShader::ShaderType type, const std::string& path)
+{
+    std::vector<unsigned char> source;
+    if (!instance().read(path, source))
+    {
+        qWarning() << "cannot read shader" << QString::fromStdString(path);
+        return false;
+    }
+    return program.addShaderFromSourceCode(type, QByteArray(reinterpret_cast<const char*>(source.data()), static_cast<int>(source.size())));
+}
+
+Assimp::IOSystem* AssetPack::createIOSystem()
+{
+    return new PackIOSystem();
+}
+
+std::vector<unsigned char> AssetPack::lz4Compress(const unsigned char* data, size_t bytes)
+{
+    std::vector<unsigned char> out;
+    out.reserve(bytes + bytes / 255 + 16);
+    auto writeLength = [&](size_t length) {
+        for (; length >= 255; length -= 255)
+            out.push_back(255);
+        out.push_back(static_cast<unsigned char>(length));
+    };
+    //a sequence is a run of literals and a match, the last one is literals only
+    auto writeSequence = [&](size_t literalBegin, size_t literalNum, size_t offset, size_t matchLength, bool last) {
+        size_t matchCode = last ? 0 : matchLength - 4;
+        out.push_back(static_cast<unsigned char>(std::min<size_t>(literalNum, 15) << 4 | std::min<size_t>(matchCode, 15)));
+        if (literalNum >= 15)
+            writeLength(literalNum - 15);
+        out.insert(out.end(), data + literalBegin, data + literalBegin + literalNum);
+        if (last)
+            return;
+        out.push_back(static_cast<unsigned char>(offset & 255));
+        out.push_back(static_cast<unsigned char>(offset >> 8));
+        if (matchCode >= 15)
+            writeLength(matchCode - 15);
+    };
+    auto read32 = [data](size_t i) {
+        uint32_t value;
+        std::memcpy(&value, data + i, 4);
+        return value;
+    };
+
+    //greedy matching on a hash of the next four bytes, the format wants the last match to start 12 bytes and end
+    //5 bytes before the end of the block
+    constexpr int hashBits = 14;
+    std::vector<uint32_t> table(1 << hashBits, 0);     //position + 1, 0 is empty
+    size_t anchor = 0;
+    if (bytes >= 13)
+    {
+        size_t matchLimit = bytes - 12, matchEnd = bytes - 5;
+        size_t i = 0;
+        while (i < matchLimit)
+        {
+            uint32_t sequence = read32(i);
+            uint32_t hash = (sequence * 2654435761u) >> (32 - hashBits);
+            size_t candidate = table[hash];
+            table[hash] = static_cast<uint32_t>(i + 1);
+            if (candidate == 0 || i - (candidate - 1) > 65535 || read32(candidate - 1) != sequence)
+            {
+                ++i;
+                continue;
+            }
+            size_t match = candidate - 1;
+            size_t length = 4;
+            while (i + length < matchEnd && data[match + length] == data[i + length])
+                ++length;
+            writeSequence(anchor, i - anchor, i - match, length, false);
+            i += length;
+            anchor = i;
+        }
+    }
+    writeSequence(anchor, bytes - anchor, 0, 0, true);
+    return out;
+}
+
+bool AssetPack::lz4Decompress(const unsigned char* data, size_t bytes, unsigned char* out, size_t outBytes)
+{
+    size_t in = 0, written = 0;
+    auto readLength = [&](size_t& length) {
+        unsigned char next;
+        do
+        {
+            if (in >= bytes)
+                return false;
+            next = data[in++];
+            length += next;
+        } while (next == 255);
+        return true;
+    };
+    while (in < bytes)
+    {
+        unsigned char token = data[in++];
+        size_t literalNum = token >> 4;
+        if (literalNum == 15 && !readLength(literalNum))
+            return false;
+        if (literalNum > bytes - in || literalNum > outBytes - written)
+            return false;
+        if (literalNum > 0)
+            std::memcpy(out + written, data + in, literalNum);
+        in += literalNum;
+        written += literalNum;
+        if (in == bytes)
+            break;
+
+        if (bytes - in < 2)
+            return false;
+        size_t offset = data[in] | data[in + 1] << 8;
+        in += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !readLength(matchLength))
+            return false;
+        matchLength += 4;
+        if (offset == 0 || offset > written || matchLength > outBytes - written)
+            return false;
+        //a match closer than its length repeats bytes it is writing itself
+        const unsigned char* from = out + written - offset;
+        if (offset >= matchLength)
+            std::memcpy(out + written, from, matchLength);
+        else
+        {
+            for (size_t i = 0; i < matchLength; ++i)
+                out[written + i] = from[i];
+        }
+        written += matchLength;
+    }
+    return written == outBytes;
+}
+
+uint64_t AssetPack::hashPath(const std::string& normalized)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char i : normalized)
+        hash = (hash ^ i) * 1099511628211ull;
+    return hash;
+}
+
+const AssetPack::Entry* AssetPack::find(const std::string& path) const
+{
+    if (!mapped)
+        return nullptr;
+    std::string key = normalize(path);
+    uint64_t hash = hashPath(key);
+    const Entry* end = entries + entryNum;
+    const Entry* it = std::lower_bound(entries, end, hash, [](const Entry& entry, uint64_t value) {
+        return entry.hash < value;
+    });
+    for (; it != end && it->hash == hash; ++it)
+    {
+        if (it->nameLength == key.size() && key.compare(0, key.size(), names + it->nameOffset, it->nameLength) == 0)
+            return it;
+    }
+    return nullptr;
+}
+
+bool AssetPack::readEntry(const Entry& entry, std::vector<unsigned char>& bytes)
+{
+    auto begin = steady_clock::now();
+    const unsigned char* stored = mapped + entry.offset;
+    if (!(entry.flags & compressedFlag))
+    {
+        bytes.assign(stored, stored + entry.size);
+        count(true, bytes.size(), elapsedMs(begin), 0.0);
+        return true;
+    }
+    bytes.resize(static_cast<size_t>(entry.size));
+    bool decompressed = lz4Decompress(stored, static_cast<size_t>(entry.storedSize), bytes.data(), bytes.size());
+    double decompressMs = elapsedMs(begin);
+    count(true, bytes.size(), decompressMs, decompressMs);
+    if (!decompressed)
+        qWarning() << "corrupt pack entry" << QString::fromStdString(std::string(names + entry.nameOffset, entry.nameLength));
+    return decompressed;
+}
+
+void AssetPack::unmount()
+{
+    if (mapped)
+        file.unmap(const_cast<unsigned char*>(mapped));
+    if (file.isOpen())
+        file.close();
+    mapped = nullptr;
+    mappedSize = 0;
+    entries = nullptr;
+    entryNum = 0;
+    names = nullptr;
+}
+
+void AssetPack::count(bool fromPack, size_t bytes, double readMs, double decompressMs)
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    if (fromPack)
+    {
+        ++statistics.packReads;
+        statistics.packBytes += bytes;
+    }
+    else
+    {
+        ++statistics.diskReads;
+        statistics.diskBytes += bytes;
+    }
+    statistics.readMs += readMs;
+    statistics.decompressMs += decompressMs;
+}
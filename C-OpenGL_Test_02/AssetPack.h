@@ -0,0 +1,117 @@
+#pragma once
+#include<qfile.h>
+#include<qopenglshaderprogram.h>
+#include<cstdint>
+#include<istream>
+#include<memory>
+#include<mutex>
+#include<string>
+#include<vector>
+
+namespace Assimp
+{
+    class IOSystem;
+}
+
+//a read only virtual file system over one archive of the shaders, images and models: the index is sorted by path hash,
+//every entry starts on a 4K boundary and is stored raw or LZ4 compressed, the archive is mapped once and raw entries are
+//read straight out of the mapping, paths the pack does not hold fall through to the disk
+class AssetPack
+{
+public:
+    constexpr static uint32_t magic = 0x4B415041;   //"APAK"
+    //2 leaves the generated caches out
+    constexpr static uint32_t version = 2;
+    constexpr static uint64_t alignment = 4096;
+    //entries are only kept compressed when that saves at least a tenth
+    constexpr static double minSaving = 0.1;
+
+    struct Stats
+    {
+        int packReads = 0;
+        int diskReads = 0;
+        size_t packBytes = 0;
+        size_t diskBytes = 0;
+        double readMs = 0.0;
+        double decompressMs = 0.0;
+    };
+
+    AssetPack() = default;
+    ~AssetPack();
+    AssetPack(const AssetPack&) = delete;
+    AssetPack& operator=(const AssetPack&) = delete;
+
+    //the pack every loader reads through
+    static AssetPack& instance();
+
+    bool mount(const std::string& packPath);
+    bool mounted() const;
+    bool contains(const std::string& path) const;
+    //in the pack or on disk
+    bool exists(const std::string& path) const;
+    //the whole file, from the pack when it holds it and from disk otherwise
+    bool read(const std::string& path, std::vector<unsigned char>& bytes);
+    //raw entries straight out of the mapping, null for compressed entries and files the pack does not hold
+    const unsigned char* mappedBytes(const std::string& path, size_t& size);
+    //a seekable stream over the file, raw entries are read out of the mapping without a copy, null when there is none
+    std::unique_ptr<std::istream> open(const std::string& path);
+    Stats stats() const;
+
+    //bundles every file below the directories except generated caches, paths are kept relative to the working directory
+    static bool build(const std::string& packPath, const std::vector<std::string>& directories);
+    //times reading every file in the pack as loose files and through the pack, twice each
+    static void benchmark(const std::string& packPath);
+    //the key of a path in the pack: forward slashes, no leading ./
+    static std::string normalize(const std::string& path);
+    //one shader stage read through the pack
+    static bool addShader(QOpenGLShaderProgram& program, QOpenGLShader::ShaderType type, const std::string& path);
+    //Assimp reads the model and its material files through this, the importer takes ownership
+    static Assimp::IOSystem* createIOSystem();
+
+    //LZ4 block format, decompress fails on anything that does not produce exactly outBytes
+    static std::vector<unsigned char> lz4Compress(const unsigned char* data, size_t bytes);
+    static bool lz4Decompress(const unsigned char* data, size_t bytes, unsigned char* out, size_t outBytes);
+
+private:
+    constexpr static uint32_t compressedFlag = 1;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t entryNum;
+        uint32_t reserved;
+        uint64_t indexOffset;
+        uint64_t namesOffset;
+    };
+
+    struct Entry
+    {
+        uint64_t hash;
+        uint64_t offset;
+        uint64_t storedSize;
+        uint64_t size;
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        uint32_t flags;
+        uint32_t reserved;
+    };
+
+    QFile file;
+    const unsigned char* mapped = nullptr;
+    uint64_t mappedSize = 0;
+    const Entry* entries = nullptr;
+    uint32_t entryNum = 0;
+    const char* names = nullptr;
+
+    mutable std::mutex statsMutex;
+    Stats statistics;
+
+    static uint64_t hashPath(const std::string& normalized);
+    //caches the loaders write next to their sources, left out of the pack
+    static bool generated(const std::string& path);
+    const Entry* find(const std::string& path) const;
+    bool readEntry(const Entry& entry, std::vector<unsigned char>& bytes);
+    void unmount();
+    void count(bool fromPack, size_t bytes, double readMs, double decompressMs);
+};
@@ -0,0 +1,429 @@
+#include "Bvh.h"
+#include<algorithm>
+#include<numeric>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include<emmintrin.h>
+#define BVH_SSE2
+#endif
+
+void Bvh::Bounds::grow(const glm::vec3& point)
+{
+    lower = glm::min(lower, point);
+    upper = glm::max(upper, point);
+}
+
+void Bvh::Bounds::grow(const Bounds& other)
+{
+    lower = glm::min(lower, other.lower);
+    upper = glm::max(upper, other.upper);
+}
+
+bool Bvh::Bounds::empty() const
+{
+    return lower.x > upper.x || lower.y > upper.y || lower.z > upper.z;
+}
+
+float Bvh::Bounds::area() const
+{
+    if (empty())
+        return 0.0f;
+    glm::vec3 extent = upper - lower;
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+bool Bvh::Bounds::overlaps(const Bounds& other) const
+{
+    return lower.x <= other.upper.x && upper.x >= other.lower.x && lower.y <= other.upper.y && upper.y >= other.lower.y
+        && lower.z <= other.upper.z && upper.z >= other.lower.z;
+}
+
+Bvh::Bounds Bvh::Bounds::transformed(const glm::mat4& transform) const
+{
+    Bounds result;
+    if (empty())
+        return result;
+    for (int i = 0; i < 8; ++i)
+    {
+        glm::vec3 corner((i & 1) ? upper.x : lower.x, (i & 2) ? upper.y : lower.y, (i & 4) ? upper.z : lower.z);
+        result.grow(glm::vec3(transform * glm::vec4(corner, 1.0f)));
+    }
+    return result;
+}
+
+void Bvh::build(const std::vector<Bounds>& primitives, JobSystem& jobs)
+{
+    clear();
+    if (primitives.empty())
+        return;
+    uint32_t count = static_cast<uint32_t>(primitives.size());
+    BuildState state(primitives, jobs);
+    state.centroids.resize(count);
+    jobs.parallelFor(count, parallelThreshold, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            state.centroids[i] = (primitives[i].lower + primitives[i].upper) * 0.5f;
+    });
+    //a binary tree over n primitives never has more than 2n - 1 nodes, so splits only bump an atomic
+    state.nodes.resize(static_cast<size_t>(count) * 2);
+    state.nodes[0].first = 0;
+    state.nodes[0].count = count;
+    primitiveOrder.resize(count);
+    std::iota(primitiveOrder.begin(), primitiveOrder.end(), 0u);
+    split(state, 0, 0);
+    rootBounds = state.nodes[0].bounds;
+
+    nodeList.reserve(state.nodeNum / 3 + 1);
+    leafList.reserve(count / 2 + 1);
+    collapse(state, 0);
+}
+
+void Bvh::clear()
+{
+    nodeList.clear();
+    leafList.clear();
+    primitiveOrder.clear();
+    rootBounds = Bounds();
+}
+
+bool Bvh::empty() const
+{
+    return nodeList.empty();
+}
+
+const Bvh::Bounds& Bvh::bounds() const
+{
+    return rootBounds;
+}
+
+const std::vector<Bvh::Node>& Bvh::nodes() const
+{
+    return nodeList;
+}
+
+const std::vector<Bvh::Leaf>& Bvh::leaves() const
+{
+    return leafList;
+}
+
+const std::vector<uint32_t>& Bvh::order() const
+{
+    return primitiveOrder;
+}
+
+size_t Bvh::bytes() const
+{
+    return nodeList.size() * sizeof(Node) + leafList.size() * sizeof(Leaf) + primitiveOrder.size() * sizeof(uint32_t);
+}
+
+void Bvh::split(BuildState& state, uint32_t index, int depth)
+{
+    //the node array never grows during the build, so references into it stay valid across threads
+    BuildNode& node = state.nodes[index];
+    Bounds centroidBounds;
+    for (uint32_t i = node.first; i < node.first + node.count; ++i)
+    {
+        uint32_t primitive = primitiveOrder[i];
+        node.bounds.grow(state.primitives[primitive]);
+        centroidBounds.grow(state.centroids[primitive]);
+    }
+    //a leaf is tested four primitives at once, so anything that fits is not worth splitting
+    if (node.count <= leafSize)
+        return;
+
+    uint32_t middle = partition(state, node, centroidBounds, depth);
+    uint32_t left = state.nodeNum.fetch_add(2);
+    state.nodes[left].first = node.first;
+    state.nodes[left].count = middle - node.first;
+    state.nodes[left + 1].first = middle;
+    state.nodes[left + 1].count = node.first + node.count - middle;
+    node.left = left;
+
+    if (node.count >= parallelThreshold)
+    {
+        JobSystem::JobHandle job = state.jobs.run([this, &state, left, depth] { split(state, left, depth + 1); });
+        split(state, left + 1, depth + 1);
+        state.jobs.wait(job);
+    }
+    else
+    {
+        split(state, left, depth + 1);
+        split(state, left + 1, depth + 1);
+    }
+}
+
+uint32_t Bvh::partition(BuildState& state, const BuildNode& node, const Bounds& centroidBounds, int depth)
+{
+    uint32_t* begin = primitiveOrder.data() + node.first;
+    uint32_t* end = begin + node.count;
+    glm::vec3 extent = centroidBounds.upper - centroidBounds.lower;
+    auto binOf = [&](uint32_t primitive, int axis) {
+        float offset = (state.centroids[primitive][axis] - centroidBounds.lower[axis]) / extent[axis];
+        return std::min(static_cast<int>(offset * binNum), binNum - 1);
+    };
+
+    //halving keeps the rest of the tree under 32 levels whatever the primitives look like
+    if (depth >= sahDepth)
+        return node.first + node.count / 2;
+    //cost of a plane between bins is the area weighted primitive count of both sides, the constant terms do not change the choice
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1, bestBin = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (extent[axis] <= 0.0f)
+            continue;
+        std::array<Bounds, binNum> bins;
+        std::array<uint32_t, binNum> counts{};
+        for (uint32_t* i = begin; i < end; ++i)
+        {
+            int bin = binOf(*i, axis);
+            bins[bin].grow(state.primitives[*i]);
+            ++counts[bin];
+        }
+        std::array<float, binNum> rightCost{};
+        Bounds right;
+        uint32_t rightCount = 0;
+        for (int bin = binNum - 1; bin > 0; --bin)
+        {
+            right.grow(bins[bin]);
+            rightCount += counts[bin];
+            rightCost[bin] = right.area() * rightCount;
+        }
+        Bounds left;
+        uint32_t leftCount = 0;
+        for (int bin = 1; bin < binNum; ++bin)
+        {
+            left.grow(bins[bin - 1]);
+            leftCount += counts[bin - 1];
+            float cost = left.area() * leftCount + rightCost[bin];
+            if (leftCount > 0 && leftCount < node.count && cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = bin;
+            }
+        }
+    }
+    //all centroids in one spot, any split is as good as another
+    if (bestAxis < 0)
+        return node.first + node.count / 2;
+    uint32_t* middle = std::partition(begin, end, [&](uint32_t primitive) { return binOf(primitive, bestAxis) < bestBin; });
+    return node.first + static_cast<uint32_t>(middle - begin);
+}
+
+int32_t Bvh::collapse(const BuildState& state, uint32_t index)
+{
+    auto isLeaf = [&](uint32_t i) { return state.nodes[i].left == 0; };
+    //pull grandchildren up into the free slots, the largest inner child first since it is entered most often
+    std::array<uint32_t, width> children{};
+    int childNum = 0;
+    if (isLeaf(index))
+        children[childNum++] = index;
+    else
+    {
+        children[childNum++] = state.nodes[index].left;
+        children[childNum++] = state.nodes[index].left + 1;
+        while (childNum < width)
+        {
+            int widest = -1;
+            float widestArea = -1.0f;
+            for (int i = 0; i < childNum; ++i)
+            {
+                if (!isLeaf(children[i]) && state.nodes[children[i]].bounds.area() > widestArea)
+                {
+                    widest = i;
+                    widestArea = state.nodes[children[i]].bounds.area();
+                }
+            }
+            if (widest < 0)
+                break;
+            uint32_t opened = state.nodes[children[widest]].left;
+            children[widest] = opened;
+            children[childNum++] = opened + 1;
+        }
+    }
+
+    int32_t nodeIndex = static_cast<int32_t>(nodeList.size());
+    nodeList.emplace_back();
+    for (int slot = 0; slot < width; ++slot)
+    {
+        Bounds box;
+        int32_t child = emptyChild;
+        if (slot < childNum)
+        {
+            const BuildNode& node = state.nodes[children[slot]];
+            box = node.bounds;
+            if (isLeaf(children[slot]))
+            {
+                leafList.push_back(Leaf{ node.first, node.count });
+                child = ~static_cast<int32_t>(leafList.size() - 1);
+            }
+            else
+                child = collapse(state, children[slot]);
+        }
+        //the recursion may have moved the node list
+        Node& out = nodeList[nodeIndex];
+        out.lowerX[slot] = box.lower.x;
+        out.lowerY[slot] = box.lower.y;
+        out.lowerZ[slot] = box.lower.z;
+        out.upperX[slot] = box.upper.x;
+        out.upperY[slot] = box.upper.y;
+        out.upperZ[slot] = box.upper.z;
+        out.child[slot] = child;
+    }
+    return nodeIndex;
+}
+
+int Bvh::intersectChildren(const Node& node, const glm::vec3& origin, const glm::vec3& invDirection, float distance, float entry[width])
+{
+    //the near side of every slab comes from the direction signs, which also leaves the inverted boxes of empty slots unhit
+    const float* nearX = invDirection.x >= 0.0f ? node.lowerX : node.upperX;
+    const float* farX = invDirection.x >= 0.0f ? node.upperX : node.lowerX;
+    const float* nearY = invDirection.y >= 0.0f ? node.lowerY : node.upperY;
+    const float* farY = invDirection.y >= 0.0f ? node.upperY : node.lowerY;
+    const float* nearZ = invDirection.z >= 0.0f ? node.lowerZ : node.upperZ;
+    const float* farZ = invDirection.z >= 0.0f ? node.upperZ : node.lowerZ;
+#ifdef BVH_SSE2
+    __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+    __m128 ix = _mm_set1_ps(invDirection.x), iy = _mm_set1_ps(invDirection.y), iz = _mm_set1_ps(invDirection.z);
+    __m128 nearT = _mm_max_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(nearX), ox), ix), _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(nearY), oy), iy)),
+        _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(nearZ), oz), iz), _mm_setzero_ps()));
+    __m128 farT = _mm_min_ps(_mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(farX), ox), ix), _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(farY), oy), iy)),
+        _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(farZ), oz), iz), _mm_set1_ps(distance)));
+    _mm_storeu_ps(entry, nearT);
+    return _mm_movemask_ps(_mm_cmple_ps(nearT, farT));
+#else
+    int mask = 0;
+    for (int i = 0; i < width; ++i)
+    {
+        float nearT = std::max(std::max((nearX[i] - origin.x) * invDirection.x, (nearY[i] - origin.y) * invDirection.y),
+            std::max((nearZ[i] - origin.z) * invDirection.z, 0.0f));
+        float farT = std::min(std::min((farX[i] - origin.x) * invDirection.x, (farY[i] - origin.y) * invDirection.y),
+            std::min((farZ[i] - origin.z) * invDirection.z, distance));
+        entry[i] = nearT;
+        if (nearT <= farT)
+            mask |= 1 << i;
+    }
+    return mask;
+#endif
+}
+
+Bvh::PacketLanes Bvh::lanes(const RayPacket& packet)
+{
+    PacketLanes result;
+    for (int i = 0; i < 4; ++i)
+    {
+        const Ray& ray = packet[i];
+        glm::vec3 inv = inverse(ray.direction);
+        result.originX[i] = ray.origin.x;
+        result.originY[i] = ray.origin.y;
+        result.originZ[i] = ray.origin.z;
+        result.directionX[i] = ray.direction.x;
+        result.directionY[i] = ray.direction.y;
+        result.directionZ[i] = ray.direction.z;
+        result.invX[i] = inv.x;
+        result.invY[i] = inv.y;
+        result.invZ[i] = inv.z;
+        result.distance[i] = ray.maxDistance > 0.0f ? ray.maxDistance : -1.0f;
+    }
+    return result;
+}
+
+int Bvh::intersectChild(const Node& node, int slot, const PacketLanes& packet, float& nearestEntry)
+{
+#ifdef BVH_SSE2
+    //the lanes may point different ways, so the near side is picked per lane
+    auto slab = [](float lower, float upper, const float* origin, const float* inv, __m128& nearT, __m128& farT) {
+        __m128 i = _mm_loadu_ps(inv);
+        __m128 negative = _mm_cmplt_ps(i, _mm_setzero_ps());
+        __m128 lo = _mm_set1_ps(lower), hi = _mm_set1_ps(upper);
+        __m128 nearSide = _mm_or_ps(_mm_and_ps(negative, hi), _mm_andnot_ps(negative, lo));
+        __m128 farSide = _mm_or_ps(_mm_and_ps(negative, lo), _mm_andnot_ps(negative, hi));
+        __m128 o = _mm_loadu_ps(origin);
+        nearT = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(nearSide, o), i), nearT);
+        farT = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(farSide, o), i), farT);
+    };
+    __m128 nearT = _mm_setzero_ps();
+    __m128 farT = _mm_loadu_ps(packet.distance);
+    slab(node.lowerX[slot], node.upperX[slot], packet.originX, packet.invX, nearT, farT);
+    slab(node.lowerY[slot], node.upperY[slot], packet.originY, packet.invY, nearT, farT);
+    slab(node.lowerZ[slot], node.upperZ[slot], packet.originZ, packet.invZ, nearT, farT);
+    __m128 hit = _mm_cmple_ps(nearT, farT);
+    int mask = _mm_movemask_ps(hit);
+    __m128 entry = _mm_or_ps(_mm_and_ps(hit, nearT), _mm_andnot_ps(hit, _mm_set1_ps(std::numeric_limits<float>::max())));
+    entry = _mm_min_ps(entry, _mm_shuffle_ps(entry, entry, _MM_SHUFFLE(2, 3, 0, 1)));
+    entry = _mm_min_ps(entry, _mm_shuffle_ps(entry, entry, _MM_SHUFFLE(1, 0, 3, 2)));
+    nearestEntry = _mm_cvtss_f32(entry);
+    return mask;
+#else
+    int mask = 0;
+    nearestEntry = std::numeric_limits<float>::max();
+    const float lower[3] = { node.lowerX[slot], node.lowerY[slot], node.lowerZ[slot] };
+    const float upper[3] = { node.upperX[slot], node.upperY[slot], node.upperZ[slot] };
+    const float* origins[3] = { packet.originX, packet.originY, packet.originZ };
+    const float* invs[3] = { packet.invX, packet.invY, packet.invZ };
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        float nearT = 0.0f, farT = packet.distance[lane];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float inv = invs[axis][lane];
+            float nearSide = inv < 0.0f ? upper[axis] : lower[axis];
+            float farSide = inv < 0.0f ? lower[axis] : upper[axis];
+            nearT = std::max((nearSide - origins[axis][lane]) * inv, nearT);
+            farT = std::min((farSide - origins[axis][lane]) * inv, farT);
+        }
+        if (nearT <= farT)
+        {
+            mask |= 1 << lane;
+            nearestEntry = std::min(nearestEntry, nearT);
+        }
+    }
+    return mask;
+#endif
+}
+
+void Bvh::childDistances(const Node& node, const glm::vec3& point, float squared[width])
+{
+#ifdef BVH_SSE2
+    auto axis = [](const float* lower, const float* upper, float p) {
+        __m128 v = _mm_set1_ps(p);
+        __m128 d = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(lower), v), _mm_sub_ps(v, _mm_loadu_ps(upper))), _mm_setzero_ps());
+        return _mm_mul_ps(d, d);
+    };
+    __m128 sum = _mm_add_ps(_mm_add_ps(axis(node.lowerX, node.upperX, point.x), axis(node.lowerY, node.upperY, point.y)),
+        axis(node.lowerZ, node.upperZ, point.z));
+    _mm_storeu_ps(squared, sum);
+#else
+    for (int i = 0; i < width; ++i)
+    {
+        float dx = std::max(std::max(node.lowerX[i] - point.x, point.x - node.upperX[i]), 0.0f);
+        float dy = std::max(std::max(node.lowerY[i] - point.y, point.y - node.upperY[i]), 0.0f);
+        float dz = std::max(std::max(node.lowerZ[i] - point.z, point.z - node.upperZ[i]), 0.0f);
+        squared[i] = dx * dx + dy * dy + dz * dz;
+    }
+#endif
+}
+
+bool Bvh::childOverlaps(const Node& node, int slot, const Bounds& box)
+{
+    return node.lowerX[slot] <= box.upper.x && node.upperX[slot] >= box.lower.x && node.lowerY[slot] <= box.upper.y && node.upperY[slot] >= box.lower.y
+        && node.lowerZ[slot] <= box.upper.z && node.upperZ[slot] >= box.lower.z;
+}
+
+glm::vec3 Bvh::inverse(const glm::vec3& direction)
+{
+    //a zero component becomes an infinity of its sign, which the slab tests handle
+    return glm::vec3(1.0f) / direction;
+}
+
+void Bvh::farthestFirst(int order[width], int count, const float key[width])
+{
+    for (int i = 1; i < count; ++i)
+    {
+        int slot = order[i];
+        int j = i;
+        for (; j > 0 && key[order[j - 1]] < key[slot]; --j)
+            order[j] = order[j - 1];
+        order[j] = slot;
+    }
+}
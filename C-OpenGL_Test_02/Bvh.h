@@ -0,0 +1,152 @@
+#pragma once
+#include<glm.hpp>
+#include<array>
+#include<atomic>
+#include<cstdint>
+#include<limits>
+#include<vector>
+#include"JobSystem.h"
+
+//bounding volume hierarchy over primitive boxes for queries on the CPU, built with binned SAH into a binary tree and then
+//collapsed into nodes of four children kept as structures of arrays, so a ray tests all four child boxes with one SSE2 op,
+//every leaf holds at most four primitives for the same reason, see MeshBvh and SceneBvh for what the primitives are
+class Bvh
+{
+public:
+    struct Bounds
+    {
+        glm::vec3 lower{ std::numeric_limits<float>::max() };
+        glm::vec3 upper{ -std::numeric_limits<float>::max() };
+
+        void grow(const glm::vec3& point);
+        void grow(const Bounds& other);
+        bool empty() const;
+        float area() const;
+        bool overlaps(const Bounds& other) const;
+        //the box around this one taken through transform
+        Bounds transformed(const glm::mat4& transform) const;
+    };
+
+    struct Ray
+    {
+        glm::vec3 origin{ 0.0f };
+        //need not be unit length, distances are in multiples of it
+        glm::vec3 direction{ 0.0f, 0.0f, 1.0f };
+        float maxDistance = std::numeric_limits<float>::max();
+    };
+
+    //four rays traced together, lanes with a maxDistance of 0 are inactive
+    using RayPacket = std::array<Ray, 4>;
+
+    constexpr static unsigned int invalid = 0xffffffffu;
+
+    struct Hit
+    {
+        float distance = std::numeric_limits<float>::max();
+        unsigned int instance = invalid;
+        unsigned int triangle = invalid;
+        //barycentrics of the second and third vertex
+        float u = 0.0f, v = 0.0f;
+
+        bool valid() const { return triangle != invalid; }
+    };
+
+    struct Nearest
+    {
+        //searched up to the distance passed in
+        float distance = std::numeric_limits<float>::max();
+        glm::vec3 point{ 0.0f };
+        unsigned int instance = invalid;
+        unsigned int triangle = invalid;
+
+        bool valid() const { return triangle != invalid; }
+    };
+
+    constexpr static int width = 4;
+    constexpr static unsigned int leafSize = 4;
+    //below this many primitives a subtree is built on the thread that split it
+    constexpr static unsigned int parallelThreshold = 4096;
+    constexpr static int binNum = 16;
+    //past this depth splits fall back to the median, so no tree is deeper than maxDepth and traversal stacks can be fixed
+    constexpr static int sahDepth = 64;
+    constexpr static int maxDepth = sahDepth + 32;
+    //every level of a traversal pushes at most three children besides the one it continues with
+    constexpr static int stackSize = (width - 1) * maxDepth + 1;
+
+    //child >= 0 is an inner node, a negative child is ~leaf index, unused slots hold emptyChild and an inverted box
+    struct alignas(16) Node
+    {
+        float lowerX[width], lowerY[width], lowerZ[width];
+        float upperX[width], upperY[width], upperZ[width];
+        int32_t child[width];
+    };
+    constexpr static int32_t emptyChild = std::numeric_limits<int32_t>::min();
+
+    //primitives first to first + count - 1 of order
+    struct Leaf
+    {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    void build(const std::vector<Bounds>& primitives, JobSystem& jobs);
+    void clear();
+    bool empty() const;
+    const Bounds& bounds() const;
+    const std::vector<Node>& nodes() const;
+    const std::vector<Leaf>& leaves() const;
+    //primitive indices in leaf order
+    const std::vector<uint32_t>& order() const;
+    size_t bytes() const;
+
+    //the children of node a ray enters before distance, with their entry distances, one bit per child
+    //invDirection holds 1 / direction and the near corner of every box is picked by its signs
+    static int intersectChildren(const Node& node, const glm::vec3& origin, const glm::vec3& invDirection, float distance, float entry[width]);
+    //a packet as structures of arrays, inactive lanes get a negative distance so they never enter a box
+    struct alignas(16) PacketLanes
+    {
+        float originX[4], originY[4], originZ[4];
+        float directionX[4], directionY[4], directionZ[4];
+        float invX[4], invY[4], invZ[4];
+        float distance[4];
+    };
+    static PacketLanes lanes(const RayPacket& packet);
+    //for every active lane whether it enters child slot of node before its distance, one bit per lane
+    static int intersectChild(const Node& node, int slot, const PacketLanes& packet, float& nearestEntry);
+    //squared distances from point to the child boxes
+    static void childDistances(const Node& node, const glm::vec3& point, float squared[width]);
+    static bool childOverlaps(const Node& node, int slot, const Bounds& box);
+    static glm::vec3 inverse(const glm::vec3& direction);
+    //orders up to width child slots by descending key, so pushing them in order leaves the nearest on top of the stack
+    static void farthestFirst(int order[width], int count, const float key[width]);
+
+private:
+    struct BuildNode
+    {
+        Bounds bounds;
+        uint32_t first = 0, count = 0;
+        //children are left and left + 1, 0 for leaves since the root is never a child
+        uint32_t left = 0;
+    };
+
+    struct BuildState
+    {
+        const std::vector<Bounds>& primitives;
+        std::vector<glm::vec3> centroids;
+        std::vector<BuildNode> nodes;
+        std::atomic<uint32_t> nodeNum{ 1 };
+        JobSystem& jobs;
+
+        BuildState(const std::vector<Bounds>& primitives, JobSystem& jobs) :primitives(primitives), jobs(jobs) {}
+    };
+
+    std::vector<Node> nodeList;
+    std::vector<Leaf> leafList;
+    std::vector<uint32_t> primitiveOrder;
+    Bounds rootBounds;
+
+    void split(BuildState& state, uint32_t index, int depth);
+    //partitions the node's range by the cheapest binned SAH plane, returns where the right half starts
+    uint32_t partition(BuildState& state, const BuildNode& node, const Bounds& centroidBounds, int depth);
+    int32_t collapse(const BuildState& state, uint32_t index);
+};
@@ -3,9 +3,6 @@
 #include<gtc/matrix_transform.hpp>
 #include<cmath>
 
-using std::chrono::duration_cast;
-using std::chrono::duration;
-using std::chrono::steady_clock;
 using glm::vec3;
 using glm::cross;
 using glm::normalize;
@@ -26,10 +23,8 @@ void Camera::resizeCamera(int w, int h)
     projectionMat = perspective(FOV, windowWidth / windowHeight, nearPlane, farPlane);
 }
 
-void Camera::caculateCamera()
+void Camera::caculateCamera(float intervalTime)
 {
-    auto currentTime = steady_clock::now();
-    float intervalTime = duration_cast<duration<float>>(currentTime - lastFrame).count();
     if (keyW)
     {
         position += front * intervalTime * speed;
@@ -46,12 +41,24 @@ void Camera::caculateCamera()
     {
         position += normalize(cross(front, worldUp)) * intervalTime * speed;
     }
-    lastFrame = currentTime;
 }
 
 glm::mat4 Camera::viewProjectionMat()
 {
-    return projectionMat * lookAt(position, position + front, worldUp);
+    return projectionMat * viewMat();
+}
+
+glm::mat4 Camera::viewMat() const
+{
+    return lookAt(position, position + front, worldUp);
+}
+
+float Camera::projectedSize(const glm::vec3& center, float radius) const
+{
+    float distance = glm::dot(center - position, normalize(front));
+    if (distance <= radius)
+        return windowHeight;
+    return radius / distance * projectionMat[1][1] * windowHeight;
 }
 
 void Camera::setKeyW(bool current)
@@ -76,12 +83,17 @@ void Camera::setKeyD(bool current)
 
 void Camera::processMouseMovement(float w, float h)
 {
-    yaw += w / windowWidth * mouseSensitivity;
-    pitch -= h / windowHeight * mouseSensitivity;
+    setOrientation(yaw + w / windowWidth * mouseSensitivity, pitch - h / windowHeight * mouseSensitivity);
+}
+
+void Camera::setOrientation(float yaw, float pitch)
+{
     if (pitch > 1.57f)
         pitch = 1.57f;
     if (pitch < -1.57f)
         pitch = -1.57f;
+    this->yaw = yaw;
+    this->pitch = pitch;
 
     front.y = sinf(pitch);
     front.x = cosf(pitch) * cosf(yaw);
@@ -1,6 +1,5 @@
 #pragma once
 #include<glm.hpp>
-#include<chrono>
 
 class Camera
 {
@@ -10,7 +9,8 @@ public:
     glm::vec3 position{ 0.0f,0.0f,-3.0f };
     glm::vec3 front{ 0.0f,0.0f,1.0f };
     glm::vec3 worldUp{ 0.0f,1.0f,0.0f };
-    float yaw = 0.0f, pitch = 0.0f;
+    //matches the initial front
+    float yaw = 1.5707964f, pitch = 0.0f;
 
     float FOV = 45.0f;
     float nearPlane = 0.1f, farPlane = 100.0f;
@@ -21,14 +21,17 @@ public:
     float speed = 2.0f;
     float mouseSensitivity = 5.0f;
 
-    std::chrono::steady_clock::time_point lastFrame = std::chrono::steady_clock::now();
-
     bool keyW = false, keyS = false, keyA = false, keyD = false;
-    void caculateCamera();
+    //moves the camera by the held keys over intervalTime seconds
+    void caculateCamera(float intervalTime);
     glm::mat4 viewProjectionMat();
+    glm::mat4 viewMat() const;
+    //on-screen diameter in pixels of a bounding sphere
+    float projectedSize(const glm::vec3& center, float radius) const;
     void setKeyW(bool current);
     void setKeyS(bool current);
     void setKeyA(bool current);
     void setKeyD(bool current);
     void processMouseMovement(float w, float h);
+    void setOrientation(float yaw, float pitch);
 };
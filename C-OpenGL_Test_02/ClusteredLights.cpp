@@ -0,0 +1,246 @@
+#include "ClusteredLights.h"
+#include"JobSystem.h"
+#include<gtc/type_ptr.hpp>
+#include<qdebug.h>
+#include<algorithm>
+#include<cmath>
+#include<random>
+#include"AssetPack.h"
+
+void ClusteredLights::init()
+{
+    QOpenGLFunctions_4_5_Core::initializeOpenGLFunctions();
+
+    assignShader.create();
+    AssetPack::addShader(assignShader, QOpenGLShader::Compute, "./shaders/clusterAssign.comp");
+    assignShader.link();
+
+    GpuResources& gpu = GpuResources::instance();
+    countBuffer = gpu.createBuffer(clusterNum * sizeof(unsigned int), nullptr, 0, "cluster light counts");
+    indexBuffer = gpu.createBuffer(clusterNum * maxClusterLights * sizeof(unsigned int), nullptr, 0, "cluster light indices");
+    paramsBuffer = gpu.createBuffer(sizeof(Params), nullptr, 0, "cluster params");
+
+    for (auto& i : frames)
+    {
+        glGenQueries(StampNum, i.queries.data());
+        i.statsBuffer = gpu.createBuffer(3 * sizeof(unsigned int), nullptr, 0, "cluster stats");
+    }
+}
+
+void ClusteredLights::resize(int w, int h)
+{
+    width = std::max(w, 1);
+    height = std::max(h, 1);
+}
+
+void ClusteredLights::setLightCount(int lightNum)
+{
+    //over the plane and up to a bit above the boxes, small ranges so thousands of them stay local
+    std::default_random_engine dre(37);
+    std::uniform_real_distribution<float> horizontal(-3.0f, 3.0f);
+    std::uniform_real_distribution<float> vertical(-0.4f, 2.0f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    baseLights.resize(static_cast<size_t>(std::max(lightNum, 0)));
+    //fewer lights get larger ranges so the scene is lit about as much
+    float range = std::min(std::max(6.0f / std::sqrt(static_cast<float>(std::max(lightNum, 1))), 0.25f), 2.0f);
+    for (auto& i : baseLights)
+    {
+        i.positionRange = glm::vec4(horizontal(dre), vertical(dre), horizontal(dre), range * (0.75f + 0.5f * unit(dre)));
+        glm::vec3 color(unit(dre), unit(dre), unit(dre));
+        i.color = glm::vec4(color / std::max(std::max(color.x, color.y), std::max(color.z, 0.01f)), unit(dre) * 6.2831853f);
+    }
+    lights = baseLights;
+    for (auto& i : lights)
+        i.color.w = -1.0f;
+
+    size_t bytes = std::max<size_t>(lights.size(), 1) * sizeof(PointLight);
+    if (bytes > lightBytes)
+    {
+        lightBytes = bytes;
+        lightBuffer = GpuResources::instance().createBuffer(lightBytes, nullptr, 0, "point lights");
+    }
+    statistics.lights = lightNum;
+}
+
+int ClusteredLights::lightCount() const
+{
+    return static_cast<int>(lights.size());
+}
+
+void ClusteredLights::setClustered(bool on)
+{
+    useClusters = on;
+    statistics.clustered = on;
+}
+
+bool ClusteredLights::clustered() const
+{
+    return useClusters;
+}
+
+void ClusteredLights::animate(float time)
+{
+    //every light circles its base position, the phase is kept in the alpha of the base color
+    JobSystem::instance().parallelFor(lights.size(), 4096, [this, time](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const PointLight& base = baseLights[i];
+            float angle = time * 0.5f + base.color.w;
+            lights[i].positionRange = base.positionRange + glm::vec4(std::cos(angle) * 0.3f, 0.0f, std::sin(angle) * 0.3f, 0.0f);
+            lights[i].color.w = -1.0f;
+        }
+    });
+}
+
+const std::vector<ClusteredLights::PointLight>& ClusteredLights::currentLights() const
+{
+    return lights;
+}
+
+void ClusteredLights::setShadowCaster(int light, int caster)
+{
+    lights[light].color.w = static_cast<float>(caster);
+}
+
+void ClusteredLights::update(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane)
+{
+    frameIndex = (frameIndex + 1) % queryLatency;
+    Frame& frame = frames[frameIndex];
+    if (frame.fence)
+        collect(frame);
+    frame.issued.fill(false);
+    frame.benchmarkStep = stepIndex;
+    unsigned int zero = 0;
+    glClearNamedBufferData(frame.statsBuffer.get(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+    if (!lights.empty())
+        glNamedBufferSubData(lightBuffer.get(), 0, lights.size() * sizeof(PointLight), lights.data());
+
+    Params params;
+    params.view = view;
+    params.grid = glm::uvec4(gridX, gridY, gridZ, maxClusterLights);
+    params.lights = glm::uvec4(static_cast<unsigned int>(lights.size()), useClusters ? 1u : 0u, 0u, 0u);
+    params.depth = glm::vec4(nearPlane, farPlane, gridZ / std::log(farPlane / nearPlane), 0.0f);
+    params.screen = glm::vec4(static_cast<float>(width), static_cast<float>(height), 1.0f / projection[0][0], 1.0f / projection[1][1]);
+    glNamedBufferSubData(paramsBuffer.get(), 0, sizeof(Params), &params);
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, paramsBinding, paramsBuffer.get());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, lightBinding, lightBuffer.get());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, countBinding, countBuffer.get());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, indexBinding, indexBuffer.get());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, statsBinding, frame.statsBuffer.get());
+    if (!useClusters)
+        return;
+
+    stamp(AssignBegin);
+    assignShader.bind();
+    glDispatchCompute((clusterNum + 127) / 128, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    stamp(AssignEnd);
+}
+
+void ClusteredLights::beginShading()
+{
+    stamp(ShadeBegin);
+}
+
+void ClusteredLights::endShading()
+{
+    stamp(ShadeEnd);
+    frames[frameIndex].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+const ClusteredLights::Stats& ClusteredLights::stats() const
+{
+    return statistics;
+}
+
+void ClusteredLights::toggleBenchmark()
+{
+    if (benchmarkRunning())
+    {
+        qDebug() << "clustered lighting benchmark stopped";
+        stepIndex = -1;
+        setLightCount(savedLightNum);
+        setClustered(savedClustered);
+        return;
+    }
+    benchmarkSteps.clear();
+    for (int i : benchmarkCounts)
+    {
+        benchmarkSteps.push_back(Step{ i, true, 0, 0.0, 0.0 });
+        if (i <= maxBruteForceLights)
+            benchmarkSteps.push_back(Step{ i, false, 0, 0.0, 0.0 });
+    }
+    savedLightNum = lightCount();
+    savedClustered = useClusters;
+    stepIndex = 0;
+    setLightCount(benchmarkSteps[0].lightNum);
+    setClustered(benchmarkSteps[0].clustered);
+    qDebug() << "clustered lighting benchmark," << clusterNum << "clusters";
+}
+
+bool ClusteredLights::benchmarkRunning() const
+{
+    return stepIndex >= 0;
+}
+
+void ClusteredLights::stamp(Stamp which)
+{
+    Frame& frame = frames[frameIndex];
+    glQueryCounter(frame.queries[which], GL_TIMESTAMP);
+    frame.issued[which] = true;
+}
+
+void ClusteredLights::collect(Frame& frame)
+{
+    //written queryLatency frames ago, normally long done
+    glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    glDeleteSync(frame.fence);
+    frame.fence = nullptr;
+
+    unsigned int counters[3];
+    glGetNamedBufferSubData(frame.statsBuffer.get(), 0, sizeof(counters), counters);
+    statistics.lightRefs = counters[0];
+    statistics.maxClusterLights = counters[1];
+    statistics.overflowClusters = counters[2];
+
+    std::array<GLuint64, StampNum> times{};
+    for (int i = 0; i < StampNum; ++i)
+    {
+        if (frame.issued[i])
+            glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &times[i]);
+    }
+    auto span = [&](Stamp begin, Stamp end) {
+        return frame.issued[begin] && frame.issued[end] ? (times[end] - times[begin]) / 1e6f : 0.0f;
+    };
+    statistics.assignMs = span(AssignBegin, AssignEnd);
+    statistics.shadeMs = span(ShadeBegin, ShadeEnd);
+
+    //results of an earlier step arriving late are not counted
+    if (stepIndex < 0 || frame.benchmarkStep != stepIndex)
+        return;
+    Step& step = benchmarkSteps[stepIndex];
+    step.assignMs += statistics.assignMs;
+    step.shadeMs += statistics.shadeMs;
+    if (++step.frames == framesPerStep)
+        finishStep();
+}
+
+void ClusteredLights::finishStep()
+{
+    const Step& step = benchmarkSteps[stepIndex];
+    qDebug() << "  " << step.lightNum << "lights" << (step.clustered ? "clustered:" : "brute force:")
+        << "assign" << step.assignMs / step.frames << "ms, shade" << step.shadeMs / step.frames << "ms";
+
+    if (++stepIndex == static_cast<int>(benchmarkSteps.size()))
+    {
+        qDebug() << "clustered lighting benchmark done";
+        stepIndex = -1;
+        setLightCount(savedLightNum);
+        setClustered(savedClustered);
+        return;
+    }
+    setLightCount(benchmarkSteps[stepIndex].lightNum);
+    setClustered(benchmarkSteps[stepIndex].clustered);
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include<qopenglfunctions_4_5_core.h>
+#include<qopenglshaderprogram.h>
+#include<glm.hpp>
+#include<array>
+#include<vector>
+#include"GpuResources.h"
+
+//point lights shaded per cluster, the view frustum is split into screen tiles and exponential depth slices,
+//a compute pass lists the lights touching every cluster and fragments only loop over the list of their own
+class ClusteredLights :protected QOpenGLFunctions_4_5_Core
+{
+public:
+    //std430 layout of clusteredLighting.frag
+    struct PointLight
+    {
+        glm::vec4 positionRange;    //w is the distance the light fades out at
+        glm::vec4 color;            //w is the index of its shadow caster, -1 without a shadow
+    };
+
+    struct Stats
+    {
+        int lights = 0;
+        bool clustered = true;
+        unsigned int lightRefs = 0;
+        unsigned int maxClusterLights = 0;
+        unsigned int overflowClusters = 0;
+        float assignMs = 0.0f;
+        float shadeMs = 0.0f;
+    };
+
+    constexpr static unsigned int gridX = 16, gridY = 9, gridZ = 24;
+    constexpr static unsigned int clusterNum = gridX * gridY * gridZ;
+    //lights beyond this in one cluster are dropped and counted as overflow
+    constexpr static unsigned int maxClusterLights = 256;
+    constexpr static int queryLatency = 3;
+    constexpr static int framesPerStep = 120;
+    //the buffer bindings both shaders declare, clear of the ones the culling pass uses
+    constexpr static unsigned int paramsBinding = 3;
+    constexpr static unsigned int lightBinding = 6, countBinding = 7, indexBinding = 8, statsBinding = 9;
+
+    void init();
+    void resize(int w, int h);
+    //lights are scattered over the scene with a fixed seed, so the same count always gives the same lights
+    void setLightCount(int lightNum);
+    int lightCount() const;
+    //without clustering every fragment loops over every light, only there to compare against
+    void setClustered(bool on);
+    bool clustered() const;
+    //moves the lights to where they are at time, none of them casting a shadow
+    void animate(float time);
+    const std::vector<PointLight>& currentLights() const;
+    //between animate and update, caster indexes the shadow casters of clusteredLighting.frag
+    void setShadowCaster(int light, int caster);
+    //uploads the animated lights, assigns them to the clusters of this view and binds everything for shading
+    void update(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane);
+    //bracket the draws that shade with the lights
+    void beginShading();
+    void endShading();
+    const Stats& stats() const;
+
+    //steps through the light counts, clustered and brute force where that is still bearable, and logs every step
+    void toggleBenchmark();
+    bool benchmarkRunning() const;
+
+private:
+    struct Params
+    {
+        glm::mat4 view;
+        glm::uvec4 grid;    //cluster counts and maxClusterLights
+        glm::uvec4 lights;  //count and whether to use the clusters
+        glm::vec4 depth;    //near, far, slices per unit of log depth
+        glm::vec4 screen;   //size and the inverse projection scale
+    };
+
+    enum Stamp
+    {
+        AssignBegin, AssignEnd, ShadeBegin, ShadeEnd, StampNum
+    };
+
+    struct Frame
+    {
+        std::array<unsigned int, StampNum> queries{};
+        std::array<bool, StampNum> issued{};
+        GpuResources::Buffer statsBuffer;
+        GLsync fence = nullptr;
+        int benchmarkStep = -1;
+    };
+
+    struct Step
+    {
+        int lightNum;
+        bool clustered;
+        int frames;
+        double assignMs;
+        double shadeMs;
+    };
+
+    QOpenGLShaderProgram assignShader;
+    int width = 1, height = 1;
+    bool useClusters = true;
+
+    std::vector<PointLight> baseLights;
+    std::vector<PointLight> lights;
+    GpuResources::Buffer lightBuffer;
+    size_t lightBytes = 0;
+    GpuResources::Buffer countBuffer, indexBuffer, paramsBuffer;
+
+    std::array<Frame, queryLatency> frames;
+    int frameIndex = 0;
+    Stats statistics;
+
+    std::vector<int> benchmarkCounts{ 256, 1024, 4096, 16384, 65536 };
+    //brute force above this takes seconds per frame
+    int maxBruteForceLights = 4096;
+    std::vector<Step> benchmarkSteps;
+    int stepIndex = -1;
+    int savedLightNum = 0;
+    bool savedClustered = true;
+
+    void stamp(Stamp which);
+    void collect(Frame& frame);
+    void finishStep();
+};
@@ -0,0 +1,204 @@
+#include "CommandBuffer.h"
+#include<algorithm>
+#include<type_traits>
+
+template<typename T>
+T& CommandBuffer::allocate(Type type)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "commands must be POD");
+    static_assert(alignof(T) <= alignof(intptr_t), "commands are packed at intptr_t alignment");
+    //rounded up so the next command stays aligned
+    constexpr size_t size = (sizeof(T) + alignof(intptr_t) - 1) / alignof(intptr_t) * alignof(intptr_t);
+    if (blocks.empty())
+    {
+        blocks.emplace_back(new unsigned char[blockSize]);
+        used.push_back(0);
+        current = 0;
+    }
+    if (used[current] + size > blockSize)
+    {
+        ++current;
+        if (current == blocks.size())
+        {
+            blocks.emplace_back(new unsigned char[blockSize]);
+            used.push_back(0);
+        }
+    }
+
+    T* command = reinterpret_cast<T*>(blocks[current].get() + used[current]);
+    used[current] += size;
+    command->header.type = type;
+    command->header.size = static_cast<uint16_t>(size);
+    ++commands;
+    return *command;
+}
+
+void CommandBuffer::bindProgram(unsigned int program)
+{
+    allocate<BindProgram>(Type::BindProgram).program = program;
+}
+
+void CommandBuffer::bindVertexArray(unsigned int vao)
+{
+    allocate<BindVertexArray>(Type::BindVertexArray).vao = vao;
+}
+
+void CommandBuffer::bindTextures(unsigned int first, unsigned int count, const unsigned int* textures)
+{
+    BindTextures& command = allocate<BindTextures>(Type::BindTextures);
+    command.first = first;
+    command.count = count < maxTextures ? count : maxTextures;
+    std::copy(textures, textures + command.count, command.textures);
+}
+
+void CommandBuffer::bindUniformRange(unsigned int index, unsigned int buffer, intptr_t offset, intptr_t size)
+{
+    BindUniformRange& command = allocate<BindUniformRange>(Type::BindUniformRange);
+    command.index = index;
+    command.buffer = buffer;
+    command.offset = offset;
+    command.size = size;
+}
+
+void CommandBuffer::drawArrays(unsigned int mode, int first, int count, int instanceCount, unsigned int baseInstance)
+{
+    DrawArrays& command = allocate<DrawArrays>(Type::DrawArrays);
+    command.mode = mode;
+    command.first = first;
+    command.count = count;
+    command.instanceCount = instanceCount;
+    command.baseInstance = baseInstance;
+}
+
+void CommandBuffer::drawElements(unsigned int mode, int count, unsigned int firstIndex, int instanceCount, int baseVertex, unsigned int baseInstance)
+{
+    DrawElements& command = allocate<DrawElements>(Type::DrawElements);
+    command.mode = mode;
+    command.count = count;
+    command.firstIndex = firstIndex;
+    command.instanceCount = instanceCount;
+    command.baseVertex = baseVertex;
+    command.baseInstance = baseInstance;
+}
+
+void CommandBuffer::drawArraysIndirect(unsigned int mode, unsigned int buffer, intptr_t offset)
+{
+    drawIndirect(Type::DrawArraysIndirect, mode, buffer, offset);
+}
+
+void CommandBuffer::drawElementsIndirect(unsigned int mode, unsigned int buffer, intptr_t offset)
+{
+    drawIndirect(Type::DrawElementsIndirect, mode, buffer, offset);
+}
+
+void CommandBuffer::drawIndirect(Type type, unsigned int mode, unsigned int buffer, intptr_t offset)
+{
+    DrawIndirect& command = allocate<DrawIndirect>(type);
+    command.mode = mode;
+    command.buffer = buffer;
+    command.offset = offset;
+}
+
+void CommandBuffer::reset()
+{
+    std::fill(used.begin(), used.end(), 0);
+    current = 0;
+    commands = 0;
+}
+
+size_t CommandBuffer::commandCount() const
+{
+    return commands;
+}
+
+size_t CommandBuffer::bytes() const
+{
+    size_t result = 0;
+    for (auto i : used)
+        result += i;
+    return result;
+}
+
+void CommandReplayer::init()
+{
+    QOpenGLFunctions_4_5_Core::initializeOpenGLFunctions();
+}
+
+void CommandReplayer::begin()
+{
+    program = 0;
+    vao = 0;
+    indirectBuffer = 0;
+}
+
+void CommandReplayer::execute(const CommandBuffer& buffer)
+{
+    using Type = CommandBuffer::Type;
+    buffer.forEach([this](const CommandBuffer::Header& header) {
+        switch (header.type)
+        {
+        case Type::BindProgram:
+        {
+            auto& command = reinterpret_cast<const CommandBuffer::BindProgram&>(header);
+            if (command.program != program)
+            {
+                program = command.program;
+                glUseProgram(program);
+            }
+            break;
+        }
+        case Type::BindVertexArray:
+        {
+            auto& command = reinterpret_cast<const CommandBuffer::BindVertexArray&>(header);
+            if (command.vao != vao)
+            {
+                vao = command.vao;
+                glBindVertexArray(vao);
+            }
+            break;
+        }
+        case Type::BindTextures:
+        {
+            auto& command = reinterpret_cast<const CommandBuffer::BindTextures&>(header);
+            glBindTextures(command.first, command.count, command.textures);
+            break;
+        }
+        case Type::BindUniformRange:
+        {
+            auto& command = reinterpret_cast<const CommandBuffer::BindUniformRange&>(header);
+            glBindBufferRange(GL_UNIFORM_BUFFER, command.index, command.buffer, command.offset, command.size);
+            break;
+        }
+        case Type::DrawArrays:
+        {
+            auto& command = reinterpret_cast<const CommandBuffer::DrawArrays&>(header);
+            glDrawArraysInstancedBaseInstance(command.mode, command.first, command.count, command.instanceCount, command.baseInstance);
+            break;
+        }
+        case Type::DrawElements:
+        {
+            auto& command = reinterpret_cast<const CommandBuffer::DrawElements&>(header);
+            glDrawElementsInstancedBaseVertexBaseInstance(command.mode, command.count, GL_UNSIGNED_INT,
+                reinterpret_cast<const void*>(static_cast<uintptr_t>(command.firstIndex) * sizeof(unsigned int)),
+                command.instanceCount, command.baseVertex, command.baseInstance);
+            break;
+        }
+        case Type::DrawArraysIndirect:
+        case Type::DrawElementsIndirect:
+        {
+            auto& command = reinterpret_cast<const CommandBuffer::DrawIndirect&>(header);
+            if (command.buffer != indirectBuffer)
+            {
+                indirectBuffer = command.buffer;
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            }
+            const void* offset = reinterpret_cast<const void*>(command.offset);
+            if (header.type == Type::DrawArraysIndirect)
+                glDrawArraysIndirect(command.mode, offset);
+            else
+                glDrawElementsIndirect(command.mode, GL_UNSIGNED_INT, offset);
+            break;
+        }
+        }
+    });
+}
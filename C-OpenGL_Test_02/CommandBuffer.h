@@ -0,0 +1,141 @@
+#pragma once
+#include<qopenglfunctions_4_5_core.h>
+#include<cstddef>
+#include<cstdint>
+#include<memory>
+#include<vector>
+
+//draw submission recorded as small POD commands, any thread can record into its own buffer
+//and only the GL thread replays them, memory comes from blocks that are kept across reset()
+class CommandBuffer
+{
+public:
+    enum class Type : uint16_t
+    {
+        BindProgram, BindVertexArray, BindTextures, BindUniformRange, DrawArrays, DrawElements, DrawArraysIndirect, DrawElementsIndirect
+    };
+
+    struct Header
+    {
+        Type type;
+        uint16_t size;
+    };
+
+    constexpr static unsigned int maxTextures = 8;
+
+    struct BindProgram
+    {
+        Header header;
+        unsigned int program;
+    };
+
+    struct BindVertexArray
+    {
+        Header header;
+        unsigned int vao;
+    };
+
+    struct BindTextures
+    {
+        Header header;
+        unsigned int first;
+        unsigned int count;
+        unsigned int textures[maxTextures];
+    };
+
+    struct BindUniformRange
+    {
+        Header header;
+        unsigned int index;
+        unsigned int buffer;
+        intptr_t offset;
+        intptr_t size;
+    };
+
+    struct DrawArrays
+    {
+        Header header;
+        unsigned int mode;
+        int first;
+        int count;
+        int instanceCount;
+        unsigned int baseInstance;
+    };
+
+    //indices are always GL_UNSIGNED_INT like everywhere else in the project
+    struct DrawElements
+    {
+        Header header;
+        unsigned int mode;
+        int count;
+        unsigned int firstIndex;
+        int instanceCount;
+        int baseVertex;
+        unsigned int baseInstance;
+    };
+
+    //parameters come from a GL_DRAW_INDIRECT_BUFFER written on the GPU, shared by both indirect kinds
+    struct DrawIndirect
+    {
+        Header header;
+        unsigned int mode;
+        unsigned int buffer;
+        intptr_t offset;
+    };
+
+    void bindProgram(unsigned int program);
+    void bindVertexArray(unsigned int vao);
+    void bindTextures(unsigned int first, unsigned int count, const unsigned int* textures);
+    void bindUniformRange(unsigned int index, unsigned int buffer, intptr_t offset, intptr_t size);
+    void drawArrays(unsigned int mode, int first, int count, int instanceCount = 1, unsigned int baseInstance = 0);
+    void drawElements(unsigned int mode, int count, unsigned int firstIndex = 0, int instanceCount = 1, int baseVertex = 0, unsigned int baseInstance = 0);
+    void drawArraysIndirect(unsigned int mode, unsigned int buffer, intptr_t offset);
+    void drawElementsIndirect(unsigned int mode, unsigned int buffer, intptr_t offset);
+
+    void reset();
+    size_t commandCount() const;
+    size_t bytes() const;
+
+    //calls func(const Header&) for every command in recording order
+    template<typename Func>
+    void forEach(Func&& func) const
+    {
+        for (size_t i = 0; i < blocks.size() && i <= current; ++i)
+        {
+            const unsigned char* data = blocks[i].get();
+            for (size_t offset = 0; offset < used[i];)
+            {
+                const Header& header = *reinterpret_cast<const Header*>(data + offset);
+                func(header);
+                offset += header.size;
+            }
+        }
+    }
+
+private:
+    constexpr static size_t blockSize = 64 * 1024;
+
+    std::vector<std::unique_ptr<unsigned char[]>> blocks;
+    std::vector<size_t> used;
+    size_t current = 0;
+    size_t commands = 0;
+
+    template<typename T>
+    T& allocate(Type type);
+    void drawIndirect(Type type, unsigned int mode, unsigned int buffer, intptr_t offset);
+};
+
+//replays command buffers on the GL thread, skipping binds that would not change anything
+class CommandReplayer :protected QOpenGLFunctions_4_5_Core
+{
+public:
+    void init();
+    //forget the cached state, call whenever other code may have bound things since the last replay
+    void begin();
+    void execute(const CommandBuffer& buffer);
+
+private:
+    unsigned int program = 0;
+    unsigned int vao = 0;
+    unsigned int indirectBuffer = 0;
+};
@@ -0,0 +1,135 @@
+#include "DepthPrepass.h"
+#include<qdebug.h>
+
+void DepthPrepass::init()
+{
+    QOpenGLFunctions_4_5_Core::initializeOpenGLFunctions();
+    for (auto& i : frames)
+        glGenQueries(StampNum, i.queries.data());
+}
+
+void DepthPrepass::setEnabled(bool enable)
+{
+    prepassEnabled = enable;
+}
+
+bool DepthPrepass::enabled() const
+{
+    return prepassEnabled;
+}
+
+void DepthPrepass::begin()
+{
+    frameIndex = (frameIndex + 1) % queryLatency;
+    Frame& frame = frames[frameIndex];
+    if (frame.issued)
+        collect(frame);
+
+    active = prepassEnabled;
+    glQueryCounter(frame.queries[PrepassBegin], GL_TIMESTAMP);
+    if (!active)
+        return;
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+}
+
+void DepthPrepass::beginShading()
+{
+    glQueryCounter(frames[frameIndex].queries[ShadingBegin], GL_TIMESTAMP);
+    if (!active)
+        return;
+    //the shaders compute gl_Position as invariant, so the same surface lands on exactly the same depth
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+}
+
+void DepthPrepass::end()
+{
+    Frame& frame = frames[frameIndex];
+    glQueryCounter(frame.queries[ShadingEnd], GL_TIMESTAMP);
+    frame.issued = true;
+    frame.prepass = active;
+    frame.benchmarkStep = stepIndex;
+    if (!active)
+        return;
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_TRUE);
+    active = false;
+}
+
+const DepthPrepass::Stats& DepthPrepass::stats() const
+{
+    return statistics;
+}
+
+void DepthPrepass::toggleBenchmark()
+{
+    if (benchmarkRunning())
+    {
+        qDebug() << "depth prepass benchmark stopped";
+        stepIndex = -1;
+        setEnabled(savedEnabled);
+        return;
+    }
+    //a few rounds of both, the scene moves while it runs
+    benchmarkSteps.clear();
+    for (int i = 0; i < benchmarkRounds; ++i)
+    {
+        benchmarkSteps.push_back(Step{ false, 0, 0.0, 0.0 });
+        benchmarkSteps.push_back(Step{ true, 0, 0.0, 0.0 });
+    }
+    savedEnabled = prepassEnabled;
+    stepIndex = 0;
+    setEnabled(benchmarkSteps[0].prepass);
+    qDebug() << "depth prepass benchmark";
+}
+
+bool DepthPrepass::benchmarkRunning() const
+{
+    return stepIndex >= 0;
+}
+
+void DepthPrepass::collect(Frame& frame)
+{
+    //issued queryLatency frames ago, normally long available
+    std::array<GLuint64, StampNum> times{};
+    for (int i = 0; i < StampNum; ++i)
+        glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &times[i]);
+    frame.issued = false;
+    float prepassMs = (times[ShadingBegin] - times[PrepassBegin]) / 1e6f;
+    float shadingMs = (times[ShadingEnd] - times[ShadingBegin]) / 1e6f;
+
+    int index = frame.prepass ? 1 : 0;
+    auto average = [](float& value, float sample) {
+        value = value == 0.0f ? sample : value * 0.95f + sample * 0.05f;
+    };
+    average(statistics.prepassMs[index], prepassMs);
+    average(statistics.shadingMs[index], shadingMs);
+
+    //results of an earlier step arriving late are not counted
+    if (stepIndex < 0 || frame.benchmarkStep != stepIndex)
+        return;
+    Step& step = benchmarkSteps[stepIndex];
+    step.prepassMs += prepassMs;
+    step.shadingMs += shadingMs;
+    if (++step.frames == framesPerStep)
+        finishStep();
+}
+
+void DepthPrepass::finishStep()
+{
+    const Step& step = benchmarkSteps[stepIndex];
+    double prepassMs = step.prepassMs / step.frames;
+    double shadingMs = step.shadingMs / step.frames;
+    qDebug() << "  " << (step.prepass ? "with prepass   " : "without prepass") << ": prepass" << prepassMs << "ms, shading" << shadingMs
+        << "ms, opaque total" << prepassMs + shadingMs << "ms";
+
+    if (++stepIndex == static_cast<int>(benchmarkSteps.size()))
+    {
+        qDebug() << "depth prepass benchmark done";
+        stepIndex = -1;
+        setEnabled(savedEnabled);
+        return;
+    }
+    setEnabled(benchmarkSteps[stepIndex].prepass);
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include<qopenglfunctions_4_5_core.h>
+#include<array>
+#include<vector>
+
+//lays down the depth of the opaque scene before it is shaded, so the expensive shading pass runs only
+//for the nearest surface of every pixel, the opaque pass goes begin, prepass draws, beginShading, shaded draws, end
+class DepthPrepass :protected QOpenGLFunctions_4_5_Core
+{
+public:
+    //averaged over the frames drawn in each mode, index 0 without the prepass and 1 with it
+    struct Stats
+    {
+        std::array<float, 2> prepassMs{};
+        std::array<float, 2> shadingMs{};
+    };
+
+    constexpr static int framesPerStep = 120;
+    constexpr static int queryLatency = 3;
+
+    void init();
+    void setEnabled(bool enable);
+    bool enabled() const;
+    //depth only from here, colour writes are off
+    void begin();
+    //only what matches the laid down depth is shaded, without writing depth again
+    void beginShading();
+    //back to the usual depth test, draws after this are not covered by the prepass
+    void end();
+    const Stats& stats() const;
+
+    //alternates between shading with and without the prepass and logs the GPU time of both
+    void toggleBenchmark();
+    bool benchmarkRunning() const;
+
+private:
+    enum Stamp
+    {
+        PrepassBegin, ShadingBegin, ShadingEnd, StampNum
+    };
+
+    struct Frame
+    {
+        std::array<unsigned int, StampNum> queries{};
+        bool issued = false;
+        bool prepass = false;
+        int benchmarkStep = -1;
+    };
+
+    struct Step
+    {
+        bool prepass;
+        int frames;
+        double prepassMs;
+        double shadingMs;
+    };
+
+    bool prepassEnabled = false;
+    //decided in begin, so toggling in the middle of a pass changes nothing until the next one
+    bool active = false;
+    std::array<Frame, queryLatency> frames;
+    int frameIndex = 0;
+    Stats statistics;
+
+    constexpr static int benchmarkRounds = 3;
+    std::vector<Step> benchmarkSteps;
+    int stepIndex = -1;
+    bool savedEnabled = false;
+
+    void collect(Frame& frame);
+    void finishStep();
+};
@@ -0,0 +1,163 @@
+#include "DrawBenchmark.h"
+#include"JobSystem.h"
+#include<gtc/matrix_transform.hpp>
+#include<gtc/type_ptr.hpp>
+#include<qdebug.h>
+#include<algorithm>
+#include<chrono>
+#include<cmath>
+#include<cstring>
+#include"AssetPack.h"
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::duration;
+
+namespace
+{
+    struct DrawData
+    {
+        glm::mat4 modelMat;
+        glm::vec4 color;
+    };
+}
+
+void DrawBenchmark::init()
+{
+    QOpenGLFunctions_4_5_Core::initializeOpenGLFunctions();
+    replayer.init();
+
+    program.create();
+    AssetPack::addShader(program, QOpenGLShader::Vertex, "./shaders/commandDraw.vert");
+    AssetPack::addShader(program, QOpenGLShader::Fragment, "./shaders/commandDraw.frag");
+    program.link();
+}
+
+void DrawBenchmark::toggle()
+{
+    if (running())
+    {
+        qDebug() << "command buffer benchmark stopped";
+        stepIndex = -1;
+        return;
+    }
+    //the buffer is only allocated once somebody runs the benchmark
+    if (!drawBuffer)
+        allocateDrawBuffer(*std::max_element(drawCounts.begin(), drawCounts.end()));
+    stepIndex = 0;
+    step = Step{};
+    step.drawCount = drawCounts[0];
+    qDebug() << "command buffer benchmark," << JobSystem::instance().workerCount() + 1 << "recording threads";
+}
+
+bool DrawBenchmark::running() const
+{
+    return stepIndex >= 0;
+}
+
+void DrawBenchmark::allocateDrawBuffer(int maxDraws)
+{
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    drawStride = (sizeof(DrawData) + alignment - 1) / alignment * alignment;
+    regionBytes = drawStride * maxDraws;
+
+    //persistent and coherent, the recording threads write straight into it
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    drawBuffer = GpuResources::instance().createBuffer(regionBytes * regionNum, nullptr, flags, "draw benchmark");
+    mappedDrawBuffer = static_cast<unsigned char*>(glMapNamedBufferRange(drawBuffer.get(), 0, regionBytes * regionNum, flags));
+}
+
+void DrawBenchmark::draw(const glm::mat4& viewProjection, unsigned int vao, float time)
+{
+    if (!running() || !mappedDrawBuffer)
+        return;
+
+    //the region was last used regionNum frames ago, normally this never blocks
+    if (regionFences[region])
+    {
+        glClientWaitSync(regionFences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        glDeleteSync(regionFences[region]);
+        regionFences[region] = nullptr;
+    }
+
+    JobSystem& jobs = JobSystem::instance();
+    size_t threads = static_cast<size_t>(jobs.workerCount() + 1);
+    if (commandBuffers.size() < threads)
+        commandBuffers.resize(threads);
+
+    int drawCount = step.drawCount;
+    size_t grain = (drawCount + threads - 1) / threads;
+    int side = static_cast<int>(std::ceil(std::cbrt(static_cast<float>(drawCount))));
+    float spacing = 0.12f;
+    glm::vec3 origin(-side * spacing * 0.5f, 1.0f, -side * spacing * 0.5f);
+    size_t regionOffset = regionBytes * region;
+    unsigned int programId = program.programId();
+    unsigned int uniformBuffer = drawBuffer.get();
+
+    auto recordBegin = steady_clock::now();
+    jobs.parallelFor(drawCount, grain, [&](size_t begin, size_t end) {
+        CommandBuffer& commands = commandBuffers[begin / grain];
+        commands.reset();
+        commands.bindProgram(programId);
+        commands.bindVertexArray(vao);
+        for (size_t i = begin; i < end; ++i)
+        {
+            int x = static_cast<int>(i) % side;
+            int y = static_cast<int>(i) / side % side;
+            int z = static_cast<int>(i) / (side * side);
+            DrawData data;
+            data.modelMat = glm::translate(glm::mat4(1.0f), origin + glm::vec3(x, y, z) * spacing);
+            data.modelMat = glm::rotate(data.modelMat, time + i * 0.01f, glm::vec3(0.0f, 1.0f, 0.0f));
+            data.modelMat = glm::scale(data.modelMat, glm::vec3(0.04f));
+            data.color = glm::vec4(0.3f + 0.7f * x / side, 0.3f + 0.7f * y / side, 0.3f + 0.7f * z / side, 1.0f);
+
+            size_t offset = regionOffset + i * drawStride;
+            std::memcpy(mappedDrawBuffer + offset, &data, sizeof(DrawData));
+            commands.bindUniformRange(0, uniformBuffer, offset, sizeof(DrawData));
+            commands.drawArrays(GL_TRIANGLES, 0, 36);
+        }
+    });
+    auto recordEnd = steady_clock::now();
+
+    //chunks are numbered by their first item, so replaying the buffers in order keeps the recording order
+    program.bind();
+    glUniformMatrix4fv(program.uniformLocation("VP"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+    replayer.begin();
+    size_t used = std::min(threads, (drawCount + grain - 1) / grain);
+    size_t commandBytes = 0;
+    for (size_t i = 0; i < used; ++i)
+    {
+        replayer.execute(commandBuffers[i]);
+        commandBytes += commandBuffers[i].bytes();
+    }
+    auto replayEnd = steady_clock::now();
+    glBindVertexArray(0);
+
+    regionFences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    region = (region + 1) % regionNum;
+
+    step.recordMs += duration_cast<duration<double, std::milli>>(recordEnd - recordBegin).count();
+    step.replayMs += duration_cast<duration<double, std::milli>>(replayEnd - recordEnd).count();
+    step.commandBytes = commandBytes;
+    if (++step.frames == framesPerStep)
+        finishStep();
+}
+
+void DrawBenchmark::finishStep()
+{
+    double recordMs = step.recordMs / step.frames;
+    double replayMs = step.replayMs / step.frames;
+    qDebug() << "  " << step.drawCount << "draws: record" << recordMs << "ms (" << recordMs * 1e6 / step.drawCount << "ns/draw)"
+        << "replay" << replayMs << "ms (" << replayMs * 1e6 / step.drawCount << "ns/draw)"
+        << "commands" << step.commandBytes / 1024 << "KiB";
+
+    if (++stepIndex == static_cast<int>(drawCounts.size()))
+    {
+        qDebug() << "command buffer benchmark done";
+        stepIndex = -1;
+        return;
+    }
+    step = Step{};
+    step.drawCount = drawCounts[stepIndex];
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include<qopenglfunctions_4_5_core.h>
+#include<qopenglshaderprogram.h>
+#include<glm.hpp>
+#include<array>
+#include<vector>
+#include"CommandBuffer.h"
+#include"GpuResources.h"
+
+//draws a grid of separate cubes through command buffers recorded on the job system
+//and times recording against replay while the draw count steps up
+class DrawBenchmark :protected QOpenGLFunctions_4_5_Core
+{
+public:
+    struct Step
+    {
+        int drawCount = 0;
+        int frames = 0;
+        double recordMs = 0.0;
+        double replayMs = 0.0;
+        size_t commandBytes = 0;
+    };
+
+    constexpr static int framesPerStep = 120;
+    constexpr static int regionNum = 3;
+
+    void init();
+    //steps through drawCounts and logs every step, a second call stops the sweep
+    void toggle();
+    bool running() const;
+    //records and replays one frame of the current step, vao holds the 36 vertex cube
+    void draw(const glm::mat4& viewProjection, unsigned int vao, float time);
+
+private:
+    std::vector<int> drawCounts{ 1000, 5000, 10000, 20000, 40000 };
+    int stepIndex = -1;
+    Step step;
+
+    QOpenGLShaderProgram program;
+    //per draw data, regionNum regions so the CPU never writes what the GPU still reads
+    GpuResources::Buffer drawBuffer;
+    unsigned char* mappedDrawBuffer = nullptr;
+    size_t drawStride = 0;
+    size_t regionBytes = 0;
+    std::array<GLsync, regionNum> regionFences{};
+    int region = 0;
+
+    //one command buffer per recording thread, kept so their blocks are reused every frame
+    std::vector<CommandBuffer> commandBuffers;
+    CommandReplayer replayer;
+
+    void allocateDrawBuffer(int maxDraws);
+    void finishStep();
+};
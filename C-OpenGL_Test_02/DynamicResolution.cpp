@@ -0,0 +1,196 @@
+#include "DynamicResolution.h"
+#include<qdebug.h>
+#include<algorithm>
+#include<cmath>
+
+void DynamicResolution::init()
+{
+    QOpenGLFunctions_4_5_Core::initializeOpenGLFunctions();
+    for (auto& i : frames)
+        glGenQueries(2, i.queries.data());
+}
+
+void DynamicResolution::resize(int w, int h)
+{
+    outputWidth = std::max(w, 1);
+    outputHeight = std::max(h, 1);
+    //every kept target is for the old size
+    pool.clear();
+    useScale(scaleSteps);
+}
+
+void DynamicResolution::setEnabled(bool enable)
+{
+    scalingEnabled = enable;
+    gpuMsSum = 0.0f;
+    gpuSamples = 0;
+    if (enable)
+        return;
+    if (pool.empty())
+        scaleSteps = fullSteps;
+    else
+        useScale(fullSteps);
+}
+
+bool DynamicResolution::enabled() const
+{
+    return scalingEnabled;
+}
+
+void DynamicResolution::setTargetMs(float ms)
+{
+    frameTargetMs = ms;
+}
+
+float DynamicResolution::targetMs() const
+{
+    return frameTargetMs;
+}
+
+void DynamicResolution::setFilter(Filter filter)
+{
+    upscaleFilter = filter;
+}
+
+DynamicResolution::Filter DynamicResolution::filter() const
+{
+    return upscaleFilter;
+}
+
+const char* DynamicResolution::filterName(Filter filter)
+{
+    switch (filter)
+    {
+    case Filter::Bilinear:
+        return "bilinear";
+    case Filter::Bicubic:
+        return "bicubic";
+    default:
+        return "sharpened bicubic";
+    }
+}
+
+bool DynamicResolution::beginFrame()
+{
+    frameIndex = (frameIndex + 1) % queryLatency;
+    Frame& frame = frames[frameIndex];
+    if (frame.issued)
+        collect(frame);
+    glQueryCounter(frame.queries[0], GL_TIMESTAMP);
+
+    bool result = changed;
+    changed = false;
+    return result;
+}
+
+void DynamicResolution::endFrame()
+{
+    Frame& frame = frames[frameIndex];
+    glQueryCounter(frame.queries[1], GL_TIMESTAMP);
+    frame.issued = true;
+}
+
+const DynamicResolution::Target& DynamicResolution::target() const
+{
+    return pool.front();
+}
+
+DynamicResolution::Filter DynamicResolution::activeFilter() const
+{
+    return scaleSteps == fullSteps ? Filter::Bilinear : upscaleFilter;
+}
+
+const DynamicResolution::Stats& DynamicResolution::stats() const
+{
+    return statistics;
+}
+
+void DynamicResolution::collect(Frame& frame)
+{
+    //issued queryLatency frames ago, normally long available
+    std::array<GLuint64, 2> times{};
+    for (int i = 0; i < 2; ++i)
+        glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &times[i]);
+    frame.issued = false;
+    gpuMsSum += (times[1] - times[0]) / 1e6f;
+    if (++gpuSamples < adjustInterval)
+        return;
+    float gpuMs = gpuMsSum / gpuSamples;
+    gpuMsSum = 0.0f;
+    gpuSamples = 0;
+    statistics.gpuMs = gpuMs;
+    if (scalingEnabled)
+        adjust(gpuMs);
+}
+
+void DynamicResolution::adjust(float gpuMs)
+{
+    //the cost that scales goes with the pixel count, the square of the scale, a scale for the target follows from that
+    float scale = static_cast<float>(scaleSteps) / fullSteps;
+    float ideal = scale * std::sqrt(frameTargetMs / std::max(gpuMs, 0.01f));
+    int steps = static_cast<int>(std::floor(ideal * fullSteps));
+    //down quickly when over budget, up one step at a time so a single cheap stretch does not bounce it back,
+    //and only up with some headroom so it does not hunt around the target
+    if (steps > scaleSteps)
+        steps = gpuMs < frameTargetMs * 0.85f ? scaleSteps + 1 : scaleSteps;
+    else
+        steps = std::max(steps, scaleSteps - 4);
+    steps = std::min(std::max(steps, minSteps), fullSteps);
+    if (steps == scaleSteps)
+        return;
+    useScale(steps);
+    qDebug() << "render scale" << statistics.scale << "(" << statistics.width << "x" << statistics.height << "), gpu" << gpuMs
+        << "ms for a target of" << frameTargetMs << "ms";
+}
+
+void DynamicResolution::useScale(int steps)
+{
+    int w = std::max(outputWidth * steps / fullSteps, 1);
+    int h = std::max(outputHeight * steps / fullSteps, 1);
+    scaleSteps = steps;
+    statistics.scale = static_cast<float>(steps) / fullSteps;
+    statistics.width = w;
+    statistics.height = h;
+    if (!pool.empty() && pool.front().width == w && pool.front().height == h)
+        return;
+    changed = true;
+    ++statistics.changes;
+
+    auto found = std::find_if(pool.begin(), pool.end(), [&](const Target& i) {
+        return i.width == w && i.height == h;
+    });
+    if (found != pool.end())
+    {
+        pool.splice(pool.begin(), pool, found);
+        statistics.pooledTargets = static_cast<int>(pool.size());
+        return;
+    }
+
+    pool.emplace_front();
+    Target& target = pool.front();
+    target.width = w;
+    target.height = h;
+    GpuResources& gpu = GpuResources::instance();
+    target.colorTex = gpu.createTexture2D(GL_RGBA16F, 1, w, h, "scene color");
+    unsigned int colorTex = target.colorTex.get();
+    glTextureParameteri(colorTex, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(colorTex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(colorTex, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(colorTex, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    target.depthTex = gpu.createTexture2D(GL_DEPTH_COMPONENT32F, 1, w, h, "scene depth");
+    unsigned int depthTex = target.depthTex.get();
+    glTextureParameteri(depthTex, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTextureParameteri(depthTex, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    target.fbo = gpu.createFramebuffer("scene");
+    glNamedFramebufferTexture(target.fbo.get(), GL_COLOR_ATTACHMENT0, colorTex, 0);
+    glNamedFramebufferTexture(target.fbo.get(), GL_DEPTH_ATTACHMENT, depthTex, 0);
+    if (glCheckNamedFramebufferStatus(target.fbo.get(), GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        qWarning() << "scene framebuffer is incomplete";
+
+    //the least recently used go first
+    while (static_cast<int>(pool.size()) > poolSize)
+        pool.pop_back();
+    statistics.pooledTargets = static_cast<int>(pool.size());
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include<qopenglfunctions_4_5_core.h>
+#include<array>
+#include<list>
+#include"GpuResources.h"
+
+//renders the scene below the widget size when the GPU falls behind, the GPU time of every frame is measured and
+//every few frames the scale moves toward the one expected to hit the target time, in fixed steps so the targets
+//of the last few scales are kept and handed out again instead of being made anew
+class DynamicResolution :protected QOpenGLFunctions_4_5_Core
+{
+public:
+    //the scene colour and depth at render size
+    struct Target
+    {
+        GpuResources::Framebuffer fbo;
+        GpuResources::Texture colorTex;
+        GpuResources::Texture depthTex;
+        int width = 0, height = 0;
+    };
+
+    //how the scene is brought up to the widget size, fboOutput.frag
+    enum class Filter
+    {
+        Bilinear, Bicubic, Sharpened
+    };
+
+    struct Stats
+    {
+        float scale = 1.0f;
+        int width = 0, height = 0;
+        float gpuMs = 0.0f;         //whole frame, averaged over the last adjustment
+        int changes = 0;
+        int pooledTargets = 0;
+    };
+
+    //the scale goes in twentieths from half to full size
+    constexpr static int fullSteps = 20;
+    constexpr static int minSteps = 10;
+    constexpr static int adjustInterval = 8;
+    constexpr static int poolSize = 4;
+    constexpr static int queryLatency = 3;
+
+    void init();
+    //the widget size, the scale is applied on top
+    void resize(int w, int h);
+    void setEnabled(bool enable);
+    bool enabled() const;
+    void setTargetMs(float ms);
+    float targetMs() const;
+    void setFilter(Filter filter);
+    Filter filter() const;
+    static const char* filterName(Filter filter);
+
+    //call before the first GPU work of a frame, true when the render size changed since the last call
+    //and everything sized to the scene has to follow
+    bool beginFrame();
+    //after the last GPU work of the frame
+    void endFrame();
+    const Target& target() const;
+    //the filter to upscale with, plain sampling when the scene is at full size
+    Filter activeFilter() const;
+    const Stats& stats() const;
+
+private:
+    struct Frame
+    {
+        std::array<unsigned int, 2> queries{};
+        bool issued = false;
+    };
+
+    bool scalingEnabled = true;
+    float frameTargetMs = 16.6f;
+    Filter upscaleFilter = Filter::Sharpened;
+    int outputWidth = 1, outputHeight = 1;
+    int scaleSteps = fullSteps;
+    //the target in use is always the first, the rest are kept for scales used recently
+    std::list<Target> pool;
+    bool changed = true;
+
+    std::array<Frame, queryLatency> frames;
+    int frameIndex = 0;
+    float gpuMsSum = 0.0f;
+    int gpuSamples = 0;
+    Stats statistics;
+
+    void collect(Frame& frame);
+    void adjust(float gpuMs);
+    void useScale(int steps);
+};
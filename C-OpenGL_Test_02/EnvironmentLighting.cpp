@@ -0,0 +1,604 @@
+#include "EnvironmentLighting.h"
+#include<qimage.h>
+#include<qdebug.h>
+#include<algorithm>
+#include<chrono>
+#include<cmath>
+#include<cstdio>
+#include<fstream>
+#include<thread>
+#include"AssetPack.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include<emmintrin.h>
+#define ENVIRONMENT_LIGHTING_SSE2
+#endif
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::duration;
+using CubeLevel = EnvironmentLighting::CubeLevel;
+
+namespace
+{
+    constexpr uint32_t cacheMagic = 0x43564E45;     //"ENVC"
+    //bumped whenever projection or filtering changes so stale caches are rebuilt
+    constexpr uint32_t cacheVersion = 1;
+    constexpr float pi = 3.14159265f;
+    //the cube the prefilter samples from, twice the size of its first level
+    constexpr int sourceSize = EnvironmentLighting::prefilterSize * 2;
+
+    double elapsedMs(steady_clock::time_point begin)
+    {
+        return duration_cast<duration<double, std::milli>>(steady_clock::now() - begin).count();
+    }
+
+    //the direction through a point of a face is constant + s * x + t * y per component, with s and t from -1 to 1
+    //across the face in GL cube map layout
+    struct FaceAxes
+    {
+        float c[3], s[3], t[3];
+    };
+
+    constexpr FaceAxes faceAxes[6] = {
+        { { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f } },
+        { { -1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, -1.0f, 0.0f } },
+        { { 0.0f, 1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
+        { { 0.0f, -1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -1.0f } },
+        { { 0.0f, 0.0f, 1.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f } },
+        { { 0.0f, 0.0f, -1.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f } },
+    };
+
+    glm::vec3 texelDirection(int face, int size, int x, int y)
+    {
+        float s = (x + 0.5f) * 2.0f / size - 1.0f;
+        float t = (y + 0.5f) * 2.0f / size - 1.0f;
+        const FaceAxes& a = faceAxes[face];
+        return glm::normalize(glm::vec3(a.c[0] + a.s[0] * s + a.t[0] * t, a.c[1] + a.s[1] * s + a.t[1] * t, a.c[2] + a.s[2] * s + a.t[2] * t));
+    }
+
+    //the inverse of texelDirection, s and t from 0 to 1
+    void faceCoords(const glm::vec3& dir, int& face, float& s, float& t)
+    {
+        glm::vec3 a = glm::abs(dir);
+        float major, sc, tc;
+        if (a.x >= a.y && a.x >= a.z)
+        {
+            major = a.x;
+            face = dir.x > 0.0f ? 0 : 1;
+            sc = dir.x > 0.0f ? -dir.z : dir.z;
+            tc = -dir.y;
+        }
+        else if (a.y >= a.z)
+        {
+            major = a.y;
+            face = dir.y > 0.0f ? 2 : 3;
+            sc = dir.x;
+            tc = dir.y > 0.0f ? dir.z : -dir.z;
+        }
+        else
+        {
+            major = a.z;
+            face = dir.z > 0.0f ? 4 : 5;
+            sc = dir.z > 0.0f ? dir.x : -dir.x;
+            tc = -dir.y;
+        }
+        s = (sc / major + 1.0f) * 0.5f;
+        t = (tc / major + 1.0f) * 0.5f;
+    }
+
+    //bilinear inside the face, clamped at its edges
+    glm::vec3 sampleLevel(const CubeLevel& level, const glm::vec3& dir)
+    {
+        int face;
+        float s, t;
+        faceCoords(dir, face, s, t);
+        int size = level.size;
+        float x = std::min(std::max(s * size - 0.5f, 0.0f), size - 1.0f);
+        float y = std::min(std::max(t * size - 0.5f, 0.0f), size - 1.0f);
+        int x0 = static_cast<int>(x), y0 = static_cast<int>(y);
+        int x1 = std::min(x0 + 1, size - 1), y1 = std::min(y0 + 1, size - 1);
+        float fx = x - x0, fy = y - y0;
+        const std::vector<glm::vec3>& texels = level.faces[face];
+        glm::vec3 top = glm::mix(texels[y0 * size + x0], texels[y0 * size + x1], fx);
+        glm::vec3 bottom = glm::mix(texels[y1 * size + x0], texels[y1 * size + x1], fx);
+        return glm::mix(top, bottom, fy);
+    }
+
+    glm::vec3 sampleTrilinear(const std::vector<CubeLevel>& chain, const glm::vec3& dir, float mip)
+    {
+        mip = std::min(std::max(mip, 0.0f), static_cast<float>(chain.size() - 1));
+        int lower = static_cast<int>(mip);
+        int upper = std::min(lower + 1, static_cast<int>(chain.size()) - 1);
+        return glm::mix(sampleLevel(chain[lower], dir), sampleLevel(chain[upper], dir), mip - lower);
+    }
+
+    //the nine basis functions times the weighted colour, plus the weight, per texel
+    constexpr int sumNum = 9 * 3 + 1;
+
+    void projectTexel(const FaceAxes& a, float s, float t, const unsigned char* rgb, float* sums)
+    {
+        glm::vec3 dir(a.c[0] + a.s[0] * s + a.t[0] * t, a.c[1] + a.s[1] * s + a.t[1] * t, a.c[2] + a.s[2] * s + a.t[2] * t);
+        //|dir| is sqrt(1 + s^2 + t^2), the solid angle of a texel goes with its inverse cube
+        float invLength = 1.0f / std::sqrt(1.0f + s * s + t * t);
+        float weight = invLength * invLength * invLength;
+        dir *= invLength;
+        float basis[9] = { 1.0f, dir.y, dir.z, dir.x, dir.x * dir.y, dir.y * dir.z, 3.0f * dir.z * dir.z - 1.0f, dir.x * dir.z, dir.x * dir.x - dir.y * dir.y };
+        for (int c = 0; c < 3; ++c)
+        {
+            float value = rgb[c] * (weight / 255.0f);
+            for (int i = 0; i < 9; ++i)
+                sums[i * 3 + c] += basis[i] * value;
+        }
+        sums[27] += weight;
+    }
+
+    void projectRow(int face, int size, int y, const unsigned char* row, float* sums)
+    {
+        const FaceAxes& a = faceAxes[face];
+        float step = 2.0f / size;
+        float t = (y + 0.5f) * step - 1.0f;
+        int x = 0;
+#ifdef ENVIRONMENT_LIGHTING_SSE2
+        //four texels of the row per iteration, one per lane
+        __m128 acc[sumNum];
+        for (auto& i : acc)
+            i = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        __m128 base[3], across[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            base[c] = _mm_set1_ps(a.c[c] + a.t[c] * t);
+            across[c] = _mm_set1_ps(a.s[c]);
+        }
+        for (; x + 4 <= size; x += 4)
+        {
+            __m128 s = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets), _mm_set1_ps(step)), one);
+            __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(one, _mm_mul_ps(s, s)), _mm_set1_ps(t * t))));
+            __m128 weight = _mm_mul_ps(_mm_mul_ps(invLength, invLength), invLength);
+            __m128 dx = _mm_mul_ps(_mm_add_ps(base[0], _mm_mul_ps(across[0], s)), invLength);
+            __m128 dy = _mm_mul_ps(_mm_add_ps(base[1], _mm_mul_ps(across[1], s)), invLength);
+            __m128 dz = _mm_mul_ps(_mm_add_ps(base[2], _mm_mul_ps(across[2], s)), invLength);
+            __m128 basis[9] = {
+                one, dy, dz, dx,
+                _mm_mul_ps(dx, dy), _mm_mul_ps(dy, dz), _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3.0f), _mm_mul_ps(dz, dz)), one),
+                _mm_mul_ps(dx, dz), _mm_sub_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+            };
+            const unsigned char* p = row + x * 3;
+            __m128 scaled = _mm_mul_ps(weight, _mm_set1_ps(1.0f / 255.0f));
+            for (int c = 0; c < 3; ++c)
+            {
+                __m128 value = _mm_mul_ps(_mm_set_ps(p[9 + c], p[6 + c], p[3 + c], p[c]), scaled);
+                for (int i = 0; i < 9; ++i)
+                    acc[i * 3 + c] = _mm_add_ps(acc[i * 3 + c], _mm_mul_ps(basis[i], value));
+            }
+            acc[27] = _mm_add_ps(acc[27], weight);
+        }
+        for (int i = 0; i < sumNum; ++i)
+        {
+            alignas(16) float lanes[4];
+            _mm_store_ps(lanes, acc[i]);
+            sums[i] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        }
+#endif
+        for (; x < size; ++x)
+            projectTexel(a, (x + 0.5f) * step - 1.0f, t, row + x * 3, sums);
+    }
+
+    uint64_t fnv1a(const unsigned char* data, size_t bytes, uint64_t hash = 14695981039346656037ull)
+    {
+        for (size_t i = 0; i < bytes; ++i)
+            hash = (hash ^ data[i]) * 1099511628211ull;
+        return hash;
+    }
+}
+
+EnvironmentLighting::~EnvironmentLighting()
+{
+    if (preprocessThread.joinable())
+        preprocessThread.join();
+}
+
+void EnvironmentLighting::init(const Faces& faces)
+{
+    QOpenGLFunctions_4_5_Core::initializeOpenGLFunctions();
+    faceFiles = faces;
+    GpuData data{};
+    uniforms = GpuResources::instance().createBuffer(sizeof(GpuData), &data, 0, "environment lighting");
+    writeUniforms();
+    preprocessThread = std::thread([this] {
+        loaded = preprocess(faceFiles, JobSystem::instance(), true, result, statistics);
+        preprocessed = true;
+    });
+}
+
+void EnvironmentLighting::update()
+{
+    if (!preprocessThread.joinable() || !preprocessed)
+        return;
+    preprocessThread.join();
+    if (!loaded)
+    {
+        qWarning() << "environment lighting failed, keeping the flat ambient";
+        return;
+    }
+
+    cube = GpuResources::instance().createTexture(GL_TEXTURE_CUBE_MAP, "environment prefiltered");
+    glTextureStorage2D(cube.get(), levelNum, GL_RGB16F, prefilterSize, prefilterSize);
+    cube.setBytes(GpuResources::textureBytes(GL_RGB16F, levelNum, prefilterSize, prefilterSize) * 6);
+    for (int level = 0; level < levelNum; ++level)
+    {
+        const CubeLevel& cubeLevel = result.prefiltered[level];
+        for (int face = 0; face < 6; ++face)
+            glTextureSubImage3D(cube.get(), level, 0, 0, face, cubeLevel.size, cubeLevel.size, 1, GL_RGB, GL_FLOAT, cubeLevel.faces[face].data());
+    }
+    glTextureParameteri(cube.get(), GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameteri(cube.get(), GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(cube.get(), GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(cube.get(), GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(cube.get(), GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    //rough levels are a few texels wide, filtering across face edges keeps the seams out of them
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    result.prefiltered.clear();
+    uploaded = true;
+    writeUniforms();
+
+    if (statistics.cached)
+        qDebug() << "environment lighting from the cache in" << statistics.totalMs << "ms, hashing" << statistics.hashMs << "ms";
+    else
+        qDebug() << "environment lighting in" << statistics.totalMs << "ms on" << statistics.threads << "threads: decode" << statistics.decodeMs
+            << "ms, irradiance" << statistics.projectMs << "ms, downsample" << statistics.downsampleMs << "ms, prefilter" << statistics.prefilterMs << "ms";
+}
+
+bool EnvironmentLighting::ready() const
+{
+    return uploaded;
+}
+
+bool EnvironmentLighting::settled() const
+{
+    return !preprocessThread.joinable();
+}
+
+void EnvironmentLighting::setEnabled(bool enable)
+{
+    environmentEnabled = enable;
+    writeUniforms();
+}
+
+bool EnvironmentLighting::enabled() const
+{
+    return environmentEnabled;
+}
+
+void EnvironmentLighting::bind()
+{
+    glBindBufferBase(GL_UNIFORM_BUFFER, uniformBinding, uniforms.get());
+    glBindTextureUnit(cubeUnit, cube.get());
+}
+
+const EnvironmentLighting::Stats& EnvironmentLighting::stats() const
+{
+    return statistics;
+}
+
+EnvironmentLighting::Faces EnvironmentLighting::skyboxFaces(const std::string& directory)
+{
+    return Faces{ directory + "/right.jpg", directory + "/left.jpg", directory + "/top.jpg", directory + "/bottom.jpg",
+        directory + "/front.jpg", directory + "/back.jpg" };
+}
+
+bool EnvironmentLighting::preprocess(const Faces& faces, JobSystem& jobs, bool useCache, Result& result, Stats& stats)
+{
+    auto begin = steady_clock::now();
+    stats = Stats();
+    stats.threads = jobs.workerCount() + 1;
+
+    //the hash is of the files as stored, the bytes read for it are decoded from as well
+    std::array<std::vector<unsigned char>, 6> files;
+    std::array<uint64_t, 6> hashes{};
+    jobs.parallelFor(6, 1, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i)
+        {
+            AssetPack::instance().read(faces[i], files[i]);
+            hashes[i] = fnv1a(files[i].data(), files[i].size());
+        }
+    });
+    uint64_t hash = fnv1a(reinterpret_cast<const unsigned char*>(hashes.data()), sizeof(hashes));
+    const uint32_t parameters[4] = { cacheVersion, prefilterSize, levelNum, sampleCount };
+    hash = fnv1a(reinterpret_cast<const unsigned char*>(parameters), sizeof(parameters), hash);
+    stats.hashMs = elapsedMs(begin);
+    std::string cacheFile = cachePath(faces, hash);
+    if (useCache && readCache(cacheFile, result))
+    {
+        stats.cached = true;
+        stats.totalMs = elapsedMs(begin);
+        return true;
+    }
+
+    auto stageBegin = steady_clock::now();
+    std::array<QImage, 6> images;
+    jobs.parallelFor(6, 1, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i)
+        {
+            if (!files[i].empty() && images[i].loadFromData(files[i].data(), static_cast<int>(files[i].size())))
+                images[i] = images[i].convertToFormat(QImage::Format_RGB888);
+        }
+    });
+    int size = images[0].width();
+    for (auto& i : images)
+    {
+        if (i.isNull() || i.width() != size || i.height() != size || size < sourceSize)
+        {
+            qWarning() << "skybox faces have to be square, of one size and at least" << sourceSize << "texels";
+            return false;
+        }
+    }
+    for (auto& i : files)
+        std::vector<unsigned char>().swap(i);
+    stats.decodeMs = elapsedMs(stageBegin);
+
+    //irradiance, every row of every face is a work item, the rows of a chunk sum into one partial
+    stageBegin = steady_clock::now();
+    constexpr size_t rowGrain = 32;
+    size_t rowNum = static_cast<size_t>(size) * 6;
+    std::vector<std::array<float, sumNum>> partials((rowNum + rowGrain - 1) / rowGrain);
+    jobs.parallelFor(rowNum, rowGrain, [&](size_t first, size_t last) {
+        std::array<float, sumNum>& sums = partials[first / rowGrain];
+        sums.fill(0.0f);
+        for (size_t i = first; i < last; ++i)
+        {
+            int face = static_cast<int>(i / size), y = static_cast<int>(i % size);
+            projectRow(face, size, y, images[face].constBits() + static_cast<size_t>(y) * images[face].bytesPerLine(), sums.data());
+        }
+    });
+    std::array<double, sumNum> totals{};
+    for (auto& i : partials)
+    {
+        for (int j = 0; j < sumNum; ++j)
+            totals[j] += i[j];
+    }
+    //the weights add up to the whole sphere, the cosine lobe scales each band by pi, 2pi/3 and pi/4, all over pi for Lambert
+    const float basisScale[9] = { 0.282095f, 0.488603f, 0.488603f, 0.488603f, 1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f };
+    const float bandScale[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+    double sphere = 4.0 * pi / totals[27];
+    for (int i = 0; i < 9; ++i)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            float coefficient = static_cast<float>(totals[i * 3 + c] * sphere) * basisScale[i];
+            result.irradianceSH[i][c] = coefficient * basisScale[i] * bandScale[i];
+        }
+    }
+    stats.projectMs = elapsedMs(stageBegin);
+
+    //box filtered down to the source of the prefilter and halved from there to one texel for filtered importance sampling
+    stageBegin = steady_clock::now();
+    std::vector<CubeLevel> chain(1);
+    chain[0].size = sourceSize;
+    for (auto& i : chain[0].faces)
+        i.resize(static_cast<size_t>(sourceSize) * sourceSize);
+    jobs.parallelFor(static_cast<size_t>(sourceSize) * 6, 8, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i)
+        {
+            int face = static_cast<int>(i / sourceSize), y = static_cast<int>(i % sourceSize);
+            int y0 = y * size / sourceSize, y1 = (y + 1) * size / sourceSize;
+            for (int x = 0; x < sourceSize; ++x)
+            {
+                int x0 = x * size / sourceSize, x1 = (x + 1) * size / sourceSize;
+                glm::vec3 sum(0.0f);
+                for (int sy = y0; sy < y1; ++sy)
+                {
+                    const unsigned char* p = images[face].constBits() + static_cast<size_t>(sy) * images[face].bytesPerLine() + x0 * 3;
+                    for (int sx = x0; sx < x1; ++sx, p += 3)
+                        sum += glm::vec3(p[0], p[1], p[2]);
+                }
+                chain[0].faces[face][y * sourceSize + x] = sum / (255.0f * (x1 - x0) * (y1 - y0));
+            }
+        }
+    });
+    while (chain.back().size > 1)
+    {
+        const CubeLevel& above = chain.back();
+        CubeLevel level;
+        level.size = above.size / 2;
+        for (int face = 0; face < 6; ++face)
+        {
+            level.faces[face].resize(static_cast<size_t>(level.size) * level.size);
+            for (int y = 0; y < level.size; ++y)
+            {
+                for (int x = 0; x < level.size; ++x)
+                {
+                    const std::vector<glm::vec3>& texels = above.faces[face];
+                    int i = y * 2 * above.size + x * 2;
+                    level.faces[face][y * level.size + x] = (texels[i] + texels[i + 1] + texels[i + above.size] + texels[i + above.size + 1]) * 0.25f;
+                }
+            }
+        }
+        chain.push_back(std::move(level));
+    }
+    stats.downsampleMs = elapsedMs(stageBegin);
+
+    //with normal and view the same every texel sees the same lobe around its own direction, so the samples,
+    //their weights and the source mips they read from are worked out once per level
+    stageBegin = steady_clock::now();
+    struct Sample
+    {
+        glm::vec3 direction;
+        float weight;
+        float mip;
+    };
+    std::vector<std::vector<Sample>> samples(levelNum);
+    float texelSolidAngle = 4.0f * pi / (6.0f * sourceSize * sourceSize);
+    for (int level = 1; level < levelNum; ++level)
+    {
+        float roughness = static_cast<float>(level) / (levelNum - 1);
+        float a = roughness * roughness;
+        for (uint32_t i = 0; i < static_cast<uint32_t>(sampleCount); ++i)
+        {
+            //Hammersley point set
+            uint32_t bits = i;
+            bits = (bits << 16u) | (bits >> 16u);
+            bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+            bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+            bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+            bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+            float u = static_cast<float>(i) / sampleCount, v = bits * 2.3283064365386963e-10f;
+
+            float phi = 2.0f * pi * u;
+            float cosTheta = std::sqrt((1.0f - v) / (1.0f + (a * a - 1.0f) * v));
+            float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+            glm::vec3 half(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+            glm::vec3 direction = 2.0f * cosTheta * half - glm::vec3(0.0f, 0.0f, 1.0f);
+            if (direction.z <= 0.0f)
+                continue;
+            float denominator = cosTheta * cosTheta * (a * a - 1.0f) + 1.0f;
+            float distribution = a * a / (pi * denominator * denominator);
+            //the pdf of direction is D / 4 when normal and view agree, a sample covering more than a texel reads a coarser mip
+            float sampleSolidAngle = 1.0f / (sampleCount * distribution * 0.25f + 1e-4f);
+            float mip = std::max(0.5f * std::log2(sampleSolidAngle / texelSolidAngle) + 1.0f, 0.0f);
+            samples[level].push_back(Sample{ direction, direction.z, mip });
+        }
+    }
+
+    result.prefiltered.assign(levelNum, CubeLevel());
+    struct Row
+    {
+        int level, face, y;
+    };
+    std::vector<Row> rows;
+    for (int level = 0; level < levelNum; ++level)
+    {
+        CubeLevel& out = result.prefiltered[level];
+        out.size = prefilterSize >> level;
+        for (int face = 0; face < 6; ++face)
+        {
+            out.faces[face].resize(static_cast<size_t>(out.size) * out.size);
+            for (int y = 0; y < out.size; ++y)
+                rows.push_back(Row{ level, face, y });
+        }
+    }
+    jobs.parallelFor(rows.size(), 4, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i)
+        {
+            const Row& row = rows[i];
+            CubeLevel& out = result.prefiltered[row.level];
+            for (int x = 0; x < out.size; ++x)
+            {
+                glm::vec3 normal = texelDirection(row.face, out.size, x, row.y);
+                glm::vec3& texel = out.faces[row.face][row.y * out.size + x];
+                //roughness 0 is a mirror, the source one level down is already at this size
+                if (row.level == 0)
+                {
+                    texel = sampleLevel(chain[1], normal);
+                    continue;
+                }
+                glm::vec3 up = std::abs(normal.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+                glm::vec3 tangent = glm::normalize(glm::cross(up, normal));
+                glm::vec3 bitangent = glm::cross(normal, tangent);
+                glm::vec3 sum(0.0f);
+                float weight = 0.0f;
+                for (const Sample& sample : samples[row.level])
+                {
+                    glm::vec3 direction = tangent * sample.direction.x + bitangent * sample.direction.y + normal * sample.direction.z;
+                    sum += sampleTrilinear(chain, direction, sample.mip) * sample.weight;
+                    weight += sample.weight;
+                }
+                texel = weight > 0.0f ? sum / weight : sampleLevel(chain[1], normal);
+            }
+        }
+    });
+    stats.prefilterMs = elapsedMs(stageBegin);
+
+    if (useCache && !writeCache(cacheFile, result))
+        qWarning() << "failed to write the environment cache" << QString::fromStdString(cacheFile);
+    stats.totalMs = elapsedMs(begin);
+    return true;
+}
+
+void EnvironmentLighting::benchmark(const Faces& faces)
+{
+    int maxThreads = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+    qDebug() << "environment preprocessing scaling, the calling thread is one of the threads";
+    double baseMs = 0.0;
+    for (int threads = 1; threads <= maxThreads; ++threads)
+    {
+        JobSystem system(threads - 1);
+        Stats best;
+        best.totalMs = 1e30;
+        for (int run = 0; run < 3; ++run)
+        {
+            Result result;
+            Stats stats;
+            if (!preprocess(faces, system, false, result, stats))
+                return;
+            if (stats.totalMs < best.totalMs)
+                best = stats;
+        }
+        if (threads == 1)
+            baseMs = best.totalMs;
+        qDebug() << "  " << threads << "threads:" << best.totalMs << "ms, speedup" << baseMs / best.totalMs << ", decode" << best.decodeMs
+            << "irradiance" << best.projectMs << "downsample" << best.downsampleMs << "prefilter" << best.prefilterMs << "ms";
+    }
+}
+
+void EnvironmentLighting::writeUniforms()
+{
+    GpuData data{};
+    //result belongs to the preprocessing thread until it has been uploaded
+    if (uploaded)
+    {
+        for (int i = 0; i < 9; ++i)
+            data.irradianceSH[i] = glm::vec4(result.irradianceSH[i], 0.0f);
+    }
+    data.params = glm::vec4(environmentEnabled && uploaded ? 1.0f : 0.0f, static_cast<float>(levelNum - 1), 0.0f, 0.0f);
+    glNamedBufferSubData(uniforms.get(), 0, sizeof(GpuData), &data);
+}
+
+std::string EnvironmentLighting::cachePath(const Faces& faces, uint64_t hash)
+{
+    std::string directory = faces[0].substr(0, faces[0].find_last_of("/\\") + 1);
+    char name[64];
+    std::snprintf(name, sizeof(name), "environment_%016llx.cache", static_cast<unsigned long long>(hash));
+    return directory + name;
+}
+
+bool EnvironmentLighting::readCache(const std::string& path, Result& result)
+{
+    std::unique_ptr<std::istream> stream = AssetPack::instance().open(path);
+    if (!stream)
+        return false;
+    std::istream& file = *stream;
+    uint32_t header[4] = {};
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!file || header[0] != cacheMagic || header[1] != cacheVersion || header[2] != prefilterSize || header[3] != levelNum)
+        return false;
+    file.read(reinterpret_cast<char*>(result.irradianceSH.data()), sizeof(result.irradianceSH));
+    result.prefiltered.assign(levelNum, CubeLevel());
+    for (int level = 0; level < levelNum; ++level)
+    {
+        CubeLevel& cubeLevel = result.prefiltered[level];
+        cubeLevel.size = prefilterSize >> level;
+        for (auto& face : cubeLevel.faces)
+        {
+            face.resize(static_cast<size_t>(cubeLevel.size) * cubeLevel.size);
+            file.read(reinterpret_cast<char*>(face.data()), face.size() * sizeof(glm::vec3));
+        }
+    }
+    return static_cast<bool>(file);
+}
+
+bool EnvironmentLighting::writeCache(const std::string& path, const Result& result)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    const uint32_t header[4] = { cacheMagic, cacheVersion, prefilterSize, levelNum };
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(result.irradianceSH.data()), sizeof(result.irradianceSH));
+    for (auto& level : result.prefiltered)
+    {
+        for (auto& face : level.faces)
+            file.write(reinterpret_cast<const char*>(face.data()), face.size() * sizeof(glm::vec3));
+    }
+    return static_cast<bool>(file);
+}
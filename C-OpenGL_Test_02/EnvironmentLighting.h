@@ -0,0 +1,103 @@
+#pragma once
+#include<qopenglfunctions_4_5_core.h>
+#include<glm.hpp>
+#include<array>
+#include<atomic>
+#include<cstdint>
+#include<string>
+#include<thread>
+#include<vector>
+#include"GpuResources.h"
+#include"JobSystem.h"
+
+//diffuse and specular light from the skybox: the faces are decoded in parallel, projected onto nine spherical
+//harmonic coefficients of irradiance and filtered into a cube whose mips hold the GGX lobe of rising roughness,
+//both are cached next to the faces under a hash of their contents, shading is then a few multiply adds and one
+//cube fetch, see environmentLighting.frag
+class EnvironmentLighting :protected QOpenGLFunctions_4_5_Core
+{
+public:
+    //in GL face order, +x -x +y -y +z -z
+    using Faces = std::array<std::string, 6>;
+
+    struct CubeLevel
+    {
+        int size = 0;
+        std::array<std::vector<glm::vec3>, 6> faces;
+    };
+
+    struct Result
+    {
+        //irradiance over pi with the basis constants folded in, the order environmentLighting.frag evaluates them in
+        std::array<glm::vec3, 9> irradianceSH{};
+        std::vector<CubeLevel> prefiltered;
+    };
+
+    struct Stats
+    {
+        bool cached = false;
+        int threads = 0;
+        double hashMs = 0.0;
+        double decodeMs = 0.0;
+        double projectMs = 0.0;
+        double downsampleMs = 0.0;
+        double prefilterMs = 0.0;
+        double totalMs = 0.0;
+    };
+
+    constexpr static int prefilterSize = 128;
+    //roughness 0 to 1 over 128 down to 4 texels
+    constexpr static int levelNum = 6;
+    constexpr static int sampleCount = 128;
+    //environmentLighting.frag
+    constexpr static unsigned int uniformBinding = 4, cubeUnit = 9;
+
+    ~EnvironmentLighting();
+
+    //starts preprocessing on its own thread, which spreads the work over the job system in chunks,
+    //until it is done the shaders get the flat ambient they had before
+    void init(const Faces& faces);
+    //call once a frame on the GL thread, uploads the result once it is there
+    void update();
+    bool ready() const;
+    //preprocessing is over, uploaded or failed
+    bool settled() const;
+    void setEnabled(bool enable);
+    bool enabled() const;
+    //binds the coefficients and the prefiltered cube for the shading passes
+    void bind();
+    const Stats& stats() const;
+
+    //the six faces of a skybox directory in GL face order
+    static Faces skyboxFaces(const std::string& directory);
+    //decodes, projects and prefilters with the given job system, or reads the cache when there is one
+    static bool preprocess(const Faces& faces, JobSystem& jobs, bool useCache, Result& result, Stats& stats);
+    //times preprocessing without the cache with 1 to N threads and prints the speedup
+    static void benchmark(const Faces& faces);
+
+private:
+    //std140 layout of environmentLighting.frag
+    struct GpuData
+    {
+        std::array<glm::vec4, 9> irradianceSH;
+        glm::vec4 params;
+    };
+
+    Faces faceFiles;
+    bool environmentEnabled = true;
+    bool uploaded = false;
+    //a job of its own would be picked up whole by whichever thread waits on the pool next
+    std::thread preprocessThread;
+    std::atomic<bool> preprocessed{ false };
+    bool loaded = false;
+    Result result;
+    Stats statistics;
+
+    GpuResources::Buffer uniforms;
+    GpuResources::Texture cube;
+
+    void writeUniforms();
+    static std::string cachePath(const Faces& faces, uint64_t hash);
+    static bool readCache(const std::string& path, Result& result);
+    static bool writeCache(const std::string& path, const Result& result);
+};
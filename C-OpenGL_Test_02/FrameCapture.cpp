@@ -0,0 +1,265 @@
+#include "FrameCapture.h"
+#include<qdebug.h>
+#include<qdir.h>
+#include<qfileinfo.h>
+#include<qimage.h>
+#include<chrono>
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::duration;
+
+FrameCapture::~FrameCapture()
+{
+    if (active || !inFlight.empty())
+        stop();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (writer.joinable())
+        writer.join();
+}
+
+void FrameCapture::init()
+{
+    QOpenGLFunctions_4_5_Core::initializeOpenGLFunctions();
+    if (!writer.joinable())
+        writer = std::thread(&FrameCapture::writerLoop, this);
+}
+
+bool FrameCapture::start(const std::string& path, Format captureFormat)
+{
+    if (active)
+        return true;
+    if (!QDir().mkpath(QString::fromStdString(path)))
+    {
+        qWarning() << "frame capture can not write to" << QString::fromStdString(path);
+        return false;
+    }
+    directory = path;
+    format = captureFormat;
+    frameCount = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        statistics = Stats();
+    }
+    active = true;
+    qDebug() << "frame capture to" << QString::fromStdString(directory) << "as" << formatName(format);
+    return true;
+}
+
+void FrameCapture::stop()
+{
+    active = false;
+    handOver(true);
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] {
+        return queue.empty() && busy == 0;
+    });
+    if (stream)
+    {
+        std::fclose(stream);
+        stream = nullptr;
+    }
+    qDebug() << "frame capture stopped," << statistics.written << "of" << statistics.captured << "frames written,"
+        << statistics.droppedGpu + statistics.droppedWriter << "dropped";
+}
+
+bool FrameCapture::recording() const
+{
+    return active;
+}
+
+void FrameCapture::capture(unsigned int framebuffer, int width, int height)
+{
+    handOver(false);
+    if (!active || width <= 0 || height <= 0)
+        return;
+
+    int frame = frameCount++;
+    //the next slot in order that is neither copying nor being written
+    int index = -1;
+    bool writerHolds = false;
+    for (int i = 0; i < ringSize && index < 0; ++i)
+    {
+        int candidate = (nextSlot + i) % ringSize;
+        Slot& slot = ring[candidate];
+        if (slot.writing.load(std::memory_order_acquire))
+            writerHolds = true;
+        else if (!slot.fence)
+            index = candidate;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++statistics.captured;
+        if (index < 0)
+        {
+            ++(writerHolds ? statistics.droppedWriter : statistics.droppedGpu);
+            return;
+        }
+    }
+    nextSlot = (index + 1) % ringSize;
+
+    Slot& slot = ring[index];
+    size_t bytes = static_cast<size_t>(width) * height * 4;
+    if (slot.bytes < bytes)
+    {
+        //read back through a mapping that stays for the life of the buffer, there is nothing to map or unmap per frame
+        GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        slot.buffer = GpuResources::instance().createBuffer(bytes, nullptr, flags, "frame capture");
+        slot.mapped = static_cast<const unsigned char*>(glMapNamedBufferRange(slot.buffer.get(), 0, bytes, flags));
+        slot.bytes = bytes;
+    }
+    slot.width = width;
+    slot.height = height;
+    slot.frame = frame;
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glReadBuffer(framebuffer ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer.get());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    inFlight.push_back(index);
+}
+
+FrameCapture::Stats FrameCapture::stats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return statistics;
+}
+
+const char* FrameCapture::formatName(Format format)
+{
+    switch (format)
+    {
+    case Format::Raw:
+        return "raw";
+    case Format::Video:
+        return "video";
+    default:
+        return "png";
+    }
+}
+
+bool FrameCapture::parseFormat(const std::string& name, Format& format)
+{
+    for (Format i : { Format::Png, Format::Raw, Format::Video })
+    {
+        if (name == formatName(i))
+        {
+            format = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void FrameCapture::handOver(bool block)
+{
+    //copies finish in order, so the first one not done yet ends the search
+    while (!inFlight.empty())
+    {
+        Slot& slot = ring[inFlight.front()];
+        GLenum result = glClientWaitSync(slot.fence, block ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, block ? 1000000000 : 0);
+        if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+            return;
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+        slot.writing.store(true, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(inFlight.front());
+        }
+        wake.notify_one();
+        inFlight.pop_front();
+    }
+}
+
+void FrameCapture::writerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [this] {
+            return stopping || !queue.empty();
+        });
+        if (stopping)
+            return;
+        int index = queue.front();
+        queue.pop_front();
+        ++busy;
+        lock.unlock();
+        auto begin = steady_clock::now();
+        size_t bytes = write(ring[index]);
+        float ms = duration_cast<duration<float, std::milli>>(steady_clock::now() - begin).count();
+        ring[index].writing.store(false, std::memory_order_release);
+        lock.lock();
+        --busy;
+        if (bytes)
+        {
+            ++statistics.written;
+            statistics.writtenBytes += bytes;
+        }
+        statistics.writeMs = statistics.writeMs == 0.0f ? ms : statistics.writeMs * 0.95f + ms * 0.05f;
+        if (queue.empty() && busy == 0)
+            idle.notify_all();
+    }
+}
+
+size_t FrameCapture::write(const Slot& slot)
+{
+    //GL rows go bottom up, files top down
+    size_t rowBytes = static_cast<size_t>(slot.width) * 4;
+    auto writeRows = [&](std::FILE* file) {
+        for (int y = slot.height - 1; y >= 0; --y)
+        {
+            if (std::fwrite(slot.mapped + y * rowBytes, 1, rowBytes, file) != rowBytes)
+                return false;
+        }
+        return true;
+    };
+    char name[64];
+    switch (format)
+    {
+    case Format::Png:
+    {
+        std::snprintf(name, sizeof(name), "/frame_%06d.png", slot.frame);
+        //alpha is whatever blending left behind, the picture on screen ignores it
+        QImage image(slot.mapped, slot.width, slot.height, static_cast<int>(rowBytes), QImage::Format_RGBX8888);
+        QString path = QString::fromStdString(directory + name);
+        if (!image.mirrored().save(path, "PNG"))
+            return 0;
+        return static_cast<size_t>(QFileInfo(path).size());
+    }
+    case Format::Raw:
+    {
+        std::snprintf(name, sizeof(name), "/frame_%06d_%dx%d.rgba", slot.frame, slot.width, slot.height);
+        std::FILE* file = std::fopen((directory + name).c_str(), "wb");
+        if (!file)
+            return 0;
+        bool written = writeRows(file);
+        std::fclose(file);
+        return written ? rowBytes * slot.height : 0;
+    }
+    default:
+    {
+        //plays with ffmpeg -f rawvideo -pixel_format rgba -video_size WxH, dropped frames are simply missing
+        if (!stream || streamWidth != slot.width || streamHeight != slot.height)
+        {
+            if (stream)
+                std::fclose(stream);
+            std::snprintf(name, sizeof(name), "/video_%06d_%dx%d.rgba", slot.frame, slot.width, slot.height);
+            stream = std::fopen((directory + name).c_str(), "wb");
+            streamWidth = slot.width;
+            streamHeight = slot.height;
+        }
+        if (!stream || !writeRows(stream))
+            return 0;
+        return rowBytes * slot.height;
+    }
+    }
+}
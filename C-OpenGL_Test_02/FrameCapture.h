@@ -0,0 +1,90 @@
+#pragma once
+#include<qopenglfunctions_4_5_core.h>
+#include<array>
+#include<atomic>
+#include<condition_variable>
+#include<cstdio>
+#include<deque>
+#include<mutex>
+#include<string>
+#include<thread>
+#include"GpuResources.h"
+
+//records frames without stalling the GPU, every capture copies the framebuffer into the next free buffer of a
+//ring and a fence tells a few frames later when the copy has landed, the persistently mapped buffer then goes to a
+//writer thread, a frame that finds every buffer still in flight or with the writer is dropped and counted instead
+class FrameCapture :protected QOpenGLFunctions_4_5_Core
+{
+public:
+    enum class Format
+    {
+        //one png per frame, one headerless rgba file per frame named with its size, or every frame appended to one rgba stream
+        Png, Raw, Video
+    };
+
+    struct Stats
+    {
+        int captured = 0;
+        int written = 0;
+        int droppedGpu = 0;         //every buffer was waiting for its copy
+        int droppedWriter = 0;      //the writer still held buffers
+        size_t writtenBytes = 0;
+        float writeMs = 0.0f;       //per frame on the writer thread, averaged
+    };
+
+    constexpr static int ringSize = 4;
+
+    ~FrameCapture();
+
+    void init();
+    //frames go to the directory at path, which is made if needed
+    bool start(const std::string& path, Format captureFormat);
+    //waits for the frames in flight to be written
+    void stop();
+    bool recording() const;
+    //call once a frame after it is drawn, reads colour attachment 0 of framebuffer, also hands finished copies
+    //to the writer so it has to be called after stop too until the ring is empty, stop does that itself
+    void capture(unsigned int framebuffer, int width, int height);
+    Stats stats();
+    static const char* formatName(Format format);
+    static bool parseFormat(const std::string& name, Format& format);
+
+private:
+    struct Slot
+    {
+        GpuResources::Buffer buffer;
+        const unsigned char* mapped = nullptr;
+        size_t bytes = 0;
+        GLsync fence = nullptr;
+        int width = 0, height = 0;
+        int frame = 0;
+        //set while the writer reads the mapping, the slot is not reused until it is cleared
+        std::atomic<bool> writing{ false };
+    };
+
+    bool active = false;
+    std::string directory;
+    Format format = Format::Png;
+    int frameCount = 0;
+    std::array<Slot, ringSize> ring;
+    //slots with a copy in flight, oldest first
+    std::deque<int> inFlight;
+    int nextSlot = 0;
+
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::deque<int> queue;
+    int busy = 0;
+    bool stopping = false;
+    Stats statistics;
+    //the stream of Video, reopened when the size changes
+    int streamWidth = 0, streamHeight = 0;
+    std::FILE* stream = nullptr;
+
+    void handOver(bool block);
+    void writerLoop();
+    //directory and format only change while the writer has nothing to do
+    size_t write(const Slot& slot);
+};
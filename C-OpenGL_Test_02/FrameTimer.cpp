@@ -0,0 +1,93 @@
+#include "FrameTimer.h"
+#include<algorithm>
+
+using std::chrono::duration_cast;
+using std::chrono::duration;
+using std::chrono::nanoseconds;
+
+void FrameTimer::init()
+{
+    QOpenGLFunctions_4_5_Core::initializeOpenGLFunctions();
+    glGenQueries(queryNum, queries.data());
+    calibrate();
+    lastFrame = Clock::now();
+}
+
+void FrameTimer::beginFrame(Clock::time_point now)
+{
+    frameTimes.push_back(duration_cast<duration<float, std::milli>>(now - lastFrame).count());
+    lastFrame = now;
+    collect();
+}
+
+void FrameTimer::endFrame(bool newInput, Clock::time_point inputTime)
+{
+    if (!newInput)
+        return;
+    //with every query still in flight the sample is skipped, latency is sampled and not traced per event
+    auto slot = std::find(pending.begin(), pending.end(), false);
+    if (slot == pending.end())
+        return;
+    int index = static_cast<int>(slot - pending.begin());
+    glQueryCounter(queries[index], GL_TIMESTAMP);
+    queryInputs[index] = inputTime;
+    pending[index] = true;
+}
+
+FrameTimer::Stats FrameTimer::takeStats()
+{
+    Stats result;
+    result.frames = static_cast<int>(frameTimes.size());
+    if (!frameTimes.empty())
+    {
+        float sum = 0.0f;
+        for (float i : frameTimes)
+            sum += i;
+        result.frameMs = sum / frameTimes.size();
+        size_t p99 = std::min(frameTimes.size() - 1, frameTimes.size() * 99 / 100);
+        std::nth_element(frameTimes.begin(), frameTimes.begin() + p99, frameTimes.end());
+        result.p99FrameMs = frameTimes[p99];
+        result.maxFrameMs = *std::max_element(frameTimes.begin(), frameTimes.end());
+    }
+    result.latencySamples = latencySamples;
+    result.latencyMs = latencySamples ? latencySumMs / latencySamples : 0.0;
+    result.maxLatencyMs = maxLatencyMs;
+
+    frameTimes.clear();
+    latencySamples = 0;
+    latencySumMs = 0.0;
+    maxLatencyMs = 0.0;
+    //the two clocks drift apart slowly, so the offset is refreshed with every report
+    calibrate();
+    return result;
+}
+
+void FrameTimer::calibrate()
+{
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    int64_t cpuNow = duration_cast<nanoseconds>(Clock::now().time_since_epoch()).count();
+    gpuToCpuNs = cpuNow - gpuNow;
+}
+
+void FrameTimer::collect()
+{
+    for (int i = 0; i < queryNum; ++i)
+    {
+        if (!pending[i])
+            continue;
+        GLint available = 0;
+        glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+        GLuint64 gpuTime = 0;
+        glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &gpuTime);
+        pending[i] = false;
+
+        int64_t inputNs = duration_cast<nanoseconds>(queryInputs[i].time_since_epoch()).count();
+        double latencyMs = (static_cast<int64_t>(gpuTime) + gpuToCpuNs - inputNs) / 1e6;
+        ++latencySamples;
+        latencySumMs += latencyMs;
+        maxLatencyMs = std::max(maxLatencyMs, latencyMs);
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include<qopenglfunctions_4_5_core.h>
+#include<array>
+#include<chrono>
+#include<cstdint>
+#include<vector>
+
+//frame times on the CPU and input latency up to the GPU finishing the first frame that shows the input,
+//GPU timestamps are mapped onto steady_clock with an offset taken against GL_TIMESTAMP
+class FrameTimer :protected QOpenGLFunctions_4_5_Core
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats
+    {
+        int frames = 0;
+        float frameMs = 0.0f;
+        float p99FrameMs = 0.0f;
+        float maxFrameMs = 0.0f;
+        int latencySamples = 0;
+        double latencyMs = 0.0;
+        double maxLatencyMs = 0.0;
+    };
+
+    constexpr static int queryNum = 8;
+
+    void init();
+    void beginFrame(Clock::time_point now);
+    //after the last draw of the frame, inputTime is only read when the frame shows new input
+    void endFrame(bool newInput, Clock::time_point inputTime);
+    //counts since the last call
+    Stats takeStats();
+
+private:
+    Clock::time_point lastFrame;
+    std::vector<float> frameTimes;
+    std::array<unsigned int, queryNum> queries{};
+    std::array<Clock::time_point, queryNum> queryInputs;
+    std::array<bool, queryNum> pending{};
+    int64_t gpuToCpuNs = 0;
+    int latencySamples = 0;
+    double latencySumMs = 0.0;
+    double maxLatencyMs = 0.0;
+
+    void calibrate();
+    void collect();
+};
@@ -0,0 +1,362 @@
+#include "GpuResources.h"
+#include<qdebug.h>
+#include<algorithm>
+#include<map>
+#include<string>
+#include<utility>
+
+GpuResources& GpuResources::instance()
+{
+    static GpuResources resources;
+    return resources;
+}
+
+GpuResources::Buffer GpuResources::createBuffer(size_t bytes, const void* data, unsigned int flags, const char* tag)
+{
+    QOpenGLFunctions_4_5_Core* gl = functions();
+    QOpenGLContextGroup* group = QOpenGLContext::currentContext()->shareGroup();
+    bytes = std::max<size_t>(bytes, 1);
+    //a persistent mapping is held on to by whoever made it, those buffers are made to size and deleted when done
+    bool pooled = !(flags & GL_MAP_PERSISTENT_BIT);
+    unsigned int name = 0;
+    size_t storageBytes = bytes;
+    if (pooled)
+    {
+        flags |= GL_DYNAMIC_STORAGE_BIT;
+        storageBytes = sizeClass(bytes);
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = std::find_if(pool.begin(), pool.end(), [&](const PooledBuffer& i) {
+            return i.bytes == storageBytes && i.flags == flags && i.group == group;
+        });
+        if (found != pool.end())
+        {
+            name = found->name;
+            pool.erase(found);
+            pooling.buffers--;
+            pooling.bytes -= storageBytes;
+            pooling.hits++;
+        }
+        else
+        {
+            pooling.misses++;
+        }
+    }
+    if (name)
+    {
+        if (data)
+            gl->glNamedBufferSubData(name, 0, bytes, data);
+    }
+    else
+    {
+        gl->glCreateBuffers(1, &name);
+        gl->glNamedBufferStorage(name, storageBytes, storageBytes == bytes ? data : nullptr, flags);
+        if (data && storageBytes != bytes)
+            gl->glNamedBufferSubData(name, 0, bytes, data);
+    }
+    track(Kind::Buffer, name, storageBytes, tag, pooled ? flags : 0);
+    return Buffer(name);
+}
+
+GpuResources::Texture GpuResources::createTexture2D(unsigned int format, int levels, int w, int h, const char* tag)
+{
+    QOpenGLFunctions_4_5_Core* gl = functions();
+    if (levels <= 0)
+        levels = fullMipLevels(w, h);
+    unsigned int name;
+    gl->glCreateTextures(GL_TEXTURE_2D, 1, &name);
+    gl->glTextureStorage2D(name, levels, format, w, h);
+    track(Kind::Texture, name, textureBytes(format, levels, w, h), tag, 0);
+    return Texture(name);
+}
+
+GpuResources::Texture GpuResources::createTexture(unsigned int target, const char* tag)
+{
+    unsigned int name;
+    functions()->glCreateTextures(target, 1, &name);
+    track(Kind::Texture, name, 0, tag, 0);
+    return Texture(name);
+}
+
+GpuResources::Texture GpuResources::createTextureView(unsigned int target, unsigned int original, unsigned int format, int minLevel, int levels, int minLayer, int layers, const char* tag)
+{
+    //a view needs a name that was never bound, which glCreateTextures does not give
+    QOpenGLFunctions_4_5_Core* gl = functions();
+    unsigned int name;
+    gl->glGenTextures(1, &name);
+    gl->glTextureView(name, target, original, format, minLevel, levels, minLayer, layers);
+    track(Kind::Texture, name, 0, tag, 0);
+    return Texture(name);
+}
+
+GpuResources::VertexArray GpuResources::createVertexArray(const char* tag)
+{
+    unsigned int name;
+    functions()->glCreateVertexArrays(1, &name);
+    track(Kind::VertexArray, name, 0, tag, 0);
+    return VertexArray(name);
+}
+
+GpuResources::Framebuffer GpuResources::createFramebuffer(const char* tag)
+{
+    unsigned int name;
+    functions()->glCreateFramebuffers(1, &name);
+    track(Kind::Framebuffer, name, 0, tag, 0);
+    return Framebuffer(name);
+}
+
+GpuResources::Program GpuResources::createProgram(const char* tag)
+{
+    unsigned int name = functions()->glCreateProgram();
+    track(Kind::Program, name, 0, tag, 0);
+    return Program(name);
+}
+
+std::array<GpuResources::KindStats, GpuResources::kindNum> GpuResources::stats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return kinds;
+}
+
+GpuResources::PoolStats GpuResources::poolStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pooling;
+}
+
+const char* GpuResources::kindName(Kind kind)
+{
+    switch (kind)
+    {
+    case Kind::Buffer:
+        return "buffers";
+    case Kind::Texture:
+        return "textures";
+    case Kind::VertexArray:
+        return "vertex arrays";
+    case Kind::Framebuffer:
+        return "framebuffers";
+    default:
+        return "programs";
+    }
+}
+
+size_t GpuResources::textureBytes(unsigned int format, int levels, int w, int h)
+{
+    //bytes per texel, or per 4x4 block for the compressed formats
+    size_t texel = 4;
+    bool block = false;
+    switch (format)
+    {
+    case GL_R8:
+        texel = 1;
+        break;
+    case GL_R16F:
+    case GL_RG8:
+        texel = 2;
+        break;
+    case GL_RGBA16F:
+    case GL_RGB16F:
+    case GL_RG32F:
+    case GL_DEPTH32F_STENCIL8:
+        texel = 8;
+        break;
+    case GL_RGBA32F:
+    case GL_RGB32F:
+        texel = 16;
+        break;
+    case 0x83F0:    //GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+    case 0x83F1:    //GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+    case 0x8DBB:    //GL_COMPRESSED_RED_RGTC1
+        texel = 8;
+        block = true;
+        break;
+    case 0x83F3:    //GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+    case 0x8DBD:    //GL_COMPRESSED_RG_RGTC2
+        texel = 16;
+        block = true;
+        break;
+    default:
+        //RGBA8, R32F, RG16F and the 24 and 32 bit depth formats, drivers pad RGB8 to four bytes as well
+        break;
+    }
+    size_t bytes = 0;
+    for (int i = 0; i < levels; ++i)
+    {
+        size_t levelWidth = static_cast<size_t>(std::max(w >> i, 1));
+        size_t levelHeight = static_cast<size_t>(std::max(h >> i, 1));
+        if (block)
+            bytes += (levelWidth + 3) / 4 * ((levelHeight + 3) / 4) * texel;
+        else
+            bytes += levelWidth * levelHeight * texel;
+    }
+    return bytes;
+}
+
+int GpuResources::fullMipLevels(int w, int h)
+{
+    int levels = 1;
+    for (int size = std::max(w, h); size > 1; size >>= 1)
+        levels++;
+    return levels;
+}
+
+size_t GpuResources::shutdown()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    QOpenGLFunctions_4_5_Core* gl = QOpenGLContext::currentContext() ? functions() : nullptr;
+    if (gl)
+        trimPool(gl, 0);
+
+    //grouped by kind and tag, a leak is usually many objects from the same place
+    std::map<std::pair<int, std::string>, std::pair<size_t, size_t>> leaks;
+    for (const auto& i : live)
+    {
+        auto& leak = leaks[std::make_pair(static_cast<int>(i.second.kind), std::string(i.second.tag))];
+        leak.first++;
+        leak.second += i.second.bytes;
+    }
+    for (int i = 0; i < kindNum; ++i)
+    {
+        const KindStats& kind = kinds[i];
+        qDebug() << "gpu" << kindName(static_cast<Kind>(i)) << "created" << kind.created << "deleted" << kind.deleted
+            << "orphaned" << kind.orphaned << "peak" << kind.peakBytes / 1024 << "KiB";
+    }
+    if (leaks.empty())
+    {
+        qDebug() << "gpu resources: no leaks";
+        return 0;
+    }
+    qDebug() << "gpu resources:" << live.size() << "objects still alive at teardown";
+    for (const auto& i : leaks)
+    {
+        qDebug() << "  " << i.second.first << kindName(static_cast<Kind>(i.first.first)) << "from" << i.first.second.c_str()
+            << "," << i.second.second / 1024 << "KiB";
+    }
+    return live.size();
+}
+
+uint64_t GpuResources::key(Kind kind, unsigned int name)
+{
+    return static_cast<uint64_t>(kind) << 32 | name;
+}
+
+size_t GpuResources::sizeClass(size_t bytes)
+{
+    //quarter steps between powers of two, so a recycled buffer wastes at most a fifth of itself
+    size_t size = 256;
+    if (bytes <= size)
+        return size;
+    while (size * 2 < bytes)
+        size *= 2;
+    size_t step = size / 4;
+    return (bytes + step - 1) / step * step;
+}
+
+QOpenGLFunctions_4_5_Core* GpuResources::functions()
+{
+    //the functions of whichever context is current, resources are made and released from more than one
+    QOpenGLFunctions_4_5_Core* gl = QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_4_5_Core>();
+    gl->initializeOpenGLFunctions();
+    return gl;
+}
+
+void GpuResources::track(Kind kind, unsigned int name, size_t bytes, const char* tag, unsigned int poolFlags)
+{
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    std::lock_guard<std::mutex> lock(mutex);
+    live[key(kind, name)] = Record{ kind, bytes, tag, context, context->shareGroup(), poolFlags };
+    KindStats& stats = kinds[static_cast<int>(kind)];
+    stats.live++;
+    stats.created++;
+    stats.bytes += bytes;
+    stats.peakBytes = std::max(stats.peakBytes, stats.bytes);
+}
+
+void GpuResources::setBytes(Kind kind, unsigned int name, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = live.find(key(kind, name));
+    if (found == live.end())
+        return;
+    KindStats& stats = kinds[static_cast<int>(kind)];
+    stats.bytes = stats.bytes - found->second.bytes + bytes;
+    stats.peakBytes = std::max(stats.peakBytes, stats.bytes);
+    found->second.bytes = bytes;
+}
+
+void GpuResources::release(Kind kind, unsigned int name)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = live.find(key(kind, name));
+    if (found == live.end())
+    {
+        qDebug() << "gpu resources: released unknown" << kindName(kind) << name;
+        return;
+    }
+    Record record = found->second;
+    live.erase(found);
+    KindStats& stats = kinds[static_cast<int>(kind)];
+    stats.live--;
+    stats.bytes -= record.bytes;
+
+    //vertex arrays and framebuffers are not shared, the rest is shared by every context of the group
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    bool shared = kind != Kind::VertexArray && kind != Kind::Framebuffer;
+    if (!context || (shared ? context->shareGroup() != record.group : context != record.context))
+    {
+        stats.orphaned++;
+        qDebug() << "gpu resources:" << kindName(kind) << name << "from" << record.tag << "released without its context current";
+        return;
+    }
+    QOpenGLFunctions_4_5_Core* gl = functions();
+    if (record.poolFlags)
+    {
+        pool.push_back(PooledBuffer{ name, record.bytes, record.poolFlags, record.group });
+        pooling.buffers++;
+        pooling.bytes += record.bytes;
+        trimPool(gl, maxPoolBytes);
+        return;
+    }
+    destroy(gl, kind, name);
+}
+
+void GpuResources::destroy(QOpenGLFunctions_4_5_Core* gl, Kind kind, unsigned int name)
+{
+    switch (kind)
+    {
+    case Kind::Buffer:
+        gl->glDeleteBuffers(1, &name);
+        break;
+    case Kind::Texture:
+        gl->glDeleteTextures(1, &name);
+        break;
+    case Kind::VertexArray:
+        gl->glDeleteVertexArrays(1, &name);
+        break;
+    case Kind::Framebuffer:
+        gl->glDeleteFramebuffers(1, &name);
+        break;
+    case Kind::Program:
+        gl->glDeleteProgram(name);
+        break;
+    }
+    kinds[static_cast<int>(kind)].deleted++;
+}
+
+void GpuResources::trimPool(QOpenGLFunctions_4_5_Core* gl, size_t maxBytes)
+{
+    //oldest first, buffers of the current group only, others wait until their group is current
+    QOpenGLContextGroup* group = QOpenGLContext::currentContext()->shareGroup();
+    for (auto i = pool.begin(); i != pool.end() && pooling.bytes > maxBytes;)
+    {
+        if (i->group != group)
+        {
+            ++i;
+            continue;
+        }
+        destroy(gl, Kind::Buffer, i->name);
+        pooling.buffers--;
+        pooling.bytes -= i->bytes;
+        i = pool.erase(i);
+    }
+}
@@ -0,0 +1,188 @@
+#pragma once
+#include<qopenglfunctions_4_5_core.h>
+#include<qopenglcontext.h>
+#include<array>
+#include<cstddef>
+#include<cstdint>
+#include<mutex>
+#include<unordered_map>
+#include<vector>
+
+enum class GpuResourceKind
+{
+    Buffer, Texture, VertexArray, Framebuffer, Program
+};
+
+//owns one GL object made by GpuResources, move-only and deleted (or pooled) when it goes away
+template<GpuResourceKind kind>
+class GpuHandle
+{
+public:
+    GpuHandle() = default;
+    GpuHandle(const GpuHandle&) = delete;
+    GpuHandle& operator=(const GpuHandle&) = delete;
+    GpuHandle(GpuHandle&& from)noexcept
+        :name(from.name)
+    {
+        from.name = 0;
+    }
+    GpuHandle& operator=(GpuHandle&& from)noexcept
+    {
+        if (this != &from)
+        {
+            reset();
+            name = from.name;
+            from.name = 0;
+        }
+        return *this;
+    }
+    ~GpuHandle()
+    {
+        reset();
+    }
+
+    unsigned int get() const
+    {
+        return name;
+    }
+    explicit operator bool() const
+    {
+        return name != 0;
+    }
+    void reset();
+    //how much memory the object holds now, for objects whose storage is not known when they are made
+    void setBytes(size_t bytes) const;
+
+private:
+    friend class GpuResources;
+    explicit GpuHandle(unsigned int name)
+        :name(name)
+    {
+    }
+
+    unsigned int name = 0;
+};
+
+//every GL object made through here is counted per kind with its size and the tag of the code that made it,
+//buffers that go away are kept by size class and handed out again instead of being deleted
+class GpuResources
+{
+public:
+    using Kind = GpuResourceKind;
+    using Buffer = GpuHandle<Kind::Buffer>;
+    using Texture = GpuHandle<Kind::Texture>;
+    using VertexArray = GpuHandle<Kind::VertexArray>;
+    using Framebuffer = GpuHandle<Kind::Framebuffer>;
+    using Program = GpuHandle<Kind::Program>;
+
+    constexpr static int kindNum = 5;
+
+    struct KindStats
+    {
+        size_t live = 0;
+        size_t bytes = 0;
+        size_t peakBytes = 0;
+        size_t created = 0;
+        size_t deleted = 0;
+        //released without the context they belong to being current, so never deleted
+        size_t orphaned = 0;
+    };
+
+    struct PoolStats
+    {
+        size_t buffers = 0;
+        size_t bytes = 0;
+        size_t hits = 0;
+        size_t misses = 0;
+    };
+
+    //the pool deletes its oldest buffers beyond this
+    size_t maxPoolBytes = 64u << 20;
+
+    static GpuResources& instance();
+
+    //tags must be string literals, they are kept for the leak report
+    //immutable storage, buffers that are not persistently mapped come from the pool and are at least bytes large,
+    //they always get GL_DYNAMIC_STORAGE_BIT so a recycled one can be filled, and hold garbage when data is null
+    Buffer createBuffer(size_t bytes, const void* data, unsigned int flags, const char* tag);
+    //glTextureStorage2D with the bytes counted, levels 0 means the full chain
+    Texture createTexture2D(unsigned int format, int levels, int w, int h, const char* tag);
+    //storage is up to the caller, who reports it through setBytes
+    Texture createTexture(unsigned int target, const char* tag);
+    //glTextureView of original, which keeps the storage and is counted with no bytes of its own
+    Texture createTextureView(unsigned int target, unsigned int original, unsigned int format, int minLevel, int levels, int minLayer, int layers, const char* tag);
+    VertexArray createVertexArray(const char* tag);
+    Framebuffer createFramebuffer(const char* tag);
+    Program createProgram(const char* tag);
+
+    std::array<KindStats, kindNum> stats();
+    PoolStats poolStats();
+    static const char* kindName(Kind kind);
+    static size_t textureBytes(unsigned int format, int levels, int w, int h);
+    static int fullMipLevels(int w, int h);
+
+    //deletes the pooled buffers and logs every object still alive by tag, call with the context current before it goes away
+    size_t shutdown();
+
+    //calls shutdown when destroyed, a member declared before everything owning GL objects
+    class LeakReport
+    {
+    public:
+        ~LeakReport()
+        {
+            GpuResources::instance().shutdown();
+        }
+    };
+
+private:
+    template<GpuResourceKind> friend class GpuHandle;
+
+    struct Record
+    {
+        Kind kind;
+        size_t bytes;
+        const char* tag;
+        //only compared, either may be gone by the time the object is released
+        QOpenGLContext* context;
+        QOpenGLContextGroup* group;
+        unsigned int poolFlags;     //0 when the buffer is not pooled
+    };
+
+    struct PooledBuffer
+    {
+        unsigned int name;
+        size_t bytes;
+        unsigned int flags;
+        QOpenGLContextGroup* group;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<uint64_t, Record> live;
+    std::array<KindStats, kindNum> kinds{};
+    std::vector<PooledBuffer> pool;
+    PoolStats pooling;
+
+    static uint64_t key(Kind kind, unsigned int name);
+    static size_t sizeClass(size_t bytes);
+    static QOpenGLFunctions_4_5_Core* functions();
+    void track(Kind kind, unsigned int name, size_t bytes, const char* tag, unsigned int poolFlags);
+    void setBytes(Kind kind, unsigned int name, size_t bytes);
+    void release(Kind kind, unsigned int name);
+    void destroy(QOpenGLFunctions_4_5_Core* gl, Kind kind, unsigned int name);
+    void trimPool(QOpenGLFunctions_4_5_Core* gl, size_t maxBytes);
+};
+
+template<GpuResourceKind kind>
+void GpuHandle<kind>::reset()
+{
+    if (name)
+        GpuResources::instance().release(kind, name);
+    name = 0;
+}
+
+template<GpuResourceKind kind>
+void GpuHandle<kind>::setBytes(size_t bytes) const
+{
+    if (name)
+        GpuResources::instance().setBytes(kind, name, bytes);
+}
@@ -0,0 +1,288 @@
+#include "HiZCuller.h"
+#include<gtc/type_ptr.hpp>
+#include<algorithm>
+#include<cmath>
+#include"AssetPack.h"
+
+void HiZCuller::init()
+{
+    QOpenGLFunctions_4_5_Core::initializeOpenGLFunctions();
+
+    buildShader.create();
+    AssetPack::addShader(buildShader, QOpenGLShader::Compute, "./shaders/hiZBuild.comp");
+    buildShader.link();
+
+    cullShader.create();
+    AssetPack::addShader(cullShader, QOpenGLShader::Compute, "./shaders/hiZCull.comp");
+    cullShader.link();
+
+    for (auto& i : frames)
+    {
+        glGenQueries(StampNum, i.queries.data());
+        i.statsBuffer = GpuResources::instance().createBuffer(4 * sizeof(unsigned int), nullptr, 0, "hi-z stats");
+    }
+}
+
+void HiZCuller::resize(int w, int h)
+{
+    width = w;
+    height = h;
+
+    //level 0 is half the depth buffer, rounded up so the last row and column are covered
+    int levelWidth = std::max((w + 1) / 2, 1);
+    int levelHeight = std::max((h + 1) / 2, 1);
+    pyramidLevels = static_cast<int>(std::floor(std::log2(std::max(levelWidth, levelHeight)))) + 1;
+    pyramid = GpuResources::instance().createTexture2D(GL_R32F, pyramidLevels, levelWidth, levelHeight, "hi-z pyramid");
+    glTextureParameteri(pyramid.get(), GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTextureParameteri(pyramid.get(), GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    pyramidValid = false;
+}
+
+void HiZCuller::setMode(Mode mode)
+{
+    cullMode = mode;
+    pyramidValid = false;
+}
+
+HiZCuller::Mode HiZCuller::mode() const
+{
+    return cullMode;
+}
+
+const char* HiZCuller::modeName(Mode mode)
+{
+    switch (mode)
+    {
+    case Mode::SinglePhase:
+        return "single phase";
+    case Mode::TwoPhase:
+        return "two phase";
+    default:
+        return "off";
+    }
+}
+
+void HiZCuller::beginFrame()
+{
+    frameIndex = (frameIndex + 1) % queryLatency;
+    Frame& frame = frames[frameIndex];
+    if (frame.fence)
+        collect(frame);
+    frame.issued.fill(false);
+    frame.mode = cullMode;
+    unsigned int zero = 0;
+    glClearNamedBufferData(frame.statsBuffer.get(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+    groups.clear();
+    instances.clear();
+    draws.clear();
+    maxInstanceNum = 0;
+}
+
+int HiZCuller::addGroup(const glm::mat4& parentMat, const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+    const InstanceTransform* groupInstances, int instanceNum, const DrawInfo& draw)
+{
+    Group group;
+    group.parentMat = parentMat;
+    group.boundsMin = glm::vec4(boundsMin, 1.0f);
+    group.boundsMax = glm::vec4(boundsMax, 1.0f);
+    group.firstInstance = static_cast<unsigned int>(instances.size());
+    group.instanceNum = static_cast<unsigned int>(instanceNum);
+    group.firstOutput = group.firstInstance;
+    group.command = static_cast<unsigned int>(groups.size());
+    groups.push_back(group);
+    instances.insert(instances.end(), groupInstances, groupInstances + instanceNum);
+    draws.push_back(draw);
+    maxInstanceNum = std::max(maxInstanceNum, group.instanceNum);
+    return static_cast<int>(groups.size()) - 1;
+}
+
+void HiZCuller::upload()
+{
+    //two sets of draws with every instance count at zero, the culling pass counts the survivors up
+    size_t instanceNum = instances.size();
+    std::vector<Command> commandData(groups.size() * 2);
+    for (size_t set = 0; set < 2; ++set)
+    {
+        for (size_t i = 0; i < groups.size(); ++i)
+        {
+            const DrawInfo& draw = draws[i];
+            unsigned int baseInstance = static_cast<unsigned int>(set * instanceNum) + groups[i].firstOutput;
+            Command& command = commandData[set * groups.size() + i];
+            if (draw.indexed)
+                command = Command{ { draw.count, 0, draw.first, static_cast<unsigned int>(draw.baseVertex), baseInstance } };
+            else
+                command = Command{ { draw.count, 0, draw.first, baseInstance, 0 } };
+        }
+    }
+
+    reserve(groupBuffer, groupBytes, groups.size() * sizeof(Group), "hi-z groups");
+    reserve(instanceBuffer, instanceBytes, instanceNum * sizeof(InstanceTransform), "hi-z instances");
+    reserve(visible, visibleBytes, instanceNum * 2 * sizeof(InstanceTransform), "hi-z visible instances");
+    reserve(commands, commandBytes, commandData.size() * sizeof(Command), "hi-z commands");
+    glNamedBufferSubData(groupBuffer.get(), 0, groups.size() * sizeof(Group), groups.data());
+    glNamedBufferSubData(instanceBuffer.get(), 0, instanceNum * sizeof(InstanceTransform), instances.data());
+    glNamedBufferSubData(commands.get(), 0, commandData.size() * sizeof(Command), commandData.data());
+
+    //a different set of instances makes the history meaningless, everything counts as visible again
+    std::vector<unsigned int> currentLayout;
+    for (auto& i : groups)
+        currentLayout.push_back(i.instanceNum);
+    if (currentLayout != layout)
+    {
+        layout = currentLayout;
+        reserve(visibility, visibilityBytes, instanceNum * sizeof(unsigned int), "hi-z visibility");
+        unsigned int one = 1;
+        glClearNamedBufferData(visibility.get(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &one);
+    }
+
+    statistics.groups = static_cast<int>(groups.size());
+    statistics.instances = static_cast<int>(instanceNum);
+}
+
+void HiZCuller::cull(int phase, const glm::mat4& viewProjection)
+{
+    if (groups.empty())
+        return;
+    Frame& frame = frames[frameIndex];
+    stamp(phase == 2 ? SecondCullBegin : FirstCullBegin);
+
+    //the single phase test looks at the pyramid from where it was built, last frame's view
+    bool useOcclusion = phase == 2 || (phase == 0 && pyramidValid);
+    cullShader.bind();
+    glUniformMatrix4fv(cullShader.uniformLocation("VP"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+    glUniformMatrix4fv(cullShader.uniformLocation("pyramidVP"), 1, GL_FALSE, glm::value_ptr(phase == 0 ? pyramidVP : viewProjection));
+    glUniform2f(cullShader.uniformLocation("depthSize"), static_cast<float>(width), static_cast<float>(height));
+    glUniform1i(cullShader.uniformLocation("pyramidLevels"), pyramidLevels);
+    glUniform1i(cullShader.uniformLocation("phase"), phase);
+    glUniform1i(cullShader.uniformLocation("useOcclusion"), useOcclusion ? 1 : 0);
+    glUniform1ui(cullShader.uniformLocation("commandBase"), phase == 2 ? static_cast<unsigned int>(groups.size()) : 0u);
+    glUniform1ui(cullShader.uniformLocation("outputBase"), phase == 2 ? static_cast<unsigned int>(instances.size()) : 0u);
+    glBindTextureUnit(0, pyramid.get());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, groupBuffer.get());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, instanceBuffer.get());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, visible.get());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, commands.get());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, visibility.get());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, frame.statsBuffer.get());
+    glDispatchCompute((maxInstanceNum + 63) / 64, static_cast<unsigned int>(groups.size()), 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    stamp(phase == 2 ? SecondCullEnd : FirstCullEnd);
+}
+
+void HiZCuller::buildPyramid(unsigned int depthTex, const glm::mat4& viewProjection)
+{
+    stamp(PyramidBegin);
+    buildShader.bind();
+    glUniform1i(buildShader.uniformLocation("fromDepth"), 1);
+    glBindTextureUnit(0, depthTex);
+    int levelWidth = std::max((width + 1) / 2, 1);
+    int levelHeight = std::max((height + 1) / 2, 1);
+    for (int level = 0; level < pyramidLevels; ++level)
+    {
+        if (level > 0)
+        {
+            glUniform1i(buildShader.uniformLocation("fromDepth"), 0);
+            glBindImageTexture(0, pyramid.get(), level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        }
+        glBindImageTexture(1, pyramid.get(), level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        levelWidth = std::max((levelWidth + 1) / 2, 1);
+        levelHeight = std::max((levelHeight + 1) / 2, 1);
+    }
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    pyramidVP = viewProjection;
+    pyramidValid = true;
+    stamp(PyramidEnd);
+}
+
+void HiZCuller::beginPass()
+{
+    stamp(PassBegin);
+}
+
+void HiZCuller::endPass()
+{
+    stamp(PassEnd);
+    //every test of the frame is done by now, a single phase pyramid after this is only timed
+    frames[frameIndex].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+unsigned int HiZCuller::visibleBuffer() const
+{
+    return visible.get();
+}
+
+unsigned int HiZCuller::commandBuffer() const
+{
+    return commands.get();
+}
+
+intptr_t HiZCuller::commandOffset(int group, int phase) const
+{
+    size_t index = (phase == 2 ? groups.size() : 0) + static_cast<size_t>(group);
+    return static_cast<intptr_t>(index * sizeof(Command));
+}
+
+const HiZCuller::Stats& HiZCuller::stats() const
+{
+    return statistics;
+}
+
+void HiZCuller::reserve(GpuResources::Buffer& buffer, size_t& capacity, size_t bytes, const char* tag)
+{
+    if (bytes <= capacity && buffer)
+        return;
+    //the old buffer goes back to the pool, a later layout of the same size gets it again
+    capacity = std::max<size_t>(bytes, 256);
+    buffer = GpuResources::instance().createBuffer(capacity, nullptr, 0, tag);
+}
+
+void HiZCuller::stamp(Stamp which)
+{
+    Frame& frame = frames[frameIndex];
+    glQueryCounter(frame.queries[which], GL_TIMESTAMP);
+    frame.issued[which] = true;
+}
+
+void HiZCuller::collect(Frame& frame)
+{
+    //written queryLatency frames ago, normally long done
+    glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    glDeleteSync(frame.fence);
+    frame.fence = nullptr;
+
+    if (frame.mode != Mode::Off)
+    {
+        unsigned int counters[4];
+        glGetNamedBufferSubData(frame.statsBuffer.get(), 0, sizeof(counters), counters);
+        statistics.tested = counters[0];
+        statistics.frustumCulled = counters[1];
+        statistics.occlusionCulled = counters[2];
+        statistics.drawnLate = counters[3];
+    }
+
+    std::array<GLuint64, StampNum> times{};
+    for (int i = 0; i < StampNum; ++i)
+    {
+        if (frame.issued[i])
+            glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &times[i]);
+    }
+    auto span = [&](Stamp begin, Stamp end) {
+        return frame.issued[begin] && frame.issued[end] ? (times[end] - times[begin]) / 1e6f : 0.0f;
+    };
+    float firstCull = span(FirstCullBegin, FirstCullEnd);
+    float secondCull = span(SecondCullBegin, SecondCullEnd);
+    float pyramidMs = span(PyramidBegin, PyramidEnd);
+    statistics.cullMs = firstCull + secondCull;
+    statistics.pyramidMs = pyramidMs;
+
+    float passMs = span(PassBegin, PassEnd);
+    //the two phase pyramid and second test run inside the pass
+    if (frame.mode == Mode::TwoPhase)
+        passMs -= pyramidMs + secondCull;
+    float& average = statistics.passMs[static_cast<int>(frame.mode)];
+    average = average == 0.0f ? passMs : average * 0.95f + passMs * 0.05f;
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include<qopenglfunctions_4_5_core.h>
+#include<qopenglshaderprogram.h>
+#include<glm.hpp>
+#include<array>
+#include<vector>
+#include"GpuResources.h"
+#include"InstanceTransform.h"
+
+//occlusion culling against a max depth pyramid, visible instance transforms are compacted into one buffer
+//that instanced attributes read through baseInstance, and the draws are issued indirectly with the surviving counts
+class HiZCuller :protected QOpenGLFunctions_4_5_Core
+{
+public:
+    enum class Mode
+    {
+        //single phase tests against the pyramid of the last frame, two phase draws last frame's visible set,
+        //builds the pyramid from that and then tests everything else against it
+        Off, SinglePhase, TwoPhase
+    };
+
+    //what every visible instance of a group draws, indexed draws use GL_UNSIGNED_INT
+    struct DrawInfo
+    {
+        bool indexed;
+        unsigned int count;
+        unsigned int first;
+        int baseVertex;
+    };
+
+    struct Stats
+    {
+        int groups = 0;
+        int instances = 0;
+        unsigned int tested = 0;
+        unsigned int frustumCulled = 0;
+        unsigned int occlusionCulled = 0;
+        unsigned int drawnLate = 0;
+        float cullMs = 0.0f;
+        float pyramidMs = 0.0f;
+        //scene geometry of the main pass without culling work, averaged per mode
+        std::array<float, 3> passMs{};
+    };
+
+    constexpr static int queryLatency = 3;
+
+    void init();
+    void resize(int w, int h);
+    void setMode(Mode mode);
+    Mode mode() const;
+    static const char* modeName(Mode mode);
+
+    //groups are added again every frame in the same order, the visibility history follows the instance order
+    void beginFrame();
+    int addGroup(const glm::mat4& parentMat, const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+        const InstanceTransform* instances, int instanceNum, const DrawInfo& draw);
+    void upload();
+    //phase 0 is the single phase test, 1 and 2 the two phases
+    void cull(int phase, const glm::mat4& viewProjection);
+    void buildPyramid(unsigned int depthTex, const glm::mat4& viewProjection);
+    //bracket the scene draws of the main pass, culling and pyramid work inside are not counted
+    void beginPass();
+    void endPass();
+
+    unsigned int visibleBuffer() const;
+    unsigned int commandBuffer() const;
+    //byte offset of the indirect draw of a group, the second of two phases has its own draws
+    intptr_t commandOffset(int group, int phase) const;
+    const Stats& stats() const;
+
+private:
+    struct Group
+    {
+        glm::mat4 parentMat;
+        glm::vec4 boundsMin;
+        glm::vec4 boundsMax;
+        unsigned int firstInstance;
+        unsigned int instanceNum;
+        unsigned int firstOutput;
+        unsigned int command;
+    };
+
+    //DrawElementsIndirectCommand, DrawArraysIndirectCommand uses the first four with baseInstance fourth
+    struct Command
+    {
+        unsigned int values[5];
+    };
+
+    enum Stamp
+    {
+        PassBegin, PassEnd, FirstCullBegin, FirstCullEnd, PyramidBegin, PyramidEnd, SecondCullBegin, SecondCullEnd, StampNum
+    };
+
+    struct Frame
+    {
+        std::array<unsigned int, StampNum> queries{};
+        std::array<bool, StampNum> issued{};
+        GpuResources::Buffer statsBuffer;
+        GLsync fence = nullptr;
+        Mode mode = Mode::Off;
+    };
+
+    Mode cullMode = Mode::Off;
+    QOpenGLShaderProgram buildShader;
+    QOpenGLShaderProgram cullShader;
+
+    int width = 0, height = 0;
+    GpuResources::Texture pyramid;
+    int pyramidLevels = 0;
+    bool pyramidValid = false;
+    glm::mat4 pyramidVP{ 1.0f };
+
+    std::vector<Group> groups;
+    std::vector<InstanceTransform> instances;
+    std::vector<DrawInfo> draws;
+    std::vector<unsigned int> layout;
+    unsigned int maxInstanceNum = 0;
+
+    GpuResources::Buffer groupBuffer, instanceBuffer, visible, commands, visibility;
+    size_t groupBytes = 0, instanceBytes = 0, visibleBytes = 0, commandBytes = 0, visibilityBytes = 0;
+
+    std::array<Frame, queryLatency> frames;
+    unsigned int frameIndex = 0;
+    Stats statistics;
+
+    void reserve(GpuResources::Buffer& buffer, size_t& capacity, size_t bytes, const char* tag);
+    void stamp(Stamp which);
+    void collect(Frame& frame);
+};
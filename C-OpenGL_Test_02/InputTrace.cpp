@@ -0,0 +1,63 @@
+#include "InputTrace.h"
+#include<qdebug.h>
+#include<fstream>
+
+namespace
+{
+    template<typename T>
+    void writeValue(std::ofstream& file, T value)
+    {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    T readValue(std::ifstream& file)
+    {
+        T value{};
+        file.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return value;
+    }
+}
+
+bool InputTrace::save(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        qWarning() << "could not write trace" << QString::fromStdString(path);
+        return false;
+    }
+    writeValue(file, magic);
+    writeValue(file, version);
+    writeValue(file, tickSeconds);
+    writeValue(file, static_cast<int32_t>(width));
+    writeValue(file, static_cast<int32_t>(height));
+    writeValue(file, static_cast<uint32_t>(events.size()));
+    writeValue(file, static_cast<uint32_t>(cameras.size()));
+    file.write(reinterpret_cast<const char*>(events.data()), events.size() * sizeof(Event));
+    file.write(reinterpret_cast<const char*>(cameras.data()), cameras.size() * sizeof(CameraState));
+    return static_cast<bool>(file);
+}
+
+bool InputTrace::load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file || readValue<uint32_t>(file) != magic || readValue<uint32_t>(file) != version)
+    {
+        qWarning() << "not a trace file" << QString::fromStdString(path);
+        return false;
+    }
+    tickSeconds = readValue<double>(file);
+    width = readValue<int32_t>(file);
+    height = readValue<int32_t>(file);
+    events.resize(readValue<uint32_t>(file));
+    cameras.resize(readValue<uint32_t>(file));
+    file.read(reinterpret_cast<char*>(events.data()), events.size() * sizeof(Event));
+    file.read(reinterpret_cast<char*>(cameras.data()), cameras.size() * sizeof(CameraState));
+    if (!file || tickSeconds <= 0.0)
+    {
+        qWarning() << "trace" << QString::fromStdString(path) << "is truncated";
+        return false;
+    }
+    return true;
+}
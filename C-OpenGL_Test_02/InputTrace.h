@@ -0,0 +1,44 @@
+#pragma once
+#include<cstdint>
+#include<string>
+#include<vector>
+
+//input applied by the simulation and the camera it produced, per tick, in a small binary file
+//replaying the events tick by tick has to reproduce the cameras exactly
+class InputTrace
+{
+public:
+    enum class EventType : uint8_t
+    {
+        Key, Mouse, Resize
+    };
+
+    struct Event
+    {
+        uint32_t tick;
+        EventType type;
+        uint8_t key;
+        uint8_t pressed;
+        uint8_t padding;
+        float x, y;
+    };
+
+    struct CameraState
+    {
+        uint32_t tick;
+        float position[3];
+        float yaw, pitch;
+    };
+
+    double tickSeconds = 0.0;
+    int width = 0, height = 0;
+    std::vector<Event> events;
+    std::vector<CameraState> cameras;
+
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+
+private:
+    constexpr static uint32_t magic = 0x45435254;     //"TRCE"
+    constexpr static uint32_t version = 1;
+};
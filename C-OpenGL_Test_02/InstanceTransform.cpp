@@ -0,0 +1,115 @@
+#include "InstanceTransform.h"
+#include"JobSystem.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include<emmintrin.h>
+#define INSTANCE_TRANSFORM_SSE2
+#endif
+
+namespace
+{
+    //columns of the cofactor matrix are cross products of the other two columns, divided by the determinant
+    //that is the inverse transpose, a singular matrix keeps its cofactors
+    glm::mat3x4 cofactorNormal(const glm::mat4& model)
+    {
+        glm::vec3 c0(model[0]), c1(model[1]), c2(model[2]);
+        glm::vec3 n0 = glm::cross(c1, c2);
+        glm::vec3 n1 = glm::cross(c2, c0);
+        glm::vec3 n2 = glm::cross(c0, c1);
+        float det = glm::dot(c0, n0);
+        float invDet = det != 0.0f ? 1.0f / det : 1.0f;
+        return glm::mat3x4(glm::vec4(n0 * invDet, 0.0f), glm::vec4(n1 * invDet, 0.0f), glm::vec4(n2 * invDet, 0.0f));
+    }
+}
+
+void InstanceTransforms::compute(const glm::mat4* models, InstanceTransform* out, size_t count)
+{
+    //small batches are not worth waking the workers, grains stay multiples of four for the SSE path
+    constexpr size_t grain = 4096;
+    if (count <= grain)
+    {
+        computeRange(models, out, count);
+        return;
+    }
+    JobSystem::instance().parallelFor(count, grain, [models, out](size_t begin, size_t end) {
+        computeRange(models + begin, out + begin, end - begin);
+    });
+}
+
+std::vector<InstanceTransform> InstanceTransforms::compute(const std::vector<glm::mat4>& models)
+{
+    std::vector<InstanceTransform> transforms(models.size());
+    compute(models.data(), transforms.data(), models.size());
+    return transforms;
+}
+
+void InstanceTransforms::computeScalar(const glm::mat4* models, InstanceTransform* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        out[i].model = models[i];
+        out[i].normal = normalMatrix(models[i]);
+    }
+}
+
+glm::mat3x4 InstanceTransforms::normalMatrix(const glm::mat4& model)
+{
+    glm::mat3 normal = glm::transpose(glm::inverse(glm::mat3(model)));
+    return glm::mat3x4(glm::vec4(normal[0], 0.0f), glm::vec4(normal[1], 0.0f), glm::vec4(normal[2], 0.0f));
+}
+
+void InstanceTransforms::computeRange(const glm::mat4* models, InstanceTransform* out, size_t count)
+{
+    size_t i = 0;
+#ifdef INSTANCE_TRANSFORM_SSE2
+    //four matrices per iteration, transposed so every register holds one component of the same column of all four
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 x[3], y[3], z[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            __m128 m0 = _mm_loadu_ps(&models[i][c][0]);
+            __m128 m1 = _mm_loadu_ps(&models[i + 1][c][0]);
+            __m128 m2 = _mm_loadu_ps(&models[i + 2][c][0]);
+            __m128 m3 = _mm_loadu_ps(&models[i + 3][c][0]);
+            _MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+            x[c] = m0;
+            y[c] = m1;
+            z[c] = m2;
+        }
+
+        __m128 nx[3], ny[3], nz[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            int a = (c + 1) % 3, b = (c + 2) % 3;
+            nx[c] = _mm_sub_ps(_mm_mul_ps(y[a], z[b]), _mm_mul_ps(z[a], y[b]));
+            ny[c] = _mm_sub_ps(_mm_mul_ps(z[a], x[b]), _mm_mul_ps(x[a], z[b]));
+            nz[c] = _mm_sub_ps(_mm_mul_ps(x[a], y[b]), _mm_mul_ps(y[a], x[b]));
+        }
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x[0], nx[0]), _mm_mul_ps(y[0], ny[0])), _mm_mul_ps(z[0], nz[0]));
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 singular = _mm_cmpeq_ps(det, _mm_setzero_ps());
+        __m128 invDet = _mm_or_ps(_mm_and_ps(singular, one), _mm_andnot_ps(singular, _mm_div_ps(one, det)));
+
+        for (int c = 0; c < 3; ++c)
+        {
+            __m128 m0 = _mm_mul_ps(nx[c], invDet);
+            __m128 m1 = _mm_mul_ps(ny[c], invDet);
+            __m128 m2 = _mm_mul_ps(nz[c], invDet);
+            __m128 m3 = _mm_setzero_ps();
+            _MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+            _mm_storeu_ps(&out[i].normal[c][0], m0);
+            _mm_storeu_ps(&out[i + 1].normal[c][0], m1);
+            _mm_storeu_ps(&out[i + 2].normal[c][0], m2);
+            _mm_storeu_ps(&out[i + 3].normal[c][0], m3);
+        }
+        for (int k = 0; k < 4; ++k)
+            out[i + k].model = models[i + k];
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        out[i].model = models[i];
+        out[i].normal = cofactorNormal(models[i]);
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include<glm.hpp>
+#include<cstddef>
+#include<vector>
+
+//what instanced draws read per instance, the model matrix and the matrix taking normals to world space,
+//the normal matrix columns are padded to vec4 so the layout is the same in std430 buffers and as vertex attributes
+struct InstanceTransform
+{
+    glm::mat4 model;
+    glm::mat3x4 normal;
+};
+
+class InstanceTransforms
+{
+public:
+    //vec4 attributes an instance takes, the model matrix columns and then the normal matrix columns
+    constexpr static unsigned int attributeNum = 7;
+
+    //inverse transposes through cofactors, four matrices at a time with SSE2 and spread over the job system when there are many
+    static void compute(const glm::mat4* models, InstanceTransform* out, size_t count);
+    static std::vector<InstanceTransform> compute(const std::vector<glm::mat4>& models);
+    //one matrix at a time through glm::inverse, what the vertex shaders used to do, kept to compare against
+    static void computeScalar(const glm::mat4* models, InstanceTransform* out, size_t count);
+    static glm::mat3x4 normalMatrix(const glm::mat4& model);
+
+private:
+    static void computeRange(const glm::mat4* models, InstanceTransform* out, size_t count);
+};
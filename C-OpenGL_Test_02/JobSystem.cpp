@@ -0,0 +1,393 @@
+#include "JobSystem.h"
+#include<qdebug.h>
+#include<algorithm>
+#include<cmath>
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::duration;
+using std::chrono::nanoseconds;
+
+namespace
+{
+    thread_local JobSystem* currentSystem = nullptr;
+    thread_local int currentWorker = -1;
+    thread_local unsigned int stealSeed = 0;
+}
+
+bool JobSystem::WorkStealingDeque::push(Job* job)
+{
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= capacity)
+        return false;
+    buffer[b & (capacity - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+JobSystem::Job* JobSystem::WorkStealingDeque::pop()
+{
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+    if (t > b)
+    {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job* job = buffer[b & (capacity - 1)].load(std::memory_order_relaxed);
+    if (t == b)
+    {
+        //last item, race the thieves for it
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            job = nullptr;
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+JobSystem::Job* JobSystem::WorkStealingDeque::steal()
+{
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b)
+        return nullptr;
+    Job* job = buffer[t & (capacity - 1)].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+    return job;
+}
+
+JobSystem::JobSystem(int workerNum)
+    :statsBegin(steady_clock::now())
+{
+    for (int i = 0; i < workerNum; ++i)
+        workers.push_back(std::make_unique<Worker>());
+    for (int i = 0; i < workerNum; ++i)
+        workers[i]->thread = std::thread(&JobSystem::workerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+    stopping = true;
+    sleepCondition.notify_all();
+    for (auto& i : workers)
+        i->thread.join();
+}
+
+JobSystem& JobSystem::instance()
+{
+    static JobSystem system(static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u)));
+    return system;
+}
+
+JobSystem::JobHandle JobSystem::create(std::function<void()> func)
+{
+    auto job = std::make_shared<Job>();
+    job->func = std::move(func);
+    return job;
+}
+
+void JobSystem::precede(const JobHandle& before, const JobHandle& after)
+{
+    std::lock_guard<std::mutex> lock(before->mutex);
+    if (before->finished)
+        return;
+    ++after->pending;
+    before->continuations.push_back(after);
+    Job* none = nullptr;
+    before->successor.compare_exchange_strong(none, after.get());
+}
+
+void JobSystem::submit(const JobHandle& job)
+{
+    job->self = job;
+    if (--job->pending == 0)
+        schedule(job.get());
+}
+
+JobSystem::JobHandle JobSystem::run(std::function<void()> func)
+{
+    JobHandle job = create(std::move(func));
+    submit(job);
+    return job;
+}
+
+void JobSystem::wait(const JobHandle& job)
+{
+    int index = currentSystem == this ? currentWorker : -1;
+    //with no workers nobody else would run the rest
+    bool helpAll = index >= 0 || workers.empty();
+    while (!job->finished)
+    {
+        Job* next = helpAll ? findJob(index) : findPreceding(job.get());
+        if (next)
+            execute(next, index);
+        else
+            std::this_thread::yield();
+    }
+}
+
+void JobSystem::parallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& func)
+{
+    grainSize = std::max<size_t>(grainSize, 1);
+    if (count <= grainSize)
+    {
+        if (count)
+            func(0, count);
+        return;
+    }
+
+    //the chunks all precede an empty job the caller waits on
+    JobHandle done = create([] {});
+    std::vector<JobHandle> chunks;
+    for (size_t begin = 0; begin < count; begin += grainSize)
+    {
+        size_t end = std::min(begin + grainSize, count);
+        chunks.push_back(create([&func, begin, end] {
+            func(begin, end);
+        }));
+        precede(chunks.back(), done);
+    }
+    submit(done);
+    for (auto& i : chunks)
+        submit(i);
+    wait(done);
+}
+
+int JobSystem::workerCount() const
+{
+    return static_cast<int>(workers.size());
+}
+
+std::vector<JobSystem::WorkerStats> JobSystem::workerStats() const
+{
+    double elapsedNs = static_cast<double>(duration_cast<nanoseconds>(steady_clock::now() - statsBegin).count());
+    std::vector<WorkerStats> result;
+    for (auto& i : workers)
+    {
+        WorkerStats stats;
+        stats.jobs = i->jobs;
+        stats.steals = i->steals;
+        stats.utilization = elapsedNs > 0.0 ? i->busyNs / elapsedNs : 0.0;
+        result.push_back(stats);
+    }
+    return result;
+}
+
+void JobSystem::resetStats()
+{
+    for (auto& i : workers)
+    {
+        i->jobs = 0;
+        i->steals = 0;
+        i->busyNs = 0;
+    }
+    statsBegin = steady_clock::now();
+}
+
+void JobSystem::workerLoop(int index)
+{
+    currentSystem = this;
+    currentWorker = index;
+    stealSeed = static_cast<unsigned int>(index) * 2654435761u + 1;
+    int idleSpins = 0;
+    while (!stopping)
+    {
+        Job* job = findJob(index);
+        if (job)
+        {
+            execute(job, index);
+            idleSpins = 0;
+            continue;
+        }
+        //spin a little before sleeping, jobs of a frame tend to arrive in bursts
+        if (++idleSpins < 64)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        ++sleeping;
+        sleepCondition.wait_for(lock, std::chrono::milliseconds(1));
+        --sleeping;
+        idleSpins = 0;
+    }
+}
+
+void JobSystem::schedule(Job* job)
+{
+    if (currentSystem != this || currentWorker < 0 || !workers[currentWorker]->deque.push(job))
+    {
+        std::lock_guard<std::mutex> lock(sharedMutex);
+        sharedQueue.push_back(job);
+        ++sharedSize;
+    }
+    if (sleeping > 0)
+        sleepCondition.notify_one();
+}
+
+JobSystem::Job* JobSystem::findJob(int index)
+{
+    if (index >= 0)
+    {
+        if (Job* job = workers[index]->deque.pop())
+            return job;
+    }
+
+    if (sharedSize > 0)
+    {
+        std::lock_guard<std::mutex> lock(sharedMutex);
+        if (!sharedQueue.empty())
+        {
+            Job* job = sharedQueue.front();
+            sharedQueue.pop_front();
+            --sharedSize;
+            return job;
+        }
+    }
+
+    //start at a pseudo random victim so thieves spread out
+    int workerNum = static_cast<int>(workers.size());
+    if (workerNum == 0)
+        return nullptr;
+    stealSeed = stealSeed * 1664525u + 1013904223u;
+    int start = static_cast<int>((stealSeed >> 8) % workerNum);
+    for (int i = 0; i < workerNum; ++i)
+    {
+        int victim = (start + i) % workerNum;
+        if (victim == index)
+            continue;
+        if (Job* job = workers[victim]->deque.steal())
+        {
+            if (index >= 0)
+                ++workers[index]->steals;
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+JobSystem::Job* JobSystem::findPreceding(const Job* awaited)
+{
+    if (sharedSize == 0)
+        return nullptr;
+    std::lock_guard<std::mutex> lock(sharedMutex);
+    for (auto i = sharedQueue.begin(); i != sharedQueue.end(); ++i)
+    {
+        //a queued job has not finished, so every job down its chain is still held by the continuations before it
+        const Job* next = *i;
+        while (next && next != awaited)
+            next = next->successor;
+        if (next)
+        {
+            Job* job = *i;
+            sharedQueue.erase(i);
+            --sharedSize;
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void JobSystem::execute(Job* job, int index)
+{
+    JobHandle keep = std::move(job->self);
+    auto begin = steady_clock::now();
+    job->func();
+
+    std::vector<JobHandle> continuations;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->finished = true;
+        continuations.swap(job->continuations);
+    }
+    for (auto& i : continuations)
+    {
+        if (--i->pending == 0)
+            schedule(i.get());
+    }
+
+    if (index >= 0)
+    {
+        ++workers[index]->jobs;
+        workers[index]->busyNs += duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+    }
+}
+
+void JobSystem::benchmark()
+{
+    //a flat parallel loop of math heavy items and a wide graph of tiny jobs that is mostly scheduling overhead
+    constexpr size_t loopCount = 1 << 22;
+    constexpr size_t loopGrain = 4096;
+    constexpr int graphWidth = 20000;
+    int maxThreads = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+
+    auto timeBest = [](const std::function<void()>& func) {
+        double best = 1e30;
+        for (int run = 0; run < 5; ++run)
+        {
+            auto begin = steady_clock::now();
+            func();
+            best = std::min(best, duration_cast<duration<double, std::milli>>(steady_clock::now() - begin).count());
+        }
+        return best;
+    };
+
+    double loopBase = 0.0, graphBase = 0.0;
+    qDebug() << "job system scaling, the calling thread is one of the threads";
+    for (int threads = 1; threads <= maxThreads; ++threads)
+    {
+        JobSystem system(threads - 1);
+        std::vector<double> partial((loopCount + loopGrain - 1) / loopGrain);
+        double loopMs = timeBest([&] {
+            system.parallelFor(loopCount, loopGrain, [&](size_t begin, size_t end) {
+                double sum = 0.0;
+                for (size_t i = begin; i < end; ++i)
+                    sum += std::sqrt(static_cast<double>(i)) * std::sin(i * 0.001);
+                partial[begin / loopGrain] = sum;
+            });
+        });
+
+        std::atomic<int> counter{ 0 };
+        double graphMs = timeBest([&] {
+            JobHandle root = system.create([] {});
+            JobHandle sink = system.create([] {});
+            std::vector<JobHandle> leaves;
+            for (int i = 0; i < graphWidth; ++i)
+            {
+                leaves.push_back(system.create([&counter] {
+                    ++counter;
+                }));
+                precede(root, leaves.back());
+                precede(leaves.back(), sink);
+            }
+            system.submit(sink);
+            for (auto& i : leaves)
+                system.submit(i);
+            system.submit(root);
+            system.wait(sink);
+        });
+
+        if (threads == 1)
+        {
+            loopBase = loopMs;
+            graphBase = graphMs;
+        }
+        uint64_t steals = 0;
+        double utilization = 0.0;
+        for (auto& i : system.workerStats())
+        {
+            steals += i.steals;
+            utilization += i.utilization;
+        }
+        qDebug() << threads << "threads: loop" << loopMs << "ms (x" << loopBase / loopMs << ")"
+            << "graph" << graphMs << "ms (x" << graphBase / graphMs << ")"
+            << "steals" << steals << "worker utilization" << (threads > 1 ? utilization / (threads - 1) : 0.0);
+    }
+}
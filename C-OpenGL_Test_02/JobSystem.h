@@ -0,0 +1,110 @@
+#pragma once
+#include<array>
+#include<atomic>
+#include<chrono>
+#include<condition_variable>
+#include<cstdint>
+#include<deque>
+#include<functional>
+#include<memory>
+#include<mutex>
+#include<thread>
+#include<vector>
+
+//work stealing scheduler: every worker owns a lock-free deque it pushes and pops at the bottom while idle
+//workers steal from the top, threads that are not workers submit through a shared queue and while waiting only
+//help with the job they wait on and the jobs preceding it, so a frame never picks up somebody else's long job
+class JobSystem
+{
+public:
+    struct Job;
+    using JobHandle = std::shared_ptr<Job>;
+
+    struct Job
+    {
+        std::function<void()> func;
+        //unfinished dependencies, plus one until the job is submitted
+        std::atomic<int> pending{ 1 };
+        std::atomic<bool> finished{ false };
+        std::mutex mutex;
+        std::vector<JobHandle> continuations;
+        JobHandle self;     //keeps the job alive while it is queued
+        //the first job this one precedes, a thread that is not a worker only helps with jobs that lead to what it waits on
+        std::atomic<Job*> successor{ nullptr };
+    };
+
+    struct WorkerStats
+    {
+        uint64_t jobs = 0;
+        uint64_t steals = 0;
+        double utilization = 0.0;
+    };
+
+    explicit JobSystem(int workerNum);
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    //one worker per core, shared by the whole program
+    static JobSystem& instance();
+
+    JobHandle create(std::function<void()> func);
+    //after only starts once before has finished, call it before after is submitted
+    static void precede(const JobHandle& before, const JobHandle& after);
+    void submit(const JobHandle& job);
+    JobHandle run(std::function<void()> func);
+    //runs other jobs until job has finished, on a thread that is not a worker only job itself and what precedes it
+    void wait(const JobHandle& job);
+    //func(begin, end) over chunks of at most grainSize items, returns when all are done
+    void parallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& func);
+
+    int workerCount() const;
+    //utilization is the busy fraction of the time since the last reset
+    std::vector<WorkerStats> workerStats() const;
+    void resetStats();
+
+    //times the same workloads with 1 to N threads and prints the speedup
+    static void benchmark();
+
+private:
+    //Chase-Lev deque with a fixed ring, push fails when full and the job goes to the shared queue instead
+    class WorkStealingDeque
+    {
+    public:
+        bool push(Job* job);
+        Job* pop();
+        Job* steal();
+
+    private:
+        constexpr static int64_t capacity = 4096;
+        std::atomic<int64_t> top{ 0 };
+        std::atomic<int64_t> bottom{ 0 };
+        std::array<std::atomic<Job*>, capacity> buffer{};
+    };
+
+    struct Worker
+    {
+        std::thread thread;
+        WorkStealingDeque deque;
+        std::atomic<uint64_t> jobs{ 0 };
+        std::atomic<uint64_t> steals{ 0 };
+        std::atomic<uint64_t> busyNs{ 0 };
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex sharedMutex;
+    std::deque<Job*> sharedQueue;
+    std::atomic<size_t> sharedSize{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    std::atomic<int> sleeping{ 0 };
+    std::atomic<bool> stopping{ false };
+    std::chrono::steady_clock::time_point statsBegin;
+
+    void workerLoop(int index);
+    void schedule(Job* job);
+    Job* findJob(int index);
+    //a queued job in the shared queue that leads to awaited
+    Job* findPreceding(const Job* awaited);
+    void execute(Job* job, int index);
+};
@@ -1,83 +1,191 @@
 #include "Mesh.h"
+#include<qopenglcontext.h>
 
 Mesh::Mesh(Mesh&& from)noexcept
 {
     vertices = std::move(from.vertices);
     indices = std::move(from.indices);
     textures = std::move(from.textures);
-    VAO = from.VAO;
-    VBO = from.VBO;
-    EBO = from.EBO;
-
-    from.VAO = from.VBO = from.EBO = 0;
+    nodeTransforms = std::move(from.nodeTransforms);
+    indicesNum = from.indicesNum;
+    boundsCenter = from.boundsCenter;
+    boundsRadius = from.boundsRadius;
+    VAO = std::move(from.VAO);
+    VBO = std::move(from.VBO);
+    depthVAO = std::move(from.depthVAO);
+    positionVBO = std::move(from.positionVBO);
+    EBO = std::move(from.EBO);
+    nodeVBO = std::move(from.nodeVBO);
 }
 
 Mesh::Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const std::vector<std::shared_ptr<Texture>>& textures)
-    :vertices(vertices), indices(indices), textures(textures), VAO(), VBO(), EBO()
+    :vertices(vertices), indices(indices), textures(textures)
 {
-
+    computeBounds();
 }
 
 Mesh::Mesh(std::vector<Vertex>&& vertices, std::vector<unsigned int>&& indices, std::vector<std::shared_ptr<Texture>>&& textures)
-    : vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)), VAO(), VBO(), EBO()
+    : vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures))
 {
+    computeBounds();
 }
 
 void Mesh::init()
 {
-    QOpenGLFunctions_4_5_Core::initializeOpenGLFunctions();
+    initBuffers();
+    initVertexArray();
+}
+
+void Mesh::initBuffers()
+{
+    //direct state access, nothing is bound so this works the same on a loader context
+    GpuResources& gpu = GpuResources::instance();
+    if (!VBO)
+        VBO = gpu.createBuffer(vertices.size() * sizeof(Vertex), vertices.data(), 0, "mesh vertices");
 
-    if (VBO == 0)
+    if (!positionVBO)
     {
-        glGenBuffers(1, &VBO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+        std::vector<glm::vec3> positions(vertices.size());
+        for (size_t i = 0; i < vertices.size(); ++i)
+            positions[i] = vertices[i].position;
+        positionVBO = gpu.createBuffer(positions.size() * sizeof(glm::vec3), positions.data(), 0, "mesh positions");
     }
 
-    if (EBO == 0)
+    if (!EBO)
     {
-        glGenBuffers(1, &EBO);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        EBO = gpu.createBuffer(indices.size() * sizeof(unsigned int), indices.data(), 0, "mesh indices");
         indicesNum = indices.size();
     }
 
-    if (VAO == 0)
+    //meshes without node references are never drawn and get no instance buffer
+    if (!nodeVBO && !nodeTransforms.empty())
+        nodeVBO = gpu.createBuffer(nodeTransforms.size() * sizeof(InstanceTransform), nodeTransforms.data(), 0, "mesh node transforms");
+}
+
+void Mesh::initVertexArray()
+{
+    QOpenGLFunctions_4_5_Core* gl = functions();
+    if (!VAO)
     {
-        glGenVertexArrays(1, &VAO);
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(0));
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, normal)));
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, texCoords)));
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        VAO = GpuResources::instance().createVertexArray("mesh");
+        gl->glBindVertexArray(VAO.get());
+        gl->glBindBuffer(GL_ARRAY_BUFFER, VBO.get());
+        gl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(0));
+        gl->glEnableVertexAttribArray(0);
+        gl->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, normal)));
+        gl->glEnableVertexAttribArray(1);
+        gl->glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, texCoords)));
+        gl->glEnableVertexAttribArray(2);
+        gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO.get());
+        gl->glBindBuffer(GL_ARRAY_BUFFER, nodeVBO.get());
+        for (unsigned int i = 0; i < InstanceTransforms::attributeNum && nodeVBO; ++i)
+        {
+            gl->glVertexAttribPointer(nodeTransformLocation + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (void*)(i * sizeof(glm::vec4)));
+            gl->glEnableVertexAttribArray(nodeTransformLocation + i);
+            gl->glVertexAttribDivisor(nodeTransformLocation + i, 1);
+        }
     }
-    glBindVertexArray(0);
+
+    //the same indices and node transforms, only the model matrix columns are needed
+    if (!depthVAO)
+    {
+        depthVAO = GpuResources::instance().createVertexArray("mesh depth");
+        gl->glBindVertexArray(depthVAO.get());
+        gl->glBindBuffer(GL_ARRAY_BUFFER, positionVBO.get());
+        gl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)(0));
+        gl->glEnableVertexAttribArray(0);
+        gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO.get());
+        gl->glBindBuffer(GL_ARRAY_BUFFER, nodeVBO.get());
+        for (unsigned int i = 0; i < 4 && nodeVBO; ++i)
+        {
+            gl->glVertexAttribPointer(nodeTransformLocation + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (void*)(i * sizeof(glm::vec4)));
+            gl->glEnableVertexAttribArray(nodeTransformLocation + i);
+            gl->glVertexAttribDivisor(nodeTransformLocation + i, 1);
+        }
+    }
+    gl->glBindVertexArray(0);
 }
 
 void Mesh::bind()
 {
-    glBindVertexArray(VAO);
+    functions()->glBindVertexArray(VAO.get());
 }
 
 void Mesh::draw()
 {
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+    functions()->glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0, nodeTransforms.size());
+}
+
+void Mesh::drawInstanced(unsigned int instanceNum)
+{
+    QOpenGLFunctions_4_5_Core* gl = functions();
+    //the instance divisor is taken by the caller's attributes, so each node transform becomes a constant attribute
+    for (unsigned int i = 0; i < InstanceTransforms::attributeNum; ++i)
+        gl->glDisableVertexArrayAttrib(VAO.get(), nodeTransformLocation + i);
+    for (auto& transform : nodeTransforms)
+    {
+        for (unsigned int i = 0; i < 4; ++i)
+            gl->glVertexAttrib4fv(nodeTransformLocation + i, &transform.model[i][0]);
+        for (unsigned int i = 0; i < 3; ++i)
+            gl->glVertexAttrib4fv(nodeTransformLocation + 4 + i, &transform.normal[i][0]);
+        gl->glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0, instanceNum);
+    }
+    for (unsigned int i = 0; i < InstanceTransforms::attributeNum; ++i)
+        gl->glEnableVertexArrayAttrib(VAO.get(), nodeTransformLocation + i);
+}
+
+void Mesh::drawDepth(unsigned int instanceRepeat)
+{
+    if (!depthVAO || !nodeVBO)
+        return;
+    QOpenGLFunctions_4_5_Core* gl = functions();
+    for (unsigned int i = 0; i < 4; ++i)
+        gl->glVertexArrayBindingDivisor(depthVAO.get(), nodeTransformLocation + i, instanceRepeat);
+    gl->glBindVertexArray(depthVAO.get());
+    gl->glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0, nodeTransforms.size() * instanceRepeat);
+    for (unsigned int i = 0; i < 4; ++i)
+        gl->glVertexArrayBindingDivisor(depthVAO.get(), nodeTransformLocation + i, 1);
+}
+
+void Mesh::drawPoints()
+{
+    functions()->glDrawArraysInstanced(GL_POINTS, 0, vertices.size(), nodeTransforms.size());
+}
+
+void Mesh::bindPullBuffers(unsigned int vertexBinding, unsigned int indexBinding, unsigned int nodeBinding)
+{
+    QOpenGLFunctions_4_5_Core* gl = functions();
+    gl->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, vertexBinding, VBO.get());
+    gl->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, indexBinding, EBO.get());
+    gl->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, nodeBinding, nodeVBO.get());
+}
+
+size_t Mesh::vertexNum() const
+{
+    return vertices.size();
+}
+
+const std::vector<Mesh::Vertex>& Mesh::getVertices() const
+{
+    return vertices;
+}
+
+const std::vector<unsigned int>& Mesh::getIndices() const
+{
+    return indices;
 }
 
 void Mesh::setShaderVariables(QOpenGLShaderProgram* shader)
 {
+    QOpenGLFunctions_4_5_Core* gl = functions();
     int diffuseNum = 1;
     int specularNum = 1;
     int texIndex = 0;
     for (auto& tex : textures)
     {
         std::string number;
-        glActiveTexture(GL_TEXTURE0 + texIndex);
-        tex->bind();
+        gl->glActiveTexture(GL_TEXTURE0 + texIndex);
+        gl->glBindTexture(GL_TEXTURE_2D, tex->tex);
         TextureType currentTexType = tex->type;
         std::string texName;
         if (currentTexType == TextureType::Diffuse)
@@ -92,8 +200,93 @@ void Mesh::setShaderVariables(QOpenGLShaderProgram* shader)
             number = std::to_string(diffuseNum++);
         else if (currentTexType == TextureType::Specular)
             number = std::to_string(specularNum++);
-        glUniform1i(shader->uniformLocation(QString::fromStdString(texName + number)), texIndex);
+        gl->glUniform1i(shader->uniformLocation(QString::fromStdString(texName + number)), texIndex);
         ++texIndex;
     }
-    glActiveTexture(GL_TEXTURE0);
+    gl->glActiveTexture(GL_TEXTURE0);
+}
+
+void Mesh::record(CommandBuffer& commands, bool depthOnly) const
+{
+    commands.bindVertexArray(depthOnly ? depthVAO.get() : VAO.get());
+    if (!depthOnly)
+        recordTextures(commands);
+    commands.drawElements(GL_TRIANGLES, static_cast<int>(indices.size()), 0, static_cast<int>(nodeTransforms.size()));
+}
+
+void Mesh::recordIndirect(CommandBuffer& commands, unsigned int indirectBuffer, intptr_t offset, bool depthOnly) const
+{
+    commands.bindVertexArray(depthOnly ? depthVAO.get() : VAO.get());
+    if (!depthOnly)
+        recordTextures(commands);
+    commands.drawElementsIndirect(GL_TRIANGLES, indirectBuffer, offset);
+}
+
+void Mesh::setInstanceSource(unsigned int buffer)
+{
+    //glVertexAttribPointer gave every attribute the binding of the same index
+    if (!VAO || !nodeVBO)
+        return;
+    QOpenGLFunctions_4_5_Core* gl = functions();
+    unsigned int source = buffer ? buffer : nodeVBO.get();
+    for (unsigned int i = 0; i < InstanceTransforms::attributeNum; ++i)
+        gl->glVertexArrayVertexBuffer(VAO.get(), nodeTransformLocation + i, source, i * sizeof(glm::vec4), sizeof(InstanceTransform));
+    for (unsigned int i = 0; i < 4 && depthVAO; ++i)
+        gl->glVertexArrayVertexBuffer(depthVAO.get(), nodeTransformLocation + i, source, i * sizeof(glm::vec4), sizeof(InstanceTransform));
+}
+
+void Mesh::requestTextureDetail(TextureStreamer& streamer, float screenSize)
+{
+    for (auto& tex : textures)
+        streamer.requestDetail(tex->streamHandle, screenSize);
+}
+
+void Mesh::setNodeTransforms(std::vector<glm::mat4>&& transforms)
+{
+    //node transforms never change, their normal matrices are worked out once here instead of per vertex
+    nodeTransforms = InstanceTransforms::compute(transforms);
+}
+
+const std::vector<InstanceTransform>& Mesh::getNodeTransforms() const
+{
+    return nodeTransforms;
+}
+
+size_t Mesh::bufferBytes() const
+{
+    return vertices.size() * (sizeof(Vertex) + sizeof(glm::vec3)) + indices.size() * sizeof(unsigned int) + nodeTransforms.size() * sizeof(InstanceTransform);
+}
+
+void Mesh::computeBounds()
+{
+    if (vertices.empty())
+        return;
+    glm::vec3 low = vertices[0].position, high = vertices[0].position;
+    for (auto& i : vertices)
+    {
+        low = glm::min(low, i.position);
+        high = glm::max(high, i.position);
+    }
+    boundsCenter = (low + high) * 0.5f;
+    boundsRadius = glm::length(high - low) * 0.5f;
 }
+
+void Mesh::recordTextures(CommandBuffer& commands) const
+{
+    unsigned int units[2] = { 0, 0 };
+    for (auto& tex : textures)
+    {
+        unsigned int& unit = units[tex->type == TextureType::Diffuse ? 0 : 1];
+        if (unit == 0)
+            unit = tex->tex;
+    }
+    commands.bindTextures(0, 2, units);
+}
+
+QOpenGLFunctions_4_5_Core* Mesh::functions()
+{
+    //buffers are made on the loader context and everything else on the GUI thread, so nothing is kept from either
+    QOpenGLFunctions_4_5_Core* gl = QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_4_5_Core>();
+    gl->initializeOpenGLFunctions();
+    return gl;
+}
\ No newline at end of file
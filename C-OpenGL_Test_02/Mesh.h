@@ -6,8 +6,12 @@
 #include<vector>
 #include<string>
 #include<memory>
+#include"GpuResources.h"
+#include"InstanceTransform.h"
+#include"TextureStreamer.h"
+#include"CommandBuffer.h"
 
-class Mesh :public QOpenGLFunctions_4_5_Core
+class Mesh
 {
 public:
     Mesh(Mesh&& from)noexcept;
@@ -26,21 +30,18 @@ public:
 
     struct Texture
     {
-        QOpenGLTexture* tex = nullptr;
+        unsigned int tex = 0;
+        int streamHandle = -1;
         TextureType type;
         std::string path;
 
-        void init()
+        void init(TextureStreamer& streamer)
         {
             if (tex)
                 return;
-            tex = new QOpenGLTexture(QImage(QString::fromStdString(path)).mirrored());
-        }
-
-        TextureType bind()
-        {
-            tex->bind();
-            return type;
+            auto texClass = type == TextureType::Diffuse ? TextureCompressor::TextureClass::Color : TextureCompressor::TextureClass::Single;
+            streamHandle = streamer.addTexture(path, texClass);
+            tex = streamer.texture(streamHandle);
         }
     };
 
@@ -48,14 +49,60 @@ public:
     Mesh(std::vector<Vertex>&& vertices, std::vector<unsigned int>&& indices, std::vector<std::shared_ptr<Texture>>&& textures);
 
     void init();
+    //buffers can be created on a shared context, the VAO has to be made on the context that draws
+    void initBuffers();
+    void initVertexArray();
     void bind();
+    //one instance per node transform
     void draw();
+    //instanceNum instances for every node transform, the caller supplies its own per instance attributes
+    void drawInstanced(unsigned int instanceNum);
     void setShaderVariables(QOpenGLShaderProgram* shader);
+    //same as bind, setShaderVariables and draw but recorded, the first diffuse map goes to unit 0 and the first specular map to unit 1
+    //depthOnly draws the packed positions and node model matrices only and binds no textures
+    void record(CommandBuffer& commands, bool depthOnly = false) const;
+    //the same with the instance count and matrices written by the GPU, see setInstanceSource
+    void recordIndirect(CommandBuffer& commands, unsigned int indirectBuffer, intptr_t offset, bool depthOnly = false) const;
+    //draws the packed positions with every node transform repeated for instanceRepeat instances in a row,
+    //shaders tell the repeats apart by gl_InstanceID, the program is up to the caller
+    void drawDepth(unsigned int instanceRepeat);
+    //every vertex as a point, one instance per node transform
+    void drawPoints();
+    //binds the vertices, indices and node transforms as storage buffers for shaders that fetch them by gl_VertexID
+    //and gl_InstanceID, a Vertex is read as eight floats, see vertexPulling.vert
+    void bindPullBuffers(unsigned int vertexBinding, unsigned int indexBinding, unsigned int nodeBinding);
+    size_t vertexNum() const;
+    //the CPU copies the buffers were made from, kept for queries like picking
+    const std::vector<Vertex>& getVertices() const;
+    const std::vector<unsigned int>& getIndices() const;
+    //where the node transform attributes are read from, 0 goes back to the node transforms
+    void setInstanceSource(unsigned int buffer);
+    void requestTextureDetail(TextureStreamer& streamer, float screenSize);
+    //where the nodes referencing this mesh place it, read by the model shaders as an InstanceTransform from nodeTransformLocation on
+    void setNodeTransforms(std::vector<glm::mat4>&& transforms);
+    const std::vector<InstanceTransform>& getNodeTransforms() const;
+    size_t bufferBytes() const;
+
+    constexpr static unsigned int nodeTransformLocation = 9;
 
     unsigned int indicesNum;
+    //bounding sphere in model space
+    glm::vec3 boundsCenter{ 0.0f };
+    float boundsRadius = 0.0f;
 private:
-    unsigned int VAO, VBO, EBO;
+    GpuResources::VertexArray VAO;
+    GpuResources::Buffer VBO, EBO;
+    //depth only passes fetch 12 bytes a vertex from here instead of the whole Vertex
+    GpuResources::VertexArray depthVAO;
+    GpuResources::Buffer positionVBO;
+    GpuResources::Buffer nodeVBO;
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
     std::vector<std::shared_ptr<Texture>> textures;
+    std::vector<InstanceTransform> nodeTransforms{ InstanceTransform{ glm::mat4(1.0f), glm::mat3x4(1.0f) } };
+
+    void computeBounds();
+    void recordTextures(CommandBuffer& commands) const;
+    //the functions of the calling thread's context, see GpuResources::functions
+    static QOpenGLFunctions_4_5_Core* functions();
 };
@@ -0,0 +1,470 @@
+#include "MeshBvh.h"
+#include<algorithm>
+#include<chrono>
+#include<cmath>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include<emmintrin.h>
+#define MESH_BVH_SSE2
+#endif
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::duration;
+
+void MeshBvh::build(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices, JobSystem& jobs)
+{
+    auto begin = steady_clock::now();
+    size_t triangleNum = indices.size() / 3;
+    std::vector<Bvh::Bounds> triangleBounds(triangleNum);
+    jobs.parallelFor(triangleNum, Bvh::parallelThreshold, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i)
+        {
+            for (int k = 0; k < 3; ++k)
+                triangleBounds[i].grow(positions[indices[i * 3 + k]]);
+        }
+    });
+    tree.build(triangleBounds, jobs);
+
+    //triangles are stored once more in leaf order, as the first vertex and both edges of four at a time
+    blocks.assign(tree.leaves().size(), TriangleBlock{});
+    const std::vector<uint32_t>& order = tree.order();
+    jobs.parallelFor(blocks.size(), Bvh::parallelThreshold, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i)
+        {
+            const Bvh::Leaf& leaf = tree.leaves()[i];
+            TriangleBlock& block = blocks[i];
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                if (lane >= static_cast<int>(leaf.count))
+                {
+                    block.triangle[lane] = Bvh::invalid;
+                    continue;
+                }
+                uint32_t triangle = order[leaf.first + lane];
+                glm::vec3 v0 = positions[indices[triangle * 3]];
+                glm::vec3 e1 = positions[indices[triangle * 3 + 1]] - v0;
+                glm::vec3 e2 = positions[indices[triangle * 3 + 2]] - v0;
+                block.v0x[lane] = v0.x;
+                block.v0y[lane] = v0.y;
+                block.v0z[lane] = v0.z;
+                block.e1x[lane] = e1.x;
+                block.e1y[lane] = e1.y;
+                block.e1z[lane] = e1.z;
+                block.e2x[lane] = e2.x;
+                block.e2y[lane] = e2.y;
+                block.e2z[lane] = e2.z;
+                block.triangle[lane] = triangle;
+            }
+        }
+    });
+
+    statistics.triangles = static_cast<unsigned int>(triangleNum);
+    statistics.nodes = static_cast<unsigned int>(tree.nodes().size());
+    statistics.leaves = static_cast<unsigned int>(blocks.size());
+    statistics.bytes = tree.bytes() + blocks.size() * sizeof(TriangleBlock);
+    statistics.buildMs = duration_cast<duration<double, std::milli>>(steady_clock::now() - begin).count();
+}
+
+bool MeshBvh::empty() const
+{
+    return tree.empty();
+}
+
+const Bvh::Bounds& MeshBvh::bounds() const
+{
+    return tree.bounds();
+}
+
+const MeshBvh::Stats& MeshBvh::stats() const
+{
+    return statistics;
+}
+
+bool MeshBvh::intersect(const Bvh::Ray& ray, Bvh::Hit& hit) const
+{
+    if (tree.empty())
+        return false;
+    glm::vec3 invDirection = Bvh::inverse(ray.direction);
+    float distance = std::min(ray.maxDistance, hit.distance);
+    bool found = false;
+    int32_t stack[Bvh::stackSize];
+    int stackTop = 0;
+    stack[stackTop++] = 0;
+    while (stackTop > 0)
+    {
+        int32_t index = stack[--stackTop];
+        if (index < 0)
+        {
+            float u, v;
+            const TriangleBlock& block = blocks[~index];
+            int lane = intersectBlock(block, ray.origin, ray.direction, distance, u, v);
+            if (lane >= 0)
+            {
+                found = true;
+                hit.distance = distance;
+                hit.triangle = block.triangle[lane];
+                hit.u = u;
+                hit.v = v;
+            }
+            continue;
+        }
+        const Bvh::Node& node = tree.nodes()[index];
+        float entry[Bvh::width];
+        int mask = Bvh::intersectChildren(node, ray.origin, invDirection, distance, entry);
+        //farthest pushed first so the nearest child is taken next and shortens the ray for the rest
+        int order[Bvh::width];
+        int count = 0;
+        for (int i = 0; i < Bvh::width; ++i)
+        {
+            if ((mask >> i & 1) && node.child[i] != Bvh::emptyChild)
+                order[count++] = i;
+        }
+        Bvh::farthestFirst(order, count, entry);
+        for (int i = 0; i < count; ++i)
+            stack[stackTop++] = node.child[order[i]];
+    }
+    return found;
+}
+
+void MeshBvh::intersect(const Bvh::RayPacket& packet, Bvh::Hit hits[4]) const
+{
+    if (tree.empty())
+        return;
+    Bvh::PacketLanes lanes = Bvh::lanes(packet);
+    for (int i = 0; i < 4; ++i)
+    {
+        if (lanes.distance[i] > 0.0f)
+            lanes.distance[i] = std::min(lanes.distance[i], hits[i].distance);
+    }
+    int32_t stack[Bvh::stackSize];
+    int stackTop = 0;
+    stack[stackTop++] = 0;
+    while (stackTop > 0)
+    {
+        int32_t index = stack[--stackTop];
+        if (index < 0)
+        {
+            intersectBlock(blocks[~index], lanes, hits);
+            continue;
+        }
+        //a child is entered when any lane enters it, ordered by the nearest of those lanes
+        const Bvh::Node& node = tree.nodes()[index];
+        float entry[Bvh::width];
+        int order[Bvh::width];
+        int count = 0;
+        for (int i = 0; i < Bvh::width; ++i)
+        {
+            if (node.child[i] != Bvh::emptyChild && Bvh::intersectChild(node, i, lanes, entry[i]))
+                order[count++] = i;
+        }
+        Bvh::farthestFirst(order, count, entry);
+        for (int i = 0; i < count; ++i)
+            stack[stackTop++] = node.child[order[i]];
+    }
+}
+
+bool MeshBvh::closestPoint(const glm::vec3& point, Bvh::Nearest& nearest) const
+{
+    if (tree.empty())
+        return false;
+    float bestSquared = nearest.distance < std::sqrt(std::numeric_limits<float>::max()) ? nearest.distance * nearest.distance : std::numeric_limits<float>::max();
+    bool found = false;
+    struct Entry
+    {
+        int32_t index;
+        float squared;
+    };
+    Entry stack[Bvh::stackSize];
+    int stackTop = 0;
+    stack[stackTop++] = Entry{ 0, 0.0f };
+    while (stackTop > 0)
+    {
+        Entry entry = stack[--stackTop];
+        //the bound may have shrunk since this entry was pushed
+        if (entry.squared >= bestSquared)
+            continue;
+        if (entry.index < 0)
+        {
+            const TriangleBlock& block = blocks[~entry.index];
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                if (block.triangle[lane] == Bvh::invalid)
+                    continue;
+                glm::vec3 vertices[3];
+                corners(block, lane, vertices);
+                glm::vec3 closest = closestOnTriangle(point, vertices[0], vertices[1], vertices[2]);
+                glm::vec3 offset = closest - point;
+                float squared = glm::dot(offset, offset);
+                if (squared < bestSquared)
+                {
+                    bestSquared = squared;
+                    found = true;
+                    nearest.point = closest;
+                    nearest.triangle = block.triangle[lane];
+                }
+            }
+            continue;
+        }
+        const Bvh::Node& node = tree.nodes()[entry.index];
+        float squared[Bvh::width];
+        Bvh::childDistances(node, point, squared);
+        int order[Bvh::width];
+        int count = 0;
+        for (int i = 0; i < Bvh::width; ++i)
+        {
+            if (node.child[i] != Bvh::emptyChild && squared[i] < bestSquared)
+                order[count++] = i;
+        }
+        Bvh::farthestFirst(order, count, squared);
+        for (int i = 0; i < count; ++i)
+            stack[stackTop++] = Entry{ node.child[order[i]], squared[order[i]] };
+    }
+    if (found)
+        nearest.distance = std::sqrt(bestSquared);
+    return found;
+}
+
+void MeshBvh::overlap(const Bvh::Bounds& box, const glm::mat4& toBox, std::vector<unsigned int>& triangles) const
+{
+    if (tree.empty() || box.empty())
+        return;
+    //nodes are culled against the box taken back to mesh space, which is looser than the box when toBox rotates,
+    //the triangles themselves are tested exactly in the space of the box
+    Bvh::Bounds meshBox = box.transformed(glm::inverse(toBox));
+    glm::vec3 center = (box.lower + box.upper) * 0.5f;
+    glm::vec3 halfExtent = (box.upper - box.lower) * 0.5f;
+    int32_t stack[Bvh::stackSize];
+    int stackTop = 0;
+    stack[stackTop++] = 0;
+    while (stackTop > 0)
+    {
+        int32_t index = stack[--stackTop];
+        if (index < 0)
+        {
+            const TriangleBlock& block = blocks[~index];
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                if (block.triangle[lane] == Bvh::invalid)
+                    continue;
+                glm::vec3 vertices[3];
+                corners(block, lane, vertices);
+                for (auto& i : vertices)
+                    i = glm::vec3(toBox * glm::vec4(i, 1.0f)) - center;
+                if (triangleOverlapsBox(vertices, halfExtent))
+                    triangles.push_back(block.triangle[lane]);
+            }
+            continue;
+        }
+        const Bvh::Node& node = tree.nodes()[index];
+        for (int i = 0; i < Bvh::width; ++i)
+        {
+            if (node.child[i] != Bvh::emptyChild && Bvh::childOverlaps(node, i, meshBox))
+                stack[stackTop++] = node.child[i];
+        }
+    }
+}
+
+void MeshBvh::corners(const TriangleBlock& block, int lane, glm::vec3 out[3])
+{
+    out[0] = glm::vec3(block.v0x[lane], block.v0y[lane], block.v0z[lane]);
+    out[1] = out[0] + glm::vec3(block.e1x[lane], block.e1y[lane], block.e1z[lane]);
+    out[2] = out[0] + glm::vec3(block.e2x[lane], block.e2y[lane], block.e2z[lane]);
+}
+
+int MeshBvh::intersectBlock(const TriangleBlock& block, const glm::vec3& origin, const glm::vec3& direction, float& distance, float& u, float& v)
+{
+    //Moller-Trumbore against four triangles at once, both faces count
+    float hitT[4], hitU[4], hitV[4];
+    int mask = 0;
+#ifdef MESH_BVH_SSE2
+    __m128 dx = _mm_set1_ps(direction.x), dy = _mm_set1_ps(direction.y), dz = _mm_set1_ps(direction.z);
+    __m128 e1x = _mm_loadu_ps(block.e1x), e1y = _mm_loadu_ps(block.e1y), e1z = _mm_loadu_ps(block.e1z);
+    __m128 e2x = _mm_loadu_ps(block.e2x), e2y = _mm_loadu_ps(block.e2y), e2z = _mm_loadu_ps(block.e2z);
+    __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+    __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+    __m128 tx = _mm_sub_ps(_mm_set1_ps(origin.x), _mm_loadu_ps(block.v0x));
+    __m128 ty = _mm_sub_ps(_mm_set1_ps(origin.y), _mm_loadu_ps(block.v0y));
+    __m128 tz = _mm_sub_ps(_mm_set1_ps(origin.z), _mm_loadu_ps(block.v0z));
+    __m128 uu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), invDet);
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+    __m128 vv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+    __m128 tt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+    __m128 zero = _mm_setzero_ps();
+    __m128 valid = _mm_cmpneq_ps(det, zero);
+    valid = _mm_and_ps(valid, _mm_cmpge_ps(uu, zero));
+    valid = _mm_and_ps(valid, _mm_cmpge_ps(vv, zero));
+    valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(uu, vv), _mm_set1_ps(1.0f)));
+    valid = _mm_and_ps(valid, _mm_cmpge_ps(tt, zero));
+    valid = _mm_and_ps(valid, _mm_cmplt_ps(tt, _mm_set1_ps(distance)));
+    mask = _mm_movemask_ps(valid);
+    if (!mask)
+        return -1;
+    _mm_storeu_ps(hitT, tt);
+    _mm_storeu_ps(hitU, uu);
+    _mm_storeu_ps(hitV, vv);
+#else
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        glm::vec3 e1(block.e1x[lane], block.e1y[lane], block.e1z[lane]);
+        glm::vec3 e2(block.e2x[lane], block.e2y[lane], block.e2z[lane]);
+        glm::vec3 p = glm::cross(direction, e2);
+        float det = glm::dot(e1, p);
+        if (det == 0.0f)
+            continue;
+        float invDet = 1.0f / det;
+        glm::vec3 t = origin - glm::vec3(block.v0x[lane], block.v0y[lane], block.v0z[lane]);
+        glm::vec3 q = glm::cross(t, e1);
+        hitU[lane] = glm::dot(t, p) * invDet;
+        hitV[lane] = glm::dot(direction, q) * invDet;
+        hitT[lane] = glm::dot(e2, q) * invDet;
+        if (hitU[lane] >= 0.0f && hitV[lane] >= 0.0f && hitU[lane] + hitV[lane] <= 1.0f && hitT[lane] >= 0.0f && hitT[lane] < distance)
+            mask |= 1 << lane;
+    }
+    if (!mask)
+        return -1;
+#endif
+    int closest = -1;
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        if ((mask >> lane & 1) && hitT[lane] < distance)
+        {
+            closest = lane;
+            distance = hitT[lane];
+        }
+    }
+    u = hitU[closest];
+    v = hitV[closest];
+    return closest;
+}
+
+void MeshBvh::intersectBlock(const TriangleBlock& block, Bvh::PacketLanes& packet, Bvh::Hit hits[4])
+{
+    //one triangle at a time against all four lanes
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        if (block.triangle[lane] == Bvh::invalid)
+            continue;
+#ifdef MESH_BVH_SSE2
+        __m128 dx = _mm_loadu_ps(packet.directionX), dy = _mm_loadu_ps(packet.directionY), dz = _mm_loadu_ps(packet.directionZ);
+        __m128 e1x = _mm_set1_ps(block.e1x[lane]), e1y = _mm_set1_ps(block.e1y[lane]), e1z = _mm_set1_ps(block.e1z[lane]);
+        __m128 e2x = _mm_set1_ps(block.e2x[lane]), e2y = _mm_set1_ps(block.e2y[lane]), e2z = _mm_set1_ps(block.e2z[lane]);
+        __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+        __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+        __m128 tx = _mm_sub_ps(_mm_loadu_ps(packet.originX), _mm_set1_ps(block.v0x[lane]));
+        __m128 ty = _mm_sub_ps(_mm_loadu_ps(packet.originY), _mm_set1_ps(block.v0y[lane]));
+        __m128 tz = _mm_sub_ps(_mm_loadu_ps(packet.originZ), _mm_set1_ps(block.v0z[lane]));
+        __m128 uu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), invDet);
+        __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+        __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+        __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+        __m128 vv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+        __m128 tt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+        __m128 zero = _mm_setzero_ps();
+        __m128 valid = _mm_cmpneq_ps(det, zero);
+        valid = _mm_and_ps(valid, _mm_cmpge_ps(uu, zero));
+        valid = _mm_and_ps(valid, _mm_cmpge_ps(vv, zero));
+        valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(uu, vv), _mm_set1_ps(1.0f)));
+        valid = _mm_and_ps(valid, _mm_cmpge_ps(tt, zero));
+        valid = _mm_and_ps(valid, _mm_cmplt_ps(tt, _mm_loadu_ps(packet.distance)));
+        int mask = _mm_movemask_ps(valid);
+        if (!mask)
+            continue;
+        float hitT[4], hitU[4], hitV[4];
+        _mm_storeu_ps(hitT, tt);
+        _mm_storeu_ps(hitU, uu);
+        _mm_storeu_ps(hitV, vv);
+        for (int ray = 0; ray < 4; ++ray)
+        {
+            if (!(mask >> ray & 1))
+                continue;
+            packet.distance[ray] = hitT[ray];
+            hits[ray].distance = hitT[ray];
+            hits[ray].triangle = block.triangle[lane];
+            hits[ray].u = hitU[ray];
+            hits[ray].v = hitV[ray];
+        }
+#else
+        for (int ray = 0; ray < 4; ++ray)
+        {
+            glm::vec3 origin(packet.originX[ray], packet.originY[ray], packet.originZ[ray]);
+            glm::vec3 direction(packet.directionX[ray], packet.directionY[ray], packet.directionZ[ray]);
+            float u, v;
+            TriangleBlock single{};
+            single.v0x[0] = block.v0x[lane];
+            single.v0y[0] = block.v0y[lane];
+            single.v0z[0] = block.v0z[lane];
+            single.e1x[0] = block.e1x[lane];
+            single.e1y[0] = block.e1y[lane];
+            single.e1z[0] = block.e1z[lane];
+            single.e2x[0] = block.e2x[lane];
+            single.e2y[0] = block.e2y[lane];
+            single.e2z[0] = block.e2z[lane];
+            if (intersectBlock(single, origin, direction, packet.distance[ray], u, v) == 0)
+            {
+                hits[ray].distance = packet.distance[ray];
+                hits[ray].triangle = block.triangle[lane];
+                hits[ray].u = u;
+                hits[ray].v = v;
+            }
+        }
+#endif
+    }
+}
+
+glm::vec3 MeshBvh::closestOnTriangle(const glm::vec3& point, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    //by the voronoi region of the triangle point falls in
+    glm::vec3 ab = b - a, ac = c - a, ap = point - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return a;
+    glm::vec3 bp = point - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return b;
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return a + ab * (d1 / (d1 - d3));
+    glm::vec3 cp = point - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return c;
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return a + ac * (d2 / (d2 - d6));
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    float denominator = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+bool MeshBvh::triangleOverlapsBox(const glm::vec3 triangle[3], const glm::vec3& halfExtent)
+{
+    //the box axes, the triangle normal and the nine edge cross products, degenerate axes separate nothing
+    glm::vec3 edges[3] = { triangle[1] - triangle[0], triangle[2] - triangle[1], triangle[0] - triangle[2] };
+    glm::vec3 axes[13] = { glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::cross(edges[0], edges[1]) };
+    int axisNum = 4;
+    for (auto& edge : edges)
+    {
+        for (int i = 0; i < 3; ++i)
+            axes[axisNum++] = glm::cross(edge, axes[i]);
+    }
+    for (auto& axis : axes)
+    {
+        float p0 = glm::dot(triangle[0], axis), p1 = glm::dot(triangle[1], axis), p2 = glm::dot(triangle[2], axis);
+        float radius = halfExtent.x * std::abs(axis.x) + halfExtent.y * std::abs(axis.y) + halfExtent.z * std::abs(axis.z);
+        if (std::min({ p0, p1, p2 }) > radius || std::max({ p0, p1, p2 }) < -radius)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include<glm.hpp>
+#include<vector>
+#include"Bvh.h"
+
+//triangles of one mesh in its own space, every leaf of the tree is one block of up to four triangles laid out for SSE2,
+//padding lanes have zero edges and never hit
+class MeshBvh
+{
+public:
+    struct Stats
+    {
+        unsigned int triangles = 0;
+        unsigned int nodes = 0;
+        unsigned int leaves = 0;
+        size_t bytes = 0;
+        double buildMs = 0.0;
+    };
+
+    void build(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices, JobSystem& jobs);
+    bool empty() const;
+    const Bvh::Bounds& bounds() const;
+    const Stats& stats() const;
+
+    //the closest hit nearer than hit.distance, hit is left alone and false returned when there is none
+    bool intersect(const Bvh::Ray& ray, Bvh::Hit& hit) const;
+    //the same for four rays through one traversal, for rays that start close and point the same way like a pixel quad
+    void intersect(const Bvh::RayPacket& packet, Bvh::Hit hits[4]) const;
+    //the closest point on any triangle nearer than nearest.distance
+    bool closestPoint(const glm::vec3& point, Bvh::Nearest& nearest) const;
+    //appends the triangles that touch box, toBox takes mesh space to the space of box
+    void overlap(const Bvh::Bounds& box, const glm::mat4& toBox, std::vector<unsigned int>& triangles) const;
+
+private:
+    struct alignas(16) TriangleBlock
+    {
+        float v0x[4], v0y[4], v0z[4];
+        float e1x[4], e1y[4], e1z[4];
+        float e2x[4], e2y[4], e2z[4];
+        unsigned int triangle[4];
+    };
+
+    Bvh tree;
+    //by leaf index
+    std::vector<TriangleBlock> blocks;
+    Stats statistics;
+
+    static void corners(const TriangleBlock& block, int lane, glm::vec3 out[3]);
+    //the closest hit of ray against the block nearer than distance, lane -1 when there is none
+    static int intersectBlock(const TriangleBlock& block, const glm::vec3& origin, const glm::vec3& direction, float& distance, float& u, float& v);
+    static void intersectBlock(const TriangleBlock& block, Bvh::PacketLanes& packet, Bvh::Hit hits[4]);
+    static glm::vec3 closestOnTriangle(const glm::vec3& point, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+    //separating axis test of a triangle against a box centred at the origin
+    static bool triangleOverlapsBox(const glm::vec3 triangle[3], const glm::vec3& halfExtent);
+};
@@ -0,0 +1,238 @@
+#include "MipGenerator.h"
+#include<algorithm>
+#include<cmath>
+#include"ParallelFor.h"
+
+namespace
+{
+    constexpr float pi = 3.14159265358979f;
+
+    float srgbToLinear(float value)
+    {
+        return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+
+    float linearToSrgb(float value)
+    {
+        return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+    }
+
+    const std::array<float, 256>& srgbToLinearTable()
+    {
+        static const std::array<float, 256> table = [] {
+            std::array<float, 256> result;
+            for (int i = 0; i < 256; ++i)
+                result[i] = srgbToLinear(i / 255.0f);
+            return result;
+        }();
+        return table;
+    }
+
+    const std::array<unsigned char, 4096>& linearToSrgbTable()
+    {
+        static const std::array<unsigned char, 4096> table = [] {
+            std::array<unsigned char, 4096> result;
+            for (int i = 0; i < 4096; ++i)
+                result[i] = static_cast<unsigned char>(linearToSrgb(i / 4095.0f) * 255.0f + 0.5f);
+            return result;
+        }();
+        return table;
+    }
+
+    unsigned char toUnorm8(float value)
+    {
+        return static_cast<unsigned char>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+
+    int wrap(int i, int n)
+    {
+        return ((i % n) + n) % n;
+    }
+
+    //zeroth order modified Bessel function, enough terms for the Kaiser window
+    float besselI0(float x)
+    {
+        float sum = 1.0f, term = 1.0f;
+        for (int k = 1; k < 16; ++k)
+        {
+            term *= (x / (2.0f * k)) * (x / (2.0f * k));
+            sum += term;
+        }
+        return sum;
+    }
+}
+
+std::vector<MipGenerator::Level> MipGenerator::build(Level base, TextureClass texClass)
+{
+    std::vector<Level> chain;
+    //parallax marches until the layer depth reaches the map, so the shallowest texel is the conservative one
+    if (texClass == TextureClass::Height)
+    {
+        chain.push_back(std::move(base));
+        while (chain.back().width > 1 || chain.back().height > 1)
+        {
+            Level next = downsampleMin(chain.back());
+            chain.push_back(std::move(next));
+        }
+        return chain;
+    }
+
+    //filtering runs on float images so rounding does not accumulate down the chain
+    FloatImage current = toFloat(base, texClass);
+    chain.push_back(std::move(base));
+    while (current.width > 1 || current.height > 1)
+    {
+        current = downsampleFiltered(current);
+        if (texClass == TextureClass::Normal)
+        {
+            for (size_t i = 0; i < current.data.size(); i += 4)
+            {
+                float* n = &current.data[i];
+                float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                if (length > 0.0f)
+                {
+                    n[0] /= length;
+                    n[1] /= length;
+                    n[2] /= length;
+                }
+                else
+                {
+                    n[0] = n[1] = 0.0f;
+                    n[2] = 1.0f;
+                }
+            }
+        }
+        chain.push_back(fromFloat(current, texClass));
+    }
+    return chain;
+}
+
+const std::array<float, MipGenerator::kaiserTaps>& MipGenerator::kaiserWeights()
+{
+    //windowed sinc for a 2:1 reduction, taps sit 0.5, 1.5 and 2.5 source texels either side of the center
+    static const std::array<float, kaiserTaps> weights = [] {
+        const float alpha = 4.0f;
+        const float halfWidth = kaiserTaps / 4.0f;
+        std::array<float, kaiserTaps> result;
+        float sum = 0.0f;
+        for (int i = 0; i < kaiserTaps; ++i)
+        {
+            float x = (i - (kaiserTaps - 1) * 0.5f) * 0.5f;
+            float sinc = std::sin(pi * x) / (pi * x);
+            float ratio = x / halfWidth;
+            float window = besselI0(alpha * std::sqrt(std::max(1.0f - ratio * ratio, 0.0f))) / besselI0(alpha);
+            result[i] = sinc * window;
+            sum += result[i];
+        }
+        for (auto& i : result)
+            i /= sum;
+        return result;
+    }();
+    return weights;
+}
+
+MipGenerator::FloatImage MipGenerator::toFloat(const Level& level, TextureClass texClass)
+{
+    const auto& table = srgbToLinearTable();
+    FloatImage image{ level.width, level.height };
+    image.data.resize(level.data.size());
+    parallelFor(level.height, [&](size_t y) {
+        size_t begin = y * level.width * 4, end = begin + level.width * 4;
+        for (size_t i = begin; i < end; ++i)
+        {
+            unsigned char value = level.data[i];
+            bool alpha = (i & 3) == 3;
+            if (texClass == TextureClass::Color && !alpha)
+                image.data[i] = table[value];
+            else if (texClass == TextureClass::Normal && !alpha)
+                image.data[i] = value / 255.0f * 2.0f - 1.0f;
+            else
+                image.data[i] = value / 255.0f;
+        }
+    });
+    return image;
+}
+
+MipGenerator::Level MipGenerator::fromFloat(const FloatImage& image, TextureClass texClass)
+{
+    const auto& table = linearToSrgbTable();
+    Level level{ image.width, image.height };
+    level.data.resize(image.data.size());
+    parallelFor(image.height, [&](size_t y) {
+        size_t begin = y * image.width * 4, end = begin + image.width * 4;
+        for (size_t i = begin; i < end; ++i)
+        {
+            float value = image.data[i];
+            bool alpha = (i & 3) == 3;
+            if (texClass == TextureClass::Color && !alpha)
+                level.data[i] = table[static_cast<int>(std::min(std::max(value, 0.0f), 1.0f) * 4095.0f + 0.5f)];
+            else if (texClass == TextureClass::Normal && !alpha)
+                level.data[i] = toUnorm8(value * 0.5f + 0.5f);
+            else
+                level.data[i] = toUnorm8(value);
+        }
+    });
+    return level;
+}
+
+MipGenerator::FloatImage MipGenerator::downsampleFiltered(const FloatImage& src)
+{
+    const auto& weights = kaiserWeights();
+    bool reduceX = src.width > 1, reduceY = src.height > 1;
+
+    //separable: halve the width first, then the height, wrapping like GL_REPEAT
+    FloatImage horizontal{ reduceX ? src.width / 2 : 1, src.height };
+    horizontal.data.resize(static_cast<size_t>(horizontal.width) * horizontal.height * 4);
+    parallelFor(horizontal.height, [&](size_t y) {
+        for (int x = 0; x < horizontal.width; ++x)
+        {
+            float sum[4] = {};
+            for (int k = 0; k < kaiserTaps; ++k)
+            {
+                int sx = reduceX ? wrap(x * 2 - kaiserTaps / 2 + 1 + k, src.width) : x;
+                const float* texel = &src.data[(y * src.width + sx) * 4];
+                for (int c = 0; c < 4; ++c)
+                    sum[c] += weights[k] * texel[c];
+            }
+            std::copy(sum, sum + 4, &horizontal.data[(y * horizontal.width + x) * 4]);
+        }
+    });
+
+    FloatImage result{ horizontal.width, reduceY ? src.height / 2 : 1 };
+    result.data.resize(static_cast<size_t>(result.width) * result.height * 4);
+    parallelFor(result.height, [&](size_t y) {
+        for (int x = 0; x < result.width; ++x)
+        {
+            float sum[4] = {};
+            for (int k = 0; k < kaiserTaps; ++k)
+            {
+                int sy = reduceY ? wrap(static_cast<int>(y) * 2 - kaiserTaps / 2 + 1 + k, horizontal.height) : static_cast<int>(y);
+                const float* texel = &horizontal.data[(sy * horizontal.width + x) * 4];
+                for (int c = 0; c < 4; ++c)
+                    sum[c] += weights[k] * texel[c];
+            }
+            std::copy(sum, sum + 4, &result.data[(y * result.width + x) * 4]);
+        }
+    });
+    return result;
+}
+
+MipGenerator::Level MipGenerator::downsampleMin(const Level& src)
+{
+    Level dst{ std::max(src.width / 2, 1), std::max(src.height / 2, 1) };
+    dst.data.resize(static_cast<size_t>(dst.width) * dst.height * 4);
+    parallelFor(dst.height, [&](size_t y) {
+        int y0 = std::min(static_cast<int>(y) * 2, src.height - 1), y1 = std::min(static_cast<int>(y) * 2 + 1, src.height - 1);
+        for (int x = 0; x < dst.width; ++x)
+        {
+            int x0 = std::min(x * 2, src.width - 1), x1 = std::min(x * 2 + 1, src.width - 1);
+            for (int c = 0; c < 4; ++c)
+            {
+                unsigned char value = std::min(std::min(src.data[(y0 * src.width + x0) * 4 + c], src.data[(y0 * src.width + x1) * 4 + c]),
+                    std::min(src.data[(y1 * src.width + x0) * 4 + c], src.data[(y1 * src.width + x1) * 4 + c]));
+                dst.data[(y * dst.width + x) * 4 + c] = value;
+            }
+        }
+    });
+    return dst;
+}
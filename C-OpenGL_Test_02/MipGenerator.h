@@ -0,0 +1,30 @@
+#pragma once
+#include<array>
+#include<vector>
+#include"TextureCompressor.h"
+
+//builds full mip chains on the CPU, the filter depends on what the texture holds:
+//color is filtered in linear space, normals are renormalized, parallax depth maps keep the per-level minimum
+class MipGenerator
+{
+public:
+    using Level = TextureCompressor::Level;
+    using TextureClass = TextureCompressor::TextureClass;
+
+    static std::vector<Level> build(Level base, TextureClass texClass);
+
+private:
+    struct FloatImage
+    {
+        int width, height;
+        std::vector<float> data;
+    };
+
+    constexpr static int kaiserTaps = 6;
+
+    static const std::array<float, kaiserTaps>& kaiserWeights();
+    static FloatImage toFloat(const Level& level, TextureClass texClass);
+    static Level fromFloat(const FloatImage& image, TextureClass texClass);
+    static FloatImage downsampleFiltered(const FloatImage& src);
+    static Level downsampleMin(const Level& src);
+};
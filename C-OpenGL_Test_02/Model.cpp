@@ -1,23 +1,279 @@
 #include "Model.h"
 #include<qdebug.h>
+#include<algorithm>
+#include<atomic>
+#include<chrono>
+#include<cmath>
+#include<random>
+#include<thread>
+#include"ParallelFor.h"
+#include"AssetPack.h"
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::duration;
+
+namespace
+{
+    double elapsedMs(steady_clock::time_point begin)
+    {
+        return duration_cast<duration<double, std::milli>>(steady_clock::now() - begin).count();
+    }
+}
 
 Model::Model()
 {
 }
 
-void Model::loadModel(std::string path)
+bool Model::loadModel(std::string path, const std::function<void(float)>& progress)
 {
+    auto begin = steady_clock::now();
     Assimp::Importer importer;
+    //the obj, its materials and anything else the importer opens come out of the asset pack when it holds them
+    importer.SetIOHandler(AssetPack::createIOSystem());
     const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
 
+    //may run on a loader thread, so failing must not take the whole program down
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
     {
-        qFatal((std::string("Error assimp::") + std::string(importer.GetErrorString())).c_str());
-        return;
+        qWarning() << "Error assimp::" << importer.GetErrorString();
+        return false;
     }
     this->path = path;
     directory = path.substr(0, path.find_last_of('/'));
-    processNode(scene->mRootNode, scene);
+    statistics = Stats{};
+    statistics.importMs = elapsedMs(begin);
+
+    //materials first, texture_loaded is shared so it is filled before the meshes go wide
+    begin = steady_clock::now();
+    std::vector<std::vector<std::shared_ptr<Mesh::Texture>>> materialTextures(scene->mNumMaterials);
+    for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
+    {
+        aiMaterial* material = scene->mMaterials[i];
+        std::vector<std::shared_ptr<Mesh::Texture>> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, Mesh::TextureType::Diffuse);
+        std::vector<std::shared_ptr<Mesh::Texture>> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, Mesh::TextureType::Specular);
+        materialTextures[i].insert(materialTextures[i].end(), diffuseMaps.begin(), diffuseMaps.end());
+        materialTextures[i].insert(materialTextures[i].end(), specularMaps.begin(), specularMaps.end());
+    }
+
+    //every scene mesh is converted once, however many nodes use it
+    const std::vector<std::shared_ptr<Mesh::Texture>> noTextures;
+    std::vector<std::unique_ptr<Mesh>> converted(scene->mNumMeshes);
+    std::atomic<unsigned int> convertedNum{ 0 };
+    parallelFor(scene->mNumMeshes, [&](size_t i) {
+        aiMesh* mesh = scene->mMeshes[i];
+        const auto& textures = mesh->mMaterialIndex < materialTextures.size() ? materialTextures[mesh->mMaterialIndex] : noTextures;
+        converted[i] = std::make_unique<Mesh>(processMesh(mesh, textures));
+        if (progress)
+            progress(static_cast<float>(++convertedNum) / scene->mNumMeshes);
+    });
+    meshes.clear();
+    meshes.reserve(scene->mNumMeshes);
+    for (auto& i : converted)
+        meshes.push_back(std::move(*i));
+
+    std::vector<std::vector<glm::mat4>> transforms(meshes.size());
+    processNode(scene->mRootNode, glm::mat4(1.0f), transforms);
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        size_t refs = transforms[i].size();
+        meshes[i].setNodeTransforms(std::move(transforms[i]));
+        statistics.nodeRefs += static_cast<unsigned int>(refs);
+        statistics.vertices += scene->mMeshes[i]->mNumVertices;
+        statistics.bufferBytes += meshes[i].bufferBytes();
+        statistics.perReferenceBytes += (meshes[i].bufferBytes() - refs * sizeof(InstanceTransform)) * refs;
+    }
+    statistics.meshes = static_cast<unsigned int>(meshes.size());
+    statistics.convertMs = elapsedMs(begin);
+    buildBvh(JobSystem::instance());
+    return true;
+}
+
+void Model::buildBvh(JobSystem& jobs)
+{
+    auto begin = steady_clock::now();
+    //meshes go wide and so do the large subtrees inside each mesh, so one big mesh does not leave the other threads idle
+    meshBvhs.clear();
+    meshBvhs.resize(meshes.size());
+    jobs.parallelFor(meshes.size(), 1, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i)
+        {
+            const std::vector<Mesh::Vertex>& vertices = meshes[i].getVertices();
+            std::vector<glm::vec3> positions(vertices.size());
+            for (size_t k = 0; k < vertices.size(); ++k)
+                positions[k] = vertices[k].position;
+            meshBvhs[i].build(positions, meshes[i].getIndices(), jobs);
+        }
+    });
+
+    std::vector<SceneBvh::Instance> instances;
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        for (auto& node : meshes[i].getNodeTransforms())
+            instances.push_back(SceneBvh::Instance{ &meshBvhs[i], node.model, static_cast<unsigned int>(i) });
+    }
+    sceneBvh.build(instances, jobs);
+
+    statistics.triangles = 0;
+    statistics.bvhBytes = sceneBvh.bytes();
+    for (auto& i : meshBvhs)
+    {
+        statistics.triangles += i.stats().triangles;
+        statistics.bvhBytes += i.stats().bytes;
+    }
+    statistics.bvhMs = elapsedMs(begin);
+}
+
+const SceneBvh& Model::bvh() const
+{
+    return sceneBvh;
+}
+
+void Model::benchmarkBvh(const std::string& path)
+{
+    Model model;
+    if (!model.loadModel(path))
+        return;
+    qDebug() << "bvh over" << model.statistics.triangles << "triangles in" << model.meshes.size() << "meshes," << model.sceneBvh.instances().size() << "instances";
+
+    int maxThreads = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+    double baseMs = 0.0;
+    for (int threads = 1; threads <= maxThreads; ++threads)
+    {
+        JobSystem system(threads - 1);
+        double bestMs = 1e30;
+        for (int run = 0; run < 3; ++run)
+        {
+            model.buildBvh(system);
+            bestMs = std::min(bestMs, model.statistics.bvhMs);
+        }
+        if (threads == 1)
+            baseMs = bestMs;
+        qDebug() << "  build with" << threads << "threads:" << bestMs << "ms, speedup" << baseMs / bestMs;
+    }
+    const SceneBvh& bvh = model.sceneBvh;
+    qDebug() << "  " << model.statistics.bvhBytes / 1024 << "KiB of nodes and triangles";
+
+    //rays from a sphere around the model at random points inside it, and a pinhole camera grid traced in 2x2 quads
+    Bvh::Bounds bounds = bvh.bounds();
+    glm::vec3 center = (bounds.lower + bounds.upper) * 0.5f;
+    float radius = glm::length(bounds.upper - bounds.lower) * 0.5f;
+    std::default_random_engine dre(11);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    auto randomDirection = [&] {
+        glm::vec3 direction;
+        do
+            direction = glm::vec3(unit(dre), unit(dre), unit(dre));
+        while (glm::dot(direction, direction) > 1.0f || glm::dot(direction, direction) < 1e-4f);
+        return glm::normalize(direction);
+    };
+    std::vector<Bvh::Ray> scattered(1 << 18);
+    for (auto& i : scattered)
+    {
+        i.origin = center + randomDirection() * radius * 2.0f;
+        glm::vec3 target = center + (bounds.upper - bounds.lower) * 0.5f * glm::vec3(unit(dre), unit(dre), unit(dre));
+        i.direction = glm::normalize(target - i.origin);
+    }
+    constexpr int gridSize = 512;
+    std::vector<Bvh::Ray> grid(gridSize * gridSize);
+    glm::vec3 eye = center + glm::vec3(0.0f, 0.0f, radius * 2.5f);
+    for (int y = 0; y < gridSize; ++y)
+    {
+        for (int x = 0; x < gridSize; ++x)
+        {
+            //quads of neighbouring pixels are stored together
+            size_t index = ((y / 2) * (gridSize / 2) + x / 2) * 4 + (y % 2) * 2 + x % 2;
+            float u = (x + 0.5f) / gridSize * 2.0f - 1.0f, v = (y + 0.5f) / gridSize * 2.0f - 1.0f;
+            grid[index].origin = eye;
+            grid[index].direction = glm::normalize(glm::vec3(u * 0.45f, v * 0.45f, -1.0f));
+        }
+    }
+
+    auto rate = [](size_t count, steady_clock::time_point begin) {
+        return count / elapsedMs(begin) / 1000.0;
+    };
+    std::vector<Bvh::Hit> hits(grid.size());
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        const std::vector<Bvh::Ray>& rays = pass == 0 ? scattered : grid;
+        hits.assign(rays.size(), Bvh::Hit());
+        auto begin = steady_clock::now();
+        for (size_t i = 0; i < rays.size(); ++i)
+            bvh.intersect(rays[i], hits[i]);
+        double singleRate = rate(rays.size(), begin);
+
+        std::vector<Bvh::Hit> packetHits(rays.size());
+        begin = steady_clock::now();
+        for (size_t i = 0; i + 4 <= rays.size(); i += 4)
+            bvh.intersect(Bvh::RayPacket{ rays[i], rays[i + 1], rays[i + 2], rays[i + 3] }, &packetHits[i]);
+        double packetRate = rate(rays.size(), begin);
+
+        std::vector<Bvh::Hit> threadedHits(rays.size());
+        begin = steady_clock::now();
+        JobSystem::instance().parallelFor(rays.size(), 4096, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i)
+                bvh.intersect(rays[i], threadedHits[i]);
+        });
+        double threadedRate = rate(rays.size(), begin);
+
+        size_t hitNum = 0, mismatches = 0;
+        for (size_t i = 0; i < rays.size(); ++i)
+        {
+            hitNum += hits[i].valid();
+            if (hits[i].valid() != packetHits[i].valid() || (hits[i].valid() && std::abs(hits[i].distance - packetHits[i].distance) > 1e-4f * radius))
+                ++mismatches;
+        }
+        qDebug() << "  " << (pass == 0 ? "scattered" : "camera grid") << "rays:" << singleRate << "Mrays/s single," << packetRate << "Mrays/s in packets,"
+            << threadedRate << "Mrays/s on every thread," << hitNum << "hits," << mismatches << "packet mismatches";
+    }
+
+    //every triangle of every instance for a few of the scattered rays, which also checks the hits
+    size_t bruteNum = std::min<size_t>(scattered.size(), 256);
+    size_t bruteMismatches = 0;
+    hits.assign(bruteNum, Bvh::Hit());
+    for (size_t i = 0; i < bruteNum; ++i)
+        bvh.intersect(scattered[i], hits[i]);
+    auto begin = steady_clock::now();
+    for (size_t i = 0; i < bruteNum; ++i)
+    {
+        float nearest = std::numeric_limits<float>::max();
+        for (auto& instance : bvh.instances())
+        {
+            const Mesh& mesh = model.meshes[instance.id];
+            const std::vector<Mesh::Vertex>& vertices = mesh.getVertices();
+            const std::vector<unsigned int>& indices = mesh.getIndices();
+            for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            {
+                glm::vec3 a(instance.transform * glm::vec4(vertices[indices[t]].position, 1.0f));
+                glm::vec3 e1 = glm::vec3(instance.transform * glm::vec4(vertices[indices[t + 1]].position, 1.0f)) - a;
+                glm::vec3 e2 = glm::vec3(instance.transform * glm::vec4(vertices[indices[t + 2]].position, 1.0f)) - a;
+                glm::vec3 p = glm::cross(scattered[i].direction, e2);
+                float det = glm::dot(e1, p);
+                if (det == 0.0f)
+                    continue;
+                glm::vec3 offset = scattered[i].origin - a;
+                glm::vec3 q = glm::cross(offset, e1);
+                float u = glm::dot(offset, p) / det, v = glm::dot(scattered[i].direction, q) / det, distance = glm::dot(e2, q) / det;
+                if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && distance >= 0.0f)
+                    nearest = std::min(nearest, distance);
+            }
+        }
+        bool found = nearest < std::numeric_limits<float>::max();
+        if (found != hits[i].valid() || (found && std::abs(nearest - hits[i].distance) > 1e-4f * radius))
+            ++bruteMismatches;
+    }
+    qDebug() << "  brute force:" << rate(bruteNum, begin) << "Mrays/s," << bruteMismatches << "of" << bruteNum << "rays disagree with the bvh";
+
+    size_t pointNum = 1 << 14;
+    begin = steady_clock::now();
+    float distanceSum = 0.0f;
+    for (size_t i = 0; i < pointNum; ++i)
+    {
+        Bvh::Nearest nearest;
+        bvh.closestPoint(center + randomDirection() * radius * unit(dre), nearest);
+        distanceSum += nearest.distance;
+    }
+    qDebug() << "  closest point:" << rate(pointNum, begin) << "M queries/s, mean distance" << distanceSum / pointNum;
 }
 
 void Model::drawWithoutShaderBinding(QOpenGLShaderProgram* shader)
@@ -30,13 +286,60 @@ void Model::drawWithoutShaderBinding(QOpenGLShaderProgram* shader)
     }
 }
 
+void Model::record(CommandBuffer& commands, bool depthOnly) const
+{
+    for (auto& i : meshes)
+    {
+        if (!i.getNodeTransforms().empty())
+            i.record(commands, depthOnly);
+    }
+}
+
+void Model::recordIndirect(CommandBuffer& commands, unsigned int indirectBuffer, const std::vector<intptr_t>& offsets, bool depthOnly) const
+{
+    for (size_t i = 0; i < meshes.size() && i < offsets.size(); ++i)
+    {
+        if (!meshes[i].getNodeTransforms().empty())
+            meshes[i].recordIndirect(commands, indirectBuffer, offsets[i], depthOnly);
+    }
+}
+
+void Model::setInstanceSource(unsigned int buffer)
+{
+    for (auto& i : meshes)
+        i.setInstanceSource(buffer);
+}
+
+void Model::drawDepth(unsigned int instanceRepeat)
+{
+    for (auto& i : meshes)
+    {
+        if (!i.getNodeTransforms().empty())
+            i.drawDepth(instanceRepeat);
+    }
+}
+
+const std::vector<Mesh>& Model::getMeshes() const
+{
+    return meshes;
+}
+
+void Model::forEachMesh(const std::function<void(Mesh&)>& func)
+{
+    for (auto& i : meshes)
+    {
+        if (!i.getNodeTransforms().empty())
+            func(i);
+    }
+}
+
 void Model::instancedDrawWithoutShaderBinding(QOpenGLShaderProgram* shader, unsigned int instanceNum)
 {
     for (auto& i : meshes)
     {
         i.bind();
         i.setShaderVariables(shader);
-        i.glDrawElementsInstanced(GL_TRIANGLES, i.indicesNum, GL_UNSIGNED_INT, 0, instanceNum);
+        i.drawInstanced(instanceNum);
     }
 }
 
@@ -49,90 +352,129 @@ void Model::setAdditionalVertexAttribute(std::function<void()> func)
     }
 }
 
-void Model::init()
+const Model::Stats& Model::stats() const
+{
+    return statistics;
+}
+
+void Model::init(TextureStreamer& streamer)
+{
+    initBuffers();
+    initVertexArrays();
+    initTextures(streamer);
+}
+
+void Model::initBuffers()
+{
+    for (auto& i : meshes)
+    {
+        i.initBuffers();
+    }
+}
+
+void Model::prepareTextures(const std::function<void(float)>& progress)
+{
+    //decoding and compressing into the ktx2 cache is the slow part of a texture, the streamer then only reads the cache
+    std::atomic<size_t> prepared{ 0 };
+    parallelFor(texture_loaded.size(), 1, [&](size_t i) {
+        const auto& tex = texture_loaded[i];
+        auto texClass = tex->type == Mesh::TextureType::Diffuse ? TextureCompressor::TextureClass::Color : TextureCompressor::TextureClass::Single;
+        if (!TextureCompressor::cacheUpToDate(tex->path))
+            TextureCompressor::buildCache(tex->path, texClass);
+        if (progress)
+            progress(static_cast<float>(++prepared) / texture_loaded.size());
+    });
+}
+
+void Model::initVertexArrays()
 {
     for (auto& i : meshes)
     {
-        i.init();
+        i.initVertexArray();
     }
+}
+
+void Model::initTextures(TextureStreamer& streamer)
+{
     for (auto& i : texture_loaded)
     {
-        i->init();
+        i->init(streamer);
     }
 }
 
-void Model::processNode(aiNode* node, const aiScene* scene)
+void Model::requestTextureDetail(TextureStreamer& streamer, const glm::mat4& modelMat, const Camera& camera)
+{
+    //the projection runs as jobs, handing the sizes to the streamer stays on this thread
+    std::vector<float> screenSizes(meshes.size());
+    parallelFor(meshes.size(), 16, [&](size_t i) {
+        float screenSize = 0.0f;
+        for (auto& nodeTransform : meshes[i].getNodeTransforms())
+        {
+            glm::mat4 transform = modelMat * nodeTransform.model;
+            float scale = std::max(std::max(glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1]))), glm::length(glm::vec3(transform[2])));
+            glm::vec3 center = glm::vec3(transform * glm::vec4(meshes[i].boundsCenter, 1.0f));
+            screenSize = std::max(screenSize, camera.projectedSize(center, meshes[i].boundsRadius * scale));
+        }
+        screenSizes[i] = screenSize;
+    });
+    for (size_t i = 0; i < meshes.size(); ++i)
+        meshes[i].requestTextureDetail(streamer, screenSizes[i]);
+}
+
+glm::mat4 Model::toMat4(const aiMatrix4x4& matrix)
+{
+    //assimp is row major, glm column major
+    return glm::mat4(
+        matrix.a1, matrix.b1, matrix.c1, matrix.d1,
+        matrix.a2, matrix.b2, matrix.c2, matrix.d2,
+        matrix.a3, matrix.b3, matrix.c3, matrix.d3,
+        matrix.a4, matrix.b4, matrix.c4, matrix.d4);
+}
+
+void Model::processNode(aiNode* node, const glm::mat4& parentTransform, std::vector<std::vector<glm::mat4>>& transforms)
 {
+    glm::mat4 transform = parentTransform * toMat4(node->mTransformation);
     for (unsigned int i = 0; i < node->mNumMeshes; ++i)
     {
-        aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        meshes.push_back(processMesh(mesh, scene));
+        transforms[node->mMeshes[i]].push_back(transform);
     }
 
     for (unsigned int i = 0; i < node->mNumChildren; ++i)
     {
-        processNode(node->mChildren[i], scene);
+        processNode(node->mChildren[i], transform, transforms);
     }
 }
 
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
+Mesh Model::processMesh(aiMesh* mesh, const std::vector<std::shared_ptr<Mesh::Texture>>& textures)
 {
     using glm::vec3;
     using glm::vec2;
 
-    std::vector<Mesh::Vertex> vertices;
-    std::vector<unsigned int> indices;
-    std::vector<std::shared_ptr<Mesh::Texture>> textures;
-
+    std::vector<Mesh::Vertex> vertices(mesh->mNumVertices);
+    bool hasNormals = mesh->HasNormals();
+    bool hasTexCoords = mesh->HasTextureCoords(0);
     for (unsigned int i = 0; i < mesh->mNumVertices; ++i)
     {
-        Mesh::Vertex vertex;
-
-        vec3 vertexAndNormalVec;
-        vertexAndNormalVec.x = mesh->mVertices[i].x;
-        vertexAndNormalVec.y = mesh->mVertices[i].y;
-        vertexAndNormalVec.z = mesh->mVertices[i].z;
-        vertex.position = vertexAndNormalVec;
-
-        vertexAndNormalVec.x = mesh->mNormals[i].x;
-        vertexAndNormalVec.y = mesh->mNormals[i].y;
-        vertexAndNormalVec.z = mesh->mNormals[i].z;
-        vertex.normal = vertexAndNormalVec;
-
-        if (mesh->HasTextureCoords(0))
-        {
-            vec2 texCoords;
-            texCoords.x = mesh->mTextureCoords[0][i].x;
-            texCoords.y = mesh->mTextureCoords[0][i].y;
-            vertex.texCoords = texCoords;
-        }
-        else
-        {
-            vertex.texCoords = vec2{ 0.0f, 0.0f };
-        }
-
-        vertices.push_back(vertex);
+        Mesh::Vertex& vertex = vertices[i];
+        vertex.position = vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+        vertex.normal = hasNormals ? vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z) : vec3(0.0f, 1.0f, 0.0f);
+        vertex.texCoords = hasTexCoords ? vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y) : vec2(0.0f, 0.0f);
     }
 
+    size_t indexNum = 0;
     for (unsigned int i = 0; i < mesh->mNumFaces; ++i)
     {
-        aiFace face = mesh->mFaces[i];
-        for (unsigned int j = 0; j < face.mNumIndices; ++j)
-        {
-            indices.push_back(face.mIndices[j]);
-        }
+        indexNum += mesh->mFaces[i].mNumIndices;
     }
-
-    if (mesh->mMaterialIndex >= 0)
+    std::vector<unsigned int> indices(indexNum);
+    unsigned int* out = indices.data();
+    for (unsigned int i = 0; i < mesh->mNumFaces; ++i)
     {
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-        std::vector<std::shared_ptr<Mesh::Texture>> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, Mesh::TextureType::Diffuse);
-        std::vector<std::shared_ptr<Mesh::Texture>> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, Mesh::TextureType::Specular);
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        const aiFace& face = mesh->mFaces[i];
+        out = std::copy(face.mIndices, face.mIndices + face.mNumIndices, out);
     }
 
-    return Mesh(std::move(vertices), std::move(indices), std::move(textures));
+    return Mesh(std::move(vertices), std::move(indices), std::vector<std::shared_ptr<Mesh::Texture>>(textures));
 }
 
 std::vector<std::shared_ptr<Mesh::Texture>> Model::loadMaterialTextures(aiMaterial* material, aiTextureType type, Mesh::TextureType texType)
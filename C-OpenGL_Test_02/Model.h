@@ -8,25 +8,72 @@
 #include<assimp/scene.h>
 #include<assimp/postprocess.h>
 #include"Mesh.h"
+#include"Camera.h"
+#include"MeshBvh.h"
+#include"SceneBvh.h"
 
 
 class Model
 {
 public:
+    struct Stats
+    {
+        unsigned int meshes = 0;
+        unsigned int nodeRefs = 0;
+        size_t vertices = 0;
+        size_t bufferBytes = 0;
+        size_t perReferenceBytes = 0;   //what uploading a copy per node reference would take
+        double importMs = 0.0;
+        double convertMs = 0.0;
+        unsigned int triangles = 0;
+        size_t bvhBytes = 0;
+        double bvhMs = 0.0;
+    };
+
     Model();
 
-    void loadModel(std::string path);
-    void init();
+    //progress is called with the fraction of meshes converted so far, possibly from several threads at once
+    bool loadModel(std::string path, const std::function<void(float)>& progress = nullptr);
+    void init(TextureStreamer& streamer);
+    //the pieces of init, buffers and texture caches may be prepared on a loader thread
+    void initBuffers();
+    void prepareTextures(const std::function<void(float)>& progress = nullptr);
+    void initVertexArrays();
+    void initTextures(TextureStreamer& streamer);
+    //reports how large each mesh is on screen so its textures stream in at a matching level
+    void requestTextureDetail(TextureStreamer& streamer, const glm::mat4& modelMat, const Camera& camera);
     void drawWithoutShaderBinding(QOpenGLShaderProgram* shader);
+    //records every mesh with node references, the program and its uniforms are up to the caller
+    //depthOnly draws from the packed positions with no textures, for depth only programs
+    void record(CommandBuffer& commands, bool depthOnly = false) const;
+    //offsets holds the indirect draw of every mesh by mesh index, meshes without node references are skipped
+    void recordIndirect(CommandBuffer& commands, unsigned int indirectBuffer, const std::vector<intptr_t>& offsets, bool depthOnly = false) const;
+    void setInstanceSource(unsigned int buffer);
+    //every mesh with node references through Mesh::drawDepth
+    void drawDepth(unsigned int instanceRepeat);
+    const std::vector<Mesh>& getMeshes() const;
+    //for passes that draw the meshes their own way, meshes without node references are skipped
+    void forEachMesh(const std::function<void(Mesh&)>& func);
     void instancedDrawWithoutShaderBinding(QOpenGLShaderProgram* shader, unsigned int instanceNum);
     void setAdditionalVertexAttribute(std::function<void()> func);
+    const Stats& stats() const;
+    //a BVH over every mesh and one over the node references placing them, loadModel builds them on the global job system
+    void buildBvh(JobSystem& jobs);
+    //in model space, SceneBvh instances carry the mesh index as their id
+    const SceneBvh& bvh() const;
+    //times the BVH build from 1 to N threads, then single rays, packets and closest points against brute force
+    static void benchmarkBvh(const std::string& path);
 private:
     std::string path;
     std::vector<Mesh> meshes;
+    std::vector<MeshBvh> meshBvhs;
+    SceneBvh sceneBvh;
     std::string directory;
     std::vector<std::shared_ptr<Mesh::Texture>> texture_loaded;
+    Stats statistics;
 
-    void processNode(aiNode* node, const aiScene* scene);
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene);
+    static glm::mat4 toMat4(const aiMatrix4x4& matrix);
+    void processNode(aiNode* node, const glm::mat4& parentTransform, std::vector<std::vector<glm::mat4>>& transforms);
+    static Mesh processMesh(aiMesh* mesh, const std::vector<std::shared_ptr<Mesh::Texture>>& textures);
     std::vector<std::shared_ptr<Mesh::Texture>> loadMaterialTextures(aiMaterial* material, aiTextureType type, Mesh::TextureType texType);
 };
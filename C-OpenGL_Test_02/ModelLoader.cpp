@@ -0,0 +1,219 @@
+#include "ModelLoader.h"
+#include<qthread.h>
+#include<qdebug.h>
+#include<chrono>
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::duration;
+
+class ModelLoader::Thread :public QThread
+{
+public:
+    explicit Thread(ModelLoader& loader)
+        :loader(loader)
+    {
+    }
+
+protected:
+    void run() override
+    {
+        loader.workerLoop();
+    }
+
+private:
+    ModelLoader& loader;
+};
+
+ModelLoader::ModelLoader()
+{
+}
+
+ModelLoader::~ModelLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (thread)
+        thread->wait();
+}
+
+void ModelLoader::init(QOpenGLContext* shareContext)
+{
+    QOpenGLFunctions_4_5_Core::initializeOpenGLFunctions();
+    guiThread = QThread::currentThread();
+
+    //the surface has to be created on the GUI thread, the context is handed to the worker before it is made current
+    surface = std::make_unique<QOffscreenSurface>();
+    surface->setFormat(shareContext->format());
+    surface->create();
+    context = std::make_unique<QOpenGLContext>();
+    context->setFormat(shareContext->format());
+    context->setShareContext(shareContext);
+    if (!surface->isValid() || !context->create())
+    {
+        qWarning() << "model loader context could not be created, models load on the GUI thread";
+        context.reset();
+        return;
+    }
+
+    thread = std::make_unique<Thread>(*this);
+    context->moveToThread(thread.get());
+    thread->start();
+}
+
+std::shared_ptr<ModelLoader::Load> ModelLoader::load(const std::string& path)
+{
+    auto result = std::make_shared<Load>();
+    result->path = path;
+    if (!thread)
+    {
+        runLoad(*result, *this);
+        std::lock_guard<std::mutex> lock(mutex);
+        uploaded.push_back(result);
+        return result;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.push_back(result);
+    wake.notify_one();
+    return result;
+}
+
+void ModelLoader::update(TextureStreamer& streamer)
+{
+    std::vector<std::shared_ptr<Load>> waiting;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        waiting.swap(uploaded);
+    }
+
+    std::vector<std::shared_ptr<Load>> notReady;
+    for (auto& i : waiting)
+    {
+        if (i->state == State::Failed)
+            continue;
+        //a zero timeout only polls, the frame never waits on the loader
+        GLenum status = glClientWaitSync(i->fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+        {
+            notReady.push_back(i);
+            continue;
+        }
+        glDeleteSync(i->fence);
+        i->fence = nullptr;
+        //GL_WAIT_FAILED never turns into signalled, polling it again would keep the load pending forever
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            i->progress = 1.0f;
+            i->state = State::Failed;
+            qWarning() << "model" << QString::fromStdString(i->path) << "failed, waiting on its upload fence returned" << status;
+            continue;
+        }
+
+        auto begin = steady_clock::now();
+        i->model.initVertexArrays();
+        i->model.initTextures(streamer);
+        double finishMs = duration_cast<duration<double, std::milli>>(steady_clock::now() - begin).count();
+        i->progress = 1.0f;
+        i->state = State::Ready;
+        qDebug() << "model" << QString::fromStdString(i->path) << "ready after" << i->loadMs << "ms off thread," << finishMs << "ms on the GUI thread";
+        const Model::Stats& modelStats = i->model.stats();
+        qDebug() << "  import" << modelStats.importMs << "ms, convert" << modelStats.convertMs << "ms," << modelStats.meshes << "meshes drawn through" << modelStats.nodeRefs << "node references";
+        qDebug() << "  buffers" << modelStats.bufferBytes / 1024 << "KiB, a copy per reference would be" << modelStats.perReferenceBytes / 1024 << "KiB";
+        qDebug() << "  bvh over" << modelStats.triangles << "triangles built in" << modelStats.bvhMs << "ms," << modelStats.bvhBytes / 1024 << "KiB";
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    uploaded.insert(uploaded.end(), notReady.begin(), notReady.end());
+}
+
+int ModelLoader::loading() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return static_cast<int>(queue.size() + uploaded.size()) + active;
+}
+
+const char* ModelLoader::stateName(State state)
+{
+    switch (state)
+    {
+    case State::Queued:
+        return "queued";
+    case State::Importing:
+        return "importing";
+    case State::PreparingTextures:
+        return "preparing textures";
+    case State::Uploading:
+        return "uploading";
+    case State::WaitingForGpu:
+        return "waiting for gpu";
+    case State::Ready:
+        return "ready";
+    default:
+        return "failed";
+    }
+}
+
+void ModelLoader::workerLoop()
+{
+    context->makeCurrent(surface.get());
+    QOpenGLFunctions_4_5_Core gl;
+    gl.initializeOpenGLFunctions();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [this] {
+            return stopping || !queue.empty();
+        });
+        if (stopping)
+            break;
+        std::shared_ptr<Load> current = queue.front();
+        queue.pop_front();
+        ++active;
+        lock.unlock();
+        runLoad(*current, gl);
+        lock.lock();
+        --active;
+        if (current->state != State::Failed)
+            uploaded.push_back(current);
+    }
+
+    //hand the context back so it is destroyed on the thread that made it
+    context->doneCurrent();
+    context->moveToThread(guiThread);
+}
+
+void ModelLoader::runLoad(Load& load, QOpenGLFunctions_4_5_Core& gl)
+{
+    auto begin = steady_clock::now();
+
+    //import 0 - 50%, texture caches 50 - 90%, buffers up to 95%, the rest is the GUI side
+    load.state = State::Importing;
+    bool loaded = load.model.loadModel(load.path, [&load](float done) {
+        load.progress = done * 0.5f;
+    });
+    if (!loaded)
+    {
+        load.progress = 1.0f;
+        load.state = State::Failed;
+        return;
+    }
+
+    load.state = State::PreparingTextures;
+    load.model.prepareTextures([&load](float done) {
+        load.progress = 0.5f + done * 0.4f;
+    });
+
+    load.state = State::Uploading;
+    load.model.initBuffers();
+    load.fence = gl.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    //the fence has to reach the GPU before another context can wait on it
+    gl.glFlush();
+    load.progress = 0.95f;
+    load.loadMs = duration_cast<duration<double, std::milli>>(steady_clock::now() - begin).count();
+    load.state = State::WaitingForGpu;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include<qopenglfunctions_4_5_core.h>
+#include<qopenglcontext.h>
+#include<qoffscreensurface.h>
+#include<atomic>
+#include<condition_variable>
+#include<deque>
+#include<memory>
+#include<mutex>
+#include<string>
+#include<vector>
+#include"Model.h"
+#include"TextureStreamer.h"
+
+//imports models on a worker thread that owns a context shared with the widget, buffers are filled there
+//and a fence tells the GUI thread when it may build the VAOs and start drawing the model
+class ModelLoader :protected QOpenGLFunctions_4_5_Core
+{
+public:
+    enum class State
+    {
+        Queued, Importing, PreparingTextures, Uploading, WaitingForGpu, Ready, Failed
+    };
+
+    struct Load
+    {
+        std::string path;
+        std::atomic<State> state{ State::Queued };
+        std::atomic<float> progress{ 0.0f };
+        Model model;
+        double loadMs = 0.0;
+        GLsync fence = nullptr;
+    };
+
+    ModelLoader();
+    ~ModelLoader();
+
+    //call on the GUI thread while shareContext is current
+    void init(QOpenGLContext* shareContext);
+    std::shared_ptr<Load> load(const std::string& path);
+    //call once a frame on the GUI thread, finishes every load whose fence has signaled
+    void update(TextureStreamer& streamer);
+    int loading() const;
+
+    static const char* stateName(State state);
+
+private:
+    class Thread;
+
+    std::unique_ptr<QOffscreenSurface> surface;
+    std::unique_ptr<QOpenGLContext> context;
+    std::unique_ptr<Thread> thread;
+    QThread* guiThread = nullptr;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::shared_ptr<Load>> queue;
+    std::vector<std::shared_ptr<Load>> uploaded;
+    int active = 0;
+    bool stopping = false;
+
+    void workerLoop();
+    //everything that does not need the drawing context, gl is whichever context is current
+    static void runLoad(Load& load, QOpenGLFunctions_4_5_Core& gl);
+};
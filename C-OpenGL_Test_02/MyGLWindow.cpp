@@ -1,9 +1,15 @@
 #include "MyGLWindow.h"
 
 #include<qimage.h>
+#include<qcoreapplication.h>
+#include<qfileinfo.h>
 #include<QKeyEvent>
+#include<algorithm>
 #include<cmath>
+#include<cstdint>
+#include<fstream>
 #include<memory>
+#include"AssetPack.h"
 
 using std::chrono::steady_clock;
 using std::chrono::duration_cast;
@@ -35,16 +41,48 @@ MyGLWindow::MyGLWindow(QWidget* parent)
     format.setProfile(QSurfaceFormat::CoreProfile);
     format.setRenderableType(QSurfaceFormat::OpenGL);
     format.setVersion(4, 5);
+
+    QStringList arguments = QCoreApplication::arguments();
+    int captureArgument = arguments.indexOf("--capture");
+    if (captureArgument >= 0 && captureArgument + 1 < arguments.size())
+        capturePath = arguments.at(captureArgument + 1).toStdString();
+    int recordArgument = arguments.indexOf("--record");
+    if (recordArgument >= 0 && recordArgument + 1 < arguments.size())
+    {
+        recordPath = arguments.at(recordArgument + 1).toStdString();
+        recordFromStart = true;
+    }
+    int recordFormatArgument = arguments.indexOf("--record-format");
+    if (recordFormatArgument >= 0 && recordFormatArgument + 1 < arguments.size()
+        && !FrameCapture::parseFormat(arguments.at(recordFormatArgument + 1).toStdString(), recordFormat))
+        qWarning() << "unknown record format" << arguments.at(recordFormatArgument + 1);
+    int replayArgument = arguments.indexOf("--replay");
+    if (replayArgument >= 0 && replayArgument + 1 < arguments.size() && replayTrace.load(arguments.at(replayArgument + 1).toStdString()))
+    {
+        replayPath = arguments.at(replayArgument + 1).toStdString();
+        replayChecksums = arguments.contains("--checksum");
+        //frames are produced as fast as possible at the size the trace was captured at
+        format.setSwapInterval(0);
+        resize(replayTrace.width, replayTrace.height);
+    }
     setFormat(format);
 }
 
 MyGLWindow::~MyGLWindow()
 {
+    if (!capturePath.empty() && simulation.capturing())
+    {
+        InputTrace trace = simulation.stopCapture();
+        if (trace.save(capturePath))
+            qDebug() << "trace with" << trace.events.size() << "events over" << trace.cameras.size() << "ticks saved to" << QString::fromStdString(capturePath);
+    }
+    //left current so the members release their GL objects into the context that made them
+    makeCurrent();
 }
 
 void MyGLWindow::initializeGL()
 {
-    programBeginPoint = lastTimePoint = std::chrono::steady_clock::now();
+    programBeginPoint = lastTimePoint = lastStatsPoint = std::chrono::steady_clock::now();
     std::default_random_engine dre(std::chrono::system_clock::now().time_since_epoch().count());
 
     QOpenGLFunctions_4_5_Core::initializeOpenGLFunctions();
@@ -58,12 +96,11 @@ void MyGLWindow::initializeGL()
     //set up box
     glPrimitiveRestartIndex(0xFFFF);
     glEnable(GL_PRIMITIVE_RESTART);
-    glGenVertexArrays(1, &box.vao);
-    glGenBuffers(1, &box.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, box.vbo);
-    glBufferData(GL_ARRAY_BUFFER, box.vertices.size() * sizeof(float), box.vertices.data(), GL_STATIC_DRAW);
-    glBindVertexArray(box.vao);
-    glBindBuffer(GL_ARRAY_BUFFER, box.vbo);
+    GpuResources& gpu = GpuResources::instance();
+    box.vao = gpu.createVertexArray("box");
+    box.vbo = gpu.createBuffer(box.vertices.size() * sizeof(float), box.vertices.data(), 0, "box vertices");
+    glBindVertexArray(box.vao.get());
+    glBindBuffer(GL_ARRAY_BUFFER, box.vbo.get());
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), 0);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
@@ -72,22 +109,14 @@ void MyGLWindow::initializeGL()
     glEnableVertexAttribArray(2);
     glBindVertexArray(0);
 
-    //init box model mat
-    std::vector<mat4> modelMats;
-    modelMats.push_back(mat4{ 1.0f });
-    modelMats.push_back(translate(mat4{ 1.0f }, vec3{ 0.0f,1.5f,0.0f }) * scale(mat4{ 1.0f }, vec3(0.5f)));
-    modelMats.push_back(translate(mat4{ 1.0f }, vec3(-1.0f, 0.0f, 2.0f))
-        * rotate(mat4{ 1.0f }, radians(60.0f), normalize(vec3(1.0f, 0.0f, 1.0f)))
-        * scale(mat4{ 1.0f }, vec3(0.25f)));
-    glGenBuffers(1, &box.modelMatVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, box.modelMatVbo);
-    glBufferStorage(GL_ARRAY_BUFFER, modelMats.size() * sizeof(mat4), modelMats.data(), 0);
-    glBindVertexArray(box.vao);
-    glBindBuffer(GL_ARRAY_BUFFER, box.modelMatVbo);
-    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float), 0);
-    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (void*)(4 * sizeof(float)));
-    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (void*)(8 * sizeof(float)));
-    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (void*)(12 * sizeof(float)));
+    //box model and normal mats, written from the simulation snapshot every frame
+    box.modelMatVbo = gpu.createBuffer(Simulation::boxNum * sizeof(InstanceTransform), nullptr, 0, "box model mats");
+    glBindVertexArray(box.vao.get());
+    glBindBuffer(GL_ARRAY_BUFFER, box.modelMatVbo.get());
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), 0);
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (void*)(4 * sizeof(float)));
+    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (void*)(8 * sizeof(float)));
+    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (void*)(12 * sizeof(float)));
     glEnableVertexAttribArray(3);
     glEnableVertexAttribArray(4);
     glEnableVertexAttribArray(5);
@@ -96,15 +125,20 @@ void MyGLWindow::initializeGL()
     glVertexAttribDivisor(4, 1);
     glVertexAttribDivisor(5, 1);
     glVertexAttribDivisor(6, 1);
+    //the normal mats follow the model mat of the same instance, so the shaders need no inverse
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        glVertexAttribPointer(13 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (void*)(sizeof(mat4) + i * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(13 + i);
+        glVertexAttribDivisor(13 + i, 1);
+    }
     glBindVertexArray(0);
 
     //init plane
-    glGenVertexArrays(1, &plane.vao);
-    glGenBuffers(1, &plane.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, plane.vbo);
-    glBufferStorage(GL_ARRAY_BUFFER, plane.planeVertices.size() * sizeof(float), plane.planeVertices.data(), 0);
-    glBindVertexArray(plane.vao);
-    glBindBuffer(GL_ARRAY_BUFFER, plane.vbo);
+    plane.vao = gpu.createVertexArray("plane");
+    plane.vbo = gpu.createBuffer(plane.planeVertices.size() * sizeof(float), plane.planeVertices.data(), 0, "plane vertices");
+    glBindVertexArray(plane.vao.get());
+    glBindBuffer(GL_ARRAY_BUFFER, plane.vbo.get());
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), 0);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
@@ -117,66 +151,115 @@ void MyGLWindow::initializeGL()
     glVertexAttrib4fv(4, value_ptr(planeModel[1]));
     glVertexAttrib4fv(5, value_ptr(planeModel[2]));
     glVertexAttrib4fv(6, value_ptr(planeModel[3]));
+    for (unsigned int i = 0; i < 3; ++i)
+        glVertexAttrib4fv(13 + i, value_ptr(glm::vec4(planeModel[i])));
+    glBindVertexArray(0);
+
+    //tightly packed positions for the depth only passes, which would otherwise fetch all eight floats of a vertex
+    auto packPositions = [](const float* begin, const float* end) {
+        std::vector<vec3> positions;
+        for (const float* i = begin; i < end; i += 8)
+            positions.emplace_back(i[0], i[1], i[2]);
+        return positions;
+    };
+    std::vector<vec3> boxPositions = packPositions(box.vertices.data(), box.vertices.data() + box.vertices.size());
+    box.positionVbo = gpu.createBuffer(boxPositions.size() * sizeof(vec3), boxPositions.data(), 0, "box positions");
+    box.depthVao = gpu.createVertexArray("box depth");
+    glBindVertexArray(box.depthVao.get());
+    glBindBuffer(GL_ARRAY_BUFFER, box.positionVbo.get());
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), 0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, box.modelMatVbo.get());
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (void*)(i * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(3 + i);
+        glVertexAttribDivisor(3 + i, 1);
+    }
+    box.pointShadowVao = gpu.createVertexArray("box point shadow");
+    glBindVertexArray(box.pointShadowVao.get());
+    glBindBuffer(GL_ARRAY_BUFFER, box.positionVbo.get());
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), 0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, box.modelMatVbo.get());
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (void*)(i * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(3 + i);
+        glVertexAttribDivisor(3 + i, 6);
+    }
+
+    std::vector<vec3> planePositions = packPositions(plane.planeVertices.data(), plane.planeVertices.data() + plane.planeVertices.size());
+    plane.positionVbo = gpu.createBuffer(planePositions.size() * sizeof(vec3), planePositions.data(), 0, "plane positions");
+    plane.depthVao = gpu.createVertexArray("plane depth");
+    glBindVertexArray(plane.depthVao.get());
+    glBindBuffer(GL_ARRAY_BUFFER, plane.positionVbo.get());
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), 0);
+    glEnableVertexAttribArray(0);
     glBindVertexArray(0);
 
     //init plane tex
-    QImage image = QImage("./images/bricks.jpg").convertToFormat(QImage::Format_RGBA8888).mirrored();
-    glGenTextures(1, &plane.tex);
-    glBindTexture(GL_TEXTURE_2D, plane.tex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.width(), image.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, image.bits());
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    textureCompressor.init();
+    textureStreamer.init();
+    brickStreams[0] = textureStreamer.addTexture("./images/bricks.jpg", TextureCompressor::TextureClass::Color);
+    plane.tex = textureStreamer.texture(brickStreams[0]);
 
     //init depth map fbo
-    glGenFramebuffers(1, &ldMap.fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, ldMap.fbo);
-    glGenTextures(1, &ldMap.depthMap);
-    glBindTexture(GL_TEXTURE_2D, ldMap.depthMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, 1024, 1024, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    ldMap.depthMap = gpu.createTexture2D(GL_DEPTH_COMPONENT24, 1, 1024, 1024, "light depth map");
+    glTextureParameteri(ldMap.depthMap.get(), GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTextureParameteri(ldMap.depthMap.get(), GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTextureParameteri(ldMap.depthMap.get(), GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTextureParameteri(ldMap.depthMap.get(), GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
     float borderColor[] = { 1.0f,1.0f,1.0f,1.0f };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, ldMap.depthMap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+    glTextureParameterfv(ldMap.depthMap.get(), GL_TEXTURE_BORDER_COLOR, borderColor);
+    ldMap.fbo = gpu.createFramebuffer("light depth map");
+    glNamedFramebufferTexture(ldMap.fbo.get(), GL_DEPTH_ATTACHMENT, ldMap.depthMap.get(), 0);
+    glNamedFramebufferDrawBuffer(ldMap.fbo.get(), GL_NONE);
+    glNamedFramebufferReadBuffer(ldMap.fbo.get(), GL_NONE);
 
     //init test shader
     testShader.create();
-    testShader.addShaderFromSourceFile(QOpenGLShader::Vertex, "./shaders/parallaxMapping.vert");
-    testShader.addShaderFromSourceFile(QOpenGLShader::Fragment, "./shaders/parallaxMapping.frag");
+    AssetPack::addShader(testShader, QOpenGLShader::Vertex, "./shaders/parallaxMapping.vert");
+    AssetPack::addShader(testShader, QOpenGLShader::Fragment, "./shaders/parallaxMapping.frag");
+    AssetPack::addShader(testShader, QOpenGLShader::Fragment, "./shaders/clusteredLighting.frag");
+    AssetPack::addShader(testShader, QOpenGLShader::Fragment, "./shaders/parallaxSearch.frag");
     testShader.link();
 
+    //init depth prepass shaders
+    parallaxDepthShader.create();
+    AssetPack::addShader(parallaxDepthShader, QOpenGLShader::Vertex, "./shaders/parallaxMapping.vert");
+    AssetPack::addShader(parallaxDepthShader, QOpenGLShader::Fragment, "./shaders/parallaxDepth.frag");
+    AssetPack::addShader(parallaxDepthShader, QOpenGLShader::Fragment, "./shaders/parallaxSearch.frag");
+    parallaxDepthShader.link();
+    modelDepthShader.create();
+    AssetPack::addShader(modelDepthShader, QOpenGLShader::Vertex, "./shaders/modelDepth.vert");
+    AssetPack::addShader(modelDepthShader, QOpenGLShader::Fragment, "./shaders/emptyFrag.frag");
+    modelDepthShader.link();
+    depthPrepass.init();
+    pointShadows.init();
+    environmentLighting.init(EnvironmentLighting::skyboxFaces("./images/skybox"));
+    primitiveExpansion.init();
+    particleSystem.init();
+    particleSystem.setEmitter(vec3(1.5f, -0.5f, -1.5f), -0.5f);
+
     //init light map shader
     lightMapShader.create();
-    lightMapShader.addShaderFromSourceFile(QOpenGLShader::Vertex, "./shaders/lightMapping.vert");
-    lightMapShader.addShaderFromSourceFile(QOpenGLShader::Fragment, "./shaders/emptyFrag.frag");
+    AssetPack::addShader(lightMapShader, QOpenGLShader::Vertex, "./shaders/lightMapping.vert");
+    AssetPack::addShader(lightMapShader, QOpenGLShader::Fragment, "./shaders/emptyFrag.frag");
     lightMapShader.link();
 
     //init normal map
-    QImage normalImage = QImage("./images/bricksNormal.png").convertToFormat(QImage::Format_RGBA8888).mirrored();
-    glGenTextures(1, &normalTex);
-    glBindTexture(GL_TEXTURE_2D, normalTex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, normalImage.width(), normalImage.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, normalImage.bits());
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    brickStreams[1] = textureStreamer.addTexture("./images/bricksNormal.png", TextureCompressor::TextureClass::Normal);
+    normalTex = textureStreamer.texture(brickStreams[1]);
 
     //init displacement map
-    QImage displacementImage = QImage("./images/bricks2_disp.jpg").convertToFormat(QImage::Format_RGBA8888).mirrored();
-    glGenTextures(1, &displacementTex);
-    glBindTexture(GL_TEXTURE_2D, displacementTex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, displacementImage.width(), displacementImage.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, displacementImage.bits());
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    brickStreams[2] = textureStreamer.addTexture("./images/bricks2_disp.jpg", TextureCompressor::TextureClass::Height);
+    displacementTex = textureStreamer.texture(brickStreams[2]);
+
+    const TextureStreamer::Stats& texStats = textureStreamer.stats();
+    qDebug() << "textures:" << texStats.textures << "added," << texStats.cacheHits << "from ktx2 cache," << texStats.cacheBuilds << "building their cache in the background";
+    qDebug() << "  vram" << texStats.residentBytes / 1024 << "KiB resident, every level" << texStats.fullBytes / 1024 << "KiB, rgba8 would be" << texStats.rgba8Bytes / 1024 << "KiB";
+    qDebug() << "  load" << texStats.addMs << "ms on the GUI thread";
 
     auto caculateTB = [](std::array<vec3,3> vertices,std::array<vec2,3> texCoords)
         ->std::array<vec3, 2>
@@ -202,11 +285,12 @@ void MyGLWindow::initializeGL()
         return std::array<vec3, 2>{t, b};
     };
 
-    //caculate btn for box
+    //the two tangent sets are independent, compute them as jobs and upload once both are done
+    auto caculateTangentSpace = [&caculateTB](const float* begin, const float* end)
     {
         std::vector<vec3> vertices;
         std::vector<vec2> texCoords;
-        for (auto i = box.vertices.begin(); i != box.vertices.end(); i += 8)
+        for (auto i = begin; i != end; i += 8)
         {
             vertices.push_back(vec3(*i, *(i + 1), *(i + 2)));
             texCoords.push_back(vec2(*(i + 6), *(i + 7)));
@@ -225,13 +309,25 @@ void MyGLWindow::initializeGL()
             tangentSpace.push_back(TB[0]);
             tangentSpace.push_back(TB[1]);
         }
+        return tangentSpace;
+    };
+    std::vector<vec3> boxTangentSpace, planeTangentSpace;
+    JobSystem& jobs = JobSystem::instance();
+    auto boxTangentJob = jobs.run([&] {
+        boxTangentSpace = caculateTangentSpace(box.vertices.data(), box.vertices.data() + box.vertices.size());
+    });
+    auto planeTangentJob = jobs.run([&] {
+        planeTangentSpace = caculateTangentSpace(plane.planeVertices.data(), plane.planeVertices.data() + plane.planeVertices.size());
+    });
+    jobs.wait(boxTangentJob);
+    jobs.wait(planeTangentJob);
 
-        glGenBuffers(1, &box.tbnBuffer);
-        glBindBuffer(GL_ARRAY_BUFFER, box.tbnBuffer);
-        glBufferData(GL_ARRAY_BUFFER, tangentSpace.size() * sizeof(vec3), tangentSpace.data(), GL_STATIC_DRAW);
+    //caculate btn for box
+    {
+        box.tbnBuffer = gpu.createBuffer(boxTangentSpace.size() * sizeof(vec3), boxTangentSpace.data(), 0, "box tangent space");
 
-        glBindVertexArray(box.vao);
-        glBindBuffer(GL_ARRAY_BUFFER, box.tbnBuffer);
+        glBindVertexArray(box.vao.get());
+        glBindBuffer(GL_ARRAY_BUFFER, box.tbnBuffer.get());
         glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), 0);
         glVertexAttribPointer(8, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
         glEnableVertexAttribArray(7);
@@ -240,58 +336,251 @@ void MyGLWindow::initializeGL()
 
     //caculate btn for plane
     {
-        std::vector<vec3> vertices;
-        std::vector<vec2> texCoords;
-        for (auto i = plane.planeVertices.begin(); i != plane.planeVertices.end(); i += 8)
-        {
-            vertices.push_back(vec3(*i, *(i + 1), *(i + 2)));
-            texCoords.push_back(vec2(*(i + 6), *(i + 7)));
-        }
-
-        std::vector<vec3> tangentSpace;
-        for (auto i = 0; i < vertices.size(); i += 3)
-        {
-            std::array<vec3, 3> triangleVert{ vertices[i],vertices[i + 1],vertices[i + 2] };
-            std::array<vec2, 3> tiangleTexCoords{ texCoords[i],texCoords[i + 1],texCoords[i + 2] };
-            auto TB = caculateTB(triangleVert, tiangleTexCoords);
-            tangentSpace.push_back(TB[0]);
-            tangentSpace.push_back(TB[1]);
-            tangentSpace.push_back(TB[0]);
-            tangentSpace.push_back(TB[1]);
-            tangentSpace.push_back(TB[0]);
-            tangentSpace.push_back(TB[1]);
-        }
-
-        glGenBuffers(1, &plane.tbnBuffer);
-        glBindBuffer(GL_ARRAY_BUFFER, plane.tbnBuffer);
-        glBufferData(GL_ARRAY_BUFFER, tangentSpace.size() * sizeof(vec3), tangentSpace.data(), GL_STATIC_DRAW);
+        plane.tbnBuffer = gpu.createBuffer(planeTangentSpace.size() * sizeof(vec3), planeTangentSpace.data(), 0, "plane tangent space");
 
-        glBindVertexArray(plane.vao);
-        glBindBuffer(GL_ARRAY_BUFFER, plane.tbnBuffer);
+        glBindVertexArray(plane.vao.get());
+        glBindBuffer(GL_ARRAY_BUFFER, plane.tbnBuffer.get());
         glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), 0);
         glVertexAttribPointer(8, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
         glEnableVertexAttribArray(7);
         glEnableVertexAttribArray(8);
     }
+    glBindVertexArray(0);
+
+    //init screen quad
+    screenQuad.vao = gpu.createVertexArray("screen quad");
+    screenQuad.vbo = gpu.createBuffer(screenQuad.vertices.size() * sizeof(float), screenQuad.vertices.data(), 0, "screen quad");
+    glBindVertexArray(screenQuad.vao.get());
+    glBindBuffer(GL_ARRAY_BUFFER, screenQuad.vbo.get());
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), 0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glBindVertexArray(0);
+
+    //init output shader
+    outputShader.create();
+    AssetPack::addShader(outputShader, QOpenGLShader::Vertex, "./shaders/fboOutput.vert");
+    AssetPack::addShader(outputShader, QOpenGLShader::Fragment, "./shaders/fboOutput.frag");
+    outputShader.link();
+
+    //init post process
+    postProcess.init();
+    applyPostProcessPreset(postProcessPreset);
+
+    //init model shader, point lights come from the clusters and the spot light stays dark
+    modelShader.create();
+    AssetPack::addShader(modelShader, QOpenGLShader::Vertex, "./shaders/model.vert");
+    AssetPack::addShader(modelShader, QOpenGLShader::Fragment, "./shaders/model.frag");
+    AssetPack::addShader(modelShader, QOpenGLShader::Fragment, "./shaders/clusteredLighting.frag");
+    modelShader.link();
+    modelShader.bind();
+    glUniform1i(modelShader.uniformLocation("material.texture_diffuse1"), 0);
+    glUniform1i(modelShader.uniformLocation("material.texture_specular1"), 1);
+    glUniform1f(modelShader.uniformLocation("material.shininess"), 32.0f);
+    glUniform3fv(modelShader.uniformLocation("dirlight.direction"), 1, value_ptr(normalize(vec3(2.0f, -4.0f, 1.0f))));
+    glUniform3f(modelShader.uniformLocation("dirlight.ambient"), 0.2f, 0.2f, 0.2f);
+    glUniform3f(modelShader.uniformLocation("dirlight.diffuse"), 0.8f, 0.8f, 0.8f);
+    glUniform3f(modelShader.uniformLocation("dirlight.specular"), 0.5f, 0.5f, 0.5f);
+    glUniform1f(modelShader.uniformLocation("spotlight.constant"), 1.0f);
+    glUniform1f(modelShader.uniformLocation("spotlight.cutOff"), 1.0f);
+    glUniform1f(modelShader.uniformLocation("spotlight.outerCutOff"), 0.9f);
+    modelShader.release();
+    commandReplayer.init();
+    drawBenchmark.init();
+    vertexCost.init();
+    hiZCuller.init();
+    clusteredLights.init();
+    clusteredLights.setLightCount(lightCounts[lightCountPreset]);
+    transparency.init(textureStreamer);
+    frameCapture.init();
+    dynamicResolution.init();
+    //a replay has to draw the same pixels every run, whatever the GPU time
+    if (!replayPath.empty())
+        dynamicResolution.setEnabled(false);
+    if (recordFromStart)
+        frameCapture.start(recordPath, recordFormat);
+    transparency.setQuadCount(4000);
+    transparency.setMode(TransparencyPass::Mode::WeightedBlended);
+
+    //start loading the model, the window keeps rendering meanwhile
+    modelLoader.init(context());
+    QStringList arguments = QCoreApplication::arguments();
+    int modelArgument = arguments.indexOf("--model");
+    std::string modelPath = "./models/nanosuit/nanosuit.obj";
+    if (modelArgument >= 0 && modelArgument + 1 < arguments.size())
+        modelPath = arguments.at(modelArgument + 1).toStdString();
+    if (AssetPack::instance().exists(modelPath))
+        sceneModel = modelLoader.load(modelPath);
+
+    //--particles sets any count, small ones keep software rasterizers usable
+    int particleArgument = arguments.indexOf("--particles");
+    if (particleArgument >= 0 && particleArgument + 1 < arguments.size())
+        particleSystem.setCapacity(static_cast<unsigned int>(arguments.at(particleArgument + 1).toInt()));
+    else
+        particleSystem.setCapacity(particleCounts[particleCountPreset]);
+
+    int loadArgument = arguments.indexOf("--sim-load");
+    if (loadArgument >= 0 && loadArgument + 1 < arguments.size())
+        simulation.setLoad(arguments.at(loadArgument + 1).toFloat());
+    frameTimer.init();
+    if (!replayPath.empty())
+    {
+        //everything streams in at full detail before the replay starts so no frame depends on load timing
+        textureStreamer.budgetBytes = SIZE_MAX;
+        return;
+    }
+    if (!capturePath.empty())
+        simulation.startCapture(width(), height());
+    simulation.start();
 }
 
 void MyGLWindow::paintGL()
 {
-    mainCamera.caculateCamera();
     auto currentTime = std::chrono::steady_clock::now();
+    frameTimer.beginFrame(currentTime);
+    if (dynamicResolution.beginFrame())
+        resizeScene();
+    bool replayDone = false;
+    if (!replayPath.empty())
+    {
+        if (!replayStarted)
+        {
+            textureStreamer.requestAll();
+            bool modelSettled = !sceneModel || sceneModel->state == ModelLoader::State::Ready || sceneModel->state == ModelLoader::State::Failed;
+            if (modelSettled && modelLoader.loading() == 0 && textureStreamer.settled() && environmentLighting.settled())
+            {
+                qDebug() << "replaying" << QString::fromStdString(replayPath) << "," << replayTrace.cameras.size() << "ticks";
+                replayStarted = true;
+                programBeginPoint = lastTimePoint = currentTime;
+                replayWallBegin = currentTime;
+                simulation.startReplay(std::move(replayTrace), programBeginPoint);
+            }
+        }
+        if (replayStarted)
+        {
+            //frame n is rendered at virtual time n ticks, whatever the wall clock says
+            replayFrameMs.push_back(duration_cast<duration<float, std::milli>>(currentTime - replayWallBegin).count());
+            replayWallBegin = currentTime;
+            currentTime = programBeginPoint + duration_cast<steady_clock::duration>(duration<double>(Simulation::tickSeconds * replayFrame++));
+            replayDone = !simulation.advanceReplay(currentTime);
+        }
+    }
     float passedDuration = duration_cast<duration<float>>(currentTime - lastTimePoint).count();
     float timeFromBeginPoint = duration_cast<duration<float>>(currentTime - programBeginPoint).count();
     lastTimePoint = currentTime;
 
-    auto drawScene = [this] {
-        glBindVertexArray(box.vao);
+    //everything that moves comes from the simulation, blended between its last two ticks
+    Simulation::Frame simFrame = simulation.frame(currentTime);
+    mainCamera.position = simFrame.state.cameraPosition;
+    mainCamera.setOrientation(simFrame.state.yaw, simFrame.state.pitch);
+    std::array<mat4, Simulation::boxNum> boxMats;
+    for (int i = 0; i < Simulation::boxNum; ++i)
+        boxMats[i] = simFrame.state.boxes[i].matrix();
+    std::array<InstanceTransform, Simulation::boxNum> boxTransforms;
+    InstanceTransforms::compute(boxMats.data(), boxTransforms.data(), boxMats.size());
+    glNamedBufferSubData(box.modelMatVbo.get(), 0, sizeof(boxTransforms), boxTransforms.data());
+
+    modelLoader.update(textureStreamer);
+    bool modelReady = sceneModel && sceneModel->state == ModelLoader::State::Ready;
+    mat4 sceneModelMat = simFrame.state.model.matrix();
+    if (modelReady)
+        sceneModel->model.requestTextureDetail(textureStreamer, sceneModelMat, mainCamera);
+    if (modelReady && pickRequested)
+        pickModel(sceneModelMat);
+    pickRequested = false;
+
+    //stream the bricks at the detail of the largest surface using them
+    float brickSize = std::max(mainCamera.projectedSize(vec3(0.0f, -0.5f, 0.0f), std::sqrt(18.0f)), mainCamera.projectedSize(vec3(0.0f), std::sqrt(3.0f)));
+    for (int i : brickStreams)
+        textureStreamer.requestDetail(i, brickSize);
+    //a quad is a small part of the plane, but the nearest ones get much larger than that
+    transparency.requestTextureDetail(textureStreamer, brickSize * 0.25f);
+    textureStreamer.update();
+    environmentLighting.update();
+    particleSystem.simulate(simFrame.state.tick, static_cast<float>(Simulation::tickSeconds));
+
+    //every box and every mesh instance is a culling candidate, the instance order stays the same between frames
+    hiZCuller.beginFrame();
+    HiZCuller::Mode cullMode = hiZCuller.mode();
+    bool culling = cullMode != HiZCuller::Mode::Off;
+    int firstPhase = cullMode == HiZCuller::Mode::TwoPhase ? 1 : 0;
+    int boxGroup = -1;
+    std::vector<intptr_t> meshOffsets, lateMeshOffsets;
+    if (culling)
+    {
+        boxGroup = hiZCuller.addGroup(mat4{ 1.0f }, vec3(-1.0f), vec3(1.0f), boxTransforms.data(), Simulation::boxNum, HiZCuller::DrawInfo{ false, 36, 0, 0 });
+        std::vector<int> meshGroups;
+        if (modelReady)
+        {
+            //the bounding spheres are all the meshes keep, their boxes are loose but safe
+            for (auto& i : sceneModel->model.getMeshes())
+            {
+                const std::vector<InstanceTransform>& transforms = i.getNodeTransforms();
+                if (transforms.empty())
+                {
+                    meshGroups.push_back(-1);
+                    continue;
+                }
+                meshGroups.push_back(hiZCuller.addGroup(sceneModelMat, i.boundsCenter - vec3(i.boundsRadius), i.boundsCenter + vec3(i.boundsRadius),
+                    transforms.data(), static_cast<int>(transforms.size()), HiZCuller::DrawInfo{ true, i.indicesNum, 0, 0 }));
+            }
+        }
+        hiZCuller.upload();
+        for (int i : meshGroups)
+        {
+            meshOffsets.push_back(i < 0 ? 0 : hiZCuller.commandOffset(i, firstPhase));
+            lateMeshOffsets.push_back(i < 0 ? 0 : hiZCuller.commandOffset(i, 2));
+        }
+    }
+
+    JobSystem::JobHandle modelRecording;
+    bool prepass = depthPrepass.enabled();
+    if (modelReady)
+    {
+        unsigned int indirectBuffer = hiZCuller.commandBuffer();
+        modelRecording = JobSystem::instance().run([this, culling, prepass, indirectBuffer, meshOffsets, lateMeshOffsets] {
+            modelCommands.reset();
+            modelCommands.bindProgram(modelShader.programId());
+            modelDepthCommands.reset();
+            if (prepass)
+                modelDepthCommands.bindProgram(modelDepthShader.programId());
+            lateModelCommands.reset();
+            if (!culling)
+            {
+                sceneModel->model.record(modelCommands);
+                if (prepass)
+                    sceneModel->model.record(modelDepthCommands, true);
+                return;
+            }
+            sceneModel->model.recordIndirect(modelCommands, indirectBuffer, meshOffsets);
+            if (prepass)
+                sceneModel->model.recordIndirect(modelDepthCommands, indirectBuffer, meshOffsets, true);
+            lateModelCommands.bindProgram(modelShader.programId());
+            sceneModel->model.recordIndirect(lateModelCommands, indirectBuffer, lateMeshOffsets);
+        });
+    }
+
+    auto drawSceneDepth = [this] {
+        glBindVertexArray(box.depthVao.get());
         glDrawArraysInstanced(GL_TRIANGLES, 0, 36, 3);
-        glBindVertexArray(plane.vao);
+        glBindVertexArray(plane.depthVao.get());
         glDrawArrays(GL_TRIANGLES, 0, 6);
     };
+    //the culled boxes draw whatever count the culling pass left in their indirect draw
+    auto drawBoxes = [&](int phase) {
+        glBindVertexArray(box.vao.get());
+        if (!culling)
+        {
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 36, 3);
+            return;
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, hiZCuller.commandBuffer());
+        glDrawArraysIndirect(GL_TRIANGLES, reinterpret_cast<const void*>(hiZCuller.commandOffset(boxGroup, phase)));
+    };
 
     //draw from light position
-    glBindFramebuffer(GL_FRAMEBUFFER, ldMap.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, ldMap.fbo.get());
     glClear(GL_DEPTH_BUFFER_BIT);
     glCullFace(GL_FRONT);
     lightMapShader.bind();
@@ -301,12 +590,36 @@ void MyGLWindow::paintGL()
     mat4 lightView = lookAt(vec3(-2.0f, 4.0f, -1.0f), vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f));
     mat4 lightVO = lightOrtho * lightView;
     glUniformMatrix4fv(lightMapShader.uniformLocation("lightVP"), 1, GL_FALSE, value_ptr(lightVO));
-    drawScene();
-    glViewport(0, 0, width(), height());
-    glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+    drawSceneDepth();
+
+    //point light shadows, with the lights where they are this frame
+    clusteredLights.animate(timeFromBeginPoint);
+    std::function<void()> drawModelShadow;
+    if (modelReady)
+        drawModelShadow = [this] { sceneModel->model.drawDepth(6); };
+    pointShadows.render(clusteredLights, mainCamera, sceneModelMat, [this] {
+        glBindVertexArray(box.pointShadowVao.get());
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 36, 3 * 6);
+        glBindVertexArray(plane.depthVao.get());
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, 6);
+    }, drawModelShadow);
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneTarget->fbo.get());
+    glViewport(0, 0, sceneTarget->width, sceneTarget->height);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glCullFace(GL_BACK);
 
     //draw scene
+    mat4 viewProjection = mainCamera.viewProjectionMat();
+    clusteredLights.update(mainCamera.viewMat(), mainCamera.projectionMat, mainCamera.nearPlane, mainCamera.farPlane);
+    pointShadows.bind();
+    environmentLighting.bind();
+    if (culling)
+    {
+        setBoxInstanceSource(hiZCuller.visibleBuffer());
+        if (modelReady)
+            sceneModel->model.setInstanceSource(hiZCuller.visibleBuffer());
+        hiZCuller.cull(firstPhase, viewProjection);
+    }
     testShader.bind();
     glUniformMatrix4fv(testShader.uniformLocation("VP"), 1, GL_FALSE, value_ptr(mainCamera.viewProjectionMat()));
     glUniformMatrix4fv(testShader.uniformLocation("lightSpaceVO"), 1, GL_FALSE, value_ptr(lightVO));
@@ -317,7 +630,7 @@ void MyGLWindow::paintGL()
     glBindTexture(GL_TEXTURE_2D, plane.tex);
     glUniform1i(testShader.uniformLocation("tex"), 0);
     glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, ldMap.depthMap);
+    glBindTexture(GL_TEXTURE_2D, ldMap.depthMap.get());
     glUniform1i(testShader.uniformLocation("shadowMap"), 1);
     glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D, normalTex);
@@ -325,14 +638,366 @@ void MyGLWindow::paintGL()
     glActiveTexture(GL_TEXTURE3);
     glBindTexture(GL_TEXTURE_2D, displacementTex);
     glUniform1i(testShader.uniformLocation("displacementMap"), 3);
-    drawScene();
+    if (vertexCost.running())
+    {
+        //a single pixel, so the two shader paths differ in vertex work only
+        glViewport(0, 0, 1, 1);
+        setBoxInstanceSource(vertexCost.instanceBuffer());
+        glBindVertexArray(box.vao.get());
+        vertexCost.measure([this](bool perVertex) {
+            glUniform1i(testShader.uniformLocation("perVertexNormalMatrix"), perVertex);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 36, VertexCostBenchmark::instanceNum);
+        });
+        glUniform1i(testShader.uniformLocation("perVertexNormalMatrix"), 0);
+        setBoxInstanceSource(culling ? hiZCuller.visibleBuffer() : 0);
+        glViewport(0, 0, sceneTarget->width, sceneTarget->height);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+    hiZCuller.beginPass();
+    depthPrepass.begin();
+    if (prepass)
+    {
+        //the same vertex shader and parallax search as the shading pass, so depth and discards match it exactly
+        parallaxDepthShader.bind();
+        glUniformMatrix4fv(parallaxDepthShader.uniformLocation("VP"), 1, GL_FALSE, value_ptr(viewProjection));
+        glUniform3fv(parallaxDepthShader.uniformLocation("viewPos"), 1, value_ptr(mainCamera.position));
+        glUniform1f(parallaxDepthShader.uniformLocation("heightScale"), 0.1f);
+        glUniform1i(parallaxDepthShader.uniformLocation("displacementMap"), 3);
+        drawBoxes(firstPhase);
+        glBindVertexArray(plane.vao.get());
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        if (modelReady)
+        {
+            modelDepthShader.bind();
+            glUniformMatrix4fv(modelDepthShader.uniformLocation("MVP"), 1, GL_FALSE, value_ptr(viewProjection * sceneModelMat));
+            JobSystem::instance().wait(modelRecording);
+            commandReplayer.begin();
+            commandReplayer.execute(modelDepthCommands);
+        }
+        testShader.bind();
+    }
+    depthPrepass.beginShading();
+    clusteredLights.beginShading();
+    drawBoxes(firstPhase);
+    glBindVertexArray(plane.vao.get());
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+
+    if (modelReady)
+    {
+        modelShader.bind();
+        glUniformMatrix4fv(modelShader.uniformLocation("MVP"), 1, GL_FALSE, value_ptr(viewProjection * sceneModelMat));
+        glUniformMatrix4fv(modelShader.uniformLocation("modelMat"), 1, GL_FALSE, value_ptr(sceneModelMat));
+        glUniformMatrix3fv(modelShader.uniformLocation("modelNormalMat"), 1, GL_FALSE, value_ptr(transpose(inverse(mat3(sceneModelMat)))));
+        glUniform3fv(modelShader.uniformLocation("viewPos"), 1, value_ptr(mainCamera.position));
+        JobSystem::instance().wait(modelRecording);
+        commandReplayer.begin();
+        commandReplayer.execute(modelCommands);
+        glBindVertexArray(0);
+    }
+    depthPrepass.end();
+
+    if (cullMode == HiZCuller::Mode::TwoPhase)
+    {
+        //what was visible last frame is drawn, its depth decides what else is needed this frame
+        hiZCuller.buildPyramid(sceneTarget->depthTex.get(), viewProjection);
+        hiZCuller.cull(2, viewProjection);
+        testShader.bind();
+        glBindTextureUnit(0, plane.tex);
+        drawBoxes(2);
+        if (modelReady)
+        {
+            commandReplayer.begin();
+            commandReplayer.execute(lateModelCommands);
+        }
+        glBindVertexArray(0);
+    }
+    clusteredLights.endShading();
+    hiZCuller.endPass();
+    if (cullMode == HiZCuller::Mode::SinglePhase)
+        hiZCuller.buildPyramid(sceneTarget->depthTex.get(), viewProjection);
+    if (culling)
+    {
+        setBoxInstanceSource(0);
+        if (modelReady)
+            sceneModel->model.setInstanceSource(0);
+    }
+    if (modelReady)
+        primitiveExpansion.draw(sceneModel->model, viewProjection, sceneModelMat, timeFromBeginPoint);
+    drawBenchmark.draw(mainCamera.viewProjectionMat(), box.vao.get(), timeFromBeginPoint);
+    particleSystem.draw(viewProjection, mainCamera.viewMat());
+    transparency.draw(viewProjection, mainCamera.position, sceneTarget->fbo.get(), screenQuad.vao.get());
+
+    //post process and present
+    unsigned int finalTex = postProcess.run(sceneTarget->colorTex.get(), sceneTarget->depthTex.get());
+    glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+    glViewport(0, 0, width(), height());
+    glDisable(GL_DEPTH_TEST);
+    outputShader.bind();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, finalTex);
+    glUniform1i(outputShader.uniformLocation("tex"), 0);
+    glUniform1i(outputShader.uniformLocation("filterMode"), static_cast<int>(dynamicResolution.activeFilter()));
+    glUniform1f(outputShader.uniformLocation("sharpness"), 0.5f);
+    glBindVertexArray(screenQuad.vao.get());
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+    dynamicResolution.endFrame();
+    if (recordToggleRequested)
+    {
+        recordToggleRequested = false;
+        if (frameCapture.recording())
+            frameCapture.stop();
+        else
+            frameCapture.start(recordPath, recordFormat);
+    }
+    frameCapture.capture(defaultFramebufferObject(), width(), height());
+    frameTimer.endFrame(simFrame.newInput, simFrame.state.inputTime);
+    if (replayStarted && replayChecksums)
+        replayHashes.push_back(frameChecksum());
+    if (replayDone)
+    {
+        finishReplay();
+        return;
+    }
+
+    ++framesSinceStats;
+    if (duration_cast<duration<float>>(currentTime - lastStatsPoint).count() >= 1.0f)
+    {
+        reportStats();
+        framesSinceStats = 0;
+        lastStatsPoint = currentTime;
+    }
 
     update();
 }
 
+uint64_t MyGLWindow::frameChecksum()
+{
+    //FNV-1a over the presented image, reading it back stalls so checksummed runs are slower
+    std::vector<unsigned char> pixels(static_cast<size_t>(width()) * height() * 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width(), height(), GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char i : pixels)
+        hash = (hash ^ i) * 1099511628211ull;
+    return hash;
+}
+
+void MyGLWindow::finishReplay()
+{
+    if (frameCapture.recording())
+        frameCapture.stop();
+    //the first frame time includes the warm up
+    std::vector<float> frameMs(replayFrameMs.begin() + std::min<size_t>(1, replayFrameMs.size()), replayFrameMs.end());
+    std::sort(frameMs.begin(), frameMs.end());
+    float total = 0.0f;
+    for (float i : frameMs)
+        total += i;
+    auto percentile = [&frameMs](size_t p) {
+        return frameMs.empty() ? 0.0f : frameMs[std::min(frameMs.size() - 1, frameMs.size() * p / 100)];
+    };
+    qDebug() << "replay done:" << replayFrame << "frames, frame" << (frameMs.empty() ? 0.0f : total / frameMs.size()) << "ms, p50" << percentile(50)
+        << "ms, p99" << percentile(99) << "ms, max" << (frameMs.empty() ? 0.0f : frameMs.back()) << "ms";
+    int exitCode = 0;
+    if (simulation.replayMismatches())
+    {
+        qWarning() << "  camera diverged from the capture on" << simulation.replayMismatches() << "ticks";
+        exitCode = 1;
+    }
+
+    if (replayChecksums)
+    {
+        uint64_t combined = 14695981039346656037ull;
+        for (uint64_t i : replayHashes)
+            combined = (combined ^ i) * 1099511628211ull;
+        qDebug() << "  image checksum" << QString::number(static_cast<qulonglong>(combined), 16);
+
+        //the first checksummed run of a trace becomes the reference for later ones
+        std::string sumsPath = replayPath + ".sums";
+        std::ifstream reference(sumsPath, std::ios::binary);
+        if (reference)
+        {
+            std::vector<uint64_t> expected(replayHashes.size());
+            reference.read(reinterpret_cast<char*>(expected.data()), expected.size() * sizeof(uint64_t));
+            expected.resize(static_cast<size_t>(reference.gcount()) / sizeof(uint64_t));
+            int differing = 0, first = -1;
+            for (size_t i = 0; i < replayHashes.size(); ++i)
+            {
+                if (i >= expected.size() || expected[i] != replayHashes[i])
+                {
+                    ++differing;
+                    if (first < 0)
+                        first = static_cast<int>(i);
+                }
+            }
+            if (differing)
+            {
+                qWarning() << "  " << differing << "frames differ from" << QString::fromStdString(sumsPath) << ", first is frame" << first;
+                exitCode = 1;
+            }
+            else
+            {
+                qDebug() << "  every frame matches" << QString::fromStdString(sumsPath);
+            }
+        }
+        else
+        {
+            std::ofstream file(sumsPath, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(replayHashes.data()), replayHashes.size() * sizeof(uint64_t));
+            qDebug() << "  reference checksums written to" << QString::fromStdString(sumsPath);
+        }
+    }
+    QCoreApplication::exit(exitCode);
+}
+
 void MyGLWindow::resizeGL(int w, int h)
 {
     mainCamera.resizeCamera(w, h);
+    simulation.resize(w, h);
+    dynamicResolution.resize(w, h);
+    resizeScene();
+}
+
+void MyGLWindow::setBoxInstanceSource(unsigned int buffer)
+{
+    //attributes 3 to 6 and 13 to 15 were set up with glVertexAttribPointer, so each has the binding of the same index
+    unsigned int source = buffer ? buffer : box.modelMatVbo.get();
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        glVertexArrayVertexBuffer(box.vao.get(), 3 + i, source, i * sizeof(glm::vec4), sizeof(InstanceTransform));
+        glVertexArrayVertexBuffer(box.depthVao.get(), 3 + i, source, i * sizeof(glm::vec4), sizeof(InstanceTransform));
+    }
+    for (unsigned int i = 0; i < 3; ++i)
+        glVertexArrayVertexBuffer(box.vao.get(), 13 + i, source, sizeof(mat4) + i * sizeof(glm::vec4), sizeof(InstanceTransform));
+}
+
+void MyGLWindow::resizeScene()
+{
+    sceneTarget = &dynamicResolution.target();
+    int w = sceneTarget->width, h = sceneTarget->height;
+    transparency.resize(w, h, sceneTarget->depthTex.get());
+    postProcess.resize(w, h);
+    hiZCuller.resize(w, h);
+    clusteredLights.resize(w, h);
+}
+
+void MyGLWindow::applyPostProcessPreset(int preset)
+{
+    using EffectType = PostProcess::EffectType;
+    using Resolution = PostProcess::Resolution;
+
+    postProcess.clearEffects();
+    switch (preset)
+    {
+    case 1:
+        postProcess.addEffect(EffectType::Blur, Resolution::Full, 1.0f, 4);
+        break;
+    case 2:
+        postProcess.addEffect(EffectType::Sharpen, Resolution::Full, 0.8f, 2);
+        break;
+    case 3:
+        postProcess.addEffect(EffectType::Edge, Resolution::Full, 1.0f);
+        break;
+    case 4:
+        postProcess.addEffect(EffectType::Blur, Resolution::Half, 1.0f, 6);
+        postProcess.addEffect(EffectType::Sharpen, Resolution::Full, 0.5f, 1);
+        break;
+    case 5:
+        postProcess.addEffect(EffectType::Blur, Resolution::Quarter, 1.0f, 8);
+        break;
+    default:
+        break;
+    }
+}
+
+void MyGLWindow::reportStats()
+{
+    qDebug() << "fps:" << framesSinceStats;
+    FrameTimer::Stats frameStats = frameTimer.takeStats();
+    Simulation::Stats simStats = simulation.takeStats();
+    qDebug() << "  frame" << frameStats.frameMs << "ms, p99" << frameStats.p99FrameMs << "ms, max" << frameStats.maxFrameMs << "ms";
+    qDebug() << "  simulation" << simStats.ticks << "ticks, tick" << simStats.tickMs << "ms (max" << simStats.maxTickMs << "), load" << simStats.loadMs << "ms, dropped" << simStats.droppedTicks;
+    if (frameStats.latencySamples)
+        qDebug() << "  input to gpu done" << frameStats.latencyMs << "ms, max" << frameStats.maxLatencyMs << "ms over" << frameStats.latencySamples << "samples";
+    if (hiZCuller.mode() != HiZCuller::Mode::Off)
+    {
+        const HiZCuller::Stats& cullStats = hiZCuller.stats();
+        qDebug() << "  hi-z" << HiZCuller::modeName(hiZCuller.mode()) << cullStats.instances << "instances in" << cullStats.groups << "groups, tested" << cullStats.tested
+            << "frustum culled" << cullStats.frustumCulled << "occluded" << cullStats.occlusionCulled << "drawn late" << cullStats.drawnLate;
+        qDebug() << "  hi-z cull" << cullStats.cullMs << "ms, pyramid" << cullStats.pyramidMs << "ms";
+    }
+    {
+        //the scene pass per mode, the difference to off is the shading culling saves
+        const std::array<float, 3>& passMs = hiZCuller.stats().passMs;
+        qDebug() << "  scene pass off" << passMs[0] << "ms, single phase" << passMs[1] << "ms, two phase" << passMs[2] << "ms";
+    }
+    const ClusteredLights::Stats& lightStats = clusteredLights.stats();
+    qDebug() << "  point lights" << lightStats.lights << (lightStats.clustered ? "clustered, assign" : "brute force, assign") << lightStats.assignMs << "ms, shade" << lightStats.shadeMs << "ms";
+    if (lightStats.clustered)
+        qDebug() << "  clusters" << ClusteredLights::clusterNum << "light refs" << lightStats.lightRefs << "most in one" << lightStats.maxClusterLights << "overflowing" << lightStats.overflowClusters;
+    const PointShadows::Stats& shadowStats = pointShadows.stats();
+    qDebug() << "  point shadows" << shadowStats.casters << "casters," << shadowStats.rendered << "rendered," << shadowStats.totalMs << "ms, per light at 512"
+        << shadowStats.msPerLight[0] << "256" << shadowStats.msPerLight[1] << "128" << shadowStats.msPerLight[2] << "64" << shadowStats.msPerLight[3] << "ms";
+    if (environmentLighting.ready())
+    {
+        const EnvironmentLighting::Stats& environmentStats = environmentLighting.stats();
+        qDebug() << "  environment lighting" << (environmentLighting.enabled() ? "on" : "off") << (environmentStats.cached ? ", read from the cache in" : ", preprocessed in")
+            << environmentStats.totalMs << "ms on" << environmentStats.threads << "threads";
+    }
+    const TransparencyPass::Stats& transparencyStats = transparency.stats();
+    qDebug() << "  transparency" << TransparencyPass::modeName(transparency.mode()) << transparencyStats.quads << "quads, sorted cpu" << transparencyStats.cpuMs[1]
+        << "ms gpu" << transparencyStats.gpuMs[1] << "ms, weighted blended cpu" << transparencyStats.cpuMs[2] << "ms gpu" << transparencyStats.gpuMs[2] << "ms";
+    const DepthPrepass::Stats& prepassStats = depthPrepass.stats();
+    qDebug() << "  depth prepass" << (depthPrepass.enabled() ? "on" : "off") << ", without: shading" << prepassStats.shadingMs[0]
+        << "ms, with: prepass" << prepassStats.prepassMs[1] << "ms shading" << prepassStats.shadingMs[1] << "ms";
+    {
+        const auto& expansionMs = primitiveExpansion.stats().gpuMs;
+        qDebug() << "  primitive expansion" << PrimitiveExpansion::effectName(primitiveExpansion.effect()) << "through" << PrimitiveExpansion::pathName(primitiveExpansion.path())
+            << ", geometry shader / vertex pulling: normals" << expansionMs[1][0] << "/" << expansionMs[1][1] << "ms, explode" << expansionMs[2][0] << "/" << expansionMs[2][1]
+            << "ms, sprites" << expansionMs[3][0] << "/" << expansionMs[3][1] << "ms";
+    }
+    const ParticleSystem::Stats& particleStats = particleSystem.stats();
+    qDebug() << "  particles" << particleStats.alive << "/" << particleStats.capacity << "alive," << particleStats.steps << "steps this frame, simulate"
+        << particleStats.simulateMs << "ms, render" << particleStats.renderMs << "ms";
+    if (pickHit.valid())
+        qDebug() << "  picking mesh" << pickedMesh << "triangle" << pickHit.triangle << "at" << pickHit.distance << ", last query" << pickMs << "ms";
+    const DynamicResolution::Stats& resolutionStats = dynamicResolution.stats();
+    qDebug() << "  render scale" << resolutionStats.scale << "(" << resolutionStats.width << "x" << resolutionStats.height << ")" << (dynamicResolution.enabled() ? "dynamic" : "fixed")
+        << ", gpu frame" << resolutionStats.gpuMs << "ms, target" << dynamicResolution.targetMs() << "ms," << resolutionStats.changes << "changes," << resolutionStats.pooledTargets << "targets kept";
+    if (frameCapture.recording())
+    {
+        FrameCapture::Stats captureStats = frameCapture.stats();
+        qDebug() << "  recording" << captureStats.written << "of" << captureStats.captured << "frames written," << captureStats.writtenBytes / 1024
+            << "KiB, dropped waiting on the gpu" << captureStats.droppedGpu << "on the writer" << captureStats.droppedWriter << ", write" << captureStats.writeMs << "ms";
+    }
+    for (auto& i : postProcess.effects())
+        qDebug() << "  post process" << QString::fromStdString(postProcess.effectName(i)) << i.gpuTimeMs << "ms";
+    if (sceneModel && sceneModel->state != ModelLoader::State::Ready)
+        qDebug() << "  model" << ModelLoader::stateName(sceneModel->state) << static_cast<int>(sceneModel->progress * 100.0f) << "%";
+    JobSystem& jobs = JobSystem::instance();
+    auto workerStats = jobs.workerStats();
+    for (size_t i = 0; i < workerStats.size(); ++i)
+        qDebug() << "  worker" << i << "jobs" << workerStats[i].jobs << "steals" << workerStats[i].steals << "busy" << static_cast<int>(workerStats[i].utilization * 100.0) << "%";
+    jobs.resetStats();
+    AssetPack::Stats assetStats = AssetPack::instance().stats();
+    qDebug() << "  assets" << assetStats.packReads << "reads from the pack (" << assetStats.packBytes / 1024 << "KiB)," << assetStats.diskReads << "from disk ("
+        << assetStats.diskBytes / 1024 << "KiB), read" << assetStats.readMs << "ms of which decompressing" << assetStats.decompressMs << "ms";
+    const TextureStreamer::Stats& streamStats = textureStreamer.stats();
+    qDebug() << "  textures" << streamStats.textures << "resident" << streamStats.residentBytes / 1024 << "/" << streamStats.budgetBytes / 1024 << "KiB,"
+        << streamStats.residentLevels << "levels," << streamStats.missingBytes / 1024 << "KiB missing";
+    qDebug() << "  stream queue" << streamStats.queued << "in flight" << streamStats.inFlight << "uploads" << streamStats.uploads
+        << "evictions" << streamStats.evictions << "rejected" << streamStats.rejected;
+    GpuResources& gpu = GpuResources::instance();
+    auto gpuStats = gpu.stats();
+    for (int i = 0; i < GpuResources::kindNum; ++i)
+    {
+        const GpuResources::KindStats& kind = gpuStats[i];
+        qDebug() << "  gpu" << GpuResources::kindName(static_cast<GpuResources::Kind>(i)) << kind.live << "live," << kind.bytes / 1024
+            << "KiB, peak" << kind.peakBytes / 1024 << "KiB";
+    }
+    GpuResources::PoolStats poolStats = gpu.poolStats();
+    qDebug() << "  buffer pool" << poolStats.buffers << "buffers," << poolStats.bytes / 1024 << "KiB, hits" << poolStats.hits << "misses" << poolStats.misses;
 }
 
 void MyGLWindow::mouseMoveEvent(QMouseEvent* event)
@@ -344,32 +1009,163 @@ void MyGLWindow::mouseMoveEvent(QMouseEvent* event)
     setCursor(myCursor);
     if (std::abs(xAxisMove) < 150.0f && std::abs(yAxisMove) < 150.0f)
     {
-        mainCamera.processMouseMovement(xAxisMove, yAxisMove);
+        simulation.mouseMove(xAxisMove, yAxisMove);
+        pickRequested = true;
+    }
+}
+
+void MyGLWindow::pickModel(const mat4& modelMat)
+{
+    auto begin = steady_clock::now();
+    //the model BVH is in model space, the direction keeps its scale so hit distances stay in world units
+    mat4 toModel = inverse(modelMat);
+    Bvh::Ray ray;
+    ray.origin = vec3(toModel * glm::vec4(mainCamera.position, 1.0f));
+    ray.direction = vec3(toModel * glm::vec4(mainCamera.front, 0.0f));
+    ray.maxDistance = mainCamera.farPlane;
+    Bvh::Hit hit;
+    const SceneBvh& bvh = sceneModel->model.bvh();
+    bvh.intersect(ray, hit);
+    pickMs = duration_cast<duration<float, std::milli>>(steady_clock::now() - begin).count();
+
+    unsigned int mesh = hit.valid() ? bvh.instances()[hit.instance].id : Bvh::invalid;
+    if (mesh != pickedMesh)
+    {
+        if (hit.valid())
+            qDebug() << "pointing at mesh" << mesh << "," << hit.distance << "away";
+        else
+            qDebug() << "pointing at nothing";
     }
+    pickedMesh = mesh;
+    pickHit = hit;
 }
 
 void MyGLWindow::keyPressEvent(QKeyEvent* event)
 {
     if (event->key() == Qt::Key_Escape)
         close();
+    if (event->isAutoRepeat())
+        return;
     if (event->key() == Qt::Key_W)
-        mainCamera.setKeyW(true);
+        simulation.keyEvent(Simulation::Key::W, true);
     if (event->key() == Qt::Key_S)
-        mainCamera.setKeyS(true);
+        simulation.keyEvent(Simulation::Key::S, true);
     if (event->key() == Qt::Key_A)
-        mainCamera.setKeyA(true);
+        simulation.keyEvent(Simulation::Key::A, true);
     if (event->key() == Qt::Key_D)
-        mainCamera.setKeyD(true);
+        simulation.keyEvent(Simulation::Key::D, true);
+    if (event->key() == Qt::Key_P)
+    {
+        postProcessPreset = (postProcessPreset + 1) % 6;
+        applyPostProcessPreset(postProcessPreset);
+    }
+    if (event->key() == Qt::Key_C)
+        drawBenchmark.toggle();
+    if (event->key() == Qt::Key_N && !clusteredLights.benchmarkRunning())
+    {
+        lightCountPreset = (lightCountPreset + 1) % static_cast<int>(lightCounts.size());
+        clusteredLights.setLightCount(lightCounts[lightCountPreset]);
+        qDebug() << lightCounts[lightCountPreset] << "point lights";
+    }
+    if (event->key() == Qt::Key_M && !clusteredLights.benchmarkRunning())
+    {
+        clusteredLights.setClustered(!clusteredLights.clustered());
+        qDebug() << "clustered lighting" << (clusteredLights.clustered() ? "on" : "off");
+    }
+    if (event->key() == Qt::Key_K)
+        clusteredLights.toggleBenchmark();
+    if (event->key() == Qt::Key_H)
+    {
+        pointShadows.setEnabled(!pointShadows.enabled());
+        qDebug() << "point light shadows" << (pointShadows.enabled() ? "on" : "off");
+    }
+    if (event->key() == Qt::Key_T && !transparency.benchmarkRunning())
+    {
+        auto next = static_cast<TransparencyPass::Mode>((static_cast<int>(transparency.mode()) + 1) % 3);
+        transparency.setMode(next);
+        qDebug() << "transparency" << TransparencyPass::modeName(next);
+    }
+    if (event->key() == Qt::Key_G)
+        transparency.toggleBenchmark();
+    if (event->key() == Qt::Key_O)
+    {
+        auto next = static_cast<HiZCuller::Mode>((static_cast<int>(hiZCuller.mode()) + 1) % 3);
+        hiZCuller.setMode(next);
+        qDebug() << "occlusion culling" << HiZCuller::modeName(next);
+    }
+    if (event->key() == Qt::Key_V)
+        vertexCost.toggle();
+    if (event->key() == Qt::Key_Z && !depthPrepass.benchmarkRunning())
+    {
+        depthPrepass.setEnabled(!depthPrepass.enabled());
+        qDebug() << "depth prepass" << (depthPrepass.enabled() ? "on" : "off");
+    }
+    if (event->key() == Qt::Key_X)
+        depthPrepass.toggleBenchmark();
+    if (event->key() == Qt::Key_E && !primitiveExpansion.benchmarkRunning())
+    {
+        auto next = static_cast<PrimitiveExpansion::Effect>((static_cast<int>(primitiveExpansion.effect()) + 1) % PrimitiveExpansion::effectNum);
+        primitiveExpansion.setEffect(next);
+        qDebug() << "primitive expansion" << PrimitiveExpansion::effectName(next);
+    }
+    if (event->key() == Qt::Key_R && !primitiveExpansion.benchmarkRunning())
+    {
+        auto next = primitiveExpansion.path() == PrimitiveExpansion::Path::GeometryShader ? PrimitiveExpansion::Path::VertexPulling : PrimitiveExpansion::Path::GeometryShader;
+        primitiveExpansion.setPath(next);
+        qDebug() << "primitive expansion through" << PrimitiveExpansion::pathName(next);
+    }
+    if (event->key() == Qt::Key_B)
+        primitiveExpansion.toggleBenchmark();
+    if (event->key() == Qt::Key_I)
+    {
+        dynamicResolution.setEnabled(!dynamicResolution.enabled());
+        qDebug() << "dynamic resolution" << (dynamicResolution.enabled() ? "on" : "off");
+    }
+    if (event->key() == Qt::Key_U)
+    {
+        auto next = static_cast<DynamicResolution::Filter>((static_cast<int>(dynamicResolution.filter()) + 1) % 3);
+        dynamicResolution.setFilter(next);
+        qDebug() << "upscale filter" << DynamicResolution::filterName(next);
+    }
+    if (event->key() == Qt::Key_Y)
+    {
+        frameTargetPreset = (frameTargetPreset + 1) % static_cast<int>(frameTargets.size());
+        dynamicResolution.setTargetMs(frameTargets[frameTargetPreset]);
+        qDebug() << "gpu frame target" << frameTargets[frameTargetPreset] << "ms";
+    }
+    if (event->key() == Qt::Key_J)
+    {
+        particleCountPreset = (particleCountPreset + 1) % static_cast<int>(particleCounts.size());
+        particleSystem.setCapacity(particleCounts[particleCountPreset]);
+        qDebug() << "particles" << particleCounts[particleCountPreset];
+    }
+    if (event->key() == Qt::Key_Q)
+    {
+        environmentLighting.setEnabled(!environmentLighting.enabled());
+        qDebug() << "environment lighting" << (environmentLighting.enabled() ? "on" : "off");
+    }
+    if (event->key() == Qt::Key_F)
+        recordToggleRequested = !recordToggleRequested;
+    if (event->key() == Qt::Key_L)
+    {
+        //0 to beyond a whole tick of extra simulation work
+        const std::array<float, 5> loads{ 0.0f, 4.0f, 8.0f, 16.0f, 33.0f };
+        simulationLoadPreset = (simulationLoadPreset + 1) % static_cast<int>(loads.size());
+        simulation.setLoad(loads[simulationLoadPreset]);
+        qDebug() << "simulation load" << loads[simulationLoadPreset] << "ms per tick";
+    }
 }
 
 void MyGLWindow::keyReleaseEvent(QKeyEvent* event)
 {
+    if (event->isAutoRepeat())
+        return;
     if (event->key() == Qt::Key_W)
-        mainCamera.setKeyW(false);
+        simulation.keyEvent(Simulation::Key::W, false);
     if (event->key() == Qt::Key_S)
-        mainCamera.setKeyS(false);
+        simulation.keyEvent(Simulation::Key::S, false);
     if (event->key() == Qt::Key_A)
-        mainCamera.setKeyA(false);
+        simulation.keyEvent(Simulation::Key::A, false);
     if (event->key() == Qt::Key_D)
-        mainCamera.setKeyD(false);
+        simulation.keyEvent(Simulation::Key::D, false);
 }
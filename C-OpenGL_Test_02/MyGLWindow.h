@@ -9,6 +9,28 @@
 #include"Simple3DBox.h"
 #include"Camera.h"
 #include"Model.h"
+#include"PostProcess.h"
+#include"TextureCompressor.h"
+#include"TextureStreamer.h"
+#include"ModelLoader.h"
+#include"JobSystem.h"
+#include"CommandBuffer.h"
+#include"DrawBenchmark.h"
+#include"Simulation.h"
+#include"FrameTimer.h"
+#include"HiZCuller.h"
+#include"ClusteredLights.h"
+#include"TransparencyPass.h"
+#include"GpuResources.h"
+#include"InstanceTransform.h"
+#include"VertexCostBenchmark.h"
+#include"DepthPrepass.h"
+#include"PointShadows.h"
+#include"PrimitiveExpansion.h"
+#include"FrameCapture.h"
+#include"DynamicResolution.h"
+#include"EnvironmentLighting.h"
+#include"ParticleSystem.h"
 
 class MyGLWindow : public QOpenGLWidget, public QOpenGLFunctions_4_5_Core
 {
@@ -25,15 +47,52 @@ public:
     void keyPressEvent(QKeyEvent* event)override;
     void keyReleaseEvent(QKeyEvent* event)override;
 private:
+    //destroyed after every member holding GL objects, with the context still current, and reports what is left
+    GpuResources::LeakReport gpuLeakReport;
+    //the render camera, set from the simulation snapshot every frame
     Camera mainCamera{ 800.0f,800.0f };
+    Simulation simulation;
+    FrameTimer frameTimer;
+    int simulationLoadPreset = 0;
+
+    //--capture <path> saves the input trace when the window closes, --replay <path> renders it offscreen
+    //frame by frame on a virtual clock once every asset is loaded, --checksum also hashes every frame
+    std::string capturePath;
+    std::string replayPath;
+    InputTrace replayTrace;
+    bool replayStarted = false;
+    bool replayChecksums = false;
+    int replayFrame = 0;
+    std::chrono::steady_clock::time_point replayWallBegin;
+    std::vector<float> replayFrameMs;
+    std::vector<uint64_t> replayHashes;
+    uint64_t frameChecksum();
+    //--record <dir> records every presented frame from the start, also in a replay, F starts and stops it,
+    //--record-format picks png, raw or video
+    FrameCapture frameCapture;
+    std::string recordPath = "./recordings";
+    FrameCapture::Format recordFormat = FrameCapture::Format::Png;
+    bool recordFromStart = false;
+    //F only sets this, stopping waits on the capture fences so it is done in paintGL with the context current
+    bool recordToggleRequested = false;
+    void finishReplay();
     std::chrono::steady_clock::time_point lastTimePoint;
     std::chrono::steady_clock::time_point programBeginPoint;
+    std::chrono::steady_clock::time_point lastStatsPoint;
+    int framesSinceStats = 0;
+    void reportStats();
     //code here
     struct TriangleStripBox
     {
-        unsigned int vao, vbo;
-        unsigned int modelMatVbo;
-        unsigned int tbnBuffer;
+        GpuResources::VertexArray vao;
+        GpuResources::Buffer vbo;
+        GpuResources::Buffer modelMatVbo;
+        GpuResources::Buffer tbnBuffer;
+        //positions only with the model mats, for the shadow pass
+        GpuResources::VertexArray depthVao;
+        GpuResources::Buffer positionVbo;
+        //the same with every model mat repeated for the six faces of a point light cube
+        GpuResources::VertexArray pointShadowVao;
         constexpr static std::array<float, 288> vertices
         {
             // back face
@@ -92,8 +151,8 @@ private:
 
     struct LightDepthMap
     {
-        unsigned int fbo;
-        unsigned int depthMap;
+        GpuResources::Framebuffer fbo;
+        GpuResources::Texture depthMap;
     };
 
     LightDepthMap ldMap;
@@ -101,8 +160,11 @@ private:
     struct TutorialScene
     {
         unsigned int tex;
-        unsigned int vao, vbo;
-        unsigned int tbnBuffer;
+        GpuResources::VertexArray vao;
+        GpuResources::Buffer vbo;
+        GpuResources::Buffer tbnBuffer;
+        GpuResources::VertexArray depthVao;
+        GpuResources::Buffer positionVbo;
         constexpr static std::array<float, 48> planeVertices
         {
             -3.0f, -0.5f,  3.0f,  0.0f, 1.0f, 0.0f,   0.0f, 1.0f,
@@ -118,7 +180,89 @@ private:
     TutorialScene plane;
     unsigned int normalTex;
     unsigned int displacementTex;
+    TextureCompressor textureCompressor;
+    TextureStreamer textureStreamer{ textureCompressor };
+    //color, normal and displacement handles of the bricks shared by the plane and the boxes
+    std::array<int, 3> brickStreams;
+
+    //loaded in the background from --model <path>, drawn once it is ready
+    ModelLoader modelLoader;
+    std::shared_ptr<ModelLoader::Load> sceneModel;
+    QOpenGLShaderProgram modelShader;
+    //the model is recorded on a job while the scene is drawn and replayed after it
+    CommandBuffer modelCommands;
+    //with two phase culling the meshes that only pass the second test are drawn from here
+    CommandBuffer lateModelCommands;
+    CommandReplayer commandReplayer;
+    DrawBenchmark drawBenchmark;
+    //V times the box shader with precomputed normal matrices against inverting per vertex
+    VertexCostBenchmark vertexCost;
 
     QOpenGLShaderProgram testShader;
     QOpenGLShaderProgram lightMapShader;
+
+    //Z lays the opaque depth down first and shades with GL_EQUAL, X compares both
+    DepthPrepass depthPrepass;
+    //the parallax search still decides which fragments exist, so its prepass keeps the full vertex
+    QOpenGLShaderProgram parallaxDepthShader;
+    QOpenGLShaderProgram modelDepthShader;
+    CommandBuffer modelDepthCommands;
+
+    //the scene is rendered offscreen so post-processing can read it, below the widget size when the GPU falls behind,
+    //I switches the scaling off, U cycles the upscale filter and Y the frame time aimed at
+    DynamicResolution dynamicResolution;
+    const DynamicResolution::Target* sceneTarget = nullptr;
+    std::array<float, 3> frameTargets{ 8.3f, 16.6f, 33.3f };
+    int frameTargetPreset = 1;
+    //everything sized to the scene follows the render size
+    void resizeScene();
+
+    //the boxes and the model meshes are culled against last frame's depth, cycled with O
+    HiZCuller hiZCuller;
+    //where the instanced box transforms come from, 0 is box.modelMatVbo
+    void setBoxInstanceSource(unsigned int buffer);
+
+    //point lights for the plane, the boxes and the model, N cycles the count, M switches clustering off, K runs the sweep
+    ClusteredLights clusteredLights;
+    //shadows of the point lights largest on screen, H switches them off
+    PointShadows pointShadows;
+    //irradiance and prefiltered reflections of the skybox for the plane, the boxes and the model, Q switches them off
+    EnvironmentLighting environmentLighting;
+    std::array<int, 5> lightCounts{ 0, 64, 1024, 4096, 16384 };
+    int lightCountPreset = 1;
+
+    //grass and window quads over the plane, T cycles off, sorted and weighted blended, G runs the sweep
+    TransparencyPass transparency;
+    //normal lines, exploded triangles or vertex sprites over the model, E cycles them, R swaps geometry shader and vertex pulling, B times both
+    PrimitiveExpansion primitiveExpansion;
+    //a GPU only particle fountain on the plane, J cycles the particle count
+    ParticleSystem particleSystem;
+    std::array<unsigned int, 4> particleCounts{ 0, 16384, 131072, 1048576 };
+    int particleCountPreset = 2;
+    //what the centre of the view points at on the model, the cursor is held there for steering, redone after mouse moves
+    bool pickRequested = false;
+    Bvh::Hit pickHit;
+    unsigned int pickedMesh = Bvh::invalid;
+    float pickMs = 0.0f;
+    void pickModel(const glm::mat4& modelMat);
+
+    struct ScreenQuad
+    {
+        GpuResources::VertexArray vao;
+        GpuResources::Buffer vbo;
+        constexpr static std::array<float, 20> vertices
+        {
+            -1.0f, -1.0f, 0.0f,  0.0f, 0.0f,
+             1.0f, -1.0f, 0.0f,  1.0f, 0.0f,
+            -1.0f,  1.0f, 0.0f,  0.0f, 1.0f,
+             1.0f,  1.0f, 0.0f,  1.0f, 1.0f
+        };
+    };
+
+    ScreenQuad screenQuad;
+    QOpenGLShaderProgram outputShader;
+
+    PostProcess postProcess;
+    int postProcessPreset = 0;
+    void applyPostProcessPreset(int preset);
 };
@@ -0,0 +1,20 @@
+#pragma once
+#include<algorithm>
+#include<functional>
+#include"JobSystem.h"
+
+//runs func(begin) ... func(end - 1) for chunks of grainSize on the job system, the calling thread takes part
+inline void parallelFor(size_t count, size_t grainSize, const std::function<void(size_t)>& func)
+{
+    JobSystem::instance().parallelFor(count, grainSize, [&func](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            func(i);
+    });
+}
+
+//picks a grain that gives every thread a few chunks to balance over
+inline void parallelFor(size_t count, const std::function<void(size_t)>& func)
+{
+    size_t threadNum = static_cast<size_t>(JobSystem::instance().workerCount()) + 1;
+    parallelFor(count, std::max<size_t>(count / (threadNum * 4), 1), func);
+}
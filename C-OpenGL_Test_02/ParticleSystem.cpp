@@ -0,0 +1,221 @@
+#include "ParticleSystem.h"
+#include<gtc/type_ptr.hpp>
+#include<qdebug.h>
+#include<algorithm>
+#include<cstddef>
+#include<numeric>
+#include<vector>
+#include"AssetPack.h"
+
+void ParticleSystem::init()
+{
+    QOpenGLFunctions_4_5_Core::initializeOpenGLFunctions();
+    updateShader.create();
+    AssetPack::addShader(updateShader, QOpenGLShader::Compute, "./shaders/particleUpdate.comp");
+    updateShader.link();
+    drawShader.create();
+    AssetPack::addShader(drawShader, QOpenGLShader::Vertex, "./shaders/particle.vert");
+    AssetPack::addShader(drawShader, QOpenGLShader::Fragment, "./shaders/particle.frag");
+    drawShader.link();
+    emptyVao = GpuResources::instance().createVertexArray("particles");
+    for (auto& i : frames)
+    {
+        glGenQueries(StampNum, i.queries.data());
+        i.aliveBuffer = GpuResources::instance().createBuffer(sizeof(unsigned int), nullptr, 0, "particle stats");
+    }
+}
+
+void ParticleSystem::setCapacity(unsigned int capacity)
+{
+    //key handlers call this without a current context, the buffers are swapped at the next simulate
+    requestedCapacity = capacity;
+    resizePending = true;
+}
+
+unsigned int ParticleSystem::capacity() const
+{
+    return requestedCapacity;
+}
+
+void ParticleSystem::applyCapacity()
+{
+    GpuResources& gpu = GpuResources::instance();
+    unsigned int capacity = requestedCapacity;
+    resizePending = false;
+    particleCapacity = capacity;
+    statistics.capacity = capacity;
+    statistics.alive = 0;
+    current = 0;
+    started = false;
+    emitCarry = 0.0;
+    if (capacity == 0)
+    {
+        particles = GpuResources::Buffer();
+        aliveLists = GpuResources::Buffer();
+        deadList = GpuResources::Buffer();
+        counters = GpuResources::Buffer();
+        return;
+    }
+
+    //every slot starts out dead, the state of a dead slot is never read
+    std::vector<unsigned int> freeSlots(capacity);
+    std::iota(freeSlots.begin(), freeSlots.end(), 0u);
+    Counters initial{};
+    initial.deadCount = capacity;
+    initial.drawCommand[1] = 1;
+    particles = gpu.createBuffer(static_cast<size_t>(capacity) * 2 * sizeof(glm::vec4), nullptr, 0, "particle state");
+    aliveLists = gpu.createBuffer(static_cast<size_t>(capacity) * 2 * sizeof(unsigned int), nullptr, 0, "particle live lists");
+    deadList = gpu.createBuffer(freeSlots.size() * sizeof(unsigned int), freeSlots.data(), 0, "particle dead list");
+    counters = gpu.createBuffer(sizeof(Counters), &initial, 0, "particle counters");
+}
+
+void ParticleSystem::setEmitter(const glm::vec3& position, float floorLevel)
+{
+    emitter = position;
+    floorHeight = floorLevel;
+}
+
+void ParticleSystem::simulate(uint64_t tick, float tickSeconds)
+{
+    beginFrame();
+    if (resizePending)
+        applyCapacity();
+    if (particleCapacity == 0)
+        return;
+    if (!started || tick < lastTick)
+    {
+        started = true;
+        lastTick = tick;
+    }
+    int steps = static_cast<int>(std::min<uint64_t>(tick - lastTick, maxStepsPerFrame));
+    lastTick = tick;
+    statistics.steps = steps;
+    if (steps == 0)
+        return;
+
+    stamp(SimulateBegin);
+    updateShader.bind();
+    glUniform1ui(updateShader.uniformLocation("capacity"), particleCapacity);
+    glUniform1f(updateShader.uniformLocation("dt"), tickSeconds);
+    glUniform1f(updateShader.uniformLocation("floorHeight"), floorHeight);
+    glUniform3fv(updateShader.uniformLocation("emitterPosition"), 1, glm::value_ptr(emitter));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, particleBinding, particles.get());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, aliveBinding, aliveLists.get());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, deadBinding, deadList.get());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, counterBinding, counters.get());
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, counters.get());
+    for (int i = 0; i < steps; ++i)
+    {
+        //enough to refill the pool over one mean lifetime, the shader clamps it to the free slots
+        emitCarry += static_cast<double>(particleCapacity) * tickSeconds / lifetime;
+        unsigned int emitRequest = static_cast<unsigned int>(emitCarry);
+        emitCarry -= emitRequest;
+        glUniform1ui(updateShader.uniformLocation("current"), current);
+        glUniform1ui(updateShader.uniformLocation("emitRequest"), emitRequest);
+        glUniform1ui(updateShader.uniformLocation("seed"), static_cast<unsigned int>(tick - steps + i + 1));
+
+        //the counts only exist on the GPU, every stage after the first is sized by what the one before wrote
+        dispatchStage(Begin, -1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+        dispatchStage(Emit, offsetof(Counters, emitDispatch));
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        dispatchStage(Simulate, offsetof(Counters, simulateDispatch));
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        dispatchStage(End, -1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+        current = 1 - current;
+    }
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    updateShader.release();
+    stamp(SimulateEnd);
+}
+
+void ParticleSystem::draw(const glm::mat4& viewProjection, const glm::mat4& view)
+{
+    if (particleCapacity == 0)
+        return;
+    stamp(RenderBegin);
+    drawShader.bind();
+    glUniformMatrix4fv(drawShader.uniformLocation("VP"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+    //the rows of the view rotation are the camera axes in world space
+    glUniform3f(drawShader.uniformLocation("cameraRight"), view[0][0], view[1][0], view[2][0]);
+    glUniform3f(drawShader.uniformLocation("cameraUp"), view[0][1], view[1][1], view[2][1]);
+    glUniform1ui(drawShader.uniformLocation("aliveBase"), current * particleCapacity);
+    glUniform1f(drawShader.uniformLocation("particleSize"), 0.012f);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, particleBinding, particles.get());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, aliveBinding, aliveLists.get());
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glDepthMask(GL_FALSE);
+    glBindVertexArray(emptyVao.get());
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, counters.get());
+    glDrawArraysIndirect(GL_TRIANGLES, reinterpret_cast<const void*>(offsetof(Counters, drawCommand)));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+    drawShader.release();
+    stamp(RenderEnd);
+
+    //the live count for the stats line, read back once the GPU is long past it
+    Frame& frame = frames[frameIndex];
+    glCopyNamedBufferSubData(counters.get(), frame.aliveBuffer.get(), offsetof(Counters, aliveCount) + current * sizeof(unsigned int), 0, sizeof(unsigned int));
+    frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+const ParticleSystem::Stats& ParticleSystem::stats() const
+{
+    return statistics;
+}
+
+void ParticleSystem::dispatchStage(Stage stage, intptr_t indirectOffset)
+{
+    glUniform1ui(updateShader.uniformLocation("stage"), stage);
+    if (indirectOffset < 0)
+        glDispatchCompute(1, 1, 1);
+    else
+        glDispatchComputeIndirect(indirectOffset);
+}
+
+void ParticleSystem::stamp(Stamp which)
+{
+    Frame& frame = frames[frameIndex];
+    glQueryCounter(frame.queries[which], GL_TIMESTAMP);
+    frame.issued[which] = true;
+}
+
+void ParticleSystem::beginFrame()
+{
+    frameIndex = (frameIndex + 1) % queryLatency;
+    Frame& frame = frames[frameIndex];
+    if (frame.fence)
+        collect(frame);
+    frame.issued.fill(false);
+    statistics.steps = 0;
+}
+
+void ParticleSystem::collect(Frame& frame)
+{
+    //written queryLatency frames ago, normally long done
+    glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    glDeleteSync(frame.fence);
+    frame.fence = nullptr;
+    if (particleCapacity > 0)
+        glGetNamedBufferSubData(frame.aliveBuffer.get(), 0, sizeof(unsigned int), &statistics.alive);
+
+    std::array<GLuint64, StampNum> times{};
+    for (int i = 0; i < StampNum; ++i)
+    {
+        if (frame.issued[i])
+            glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &times[i]);
+    }
+    auto average = [](float& value, float sample) {
+        value = value == 0.0f ? sample : value * 0.95f + sample * 0.05f;
+    };
+    //frames without a tick do not pull the step time down
+    if (frame.issued[SimulateBegin] && frame.issued[SimulateEnd])
+        average(statistics.simulateMs, (times[SimulateEnd] - times[SimulateBegin]) / 1e6f);
+    if (frame.issued[RenderBegin] && frame.issued[RenderEnd])
+        average(statistics.renderMs, (times[RenderEnd] - times[RenderBegin]) / 1e6f);
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include<qopenglfunctions_4_5_core.h>
+#include<qopenglshaderprogram.h>
+#include<glm.hpp>
+#include<array>
+#include<cstdint>
+#include"GpuResources.h"
+
+//a fountain of particles that never leaves the GPU: the particle state sits in a fixed pool, free slots on a dead list
+//and the live slots in two index lists, a step emits out of the dead list, integrates the live list and compacts the
+//survivors into the other list, then writes the indirect draw for them, the CPU only ever issues commands
+class ParticleSystem :protected QOpenGLFunctions_4_5_Core
+{
+public:
+    struct Stats
+    {
+        unsigned int capacity = 0;
+        //read back queryLatency frames late, only for reporting
+        unsigned int alive = 0;
+        //simulation steps run in the last frame
+        int steps = 0;
+        float simulateMs = 0.0f;
+        float renderMs = 0.0f;
+    };
+
+    constexpr static int queryLatency = 3;
+    constexpr static unsigned int groupSize = 256;
+    //mean seconds a particle lives, emission keeps the pool about full at that
+    constexpr static float lifetime = 3.0f;
+    //ticks caught up in one frame after a stall, the rest are dropped
+    constexpr static int maxStepsPerFrame = 4;
+    //particleUpdate.comp and particle.vert
+    constexpr static unsigned int particleBinding = 14, aliveBinding = 15, deadBinding = 16, counterBinding = 17;
+
+    void init();
+    //reallocates and starts over empty at the next simulate, 0 switches the system off
+    void setCapacity(unsigned int capacity);
+    unsigned int capacity() const;
+    void setEmitter(const glm::vec3& position, float floorLevel);
+    //one step per simulation tick since the last call, so a replay emits and moves the same way
+    void simulate(uint64_t tick, float tickSeconds);
+    //additive camera facing quads into the bound framebuffer, depth tested against the scene without writing it
+    void draw(const glm::mat4& viewProjection, const glm::mat4& view);
+    const Stats& stats() const;
+
+private:
+    //std430 layout of particleUpdate.comp
+    struct Counters
+    {
+        unsigned int aliveCount[2];
+        unsigned int deadCount;
+        unsigned int emitCount;
+        //where the step's emission takes from the dead list and appends to the live list
+        unsigned int deadTop;
+        unsigned int aliveStart;
+        unsigned int emitDispatch[3];
+        unsigned int simulateDispatch[3];
+        //DrawArraysIndirectCommand, six vertices per live particle
+        unsigned int drawCommand[4];
+    };
+
+    enum Stage
+    {
+        Begin, Emit, Simulate, End
+    };
+
+    enum Stamp
+    {
+        SimulateBegin, SimulateEnd, RenderBegin, RenderEnd, StampNum
+    };
+
+    struct Frame
+    {
+        std::array<unsigned int, StampNum> queries{};
+        std::array<bool, StampNum> issued{};
+        GpuResources::Buffer aliveBuffer;
+        GLsync fence = nullptr;
+    };
+
+    QOpenGLShaderProgram updateShader;
+    QOpenGLShaderProgram drawShader;
+    GpuResources::VertexArray emptyVao;
+    GpuResources::Buffer particles, aliveLists, deadList, counters;
+
+    unsigned int particleCapacity = 0;
+    unsigned int requestedCapacity = 0;
+    bool resizePending = false;
+    //the live list a step reads, the other one receives the survivors
+    unsigned int current = 0;
+    glm::vec3 emitter{ 0.0f };
+    float floorHeight = 0.0f;
+    uint64_t lastTick = 0;
+    bool started = false;
+    double emitCarry = 0.0;
+
+    std::array<Frame, queryLatency> frames;
+    unsigned int frameIndex = 0;
+    Stats statistics;
+
+    void applyCapacity();
+    void dispatchStage(Stage stage, intptr_t indirectOffset);
+    void stamp(Stamp which);
+    void beginFrame();
+    void collect(Frame& frame);
+};
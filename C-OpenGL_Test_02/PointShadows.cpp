@@ -0,0 +1,316 @@
+#include "PointShadows.h"
+#include<gtc/matrix_transform.hpp>
+#include<gtc/type_ptr.hpp>
+#include<qopenglcontext.h>
+#include<qdebug.h>
+#include<algorithm>
+#include<functional>
+#include"AssetPack.h"
+
+void PointShadows::init()
+{
+    QOpenGLFunctions_4_5_Core::initializeOpenGLFunctions();
+
+    //the vertex shaders pick the cube face layer themselves where the driver allows it, otherwise a pass through
+    //geometry shader does, still one draw for all six faces
+    bool layerFromVertex = QOpenGLContext::currentContext()->hasExtension("GL_ARB_shader_viewport_layer_array");
+    if (!layerFromVertex)
+        qWarning() << "no GL_ARB_shader_viewport_layer_array, point shadow faces are routed through a geometry shader";
+    shadowShader.create();
+    AssetPack::addShader(shadowShader, QOpenGLShader::Vertex, "./shaders/pointShadow.vert");
+    AssetPack::addShader(shadowShader, QOpenGLShader::Fragment, "./shaders/emptyFrag.frag");
+    modelShadowShader.create();
+    AssetPack::addShader(modelShadowShader, QOpenGLShader::Vertex, "./shaders/modelPointShadow.vert");
+    AssetPack::addShader(modelShadowShader, QOpenGLShader::Fragment, "./shaders/emptyFrag.frag");
+    if (!layerFromVertex)
+    {
+        AssetPack::addShader(shadowShader, QOpenGLShader::Geometry, "./shaders/pointShadowLayer.geom");
+        AssetPack::addShader(modelShadowShader, QOpenGLShader::Geometry, "./shaders/pointShadowLayer.geom");
+    }
+    supported = shadowShader.link() && modelShadowShader.link();
+    if (!supported)
+    {
+        qWarning() << "point shadow programs failed to link, point light shadows are off";
+        shadowsEnabled = false;
+    }
+
+    GpuResources& gpu = GpuResources::instance();
+    atlas = gpu.createTexture(GL_TEXTURE_CUBE_MAP_ARRAY, "point shadow atlas");
+    glTextureStorage3D(atlas.get(), 1, GL_DEPTH_COMPONENT32F, cubeSize, cubeSize, cubeSlots * 6);
+    atlas.setBytes(GpuResources::textureBytes(GL_DEPTH_COMPONENT32F, 1, cubeSize, cubeSize) * cubeSlots * 6);
+    atlasLayers = gpu.createTextureView(GL_TEXTURE_2D_ARRAY, atlas.get(), GL_DEPTH_COMPONENT32F, 0, 1, 0, cubeSlots * 6, "point shadow atlas layers");
+    //bilinear comparisons, a 2x2 filter for free
+    glTextureParameteri(atlasLayers.get(), GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(atlasLayers.get(), GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(atlasLayers.get(), GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(atlasLayers.get(), GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(atlasLayers.get(), GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTextureParameteri(atlasLayers.get(), GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+    //attached with every layer, gl_Layer picks the face
+    fbo = gpu.createFramebuffer("point shadow atlas");
+    glNamedFramebufferTexture(fbo.get(), GL_DEPTH_ATTACHMENT, atlas.get(), 0);
+    glNamedFramebufferDrawBuffer(fbo.get(), GL_NONE);
+    glNamedFramebufferReadBuffer(fbo.get(), GL_NONE);
+
+    casterBuffer = gpu.createBuffer(maxCasters * sizeof(GpuCaster), nullptr, 0, "point shadow casters");
+    for (auto& i : frames)
+        glGenQueries(levelNum + 1, i.queries.data());
+    resetTiles();
+}
+
+void PointShadows::setEnabled(bool enable)
+{
+    shadowsEnabled = enable && supported;
+}
+
+bool PointShadows::enabled() const
+{
+    return shadowsEnabled;
+}
+
+void PointShadows::render(ClusteredLights& lights, const Camera& camera, const glm::mat4& modelMat, const std::function<void()>& drawCasters,
+    const std::function<void()>& drawModel)
+{
+    frameIndex = (frameIndex + 1) % queryLatency;
+    Frame& frame = frames[frameIndex];
+    if (frame.issued)
+        collect(frame);
+    ++frameCount;
+
+    const std::vector<ClusteredLights::PointLight>& current = lights.currentLights();
+    int currentCount = shadowsEnabled ? static_cast<int>(current.size()) : -1;
+    if (currentCount != lightCount)
+    {
+        //other lights or none at all, the tiles hold nothing of use
+        casters.clear();
+        resetTiles();
+        lightCount = currentCount;
+    }
+    statistics.casters = 0;
+    statistics.rendered = 0;
+    statistics.tiles.fill(0);
+    if (!shadowsEnabled)
+        return;
+
+    //the lights largest on screen, a face of the cube gets about half the size of the light on screen
+    std::vector<std::pair<float, int>> candidates;
+    for (size_t i = 0; i < current.size(); ++i)
+    {
+        float size = camera.projectedSize(glm::vec3(current[i].positionRange), current[i].positionRange.w);
+        if (size >= minScreenSize)
+            candidates.emplace_back(size, static_cast<int>(i));
+    }
+    size_t keep = std::min(candidates.size(), static_cast<size_t>(maxCasters));
+    std::partial_sort(candidates.begin(), candidates.begin() + keep, candidates.end(), std::greater<std::pair<float, int>>());
+    candidates.resize(keep);
+
+    //a caster with the same light and tile size keeps its tile and what was rendered into it
+    std::vector<Caster> next;
+    std::vector<bool> kept(casters.size(), false);
+    for (auto& i : candidates)
+    {
+        int level = 0;
+        while (level + 1 < levelNum && tileSize(level + 1) >= i.first * 0.5f)
+            ++level;
+        auto found = std::find_if(casters.begin(), casters.end(), [&](const Caster& caster) {
+            return caster.light == i.second && caster.tile.level == level;
+        });
+        if (found != casters.end())
+        {
+            kept[found - casters.begin()] = true;
+            next.push_back(*found);
+            continue;
+        }
+        Tile tile;
+        tile.level = level;
+        next.push_back(Caster{ i.second, tile, -1, {} });
+    }
+    for (size_t i = 0; i < casters.size(); ++i)
+    {
+        if (!kept[i])
+            freeTiles[casters[i].tile.level].push_back(casters[i].tile);
+    }
+
+    //largest first, when the free tiles are too fragmented everything is packed again and rendered anew,
+    //lights that still do not fit get smaller tiles
+    auto largestFirst = [](const Caster& a, const Caster& b) {
+        return a.tile.level < b.tile.level;
+    };
+    std::stable_sort(next.begin(), next.end(), largestFirst);
+    bool packed = true;
+    for (auto& i : next)
+    {
+        if (i.tile.slot < 0 && !allocate(i.tile.level, i.tile))
+        {
+            packed = false;
+            break;
+        }
+    }
+    if (!packed)
+    {
+        resetTiles();
+        for (auto& i : next)
+        {
+            int level = i.tile.level;
+            i.tile.slot = -1;
+            i.lastRendered = -1;
+            while (!allocate(level, i.tile) && level + 1 < levelNum)
+                ++level;
+        }
+        next.erase(std::remove_if(next.begin(), next.end(), [](const Caster& i) { return i.tile.slot < 0; }), next.end());
+        std::stable_sort(next.begin(), next.end(), largestFirst);
+    }
+    casters = std::move(next);
+
+    //tiles of the same size together, so the time between two stamps is what that size costs
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo.get());
+    frame.rendered.fill(0);
+    size_t index = 0;
+    for (int level = 0; level < levelNum; ++level)
+    {
+        glQueryCounter(frame.queries[level], GL_TIMESTAMP);
+        int size = tileSize(level);
+        for (; index < casters.size() && casters[index].tile.level == level; ++index)
+        {
+            Caster& caster = casters[index];
+            if (caster.lastRendered >= 0 && frameCount - caster.lastRendered < refreshInterval(level))
+                continue;
+            const ClusteredLights::PointLight& light = current[caster.light];
+            caster.faceMats = faceMatrices(glm::vec3(light.positionRange), light.positionRange.w);
+            caster.lastRendered = frameCount;
+            frame.rendered[level]++;
+
+            float cleared = 1.0f;
+            glClearTexSubImage(atlas.get(), 0, caster.tile.x, caster.tile.y, caster.tile.slot * 6, size, size, 6, GL_DEPTH_COMPONENT, GL_FLOAT, &cleared);
+            glViewport(caster.tile.x, caster.tile.y, size, size);
+            shadowShader.bind();
+            glUniformMatrix4fv(shadowShader.uniformLocation("faceMats"), 6, GL_FALSE, glm::value_ptr(caster.faceMats[0]));
+            glUniform1i(shadowShader.uniformLocation("cubeSlot"), caster.tile.slot);
+            drawCasters();
+            if (drawModel)
+            {
+                modelShadowShader.bind();
+                glUniformMatrix4fv(modelShadowShader.uniformLocation("faceMats"), 6, GL_FALSE, glm::value_ptr(caster.faceMats[0]));
+                glUniformMatrix4fv(modelShadowShader.uniformLocation("modelMat"), 1, GL_FALSE, glm::value_ptr(modelMat));
+                glUniform1i(modelShadowShader.uniformLocation("cubeSlot"), caster.tile.slot);
+                drawModel();
+            }
+        }
+    }
+    glQueryCounter(frame.queries[levelNum], GL_TIMESTAMP);
+    frame.issued = true;
+    glBindVertexArray(0);
+
+    //the matrices a tile was rendered with, a tile that was not refreshed is sampled the way it was made
+    std::vector<GpuCaster> gpuCasters(casters.size());
+    for (size_t i = 0; i < casters.size(); ++i)
+    {
+        const Caster& caster = casters[i];
+        int size = tileSize(caster.tile.level);
+        GpuCaster& gpuCaster = gpuCasters[i];
+        std::copy(caster.faceMats.begin(), caster.faceMats.end(), gpuCaster.faceMats);
+        gpuCaster.rect = glm::vec4(caster.tile.x, caster.tile.y, size, size) / static_cast<float>(cubeSize);
+        gpuCaster.params = glm::vec4(static_cast<float>(caster.tile.slot), 1.0f / size, 0.5f / size, 0.0f);
+        lights.setShadowCaster(caster.light, static_cast<int>(i));
+        statistics.tiles[caster.tile.level]++;
+    }
+    if (!gpuCasters.empty())
+        glNamedBufferSubData(casterBuffer.get(), 0, gpuCasters.size() * sizeof(GpuCaster), gpuCasters.data());
+    statistics.casters = static_cast<int>(casters.size());
+    for (int i : frame.rendered)
+        statistics.rendered += i;
+}
+
+void PointShadows::bind()
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, casterBinding, casterBuffer.get());
+    glBindTextureUnit(atlasUnit, atlasLayers.get());
+}
+
+const PointShadows::Stats& PointShadows::stats() const
+{
+    return statistics;
+}
+
+int PointShadows::tileSize(int level)
+{
+    return cubeSize >> level;
+}
+
+int PointShadows::refreshInterval(int level)
+{
+    //the two largest sizes every frame, then every second and every fourth
+    return 1 << std::max(level - 1, 0);
+}
+
+std::array<glm::mat4, 6> PointShadows::faceMatrices(const glm::vec3& position, float range)
+{
+    //90 degrees each, meeting at the edges, the far plane at the distance the light fades out at
+    glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.02f, range);
+    const std::array<glm::vec3, 6> directions{ glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+        glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f) };
+    const std::array<glm::vec3, 6> ups{ glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+        glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f) };
+    std::array<glm::mat4, 6> mats;
+    for (int i = 0; i < 6; ++i)
+        mats[i] = projection * glm::lookAt(position, position + directions[i], ups[i]);
+    return mats;
+}
+
+void PointShadows::resetTiles()
+{
+    for (auto& i : freeTiles)
+        i.clear();
+    for (int i = 0; i < cubeSlots; ++i)
+    {
+        Tile tile;
+        tile.slot = i;
+        freeTiles[0].push_back(tile);
+    }
+}
+
+bool PointShadows::allocate(int level, Tile& tile)
+{
+    //a free tile of this size, or one of the next larger size split in four
+    if (freeTiles[level].empty())
+    {
+        Tile parent;
+        if (level == 0 || !allocate(level - 1, parent))
+            return false;
+        int size = tileSize(level);
+        for (int i = 3; i >= 1; --i)
+        {
+            Tile child = parent;
+            child.level = level;
+            child.x += (i & 1) * size;
+            child.y += (i >> 1) * size;
+            freeTiles[level].push_back(child);
+        }
+        tile = parent;
+        tile.level = level;
+        return true;
+    }
+    tile = freeTiles[level].back();
+    freeTiles[level].pop_back();
+    return true;
+}
+
+void PointShadows::collect(Frame& frame)
+{
+    //issued queryLatency frames ago, normally long available
+    std::array<GLuint64, levelNum + 1> times{};
+    for (int i = 0; i <= levelNum; ++i)
+        glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &times[i]);
+    frame.issued = false;
+
+    auto average = [](float& value, float sample) {
+        value = value == 0.0f ? sample : value * 0.95f + sample * 0.05f;
+    };
+    for (int i = 0; i < levelNum; ++i)
+    {
+        if (frame.rendered[i])
+            average(statistics.msPerLight[i], (times[i + 1] - times[i]) / 1e6f / frame.rendered[i]);
+    }
+    average(statistics.totalMs, (times[levelNum] - times[0]) / 1e6f);
+}
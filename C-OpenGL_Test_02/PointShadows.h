@@ -0,0 +1,108 @@
+#pragma once
+#include<qopenglfunctions_4_5_core.h>
+#include<qopenglshaderprogram.h>
+#include<glm.hpp>
+#include<array>
+#include<functional>
+#include<vector>
+#include"GpuResources.h"
+#include"ClusteredLights.h"
+#include"Camera.h"
+
+//shadows for the point lights that are largest on screen, a light renders all six faces of its cube in one pass,
+//every instance of a caster goes to one face through gl_Layer, the cube map array is used as an atlas where a light
+//gets the same square tile in the six faces of one cube slot, sized by how large it is on screen, small tiles refresh less often
+class PointShadows :protected QOpenGLFunctions_4_5_Core
+{
+public:
+    constexpr static int cubeSize = 512;
+    constexpr static int cubeSlots = 4;
+    //tiles of 512, 256, 128 and 64 texels
+    constexpr static int levelNum = 4;
+    constexpr static int maxCasters = 32;
+    //lights smaller than this many pixels on screen cast no shadow
+    constexpr static float minScreenSize = 16.0f;
+    constexpr static int queryLatency = 3;
+    //clusteredLighting.frag
+    constexpr static unsigned int casterBinding = 10, atlasUnit = 8;
+
+    struct Stats
+    {
+        int casters = 0;
+        int rendered = 0;
+        std::array<int, levelNum> tiles{};
+        //GPU time of rendering one light at every tile size, averaged
+        std::array<float, levelNum> msPerLight{};
+        float totalMs = 0.0f;
+    };
+
+    void init();
+    void setEnabled(bool enable);
+    bool enabled() const;
+    //picks the casters among the animated lights, renders the tiles that are due and marks the casters in lights,
+    //drawCasters draws the boxes and the plane and drawModel the model meshes, both with six instances per instance
+    void render(ClusteredLights& lights, const Camera& camera, const glm::mat4& modelMat, const std::function<void()>& drawCasters,
+        const std::function<void()>& drawModel);
+    //binds the caster buffer and the atlas for the shading pass
+    void bind();
+    const Stats& stats() const;
+
+private:
+    //std430 layout of clusteredLighting.frag
+    struct GpuCaster
+    {
+        glm::mat4 faceMats[6];
+        glm::vec4 rect;
+        glm::vec4 params;
+    };
+
+    struct Tile
+    {
+        int slot = -1;
+        int x = 0, y = 0;
+        int level = 0;
+    };
+
+    struct Caster
+    {
+        int light;
+        Tile tile;
+        int lastRendered;
+        std::array<glm::mat4, 6> faceMats;
+    };
+
+    struct Frame
+    {
+        std::array<unsigned int, levelNum + 1> queries{};
+        std::array<int, levelNum> rendered{};
+        bool issued = false;
+    };
+
+    bool shadowsEnabled = true;
+    //false when the shadow programs did not link, shadows then stay off
+    bool supported = true;
+    QOpenGLShaderProgram shadowShader;
+    QOpenGLShaderProgram modelShadowShader;
+    GpuResources::Texture atlas;
+    //the same storage as six 2D layers per cube, for sampling a tile out of a face
+    GpuResources::Texture atlasLayers;
+    GpuResources::Framebuffer fbo;
+    GpuResources::Buffer casterBuffer;
+
+    std::vector<Caster> casters;
+    std::array<std::vector<Tile>, levelNum> freeTiles;
+    int lightCount = -1;
+    int frameCount = 0;
+
+    std::array<Frame, queryLatency> frames;
+    int frameIndex = 0;
+    Stats statistics;
+
+    static int tileSize(int level);
+    //frames between refreshes of a tile
+    static int refreshInterval(int level);
+    static std::array<glm::mat4, 6> faceMatrices(const glm::vec3& position, float range);
+    void resetTiles();
+    bool allocate(int level, Tile& tile);
+    void collect(Frame& frame);
+};
@@ -0,0 +1,262 @@
+#include "PostProcess.h"
+#include<algorithm>
+#include<cmath>
+#include<utility>
+#include"AssetPack.h"
+
+void PostProcess::init()
+{
+    QOpenGLFunctions_4_5_Core::initializeOpenGLFunctions();
+
+    separableShader.create();
+    AssetPack::addShader(separableShader, QOpenGLShader::Compute, "./shaders/separableFilter.comp");
+    separableShader.link();
+
+    downsampleShader.create();
+    AssetPack::addShader(downsampleShader, QOpenGLShader::Compute, "./shaders/downsample.comp");
+    downsampleShader.link();
+
+    upsampleShader.create();
+    AssetPack::addShader(upsampleShader, QOpenGLShader::Compute, "./shaders/bilateralUpsample.comp");
+    upsampleShader.link();
+}
+
+void PostProcess::resize(int w, int h)
+{
+    width = w;
+    height = h;
+    releasePool();
+}
+
+void PostProcess::addEffect(EffectType type, Resolution resolution, float strength, int radius)
+{
+    radius = std::min(std::max(radius, 1), maxRadius);
+    if (type == EffectType::Edge)
+        radius = 1;
+    effectList.push_back(Effect{ type, resolution, strength, radius });
+}
+
+void PostProcess::clearEffects()
+{
+    effectList.clear();
+}
+
+bool PostProcess::empty() const
+{
+    return effectList.empty();
+}
+
+const std::vector<PostProcess::Effect>& PostProcess::effects() const
+{
+    return effectList;
+}
+
+std::string PostProcess::effectName(const Effect& effect) const
+{
+    std::string name;
+    switch (effect.type)
+    {
+    case EffectType::Blur:
+        name = "blur";
+        break;
+    case EffectType::Sharpen:
+        name = "sharpen";
+        break;
+    case EffectType::Edge:
+        name = "edge";
+        break;
+    }
+    if (effect.resolution == Resolution::Half)
+        name += " (half)";
+    else if (effect.resolution == Resolution::Quarter)
+        name += " (quarter)";
+    return name;
+}
+
+unsigned int PostProcess::run(unsigned int colorTex, unsigned int depthTex)
+{
+    if (timerQueries.size() != effectList.size())
+    {
+        for (auto& i : timerQueries)
+            glDeleteQueries(queryLatency, i.data());
+        timerQueries.resize(effectList.size());
+        for (auto& i : timerQueries)
+            glGenQueries(queryLatency, i.data());
+        frameIndex = 0;
+    }
+    collectTimings();
+
+    unsigned int current = colorTex;
+    if (effectList.empty())
+        return current;
+
+    //intermediate results bounce between two pooled targets
+    std::array<unsigned int, 2> pingPong{ acquireTarget(width, height, GL_RGBA16F), acquireTarget(width, height, GL_RGBA16F) };
+    for (size_t i = 0; i < effectList.size(); ++i)
+    {
+        unsigned int target = pingPong[i % 2];
+        glBeginQuery(GL_TIME_ELAPSED, timerQueries[i][frameIndex % queryLatency]);
+        runEffect(effectList[i], current, depthTex, target);
+        glEndQuery(GL_TIME_ELAPSED);
+        current = target;
+    }
+    releaseTarget(pingPong[0]);
+    releaseTarget(pingPong[1]);
+    ++frameIndex;
+    return current;
+}
+
+unsigned int PostProcess::acquireTarget(int w, int h, unsigned int format)
+{
+    for (auto& i : targetPool)
+    {
+        if (!i.inUse && i.width == w && i.height == h && i.format == format)
+        {
+            i.inUse = true;
+            return i.tex.get();
+        }
+    }
+
+    RenderTarget target{ GpuResources::instance().createTexture2D(format, 1, w, h, "post process target"), w, h, format, true };
+    unsigned int tex = target.tex.get();
+    glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(tex, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(tex, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    targetPool.push_back(std::move(target));
+    return tex;
+}
+
+void PostProcess::releaseTarget(unsigned int tex)
+{
+    for (auto& i : targetPool)
+    {
+        if (i.tex.get() == tex)
+        {
+            i.inUse = false;
+            return;
+        }
+    }
+}
+
+void PostProcess::releasePool()
+{
+    targetPool.clear();
+}
+
+void PostProcess::separablePass(unsigned int source, unsigned int original, unsigned int target, int w, int h,
+    bool horizontal, const std::vector<float>& weights, float originalWeight, float filteredWeight)
+{
+    separableShader.bind();
+    glUniform2i(separableShader.uniformLocation("direction"), horizontal ? 1 : 0, horizontal ? 0 : 1);
+    glUniform1i(separableShader.uniformLocation("radius"), static_cast<int>(weights.size() / 2));
+    glUniform1fv(separableShader.uniformLocation("weights[0]"), static_cast<int>(weights.size()), weights.data());
+    glUniform2f(separableShader.uniformLocation("combine"), originalWeight, filteredWeight);
+    glBindTextureUnit(0, source);
+    glBindTextureUnit(1, original);
+    glBindImageTexture(0, target, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+
+    //one work group filters a tile of one row (or column)
+    int lineLength = horizontal ? w : h;
+    int lineCount = horizontal ? h : w;
+    glDispatchCompute((lineLength + tileSize - 1) / tileSize, lineCount, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+void PostProcess::runEffect(const Effect& effect, unsigned int source, unsigned int depthTex, unsigned int target)
+{
+    std::vector<float> weights;
+    float originalWeight = 0.0f, filteredWeight = 1.0f;
+    if (effect.type == EffectType::Edge)
+    {
+        //1,1,1/1,-8,1/1,1,1 is a separable 3x3 box minus nine times the center
+        weights = { 1.0f, 1.0f, 1.0f };
+        originalWeight = -9.0f * effect.strength;
+        filteredWeight = effect.strength;
+    }
+    else
+    {
+        float sigma = std::max(effect.radius * 0.5f, 0.5f);
+        float sum = 0.0f;
+        for (int i = -effect.radius; i <= effect.radius; ++i)
+        {
+            weights.push_back(std::exp(-(i * i) / (2.0f * sigma * sigma)));
+            sum += weights.back();
+        }
+        for (auto& i : weights)
+            i /= sum;
+        if (effect.type == EffectType::Sharpen)
+        {
+            //unsharp mask: original + strength * (original - blurred)
+            originalWeight = 1.0f + effect.strength;
+            filteredWeight = -effect.strength;
+        }
+    }
+
+    int scale = static_cast<int>(effect.resolution);
+    if (scale == 1)
+    {
+        unsigned int temp = acquireTarget(width, height, GL_RGBA16F);
+        separablePass(source, source, temp, width, height, true, weights, 0.0f, 1.0f);
+        separablePass(temp, source, target, width, height, false, weights, originalWeight, filteredWeight);
+        releaseTarget(temp);
+        return;
+    }
+
+    int lowWidth = std::max(width / scale, 1);
+    int lowHeight = std::max(height / scale, 1);
+    unsigned int lowColor = acquireTarget(lowWidth, lowHeight, GL_RGBA16F);
+    unsigned int lowTemp = acquireTarget(lowWidth, lowHeight, GL_RGBA16F);
+    unsigned int lowResult = acquireTarget(lowWidth, lowHeight, GL_RGBA16F);
+    unsigned int lowDepth = acquireTarget(lowWidth, lowHeight, GL_R32F);
+
+    downsampleShader.bind();
+    glUniform1i(downsampleShader.uniformLocation("scale"), scale);
+    glBindTextureUnit(0, source);
+    glBindTextureUnit(1, depthTex);
+    glBindImageTexture(0, lowColor, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    glBindImageTexture(1, lowDepth, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glDispatchCompute((lowWidth + 7) / 8, (lowHeight + 7) / 8, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+    //edge detection only makes sense against the image it was computed on, so it is combined at low resolution
+    bool combineLow = effect.type == EffectType::Edge;
+    separablePass(lowColor, lowColor, lowTemp, lowWidth, lowHeight, true, weights, 0.0f, 1.0f);
+    separablePass(lowTemp, lowColor, lowResult, lowWidth, lowHeight, false, weights,
+        combineLow ? originalWeight : 0.0f, combineLow ? filteredWeight : 1.0f);
+
+    upsampleShader.bind();
+    glUniform2f(upsampleShader.uniformLocation("combine"), combineLow ? 0.0f : originalWeight, combineLow ? 1.0f : filteredWeight);
+    glUniform1f(upsampleShader.uniformLocation("depthSharpness"), 500.0f);
+    glBindTextureUnit(0, lowResult);
+    glBindTextureUnit(1, lowDepth);
+    glBindTextureUnit(2, source);
+    glBindTextureUnit(3, depthTex);
+    glBindImageTexture(0, target, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+    releaseTarget(lowColor);
+    releaseTarget(lowTemp);
+    releaseTarget(lowResult);
+    releaseTarget(lowDepth);
+}
+
+void PostProcess::collectTimings()
+{
+    //queries are read queryLatency frames after they were issued so the CPU never waits on them
+    if (frameIndex < queryLatency)
+        return;
+    unsigned int slot = frameIndex % queryLatency;
+    for (size_t i = 0; i < effectList.size(); ++i)
+    {
+        int available = 0;
+        glGetQueryObjectiv(timerQueries[i][slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(timerQueries[i][slot], GL_QUERY_RESULT, &elapsed);
+            effectList[i].gpuTimeMs = static_cast<float>(elapsed / 1.0e6);
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include<qopenglfunctions_4_5_core.h>
+#include<qopenglshaderprogram.h>
+#include<array>
+#include<string>
+#include<vector>
+#include"GpuResources.h"
+
+class PostProcess :protected QOpenGLFunctions_4_5_Core
+{
+public:
+    enum class EffectType
+    {
+        Blur, Sharpen, Edge
+    };
+
+    //effects can run at a fraction of the target size and are bilaterally upsampled back
+    enum class Resolution
+    {
+        Full = 1, Half = 2, Quarter = 4
+    };
+
+    struct Effect
+    {
+        EffectType type;
+        Resolution resolution;
+        float strength;
+        int radius;
+        float gpuTimeMs = 0.0f;
+    };
+
+    constexpr static int tileSize = 128;
+    constexpr static int maxRadius = 8;
+    constexpr static int queryLatency = 3;
+
+    void init();
+    void resize(int w, int h);
+    void addEffect(EffectType type, Resolution resolution = Resolution::Full, float strength = 1.0f, int radius = 4);
+    void clearEffects();
+    bool empty() const;
+    const std::vector<Effect>& effects() const;
+    std::string effectName(const Effect& effect) const;
+
+    //runs every effect over colorTex and returns the texture holding the result
+    unsigned int run(unsigned int colorTex, unsigned int depthTex);
+
+private:
+    struct RenderTarget
+    {
+        GpuResources::Texture tex;
+        int width, height;
+        unsigned int format;
+        bool inUse;
+    };
+
+    int width = 0, height = 0;
+    std::vector<Effect> effectList;
+    std::vector<std::array<unsigned int, queryLatency>> timerQueries;
+    unsigned int frameIndex = 0;
+    std::vector<RenderTarget> targetPool;
+
+    QOpenGLShaderProgram separableShader;
+    QOpenGLShaderProgram downsampleShader;
+    QOpenGLShaderProgram upsampleShader;
+
+    unsigned int acquireTarget(int w, int h, unsigned int format);
+    void releaseTarget(unsigned int tex);
+    void releasePool();
+
+    void separablePass(unsigned int source, unsigned int original, unsigned int target, int w, int h,
+        bool horizontal, const std::vector<float>& weights, float originalWeight, float filteredWeight);
+    void runEffect(const Effect& effect, unsigned int source, unsigned int depthTex, unsigned int target);
+    void collectTimings();
+};
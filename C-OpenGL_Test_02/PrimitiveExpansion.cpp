@@ -0,0 +1,218 @@
+#include "PrimitiveExpansion.h"
+#include<gtc/type_ptr.hpp>
+#include<qdebug.h>
+#include<cmath>
+#include"AssetPack.h"
+
+void PrimitiveExpansion::init()
+{
+    QOpenGLFunctions_4_5_Core::initializeOpenGLFunctions();
+
+    //geometry shader pipelines and the vertex shaders that replace them, by effect
+    const char* stages[effectNum - 1][4] = {
+        { "./shaders/modelNormal.vert", "./shaders/modelNormal.geom", "./shaders/pulledNormals.vert", "./shaders/modelNormal.frag" },
+        { "./shaders/modelGeometry.vert", "./shaders/modelGeometry.geom", "./shaders/pulledExplode.vert", "./shaders/modelGeometry.frag" },
+        { "./shaders/pointsGeometry.vert", "./shaders/pointsGeometry.geom", "./shaders/pulledSprites.vert", "./shaders/pointsGeometry.frag" },
+    };
+    for (int i = 0; i < effectNum - 1; ++i)
+    {
+        auto& geometry = programs[i][static_cast<int>(Path::GeometryShader)];
+        geometry = std::make_unique<QOpenGLShaderProgram>();
+        AssetPack::addShader(*geometry, QOpenGLShader::Vertex, stages[i][0]);
+        AssetPack::addShader(*geometry, QOpenGLShader::Geometry, stages[i][1]);
+        AssetPack::addShader(*geometry, QOpenGLShader::Fragment, stages[i][3]);
+        geometry->link();
+        auto& pulling = programs[i][static_cast<int>(Path::VertexPulling)];
+        pulling = std::make_unique<QOpenGLShaderProgram>();
+        AssetPack::addShader(*pulling, QOpenGLShader::Vertex, stages[i][2]);
+        AssetPack::addShader(*pulling, QOpenGLShader::Vertex, "./shaders/vertexPulling.vert");
+        AssetPack::addShader(*pulling, QOpenGLShader::Fragment, stages[i][3]);
+        pulling->link();
+    }
+    emptyVao = GpuResources::instance().createVertexArray("vertex pulling");
+    for (auto& i : frames)
+        glGenQueries(2, i.queries.data());
+}
+
+void PrimitiveExpansion::setEffect(Effect effect)
+{
+    currentEffect = effect;
+}
+
+PrimitiveExpansion::Effect PrimitiveExpansion::effect() const
+{
+    return currentEffect;
+}
+
+void PrimitiveExpansion::setPath(Path path)
+{
+    currentPath = path;
+}
+
+PrimitiveExpansion::Path PrimitiveExpansion::path() const
+{
+    return currentPath;
+}
+
+const char* PrimitiveExpansion::effectName(Effect effect)
+{
+    switch (effect)
+    {
+    case Effect::Normals:
+        return "normals";
+    case Effect::Explode:
+        return "explode";
+    case Effect::Sprites:
+        return "sprites";
+    default:
+        return "off";
+    }
+}
+
+const char* PrimitiveExpansion::pathName(Path path)
+{
+    return path == Path::GeometryShader ? "geometry shader" : "vertex pulling";
+}
+
+void PrimitiveExpansion::draw(Model& model, const glm::mat4& viewProjection, const glm::mat4& modelMat, float time)
+{
+    frameIndex = (frameIndex + 1) % queryLatency;
+    Frame& frame = frames[frameIndex];
+    if (frame.issued)
+        collect(frame);
+    if (currentEffect == Effect::Off)
+        return;
+
+    QOpenGLShaderProgram& program = *programs[static_cast<int>(currentEffect) - 1][static_cast<int>(currentPath)];
+    glm::mat3 normalMat = glm::transpose(glm::inverse(glm::mat3(modelMat)));
+    program.bind();
+    glUniformMatrix4fv(program.uniformLocation("VP"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+    glUniformMatrix4fv(program.uniformLocation("modelMat"), 1, GL_FALSE, glm::value_ptr(modelMat));
+    glUniformMatrix3fv(program.uniformLocation("modelNormalMat"), 1, GL_FALSE, glm::value_ptr(normalMat));
+    glUniform1f(program.uniformLocation("normalLength"), 0.05f);
+    glUniform1f(program.uniformLocation("explodeConst"), (std::sin(time) + 1.0f) * 0.1f);
+    glUniform1f(program.uniformLocation("spriteSize"), 0.004f);
+
+    glQueryCounter(frame.queries[0], GL_TIMESTAMP);
+    drawMeshes(model, program);
+    glQueryCounter(frame.queries[1], GL_TIMESTAMP);
+    frame.issued = true;
+    frame.effect = currentEffect;
+    frame.path = currentPath;
+    frame.benchmarkStep = stepIndex;
+    glBindVertexArray(0);
+}
+
+void PrimitiveExpansion::drawMeshes(Model& model, QOpenGLShaderProgram& program)
+{
+    if (currentPath == Path::GeometryShader)
+    {
+        model.forEachMesh([&](Mesh& mesh) {
+            mesh.bind();
+            if (currentEffect == Effect::Sprites)
+                mesh.drawPoints();
+            else
+            {
+                mesh.setShaderVariables(&program);
+                mesh.draw();
+            }
+        });
+        return;
+    }
+    //one vertex shader invocation per emitted vertex, what the geometry shader made per input primitive
+    //comes from gl_VertexID, the instances are still the node transforms
+    glBindVertexArray(emptyVao.get());
+    model.forEachMesh([&](Mesh& mesh) {
+        mesh.bindPullBuffers(vertexBinding, indexBinding, nodeBinding);
+        int instances = static_cast<int>(mesh.getNodeTransforms().size());
+        switch (currentEffect)
+        {
+        case Effect::Normals:
+            glDrawArraysInstanced(GL_LINES, 0, mesh.indicesNum * 2, instances);
+            break;
+        case Effect::Explode:
+            mesh.setShaderVariables(&program);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, mesh.indicesNum, instances);
+            break;
+        default:
+            glDrawArraysInstanced(GL_TRIANGLES, 0, static_cast<int>(mesh.vertexNum()) * 9, instances);
+            break;
+        }
+    });
+}
+
+const PrimitiveExpansion::Stats& PrimitiveExpansion::stats() const
+{
+    return statistics;
+}
+
+void PrimitiveExpansion::toggleBenchmark()
+{
+    if (benchmarkRunning())
+    {
+        qDebug() << "primitive expansion benchmark stopped";
+        stepIndex = -1;
+        setEffect(savedEffect);
+        setPath(savedPath);
+        return;
+    }
+    benchmarkSteps.clear();
+    for (int i = 1; i < effectNum; ++i)
+    {
+        benchmarkSteps.push_back(Step{ static_cast<Effect>(i), Path::GeometryShader, 0, 0.0 });
+        benchmarkSteps.push_back(Step{ static_cast<Effect>(i), Path::VertexPulling, 0, 0.0 });
+    }
+    savedEffect = currentEffect;
+    savedPath = currentPath;
+    stepIndex = 0;
+    applyStep();
+    qDebug() << "primitive expansion benchmark";
+}
+
+bool PrimitiveExpansion::benchmarkRunning() const
+{
+    return stepIndex >= 0;
+}
+
+void PrimitiveExpansion::collect(Frame& frame)
+{
+    //issued queryLatency frames ago, normally long available
+    std::array<GLuint64, 2> times{};
+    for (int i = 0; i < 2; ++i)
+        glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &times[i]);
+    frame.issued = false;
+    float gpuMs = (times[1] - times[0]) / 1e6f;
+
+    float& value = statistics.gpuMs[static_cast<int>(frame.effect)][static_cast<int>(frame.path)];
+    value = value == 0.0f ? gpuMs : value * 0.95f + gpuMs * 0.05f;
+
+    //results of an earlier step arriving late are not counted
+    if (stepIndex < 0 || frame.benchmarkStep != stepIndex)
+        return;
+    Step& step = benchmarkSteps[stepIndex];
+    step.gpuMs += gpuMs;
+    if (++step.frames == framesPerStep)
+        finishStep();
+}
+
+void PrimitiveExpansion::finishStep()
+{
+    const Step& step = benchmarkSteps[stepIndex];
+    qDebug() << "  " << effectName(step.effect) << "through" << pathName(step.path) << ":" << step.gpuMs / step.frames << "ms";
+
+    if (++stepIndex == static_cast<int>(benchmarkSteps.size()))
+    {
+        qDebug() << "primitive expansion benchmark done";
+        stepIndex = -1;
+        setEffect(savedEffect);
+        setPath(savedPath);
+        return;
+    }
+    applyStep();
+}
+
+void PrimitiveExpansion::applyStep()
+{
+    setEffect(benchmarkSteps[stepIndex].effect);
+    setPath(benchmarkSteps[stepIndex].path);
+}
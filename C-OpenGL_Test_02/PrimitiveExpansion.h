@@ -0,0 +1,91 @@
+#pragma once
+#include<qopenglfunctions_4_5_core.h>
+#include<qopenglshaderprogram.h>
+#include<glm.hpp>
+#include<array>
+#include<memory>
+#include<vector>
+#include"GpuResources.h"
+#include"Model.h"
+
+//debug views of the model that make new primitives out of its vertices: normal lines, triangles pushed out along
+//their face normal and a small house sprite per vertex, each once through a geometry shader and once as a plain
+//vertex shader that fetches the mesh buffers itself by gl_VertexID, so the two can be timed against each other
+class PrimitiveExpansion :protected QOpenGLFunctions_4_5_Core
+{
+public:
+    enum class Effect
+    {
+        Off, Normals, Explode, Sprites
+    };
+    enum class Path
+    {
+        GeometryShader, VertexPulling
+    };
+    constexpr static int effectNum = 4;
+    constexpr static int pathNum = 2;
+
+    //GPU time of the effect, averaged over the frames drawn with it, by effect and path
+    struct Stats
+    {
+        std::array<std::array<float, pathNum>, effectNum> gpuMs{};
+    };
+
+    constexpr static int framesPerStep = 120;
+    constexpr static int queryLatency = 3;
+    //vertexPulling.vert
+    constexpr static unsigned int vertexBinding = 11, indexBinding = 12, nodeBinding = 13;
+
+    void init();
+    void setEffect(Effect effect);
+    Effect effect() const;
+    void setPath(Path path);
+    Path path() const;
+    static const char* effectName(Effect effect);
+    static const char* pathName(Path path);
+    //draws the current effect of the model into the bound framebuffer
+    void draw(Model& model, const glm::mat4& viewProjection, const glm::mat4& modelMat, float time);
+    const Stats& stats() const;
+
+    //every effect through both paths, logs the GPU time of each
+    void toggleBenchmark();
+    bool benchmarkRunning() const;
+
+private:
+    struct Frame
+    {
+        std::array<unsigned int, 2> queries{};
+        bool issued = false;
+        Effect effect = Effect::Off;
+        Path path = Path::GeometryShader;
+        int benchmarkStep = -1;
+    };
+
+    struct Step
+    {
+        Effect effect;
+        Path path;
+        int frames;
+        double gpuMs;
+    };
+
+    Effect currentEffect = Effect::Off;
+    Path currentPath = Path::VertexPulling;
+    //by effect without Off, then path
+    std::array<std::array<std::unique_ptr<QOpenGLShaderProgram>, pathNum>, effectNum - 1> programs;
+    //the pulling shaders read no attributes, but a draw still needs a vertex array bound
+    GpuResources::VertexArray emptyVao;
+    std::array<Frame, queryLatency> frames;
+    int frameIndex = 0;
+    Stats statistics;
+
+    std::vector<Step> benchmarkSteps;
+    int stepIndex = -1;
+    Effect savedEffect = Effect::Off;
+    Path savedPath = Path::VertexPulling;
+
+    void drawMeshes(Model& model, QOpenGLShaderProgram& program);
+    void collect(Frame& frame);
+    void finishStep();
+    void applyStep();
+};
@@ -0,0 +1,240 @@
+#include "SceneBvh.h"
+#include<algorithm>
+#include<cmath>
+
+void SceneBvh::build(const std::vector<Instance>& instances, JobSystem& jobs)
+{
+    instanceList.clear();
+    placed.clear();
+    std::vector<Bvh::Bounds> instanceBounds;
+    for (auto& i : instances)
+    {
+        if (!i.mesh || i.mesh->empty())
+            continue;
+        instanceList.push_back(i);
+        glm::mat3 linear(i.transform);
+        float minScale = std::min({ glm::length(linear[0]), glm::length(linear[1]), glm::length(linear[2]) });
+        placed.push_back(Placed{ glm::inverse(i.transform), minScale });
+        instanceBounds.push_back(i.mesh->bounds().transformed(i.transform));
+    }
+    tree.build(instanceBounds, jobs);
+}
+
+bool SceneBvh::empty() const
+{
+    return tree.empty();
+}
+
+const Bvh::Bounds& SceneBvh::bounds() const
+{
+    return tree.bounds();
+}
+
+const std::vector<SceneBvh::Instance>& SceneBvh::instances() const
+{
+    return instanceList;
+}
+
+size_t SceneBvh::bytes() const
+{
+    return tree.bytes() + instanceList.size() * (sizeof(Instance) + sizeof(Placed));
+}
+
+bool SceneBvh::intersect(const Bvh::Ray& ray, Bvh::Hit& hit) const
+{
+    if (tree.empty())
+        return false;
+    glm::vec3 invDirection = Bvh::inverse(ray.direction);
+    bool found = false;
+    int32_t stack[Bvh::stackSize];
+    int stackTop = 0;
+    stack[stackTop++] = 0;
+    while (stackTop > 0)
+    {
+        int32_t index = stack[--stackTop];
+        if (index < 0)
+        {
+            const Bvh::Leaf& leaf = tree.leaves()[~index];
+            for (uint32_t i = leaf.first; i < leaf.first + leaf.count; ++i)
+            {
+                //the direction is not renormalized, so distances along the mesh space ray are scene distances
+                uint32_t instance = tree.order()[i];
+                const glm::mat4& inverse = placed[instance].inverse;
+                Bvh::Ray local{ glm::vec3(inverse * glm::vec4(ray.origin, 1.0f)), glm::vec3(inverse * glm::vec4(ray.direction, 0.0f)), ray.maxDistance };
+                if (instanceList[instance].mesh->intersect(local, hit))
+                {
+                    hit.instance = instance;
+                    found = true;
+                }
+            }
+            continue;
+        }
+        const Bvh::Node& node = tree.nodes()[index];
+        float entry[Bvh::width];
+        int mask = Bvh::intersectChildren(node, ray.origin, invDirection, std::min(ray.maxDistance, hit.distance), entry);
+        int order[Bvh::width];
+        int count = 0;
+        for (int i = 0; i < Bvh::width; ++i)
+        {
+            if ((mask >> i & 1) && node.child[i] != Bvh::emptyChild)
+                order[count++] = i;
+        }
+        Bvh::farthestFirst(order, count, entry);
+        for (int i = 0; i < count; ++i)
+            stack[stackTop++] = node.child[order[i]];
+    }
+    return found;
+}
+
+void SceneBvh::intersect(const Bvh::RayPacket& packet, Bvh::Hit hits[4]) const
+{
+    if (tree.empty())
+        return;
+    Bvh::PacketLanes lanes = Bvh::lanes(packet);
+    for (int i = 0; i < 4; ++i)
+    {
+        if (lanes.distance[i] > 0.0f)
+            lanes.distance[i] = std::min(lanes.distance[i], hits[i].distance);
+    }
+    int32_t stack[Bvh::stackSize];
+    int stackTop = 0;
+    stack[stackTop++] = 0;
+    while (stackTop > 0)
+    {
+        int32_t index = stack[--stackTop];
+        if (index < 0)
+        {
+            const Bvh::Leaf& leaf = tree.leaves()[~index];
+            for (uint32_t i = leaf.first; i < leaf.first + leaf.count; ++i)
+            {
+                uint32_t instance = tree.order()[i];
+                const glm::mat4& inverse = placed[instance].inverse;
+                Bvh::RayPacket local = packet;
+                float previous[4];
+                for (int lane = 0; lane < 4; ++lane)
+                {
+                    local[lane].origin = glm::vec3(inverse * glm::vec4(packet[lane].origin, 1.0f));
+                    local[lane].direction = glm::vec3(inverse * glm::vec4(packet[lane].direction, 0.0f));
+                    previous[lane] = hits[lane].distance;
+                }
+                instanceList[instance].mesh->intersect(local, hits);
+                //a mesh only ever writes hits nearer than what was there
+                for (int lane = 0; lane < 4; ++lane)
+                {
+                    if (hits[lane].distance < previous[lane])
+                    {
+                        hits[lane].instance = instance;
+                        lanes.distance[lane] = hits[lane].distance;
+                    }
+                }
+            }
+            continue;
+        }
+        const Bvh::Node& node = tree.nodes()[index];
+        float entry[Bvh::width];
+        int order[Bvh::width];
+        int count = 0;
+        for (int i = 0; i < Bvh::width; ++i)
+        {
+            if (node.child[i] != Bvh::emptyChild && Bvh::intersectChild(node, i, lanes, entry[i]))
+                order[count++] = i;
+        }
+        Bvh::farthestFirst(order, count, entry);
+        for (int i = 0; i < count; ++i)
+            stack[stackTop++] = node.child[order[i]];
+    }
+}
+
+bool SceneBvh::closestPoint(const glm::vec3& point, Bvh::Nearest& nearest) const
+{
+    if (tree.empty())
+        return false;
+    bool found = false;
+    struct Entry
+    {
+        int32_t index;
+        float squared;
+    };
+    Entry stack[Bvh::stackSize];
+    int stackTop = 0;
+    stack[stackTop++] = Entry{ 0, 0.0f };
+    while (stackTop > 0)
+    {
+        Entry entry = stack[--stackTop];
+        if (entry.squared >= nearest.distance * nearest.distance)
+            continue;
+        if (entry.index < 0)
+        {
+            const Bvh::Leaf& leaf = tree.leaves()[~entry.index];
+            for (uint32_t i = leaf.first; i < leaf.first + leaf.count; ++i)
+            {
+                //searched in mesh space with the bound widened by the scale, then measured again in scene space
+                uint32_t instance = tree.order()[i];
+                const Placed& place = placed[instance];
+                Bvh::Nearest local;
+                if (nearest.distance < std::numeric_limits<float>::max())
+                    local.distance = place.minScale > 0.0f ? nearest.distance / place.minScale : std::numeric_limits<float>::max();
+                if (!instanceList[instance].mesh->closestPoint(glm::vec3(place.inverse * glm::vec4(point, 1.0f)), local))
+                    continue;
+                glm::vec3 scenePoint(instanceList[instance].transform * glm::vec4(local.point, 1.0f));
+                float distance = glm::length(scenePoint - point);
+                if (distance < nearest.distance)
+                {
+                    nearest.distance = distance;
+                    nearest.point = scenePoint;
+                    nearest.instance = instance;
+                    nearest.triangle = local.triangle;
+                    found = true;
+                }
+            }
+            continue;
+        }
+        const Bvh::Node& node = tree.nodes()[entry.index];
+        float squared[Bvh::width];
+        Bvh::childDistances(node, point, squared);
+        int order[Bvh::width];
+        int count = 0;
+        for (int i = 0; i < Bvh::width; ++i)
+        {
+            if (node.child[i] != Bvh::emptyChild && squared[i] < nearest.distance * nearest.distance)
+                order[count++] = i;
+        }
+        Bvh::farthestFirst(order, count, squared);
+        for (int i = 0; i < count; ++i)
+            stack[stackTop++] = Entry{ node.child[order[i]], squared[order[i]] };
+    }
+    return found;
+}
+
+void SceneBvh::overlap(const Bvh::Bounds& box, std::vector<Overlap>& overlaps) const
+{
+    if (tree.empty() || box.empty())
+        return;
+    std::vector<unsigned int> triangles;
+    int32_t stack[Bvh::stackSize];
+    int stackTop = 0;
+    stack[stackTop++] = 0;
+    while (stackTop > 0)
+    {
+        int32_t index = stack[--stackTop];
+        if (index < 0)
+        {
+            const Bvh::Leaf& leaf = tree.leaves()[~index];
+            for (uint32_t i = leaf.first; i < leaf.first + leaf.count; ++i)
+            {
+                uint32_t instance = tree.order()[i];
+                triangles.clear();
+                instanceList[instance].mesh->overlap(box, instanceList[instance].transform, triangles);
+                for (auto triangle : triangles)
+                    overlaps.push_back(Overlap{ instance, triangle });
+            }
+            continue;
+        }
+        const Bvh::Node& node = tree.nodes()[index];
+        for (int i = 0; i < Bvh::width; ++i)
+        {
+            if (node.child[i] != Bvh::emptyChild && Bvh::childOverlaps(node, i, box))
+                stack[stackTop++] = node.child[i];
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include<glm.hpp>
+#include<vector>
+#include"Bvh.h"
+#include"MeshBvh.h"
+
+//the top level over placed meshes, every instance is a MeshBvh with the matrix taking its mesh space to scene space,
+//rays are taken into mesh space per instance instead of the triangles into scene space, so moving an instance only
+//means rebuilding this small tree
+class SceneBvh
+{
+public:
+    struct Instance
+    {
+        const MeshBvh* mesh = nullptr;
+        glm::mat4 transform{ 1.0f };
+        //what the caller wants reported for it, the mesh index for a model
+        unsigned int id = 0;
+    };
+
+    struct Overlap
+    {
+        unsigned int instance;
+        unsigned int triangle;
+    };
+
+    void build(const std::vector<Instance>& instances, JobSystem& jobs);
+    bool empty() const;
+    const Bvh::Bounds& bounds() const;
+    const std::vector<Instance>& instances() const;
+    size_t bytes() const;
+
+    //the same queries as MeshBvh in scene space, hit.instance and nearest.instance are the index into instances
+    bool intersect(const Bvh::Ray& ray, Bvh::Hit& hit) const;
+    void intersect(const Bvh::RayPacket& packet, Bvh::Hit hits[4]) const;
+    //exact for rigid and uniformly scaled instances, which is all model node transforms are in practice
+    bool closestPoint(const glm::vec3& point, Bvh::Nearest& nearest) const;
+    void overlap(const Bvh::Bounds& box, std::vector<Overlap>& overlaps) const;
+
+private:
+    struct Placed
+    {
+        glm::mat4 inverse;
+        //the smallest factor the transform scales a length by, turns scene distances into mesh space bounds
+        float minScale;
+    };
+
+    Bvh tree;
+    std::vector<Instance> instanceList;
+    std::vector<Placed> placed;
+};
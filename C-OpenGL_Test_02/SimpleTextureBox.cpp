@@ -2,6 +2,7 @@
 #include<glm.hpp>
 #include<gtc/matrix_transform.hpp>
 #include<gtc/type_ptr.hpp>
+#include"AssetPack.h"
 
 void SimpleTextureBox::init()
 {
@@ -24,15 +25,19 @@ void SimpleTextureBox::init()
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 
     shader.create();
-    shader.addShaderFromSourceFile(QOpenGLShader::Vertex, "triangleVertexShader.vert");
-    shader.addShaderFromSourceFile(QOpenGLShader::Fragment, "triangleFragmentShader.frag");
+    AssetPack::addShader(shader, QOpenGLShader::Vertex, "triangleVertexShader.vert");
+    AssetPack::addShader(shader, QOpenGLShader::Fragment, "triangleFragmentShader.frag");
     shader.link();
 
     shader.bind();
 
     orthogonalMat = glm::ortho(0.0f, 1.0f, 0.0f, 1.0f, -0.5f, 0.5f);
 
-    tex = new QOpenGLTexture(QImage(QString("./images/background.jpg")).mirrored());
+    std::vector<unsigned char> encoded;
+    QImage background;
+    if (AssetPack::instance().read("./images/background.jpg", encoded))
+        background.loadFromData(encoded.data(), static_cast<int>(encoded.size()));
+    tex = new QOpenGLTexture(background.mirrored());
     scaleMat = glm::scale(glm::mat4{ 1.0f }, glm::vec3{ 1.0f,(((float)tex->height() / (float)tex->width()) * (float(1080) / float(1920))),1.0f });
     glUniformMatrix4fv(shader.uniformLocation("translateMat"), 1, GL_FALSE, glm::value_ptr(orthogonalMat * scaleMat));
 
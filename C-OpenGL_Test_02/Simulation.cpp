@@ -0,0 +1,326 @@
+#include "Simulation.h"
+#include<gtc/matrix_transform.hpp>
+#include<qdebug.h>
+#include<algorithm>
+#include<cmath>
+
+using std::chrono::duration_cast;
+using std::chrono::duration;
+using std::chrono::nanoseconds;
+
+namespace
+{
+    const float cameraTolerance = 1e-4f;
+}
+
+glm::mat4 Simulation::Transform::matrix() const
+{
+    glm::mat4 result = glm::translate(glm::mat4{ 1.0f }, position);
+    if (angle != 0.0f)
+        result = glm::rotate(result, angle, axis);
+    return glm::scale(result, scale);
+}
+
+Simulation::Transform Simulation::Transform::interpolate(const Transform& from, const Transform& to, float alpha)
+{
+    //the axis never changes while animating, so blending the parameters is exact enough for one tick
+    Transform result = to;
+    result.position = glm::mix(from.position, to.position, alpha);
+    result.angle = from.angle + (to.angle - from.angle) * alpha;
+    result.scale = glm::mix(from.scale, to.scale, alpha);
+    return result;
+}
+
+Simulation::Simulation()
+{
+    //the scene the window used to set up statically
+    state.boxes[1].position = glm::vec3(0.0f, 1.5f, 0.0f);
+    state.boxes[1].scale = glm::vec3(0.5f);
+    state.boxes[2].position = glm::vec3(-1.0f, 0.0f, 2.0f);
+    state.boxes[2].axis = glm::normalize(glm::vec3(1.0f, 0.0f, 1.0f));
+    state.boxes[2].angle = glm::radians(60.0f);
+    state.boxes[2].scale = glm::vec3(0.25f);
+    state.model.position = glm::vec3(2.5f, -0.5f, 0.0f);
+    state.model.scale = glm::vec3(0.1f);
+    state.cameraPosition = camera.position;
+    state.yaw = camera.yaw;
+    state.pitch = camera.pitch;
+    publish(Clock::now());
+}
+
+Simulation::~Simulation()
+{
+    stopping = true;
+    if (thread.joinable())
+        thread.join();
+}
+
+void Simulation::start()
+{
+    thread = std::thread(&Simulation::threadLoop, this);
+}
+
+void Simulation::setLoad(float ms)
+{
+    loadMs = std::max(ms, 0.0f);
+}
+
+float Simulation::load() const
+{
+    return loadMs;
+}
+
+void Simulation::keyEvent(Key key, bool pressed)
+{
+    pushInput(Input{ InputTrace::EventType::Key, key, pressed, 0.0f, 0.0f, 0, {} });
+}
+
+void Simulation::mouseMove(float dx, float dy)
+{
+    pushInput(Input{ InputTrace::EventType::Mouse, Key::W, false, dx, dy, 0, {} });
+}
+
+void Simulation::resize(int w, int h)
+{
+    pushInput(Input{ InputTrace::EventType::Resize, Key::W, false, static_cast<float>(w), static_cast<float>(h), 0, {} });
+}
+
+void Simulation::pushInput(const Input& input)
+{
+    if (replayMode)
+        return;
+    std::lock_guard<std::mutex> lock(inputMutex);
+    inputQueue.push_back(input);
+    inputQueue.back().sequence = ++inputSequence;
+    inputQueue.back().time = Clock::now();
+}
+
+void Simulation::startCapture(int width, int height)
+{
+    std::lock_guard<std::mutex> lock(captureMutex);
+    capture = InputTrace{};
+    capture.tickSeconds = tickSeconds;
+    capture.width = width;
+    capture.height = height;
+    capturingTrace = true;
+}
+
+InputTrace Simulation::stopCapture()
+{
+    std::lock_guard<std::mutex> lock(captureMutex);
+    capturingTrace = false;
+    return std::move(capture);
+}
+
+bool Simulation::capturing()
+{
+    std::lock_guard<std::mutex> lock(captureMutex);
+    return capturingTrace;
+}
+
+void Simulation::startReplay(InputTrace trace, Clock::time_point start)
+{
+    if (trace.tickSeconds != tickSeconds)
+        qWarning() << "trace was captured at" << 1.0 / trace.tickSeconds << "ticks per second, replaying at" << 1.0 / tickSeconds;
+    replayTrace = std::move(trace);
+    replayMode = true;
+    replayEvent = 0;
+    replayStart = start;
+    mismatches = 0;
+    publish(start);
+}
+
+bool Simulation::advanceReplay(Clock::time_point now)
+{
+    if (replayTrace.cameras.empty())
+        return false;
+    auto tick = duration_cast<Clock::duration>(duration<double>(tickSeconds));
+    uint64_t lastTick = replayTrace.cameras.back().tick;
+    auto& events = replayTrace.events;
+    while (state.tick < lastTick && replayStart + tick * static_cast<int64_t>(state.tick + 1) <= now)
+    {
+        //the events the capture applied at the start of this tick
+        while (replayEvent < events.size() && events[replayEvent].tick <= state.tick)
+        {
+            const InputTrace::Event& event = events[replayEvent++];
+            apply(Input{ event.type, static_cast<Key>(event.key), event.pressed != 0, event.x, event.y, replayEvent, replayStart + tick * static_cast<int64_t>(state.tick) });
+        }
+        step(static_cast<float>(tickSeconds));
+
+        //cameras are stored one per tick without gaps
+        size_t index = static_cast<size_t>(state.tick - replayTrace.cameras.front().tick);
+        if (index < replayTrace.cameras.size())
+        {
+            const InputTrace::CameraState& captured = replayTrace.cameras[index];
+            glm::vec3 position(captured.position[0], captured.position[1], captured.position[2]);
+            if (glm::length(position - state.cameraPosition) > cameraTolerance
+                || std::abs(captured.yaw - state.yaw) > cameraTolerance || std::abs(captured.pitch - state.pitch) > cameraTolerance)
+                ++mismatches;
+        }
+        publish(replayStart + tick * static_cast<int64_t>(state.tick));
+    }
+    return state.tick < lastTick;
+}
+
+bool Simulation::replaying() const
+{
+    return replayMode;
+}
+
+int Simulation::replayMismatches() const
+{
+    return mismatches;
+}
+
+Simulation::Frame Simulation::frame(Clock::time_point now)
+{
+    if (snapshots.update())
+    {
+        previous = hasCurrent ? current : snapshots.readBuffer();
+        current = snapshots.readBuffer();
+        hasCurrent = true;
+    }
+
+    //rendering runs one tick behind and blends towards the newest snapshot as its tick elapses
+    Frame result;
+    float elapsed = duration_cast<duration<float>>(now - current.published).count();
+    result.alpha = std::min(std::max(elapsed / static_cast<float>(tickSeconds), 0.0f), 1.0f);
+    result.state = current;
+    result.state.cameraPosition = glm::mix(previous.cameraPosition, current.cameraPosition, result.alpha);
+    result.state.yaw = previous.yaw + (current.yaw - previous.yaw) * result.alpha;
+    result.state.pitch = previous.pitch + (current.pitch - previous.pitch) * result.alpha;
+    for (int i = 0; i < boxNum; ++i)
+        result.state.boxes[i] = Transform::interpolate(previous.boxes[i], current.boxes[i], result.alpha);
+    result.state.model = Transform::interpolate(previous.model, current.model, result.alpha);
+
+    result.newInput = current.inputSequence != shownInputSequence;
+    shownInputSequence = current.inputSequence;
+    return result;
+}
+
+Simulation::Stats Simulation::takeStats()
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    Stats result = statistics;
+    if (result.ticks)
+        result.tickMs /= result.ticks;
+    result.loadMs = loadMs;
+    statistics = Stats{};
+    return result;
+}
+
+void Simulation::threadLoop()
+{
+    auto tick = duration_cast<Clock::duration>(duration<double>(tickSeconds));
+    auto nextTick = Clock::now();
+    while (!stopping)
+    {
+        auto tickBegin = Clock::now();
+        applyInput();
+        step(static_cast<float>(tickSeconds));
+        captureTick();
+
+        //stands in for heavier scene logic
+        float load = loadMs;
+        if (load > 0.0f)
+        {
+            auto loadEnd = tickBegin + duration_cast<Clock::duration>(duration<float, std::milli>(load));
+            volatile float sink = 0.0f;
+            while (Clock::now() < loadEnd)
+                sink = sink + std::sqrt(static_cast<float>(state.tick));
+        }
+
+        publish(Clock::now());
+        double tickMs = duration_cast<duration<double, std::milli>>(Clock::now() - tickBegin).count();
+
+        nextTick += tick;
+        auto now = Clock::now();
+        uint64_t dropped = 0;
+        if (now - nextTick > tick * maxCatchUpTicks)
+        {
+            //too far behind to catch up, the lost ticks simply never happen
+            dropped = static_cast<uint64_t>((now - nextTick) / tick);
+            nextTick = now;
+        }
+        {
+            std::lock_guard<std::mutex> lock(statsMutex);
+            ++statistics.ticks;
+            statistics.droppedTicks += dropped;
+            statistics.tickMs += tickMs;
+            statistics.maxTickMs = std::max(statistics.maxTickMs, tickMs);
+        }
+        if (nextTick > now)
+            std::this_thread::sleep_until(nextTick);
+    }
+}
+
+void Simulation::applyInput()
+{
+    std::vector<Input> inputs;
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        inputs.swap(inputQueue);
+    }
+    std::lock_guard<std::mutex> lock(captureMutex);
+    for (auto& i : inputs)
+    {
+        if (capturingTrace)
+        {
+            InputTrace::Event event{ static_cast<uint32_t>(state.tick), i.type, static_cast<uint8_t>(i.key), static_cast<uint8_t>(i.pressed), 0, i.x, i.y };
+            capture.events.push_back(event);
+        }
+        apply(i);
+    }
+}
+
+void Simulation::apply(const Input& i)
+{
+    switch (i.type)
+    {
+    case InputTrace::EventType::Key:
+        if (i.key == Key::W)
+            camera.setKeyW(i.pressed);
+        else if (i.key == Key::S)
+            camera.setKeyS(i.pressed);
+        else if (i.key == Key::A)
+            camera.setKeyA(i.pressed);
+        else
+            camera.setKeyD(i.pressed);
+        break;
+    case InputTrace::EventType::Mouse:
+        camera.processMouseMovement(i.x, i.y);
+        break;
+    case InputTrace::EventType::Resize:
+        camera.resizeCamera(static_cast<int>(i.x), static_cast<int>(i.y));
+        break;
+    }
+    state.inputSequence = i.sequence;
+    state.inputTime = i.time;
+}
+
+void Simulation::step(float dt)
+{
+    camera.caculateCamera(dt);
+    state.cameraPosition = camera.position;
+    state.yaw = camera.yaw;
+    state.pitch = camera.pitch;
+    //the small box on top keeps turning
+    state.boxes[1].angle += dt * 0.5f;
+    ++state.tick;
+}
+
+void Simulation::captureTick()
+{
+    std::lock_guard<std::mutex> lock(captureMutex);
+    if (!capturingTrace)
+        return;
+    InputTrace::CameraState camera{ static_cast<uint32_t>(state.tick), { state.cameraPosition.x, state.cameraPosition.y, state.cameraPosition.z }, state.yaw, state.pitch };
+    capture.cameras.push_back(camera);
+}
+
+void Simulation::publish(Clock::time_point published)
+{
+    state.published = published;
+    snapshots.writeBuffer() = state;
+    snapshots.publish();
+}
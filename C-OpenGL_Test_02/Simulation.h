@@ -0,0 +1,153 @@
+#pragma once
+#include<glm.hpp>
+#include<array>
+#include<atomic>
+#include<chrono>
+#include<cstdint>
+#include<mutex>
+#include<thread>
+#include<vector>
+#include"Camera.h"
+#include"TripleBuffer.h"
+#include"InputTrace.h"
+
+//fixed timestep scene update on its own thread, the renderer only ever sees immutable snapshots of it
+class Simulation
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    constexpr static int boxNum = 3;
+    constexpr static double tickSeconds = 1.0 / 60.0;
+    //a tick running this late is given up on instead of being caught up
+    constexpr static int maxCatchUpTicks = 5;
+
+    struct Transform
+    {
+        glm::vec3 position{ 0.0f };
+        glm::vec3 axis{ 0.0f, 1.0f, 0.0f };
+        float angle = 0.0f;
+        glm::vec3 scale{ 1.0f };
+
+        glm::mat4 matrix() const;
+        static Transform interpolate(const Transform& from, const Transform& to, float alpha);
+    };
+
+    struct Snapshot
+    {
+        uint64_t tick = 0;
+        Clock::time_point published;
+        glm::vec3 cameraPosition{ 0.0f };
+        float yaw = 0.0f, pitch = 0.0f;
+        std::array<Transform, boxNum> boxes;
+        Transform model;
+        //newest input applied so far
+        uint64_t inputSequence = 0;
+        Clock::time_point inputTime;
+    };
+
+    //what the renderer draws: previous and current snapshot blended by alpha
+    struct Frame
+    {
+        Snapshot state;
+        float alpha = 1.0f;
+        //input reaches the screen for the first time in this frame
+        bool newInput = false;
+    };
+
+    enum class Key
+    {
+        W, S, A, D
+    };
+
+    struct Stats
+    {
+        uint64_t ticks = 0;
+        uint64_t droppedTicks = 0;
+        double tickMs = 0.0;
+        double maxTickMs = 0.0;
+        float loadMs = 0.0f;
+    };
+
+    Simulation();
+    ~Simulation();
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+
+    void start();
+    //busy work added to every tick to see how rendering copes with a slow update
+    void setLoad(float ms);
+    float load() const;
+
+    //input is timestamped on arrival and applied at the start of the next tick
+    void keyEvent(Key key, bool pressed);
+    void mouseMove(float dx, float dy);
+    void resize(int w, int h);
+
+    //records every input as it is applied and the camera after every tick, call before start()
+    void startCapture(int width, int height);
+    InputTrace stopCapture();
+    bool capturing();
+    //replays on the calling thread with a virtual clock beginning at start, start() is not called and live input is ignored
+    void startReplay(InputTrace trace, Clock::time_point start);
+    //runs every tick due by now, false once the trace has no ticks left
+    bool advanceReplay(Clock::time_point now);
+    bool replaying() const;
+    //replayed ticks whose camera is not the captured one
+    int replayMismatches() const;
+
+    //render thread only
+    Frame frame(Clock::time_point now);
+    //counts since the last call
+    Stats takeStats();
+
+private:
+    struct Input
+    {
+        InputTrace::EventType type;
+        Key key;
+        bool pressed;
+        float x, y;
+        uint64_t sequence;
+        Clock::time_point time;
+    };
+
+    std::thread thread;
+    std::atomic<bool> stopping{ false };
+    std::atomic<float> loadMs{ 0.0f };
+
+    std::mutex inputMutex;
+    std::vector<Input> inputQueue;
+    uint64_t inputSequence = 0;
+
+    //owned by the simulation thread
+    Camera camera{ 800.0f, 800.0f };
+    Snapshot state;
+    TripleBuffer<Snapshot> snapshots;
+
+    //owned by the render thread
+    Snapshot previous, current;
+    bool hasCurrent = false;
+    uint64_t shownInputSequence = 0;
+
+    std::mutex statsMutex;
+    Stats statistics;
+
+    std::mutex captureMutex;
+    bool capturingTrace = false;
+    InputTrace capture;
+
+    bool replayMode = false;
+    InputTrace replayTrace;
+    size_t replayEvent = 0;
+    Clock::time_point replayStart;
+    int mismatches = 0;
+
+    void threadLoop();
+    void pushInput(const Input& input);
+    void applyInput();
+    void apply(const Input& input);
+    void step(float dt);
+    void captureTick();
+    void publish(Clock::time_point published);
+};
@@ -0,0 +1,614 @@
+#include "TextureCompressor.h"
+#include<qimage.h>
+#include<qfileinfo.h>
+#include<qdatetime.h>
+#include<qdebug.h>
+#include<algorithm>
+#include<chrono>
+#include<climits>
+#include<cstdlib>
+#include<cstring>
+#include<fstream>
+#include"MipGenerator.h"
+#include"ParallelFor.h"
+#include"AssetPack.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include<emmintrin.h>
+#define TEXTURE_COMPRESSOR_SSE2
+#endif
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::duration;
+
+namespace
+{
+    constexpr unsigned char ktx2Identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+    //bumped whenever encoding or mip filtering changes so stale caches are rebuilt
+    const std::string ktx2Writer = "C-OpenGL_Test_02 TextureCompressor 3";
+
+    double elapsedMs(steady_clock::time_point begin)
+    {
+        return duration_cast<duration<double, std::milli>>(steady_clock::now() - begin).count();
+    }
+
+    void blockMinMax(const unsigned char* rgba, unsigned char* minColor, unsigned char* maxColor)
+    {
+#ifdef TEXTURE_COMPRESSOR_SSE2
+        //16 RGBA pixels are four registers, reduce them to one pixel per lane and then across lanes
+        __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba));
+        __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + 16));
+        __m128i p2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + 32));
+        __m128i p3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + 48));
+        __m128i low = _mm_min_epu8(_mm_min_epu8(p0, p1), _mm_min_epu8(p2, p3));
+        __m128i high = _mm_max_epu8(_mm_max_epu8(p0, p1), _mm_max_epu8(p2, p3));
+        low = _mm_min_epu8(low, _mm_shuffle_epi32(low, _MM_SHUFFLE(1, 0, 3, 2)));
+        low = _mm_min_epu8(low, _mm_shuffle_epi32(low, _MM_SHUFFLE(2, 3, 0, 1)));
+        high = _mm_max_epu8(high, _mm_shuffle_epi32(high, _MM_SHUFFLE(1, 0, 3, 2)));
+        high = _mm_max_epu8(high, _mm_shuffle_epi32(high, _MM_SHUFFLE(2, 3, 0, 1)));
+        int lowValue = _mm_cvtsi128_si32(low);
+        int highValue = _mm_cvtsi128_si32(high);
+        std::memcpy(minColor, &lowValue, 4);
+        std::memcpy(maxColor, &highValue, 4);
+#else
+        for (int c = 0; c < 4; ++c)
+        {
+            minColor[c] = 255;
+            maxColor[c] = 0;
+        }
+        for (int i = 0; i < 16; ++i)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                minColor[c] = std::min(minColor[c], rgba[i * 4 + c]);
+                maxColor[c] = std::max(maxColor[c], rgba[i * 4 + c]);
+            }
+        }
+#endif
+    }
+
+    unsigned short to565(const unsigned char* color)
+    {
+        return static_cast<unsigned short>(((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3));
+    }
+
+    void expand565(unsigned short color, int* out)
+    {
+        int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+        out[0] = (r << 3) | (r >> 2);
+        out[1] = (g << 2) | (g >> 4);
+        out[2] = (b << 3) | (b >> 2);
+    }
+
+    template<typename T>
+    void writeValue(std::ofstream& file, T value)
+    {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    T readValue(std::istream& file)
+    {
+        T value{};
+        file.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return value;
+    }
+}
+
+void TextureCompressor::init()
+{
+    QOpenGLFunctions_4_5_Core::initializeOpenGLFunctions();
+    glGetFloatv(maxTextureMaxAnisotropy, &maxAnisotropy);
+    maxAnisotropy = std::max(maxAnisotropy, 1.0f);
+}
+
+GpuResources::Texture TextureCompressor::loadTexture(const std::string& path, TextureClass texClass, bool mipmaps)
+{
+    ++statistics.textures;
+    if (compress && cacheUpToDate(path))
+    {
+        auto begin = steady_clock::now();
+        unsigned int format = 0;
+        std::vector<Level> levels;
+        if (readKtx2(cachePath(path), format, levels) && acceptableFormat(texClass, format) && (levels.size() > 1) == mipmaps)
+        {
+            statistics.decodeMs += elapsedMs(begin);
+            ++statistics.cacheHits;
+            for (auto& i : levels)
+                statistics.uncompressedBytes += static_cast<size_t>(i.width) * i.height * 4;
+            return upload(format, levels, true, texClass);
+        }
+    }
+
+    auto begin = steady_clock::now();
+    Level base;
+    if (!decodeSource(path, base))
+    {
+        qWarning() << "failed to load texture" << QString::fromStdString(path);
+        return GpuResources::Texture();
+    }
+    statistics.decodeMs += elapsedMs(begin);
+
+    begin = steady_clock::now();
+    std::vector<Level> chain;
+    if (mipmaps)
+        chain = MipGenerator::build(std::move(base), texClass);
+    else
+        chain.push_back(std::move(base));
+    statistics.mipMs += elapsedMs(begin);
+    for (auto& i : chain)
+        statistics.uncompressedBytes += i.data.size();
+    if (!compress)
+        return upload(GL_RGBA8, chain, false, texClass);
+
+    unsigned int format = pickFormat(texClass, chain[0]);
+    begin = steady_clock::now();
+    std::vector<Level> encoded = encode(chain, format);
+    statistics.encodeMs += elapsedMs(begin);
+    if (!writeKtx2(cachePath(path), format, encoded))
+        qWarning() << "failed to write texture cache" << QString::fromStdString(cachePath(path));
+    return upload(format, encoded, true, texClass);
+}
+
+const TextureCompressor::Stats& TextureCompressor::stats() const
+{
+    return statistics;
+}
+
+std::string TextureCompressor::cachePath(const std::string& path)
+{
+    return path + ".ktx2";
+}
+
+bool TextureCompressor::cacheUpToDate(const std::string& path)
+{
+    QFileInfo sourceInfo(QString::fromStdString(path));
+    QFileInfo cacheInfo(QString::fromStdString(cachePath(path)));
+    return cacheInfo.exists() && cacheInfo.lastModified() >= sourceInfo.lastModified();
+}
+
+bool TextureCompressor::cacheValid(const std::string& path, TextureClass texClass)
+{
+    unsigned int format = 0;
+    std::vector<Level> levels;
+    return cacheUpToDate(path) && readKtx2(cachePath(path), format, levels, 0, 0) && acceptableFormat(texClass, format) && levels.size() > 1;
+}
+
+bool TextureCompressor::buildCache(const std::string& path, TextureClass texClass)
+{
+    Level base;
+    if (!decodeSource(path, base))
+        return false;
+    unsigned int format = pickFormat(texClass, base);
+    std::vector<Level> encoded = encode(MipGenerator::build(std::move(base), texClass), format);
+    return writeKtx2(cachePath(path), format, encoded);
+}
+
+std::vector<TextureCompressor::Level> TextureCompressor::encode(const std::vector<Level>& levels, unsigned int format)
+{
+    struct BlockRow
+    {
+        const Level* source;
+        Level* target;
+        int blockY;
+    };
+
+    int bytes = blockBytes(format);
+    std::vector<Level> result(levels.size());
+    std::vector<BlockRow> rows;
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+        int blocksX = (levels[i].width + 3) / 4;
+        int blocksY = (levels[i].height + 3) / 4;
+        result[i].width = levels[i].width;
+        result[i].height = levels[i].height;
+        result[i].data.resize(static_cast<size_t>(blocksX) * blocksY * bytes);
+        for (int y = 0; y < blocksY; ++y)
+            rows.push_back(BlockRow{ &levels[i], &result[i], y });
+    }
+
+    auto encodeRow = [format, bytes](const BlockRow& row) {
+        const Level& src = *row.source;
+        int blocksX = (src.width + 3) / 4;
+        alignas(16) unsigned char block[64];
+        for (int bx = 0; bx < blocksX; ++bx)
+        {
+            //edge blocks repeat the last row/column
+            for (int y = 0; y < 4; ++y)
+            {
+                int sy = std::min(row.blockY * 4 + y, src.height - 1);
+                for (int x = 0; x < 4; ++x)
+                {
+                    int sx = std::min(bx * 4 + x, src.width - 1);
+                    std::memcpy(block + (y * 4 + x) * 4, src.data.data() + (static_cast<size_t>(sy) * src.width + sx) * 4, 4);
+                }
+            }
+            unsigned char* out = row.target->data.data() + (static_cast<size_t>(row.blockY) * blocksX + bx) * bytes;
+            if (format == formatBC1)
+            {
+                encodeColorBlock(block, out);
+            }
+            else if (format == formatBC3)
+            {
+                encodeSingleBlock(block + 3, 4, out);
+                encodeColorBlock(block, out + 8);
+            }
+            else if (format == formatBC4)
+            {
+                encodeSingleBlock(block, 4, out);
+            }
+            else
+            {
+                encodeSingleBlock(block, 4, out);
+                encodeSingleBlock(block + 1, 4, out + 8);
+            }
+        }
+    };
+
+    parallelFor(rows.size(), [&](size_t i) {
+        encodeRow(rows[i]);
+    });
+    return result;
+}
+
+void TextureCompressor::encodeColorBlock(const unsigned char* rgba, unsigned char* out)
+{
+    unsigned char minColor[4], maxColor[4];
+    blockMinMax(rgba, minColor, maxColor);
+
+    //inset the bounding box a little, the interpolated colors then land closer to the real ones
+    for (int c = 0; c < 3; ++c)
+    {
+        int inset = (maxColor[c] - minColor[c]) >> 4;
+        minColor[c] = static_cast<unsigned char>(minColor[c] + inset);
+        maxColor[c] = static_cast<unsigned char>(maxColor[c] - inset);
+    }
+
+    //every channel of maxColor is >= minColor, so c0 >= c1 and the block is in four color mode
+    unsigned short c0 = to565(maxColor);
+    unsigned short c1 = to565(minColor);
+    unsigned int indices = 0;
+    if (c0 != c1)
+    {
+        int palette[4][3];
+        expand565(c0, palette[0]);
+        expand565(c1, palette[1]);
+        for (int c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; ++i)
+        {
+            unsigned int best = 0;
+            int bestDistance = INT_MAX;
+            for (unsigned int j = 0; j < 4; ++j)
+            {
+                int dr = rgba[i * 4] - palette[j][0];
+                int dg = rgba[i * 4 + 1] - palette[j][1];
+                int db = rgba[i * 4 + 2] - palette[j][2];
+                int distance = dr * dr + dg * dg + db * db;
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = j;
+                }
+            }
+            indices |= best << (2 * i);
+        }
+    }
+
+    out[0] = static_cast<unsigned char>(c0 & 0xFF);
+    out[1] = static_cast<unsigned char>(c0 >> 8);
+    out[2] = static_cast<unsigned char>(c1 & 0xFF);
+    out[3] = static_cast<unsigned char>(c1 >> 8);
+    for (int i = 0; i < 4; ++i)
+        out[4 + i] = static_cast<unsigned char>((indices >> (8 * i)) & 0xFF);
+}
+
+void TextureCompressor::encodeSingleBlock(const unsigned char* values, int stride, unsigned char* out)
+{
+    int minValue = 255, maxValue = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        minValue = std::min<int>(minValue, values[i * stride]);
+        maxValue = std::max<int>(maxValue, values[i * stride]);
+    }
+
+    //a0 > a1 selects the eight value palette
+    unsigned long long indices = 0;
+    if (maxValue != minValue)
+    {
+        int palette[8] = { maxValue, minValue };
+        for (int i = 1; i < 7; ++i)
+            palette[i + 1] = ((7 - i) * maxValue + i * minValue + 3) / 7;
+        for (int i = 0; i < 16; ++i)
+        {
+            unsigned long long best = 0;
+            int bestDistance = INT_MAX;
+            for (int j = 0; j < 8; ++j)
+            {
+                int distance = std::abs(values[i * stride] - palette[j]);
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = j;
+                }
+            }
+            indices |= best << (3 * i);
+        }
+    }
+
+    out[0] = static_cast<unsigned char>(maxValue);
+    out[1] = static_cast<unsigned char>(minValue);
+    for (int i = 0; i < 6; ++i)
+        out[2 + i] = static_cast<unsigned char>((indices >> (8 * i)) & 0xFF);
+}
+
+int TextureCompressor::blockBytes(unsigned int format)
+{
+    return format == formatBC1 || format == formatBC4 ? 8 : 16;
+}
+
+bool TextureCompressor::acceptableFormat(TextureClass texClass, unsigned int format)
+{
+    switch (texClass)
+    {
+    case TextureClass::Color:
+        return format == formatBC1 || format == formatBC3;
+    case TextureClass::Normal:
+        return format == formatBC5;
+    default:
+        return format == formatBC4;
+    }
+}
+
+unsigned int TextureCompressor::pickFormat(TextureClass texClass, const Level& base)
+{
+    if (texClass == TextureClass::Normal)
+        return formatBC5;
+    if (texClass != TextureClass::Color)
+        return formatBC4;
+    for (size_t i = 3; i < base.data.size(); i += 4)
+    {
+        if (base.data[i] != 255)
+            return formatBC3;
+    }
+    return formatBC1;
+}
+
+bool TextureCompressor::decodeSource(const std::string& path, Level& base)
+{
+    std::vector<unsigned char> encoded;
+    QImage image;
+    if (!AssetPack::instance().read(path, encoded) || !image.loadFromData(encoded.data(), static_cast<int>(encoded.size())))
+        return false;
+    image = image.convertToFormat(QImage::Format_RGBA8888).mirrored();
+    base.width = image.width();
+    base.height = image.height();
+    base.data.assign(image.constBits(), image.constBits() + static_cast<size_t>(base.width) * base.height * 4);
+    return true;
+}
+
+unsigned int TextureCompressor::vkFormat(unsigned int format)
+{
+    switch (format)
+    {
+    case formatBC1:
+        return 131;     //VK_FORMAT_BC1_RGB_UNORM_BLOCK
+    case formatBC3:
+        return 137;     //VK_FORMAT_BC3_UNORM_BLOCK
+    case formatBC4:
+        return 139;     //VK_FORMAT_BC4_UNORM_BLOCK
+    case formatBC5:
+        return 141;     //VK_FORMAT_BC5_UNORM_BLOCK
+    default:
+        return 0;
+    }
+}
+
+bool TextureCompressor::readKtx2(const std::string& path, unsigned int& format, std::vector<Level>& levels, int firstLevel, int levelNum)
+{
+    std::unique_ptr<std::istream> stream = AssetPack::instance().open(path);
+    if (!stream)
+        return false;
+    std::istream& file = *stream;
+    unsigned char identifier[12];
+    if (!file.read(reinterpret_cast<char*>(identifier), sizeof(identifier)) || std::memcmp(identifier, ktx2Identifier, sizeof(identifier)) != 0)
+        return false;
+
+    unsigned int fileFormat = readValue<unsigned int>(file);
+    readValue<unsigned int>(file);   //typeSize
+    unsigned int width = readValue<unsigned int>(file);
+    unsigned int height = readValue<unsigned int>(file);
+    readValue<unsigned int>(file);   //pixelDepth
+    readValue<unsigned int>(file);   //layerCount
+    unsigned int faceCount = readValue<unsigned int>(file);
+    unsigned int levelCount = std::max(readValue<unsigned int>(file), 1u);
+    unsigned int supercompression = readValue<unsigned int>(file);
+    readValue<unsigned int>(file);   //dfdByteOffset
+    readValue<unsigned int>(file);   //dfdByteLength
+    unsigned int kvdOffset = readValue<unsigned int>(file);
+    unsigned int kvdLength = readValue<unsigned int>(file);
+    file.seekg(16, std::ios::cur);   //sgd range
+    if (!file || faceCount != 1 || supercompression != 0 || width == 0 || height == 0)
+        return false;
+
+    format = 0;
+    for (unsigned int i : { formatBC1, formatBC3, formatBC4, formatBC5 })
+    {
+        if (vkFormat(i) == fileFormat)
+            format = i;
+    }
+    if (format == 0)
+        return false;
+
+    std::vector<std::pair<unsigned long long, unsigned long long>> ranges(levelCount);
+    for (auto& i : ranges)
+    {
+        i.first = readValue<unsigned long long>(file);
+        i.second = readValue<unsigned long long>(file);
+        readValue<unsigned long long>(file);
+    }
+
+    //only files written by this version are trusted, the writer id is the first key/value pair
+    std::string expected = std::string("KTXwriter") + '\0' + ktx2Writer + '\0';
+    if (kvdLength < 4 + expected.size())
+        return false;
+    std::string kvd(kvdLength, '\0');
+    file.seekg(kvdOffset);
+    file.read(&kvd[0], kvdLength);
+    if (!file || kvd.compare(4, expected.size(), expected) != 0)
+        return false;
+
+    levels.assign(levelCount, Level{});
+    for (unsigned int i = 0; i < levelCount; ++i)
+    {
+        levels[i].width = std::max<int>(width >> i, 1);
+        levels[i].height = std::max<int>(height >> i, 1);
+        size_t expected = static_cast<size_t>((levels[i].width + 3) / 4) * ((levels[i].height + 3) / 4) * blockBytes(format);
+        if (ranges[i].second != expected)
+            return false;
+        if (static_cast<int>(i) < firstLevel || static_cast<int>(i) - firstLevel >= levelNum)
+            continue;
+        levels[i].data.resize(expected);
+        file.seekg(static_cast<std::streamoff>(ranges[i].first));
+        file.read(reinterpret_cast<char*>(levels[i].data.data()), expected);
+    }
+    return static_cast<bool>(file);
+}
+
+bool TextureCompressor::writeKtx2(const std::string& path, unsigned int format, const std::vector<Level>& levels)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+
+    //basic data format descriptor: one 64 bit sample per BC1/BC4 half, two for BC3/BC5
+    bool twoSamples = format == formatBC3 || format == formatBC5;
+    unsigned int bytes = blockBytes(format);
+    unsigned int colorModel = format == formatBC1 ? 128 : format == formatBC3 ? 130 : format == formatBC4 ? 131 : 132;
+    std::vector<unsigned int> dfd;
+    unsigned int blockSize = 24 + 16 * (twoSamples ? 2 : 1);
+    dfd.push_back(4 + blockSize);
+    dfd.push_back(0);
+    dfd.push_back(2 | (blockSize << 16));
+    dfd.push_back(colorModel | (1 << 8) | (1 << 16));
+    dfd.push_back(3 | (3 << 8));
+    dfd.push_back(bytes);
+    dfd.push_back(0);
+    unsigned int firstChannel = format == formatBC3 ? 15 : 0;
+    unsigned int secondChannel = format == formatBC3 ? 0 : 1;
+    dfd.insert(dfd.end(), { 0 | (63 << 16) | (firstChannel << 24), 0, 0, 0xFFFFFFFF });
+    if (twoSamples)
+        dfd.insert(dfd.end(), { 64 | (63 << 16) | (secondChannel << 24), 0, 0, 0xFFFFFFFF });
+
+    std::string kvd = std::string("KTXwriter") + '\0' + ktx2Writer + '\0';
+    unsigned int kvdEntryLength = static_cast<unsigned int>(kvd.size());
+    kvd.insert(0, reinterpret_cast<const char*>(&kvdEntryLength), 4);
+    kvd.resize((kvd.size() + 3) / 4 * 4, '\0');
+
+    unsigned long long levelCount = levels.size();
+    unsigned long long dfdOffset = 80 + 24 * levelCount;
+    unsigned long long dfdLength = dfd.size() * 4;
+    unsigned long long kvdOffset = dfdOffset + dfdLength;
+
+    //level data is stored smallest level first, each aligned to the block size
+    std::vector<unsigned long long> offsets(levels.size());
+    unsigned long long offset = kvdOffset + kvd.size();
+    for (size_t i = levels.size(); i-- > 0;)
+    {
+        offset = (offset + bytes - 1) / bytes * bytes;
+        offsets[i] = offset;
+        offset += levels[i].data.size();
+    }
+
+    file.write(reinterpret_cast<const char*>(ktx2Identifier), sizeof(ktx2Identifier));
+    writeValue<unsigned int>(file, vkFormat(format));
+    writeValue<unsigned int>(file, 1);
+    writeValue<unsigned int>(file, levels[0].width);
+    writeValue<unsigned int>(file, levels[0].height);
+    writeValue<unsigned int>(file, 0);
+    writeValue<unsigned int>(file, 0);
+    writeValue<unsigned int>(file, 1);
+    writeValue<unsigned int>(file, static_cast<unsigned int>(levelCount));
+    writeValue<unsigned int>(file, 0);
+    writeValue<unsigned int>(file, static_cast<unsigned int>(dfdOffset));
+    writeValue<unsigned int>(file, static_cast<unsigned int>(dfdLength));
+    writeValue<unsigned int>(file, static_cast<unsigned int>(kvdOffset));
+    writeValue<unsigned int>(file, static_cast<unsigned int>(kvd.size()));
+    writeValue<unsigned long long>(file, 0);
+    writeValue<unsigned long long>(file, 0);
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+        writeValue<unsigned long long>(file, offsets[i]);
+        writeValue<unsigned long long>(file, levels[i].data.size());
+        writeValue<unsigned long long>(file, levels[i].data.size());
+    }
+    for (auto i : dfd)
+        writeValue<unsigned int>(file, i);
+    file.write(kvd.data(), kvd.size());
+    for (size_t i = levels.size(); i-- > 0;)
+    {
+        while (static_cast<unsigned long long>(file.tellp()) < offsets[i])
+            file.put(0);
+        file.write(reinterpret_cast<const char*>(levels[i].data.data()), levels[i].data.size());
+    }
+    return static_cast<bool>(file);
+}
+
+GpuResources::Texture TextureCompressor::upload(unsigned int format, const std::vector<Level>& levels, bool compressed, TextureClass texClass)
+{
+    auto begin = steady_clock::now();
+    GpuResources::Texture texture = GpuResources::instance().createTexture2D(format, static_cast<int>(levels.size()), levels[0].width, levels[0].height, "loaded texture");
+    unsigned int tex = texture.get();
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+        const Level& level = levels[i];
+        if (compressed)
+            glCompressedTextureSubImage2D(tex, static_cast<int>(i), 0, 0, level.width, level.height, format, static_cast<int>(level.data.size()), level.data.data());
+        else
+            glTextureSubImage2D(tex, static_cast<int>(i), 0, 0, level.width, level.height, GL_RGBA, GL_UNSIGNED_BYTE, level.data.data());
+        statistics.uploadedBytes += level.data.size();
+    }
+
+    applySampling(tex, texClass, format, levels.size() > 1);
+    statistics.uploadMs += elapsedMs(begin);
+    return texture;
+}
+
+void TextureCompressor::applySampling(unsigned int tex, TextureClass texClass, unsigned int format, bool mipmapped)
+{
+    //single channel maps read back as grey like the RGBA images they replace
+    if (format == formatBC4)
+    {
+        glTextureParameteri(tex, GL_TEXTURE_SWIZZLE_G, GL_RED);
+        glTextureParameteri(tex, GL_TEXTURE_SWIZZLE_B, GL_RED);
+    }
+
+    //color gets full anisotropy, the parallax height map is sampled many times per fragment so it stays cheap
+    float anisotropy = 1.0f;
+    int minFilter = GL_LINEAR_MIPMAP_LINEAR;
+    switch (texClass)
+    {
+    case TextureClass::Color:
+        anisotropy = 16.0f;
+        break;
+    case TextureClass::Normal:
+        anisotropy = 8.0f;
+        break;
+    case TextureClass::Single:
+        anisotropy = 4.0f;
+        break;
+    case TextureClass::Height:
+        minFilter = GL_LINEAR_MIPMAP_NEAREST;
+        break;
+    }
+    glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, mipmapped ? minFilter : GL_LINEAR);
+    glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(tex, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTextureParameteri(tex, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    if (mipmapped)
+        glTextureParameterf(tex, textureMaxAnisotropy, std::min(anisotropy, maxAnisotropy));
+}
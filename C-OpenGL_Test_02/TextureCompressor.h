@@ -0,0 +1,76 @@
+#pragma once
+#include<qopenglfunctions_4_5_core.h>
+#include<climits>
+#include<string>
+#include<vector>
+#include"GpuResources.h"
+
+class TextureCompressor :protected QOpenGLFunctions_4_5_Core
+{
+public:
+    //Color picks BC1 or BC3 depending on whether the image actually uses alpha,
+    //Height is a single channel parallax map in the depth convention, white is deepest as parallaxSearch.frag reads it,
+    //its mips keep the minimum depth instead of the average so a coarse level never carves deeper than the texels it covers
+    enum class TextureClass
+    {
+        Color, Normal, Single, Height
+    };
+
+    struct Level
+    {
+        int width, height;
+        std::vector<unsigned char> data;
+    };
+
+    struct Stats
+    {
+        int textures = 0;
+        int cacheHits = 0;
+        size_t uncompressedBytes = 0;
+        size_t uploadedBytes = 0;
+        double decodeMs = 0.0;
+        double mipMs = 0.0;
+        double encodeMs = 0.0;
+        double uploadMs = 0.0;
+    };
+
+    constexpr static unsigned int formatBC1 = 0x83F0;   //GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+    constexpr static unsigned int formatBC3 = 0x83F3;   //GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+    constexpr static unsigned int formatBC4 = 0x8DBB;   //GL_COMPRESSED_RED_RGTC1
+    constexpr static unsigned int formatBC5 = 0x8DBD;   //GL_COMPRESSED_RG_RGTC2
+    constexpr static unsigned int textureMaxAnisotropy = 0x84FE;    //GL_TEXTURE_MAX_ANISOTROPY
+    constexpr static unsigned int maxTextureMaxAnisotropy = 0x84FF; //GL_MAX_TEXTURE_MAX_ANISOTROPY
+
+    bool compress = true;
+
+    void init();
+    //returns a texture with immutable storage, reading path + ".ktx2" instead of the source when it is up to date
+    GpuResources::Texture loadTexture(const std::string& path, TextureClass texClass, bool mipmaps);
+    const Stats& stats() const;
+    //repeat, filtering and anisotropy for the class, BC4 also gets its red channel swizzled to grey
+    void applySampling(unsigned int tex, TextureClass texClass, unsigned int format, bool mipmapped);
+
+    static std::string cachePath(const std::string& path);
+    static bool cacheUpToDate(const std::string& path);
+    //up to date, written by this version, in a format texClass takes and mipmapped, only the header is read
+    static bool cacheValid(const std::string& path, TextureClass texClass);
+    //decodes, mips and encodes the source into its ktx2 cache without touching GL, safe off the GUI thread
+    static bool buildCache(const std::string& path, TextureClass texClass);
+    //levels gets every level's size, only [firstLevel, firstLevel + levelNum) are read from disk
+    static bool readKtx2(const std::string& path, unsigned int& format, std::vector<Level>& levels, int firstLevel = 0, int levelNum = INT_MAX);
+    static int blockBytes(unsigned int format);
+    static std::vector<Level> encode(const std::vector<Level>& levels, unsigned int format);
+    static void encodeColorBlock(const unsigned char* rgba, unsigned char* out);
+    static void encodeSingleBlock(const unsigned char* values, int stride, unsigned char* out);
+
+private:
+    Stats statistics;
+    float maxAnisotropy = 1.0f;
+
+    static unsigned int vkFormat(unsigned int format);
+    static bool acceptableFormat(TextureClass texClass, unsigned int format);
+    static unsigned int pickFormat(TextureClass texClass, const Level& base);
+    static bool decodeSource(const std::string& path, Level& base);
+    static bool writeKtx2(const std::string& path, unsigned int format, const std::vector<Level>& levels);
+    GpuResources::Texture upload(unsigned int format, const std::vector<Level>& levels, bool compressed, TextureClass texClass);
+};
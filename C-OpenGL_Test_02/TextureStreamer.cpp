@@ -0,0 +1,353 @@
+#include "TextureStreamer.h"
+#include<qdebug.h>
+#include<algorithm>
+#include<cfloat>
+#include<chrono>
+#include<cmath>
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::duration;
+
+TextureStreamer::TextureStreamer(TextureCompressor& compressor)
+    :compressor(compressor)
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (worker.joinable())
+        worker.join();
+}
+
+void TextureStreamer::init()
+{
+    QOpenGLFunctions_4_5_Core::initializeOpenGLFunctions();
+    if (!worker.joinable())
+        worker = std::thread(&TextureStreamer::workerLoop, this);
+}
+
+int TextureStreamer::addTexture(const std::string& path, TextureClass texClass)
+{
+    auto begin = steady_clock::now();
+    int handle = static_cast<int>(textures.size());
+    textures.emplace_back();
+    StreamedTexture& texture = textures.back();
+    texture.path = path;
+    texture.texClass = texClass;
+    //mutable storage, levels that were never loaded or have been evicted take no memory
+    texture.tex = GpuResources::instance().createTexture(GL_TEXTURE_2D, "streamed texture");
+
+    Request request{ handle, -1, FLT_MAX, path, texClass, tailSize };
+    //a stale writer id or format counts as missing, rebuilding it here would stall the GL thread for the whole encode
+    if (TextureCompressor::cacheValid(path, texClass))
+    {
+        //the tail of an existing cache is a few KiB, read it now so the first frame is not blank
+        Result result = load(request);
+        applyResult(result);
+        ++statistics.cacheHits;
+    }
+    else
+    {
+        texture.pending = true;
+        ++statistics.cacheBuilds;
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(request));
+        wake.notify_one();
+    }
+    statistics.textures = static_cast<int>(textures.size());
+    statistics.addMs += duration_cast<duration<double, std::milli>>(steady_clock::now() - begin).count();
+    return handle;
+}
+
+unsigned int TextureStreamer::texture(int handle) const
+{
+    return textures[handle].tex.get();
+}
+
+void TextureStreamer::requestDetail(int handle, float screenSize)
+{
+    if (handle >= 0)
+        textures[handle].screenSize = std::max(textures[handle].screenSize, screenSize);
+}
+
+void TextureStreamer::requestAll()
+{
+    for (auto& i : textures)
+        i.screenSize = std::max(i.screenSize, static_cast<float>(i.maxDimension));
+}
+
+void TextureStreamer::update()
+{
+    statistics.uploads = 0;
+    statistics.uploadedBytes = 0;
+    statistics.evictions = 0;
+    statistics.rejected = 0;
+
+    //requests the worker has not started are withdrawn and issued again with this frame's priorities
+    std::vector<Result> finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished.swap(results);
+        for (auto& i : queue)
+            textures[i.handle].pending = false;
+        queue.clear();
+    }
+    for (auto& i : finished)
+        applyResult(i);
+
+    float lowestEvictable = FLT_MAX;
+    for (auto& i : textures)
+    {
+        if (i.tailLevel >= 0 && i.residentLevel < i.tailLevel)
+            lowestEvictable = std::min(lowestEvictable, levelPriority(i, i.residentLevel));
+    }
+
+    std::vector<Request> requests;
+    statistics.missingBytes = 0;
+    statistics.residentLevels = 0;
+    for (size_t i = 0; i < textures.size(); ++i)
+    {
+        StreamedTexture& texture = textures[i];
+        if (texture.failed)
+            continue;
+        if (texture.tailLevel < 0)
+        {
+            if (!texture.pending)
+                requests.push_back(Request{ static_cast<int>(i), -1, FLT_MAX, texture.path, texture.texClass, tailSize });
+            continue;
+        }
+
+        statistics.residentLevels += static_cast<int>(texture.levelBytes.size()) - texture.residentLevel;
+        int target = targetLevel(texture);
+        for (int level = target; level < texture.residentLevel; ++level)
+            statistics.missingBytes += texture.levelBytes[level];
+
+        //one level at a time, the next finer one is asked for once this one has arrived
+        int next = texture.residentLevel - 1;
+        if (texture.pending || next < target)
+            continue;
+        float priority = levelPriority(texture, next);
+        if (statistics.residentBytes + texture.levelBytes[next] > budgetBytes && priority <= lowestEvictable)
+            continue;
+        requests.push_back(Request{ static_cast<int>(i), next, priority, texture.path, texture.texClass, tailSize });
+    }
+
+    //the worker pops from the back
+    std::sort(requests.begin(), requests.end(), [](const Request& a, const Request& b) {
+        return a.priority < b.priority;
+    });
+    for (auto& i : requests)
+        textures[i.handle].pending = true;
+    for (auto& i : textures)
+        i.screenSize = 0.0f;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue = std::move(requests);
+        statistics.queued = static_cast<int>(queue.size());
+        statistics.inFlight = busy;
+    }
+    wake.notify_one();
+    statistics.textures = static_cast<int>(textures.size());
+    statistics.budgetBytes = budgetBytes;
+}
+
+bool TextureStreamer::settled()
+{
+    for (auto& i : textures)
+    {
+        if (!i.failed && i.tailLevel < 0)
+            return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    return queue.empty() && results.empty() && busy == 0 && statistics.missingBytes == 0;
+}
+
+const TextureStreamer::Stats& TextureStreamer::stats() const
+{
+    return statistics;
+}
+
+void TextureStreamer::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [this] {
+            return stopping || !queue.empty();
+        });
+        if (stopping)
+            return;
+        Request request = std::move(queue.back());
+        queue.pop_back();
+        ++busy;
+        lock.unlock();
+        Result result = load(request);
+        lock.lock();
+        --busy;
+        results.push_back(std::move(result));
+    }
+}
+
+TextureStreamer::Result TextureStreamer::load(const Request& request)
+{
+    Result result{ request.handle, request.level, false, 0, {} };
+    std::string cachePath = TextureCompressor::cachePath(request.path);
+    if (request.level >= 0)
+    {
+        result.failed = !TextureCompressor::readKtx2(cachePath, result.format, result.levels, request.level, 1);
+        return result;
+    }
+
+    auto readTail = [&] {
+        std::vector<Level> info;
+        if (!TextureCompressor::readKtx2(cachePath, result.format, info, 0, 0) || info.size() < 2)
+            return false;
+        return TextureCompressor::readKtx2(cachePath, result.format, result.levels, tailLevelFor(info, request.tailSize));
+    };
+    bool loaded = TextureCompressor::cacheValid(request.path, request.texClass) && readTail();
+    if (!loaded)
+        loaded = TextureCompressor::buildCache(request.path, request.texClass) && readTail();
+    result.failed = !loaded;
+    return result;
+}
+
+int TextureStreamer::tailLevelFor(const std::vector<Level>& levels, int tailSize)
+{
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+        if (std::max(levels[i].width, levels[i].height) <= tailSize)
+            return static_cast<int>(i);
+    }
+    return static_cast<int>(levels.size()) - 1;
+}
+
+int TextureStreamer::targetLevel(const StreamedTexture& texture) const
+{
+    //the coarsest level that still has at least one texel per pixel
+    if (texture.screenSize < 1.0f)
+        return texture.tailLevel;
+    int level = static_cast<int>(std::floor(std::log2(texture.maxDimension / texture.screenSize)));
+    return std::min(std::max(level, 0), texture.tailLevel);
+}
+
+float TextureStreamer::levelPriority(const StreamedTexture& texture, int level) const
+{
+    //pixels covered per texel of the level, coarse levels of big meshes matter most
+    return texture.screenSize / std::max(texture.maxDimension >> level, 1);
+}
+
+void TextureStreamer::applyResult(Result& result)
+{
+    StreamedTexture& texture = textures[result.handle];
+    texture.pending = false;
+    if (result.failed)
+    {
+        texture.failed = true;
+        qWarning() << "failed to stream texture" << QString::fromStdString(texture.path);
+        return;
+    }
+
+    if (result.level < 0)
+    {
+        int bytes = TextureCompressor::blockBytes(result.format);
+        texture.format = result.format;
+        texture.maxDimension = std::max(result.levels[0].width, result.levels[0].height);
+        texture.levelBytes.clear();
+        for (auto& i : result.levels)
+        {
+            texture.levelBytes.push_back(static_cast<size_t>((i.width + 3) / 4) * ((i.height + 3) / 4) * bytes);
+            statistics.fullBytes += texture.levelBytes.back();
+            statistics.rgba8Bytes += static_cast<size_t>(i.width) * i.height * 4;
+        }
+        texture.tailLevel = tailLevelFor(result.levels, tailSize);
+
+        int levelCount = static_cast<int>(result.levels.size());
+        for (int i = levelCount - 1; i >= texture.tailLevel; --i)
+            uploadLevel(texture, i, result.levels[i]);
+        texture.residentLevel = texture.tailLevel;
+        glTextureParameteri(texture.tex.get(), GL_TEXTURE_BASE_LEVEL, texture.tailLevel);
+        glTextureParameteri(texture.tex.get(), GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+        compressor.applySampling(texture.tex.get(), texture.texClass, texture.format, true);
+        return;
+    }
+
+    //the camera may have moved on while the level was loading
+    if (result.level != texture.residentLevel - 1 || result.level < targetLevel(texture)
+        || !makeRoom(texture.levelBytes[result.level], levelPriority(texture, result.level)))
+    {
+        ++statistics.rejected;
+        return;
+    }
+    uploadLevel(texture, result.level, result.levels[result.level]);
+    texture.residentLevel = result.level;
+    glTextureParameteri(texture.tex.get(), GL_TEXTURE_BASE_LEVEL, result.level);
+}
+
+void TextureStreamer::uploadLevel(StreamedTexture& texture, int level, const Level& data)
+{
+    glBindTexture(GL_TEXTURE_2D, texture.tex.get());
+    glCompressedTexImage2D(GL_TEXTURE_2D, level, texture.format, data.width, data.height, 0, static_cast<int>(data.data.size()), data.data.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    texture.residentBytes += data.data.size();
+    texture.tex.setBytes(texture.residentBytes);
+    statistics.residentBytes += data.data.size();
+    statistics.uploadedBytes += data.data.size();
+    ++statistics.uploads;
+}
+
+void TextureStreamer::evictLevel(StreamedTexture& texture)
+{
+    //clamp sampling first, then respecify the level as empty so the driver can release it
+    int level = texture.residentLevel;
+    glTextureParameteri(texture.tex.get(), GL_TEXTURE_BASE_LEVEL, level + 1);
+    glBindTexture(GL_TEXTURE_2D, texture.tex.get());
+    glCompressedTexImage2D(GL_TEXTURE_2D, level, texture.format, 0, 0, 0, 0, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    texture.residentBytes -= texture.levelBytes[level];
+    texture.tex.setBytes(texture.residentBytes);
+    statistics.residentBytes -= texture.levelBytes[level];
+    ++texture.residentLevel;
+    ++statistics.evictions;
+}
+
+bool TextureStreamer::makeRoom(size_t bytes, float priority)
+{
+    //plan the evictions first so nothing is dropped when the space cannot be found anyway
+    std::vector<int> resident(textures.size());
+    for (size_t i = 0; i < textures.size(); ++i)
+        resident[i] = textures[i].residentLevel;
+    std::vector<int> victims;
+    size_t total = statistics.residentBytes;
+    while (total + bytes > budgetBytes)
+    {
+        int victim = -1;
+        float lowest = priority;
+        for (size_t i = 0; i < textures.size(); ++i)
+        {
+            const StreamedTexture& texture = textures[i];
+            if (texture.tailLevel < 0 || resident[i] >= texture.tailLevel)
+                continue;
+            float current = levelPriority(texture, resident[i]);
+            if (current < lowest)
+            {
+                lowest = current;
+                victim = static_cast<int>(i);
+            }
+        }
+        if (victim < 0)
+            return false;
+        total -= textures[victim].levelBytes[resident[victim]];
+        ++resident[victim];
+        victims.push_back(victim);
+    }
+    for (int i : victims)
+        evictLevel(textures[i]);
+    return true;
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include<qopenglfunctions_4_5_core.h>
+#include<condition_variable>
+#include<mutex>
+#include<string>
+#include<thread>
+#include<vector>
+#include"GpuResources.h"
+#include"TextureCompressor.h"
+
+//textures start with only their small tail mips resident, finer levels are read from the ktx2 cache
+//on a worker thread as the meshes using them grow on screen and dropped again when over budget
+class TextureStreamer :protected QOpenGLFunctions_4_5_Core
+{
+public:
+    using TextureClass = TextureCompressor::TextureClass;
+    using Level = TextureCompressor::Level;
+
+    struct Stats
+    {
+        int textures = 0;
+        int residentLevels = 0;
+        size_t residentBytes = 0;
+        size_t budgetBytes = 0;
+        size_t missingBytes = 0;    //bytes of levels wanted on screen but not resident
+        int queued = 0;
+        int inFlight = 0;
+        int uploads = 0;
+        size_t uploadedBytes = 0;
+        int evictions = 0;
+        int rejected = 0;           //finished loads dropped because the texture no longer wanted them
+        //what addTexture did on the GL thread: tails read from a valid cache, the rest waits on a cache build
+        int cacheHits = 0;
+        int cacheBuilds = 0;
+        double addMs = 0.0;
+        //every level of the textures whose cache has been read, compressed and as rgba8
+        size_t fullBytes = 0;
+        size_t rgba8Bytes = 0;
+    };
+
+    size_t budgetBytes = 128u << 20;
+    //levels no larger than this are loaded up front and never evicted
+    int tailSize = 64;
+
+    TextureStreamer(TextureCompressor& compressor);
+    ~TextureStreamer();
+
+    void init();
+    //returns a handle, the texture name behind it is valid right away and never changes
+    int addTexture(const std::string& path, TextureClass texClass);
+    unsigned int texture(int handle) const;
+    //screenSize is the on-screen diameter in pixels of something drawn with the texture, the largest one a frame wins
+    void requestDetail(int handle, float screenSize);
+    //asks for every level of every texture, for runs whose output must not depend on load timing
+    void requestAll();
+    //call once a frame on the GL thread before drawing
+    void update();
+    //nothing is loading and every texture is at the detail asked for in the last update
+    bool settled();
+    const Stats& stats() const;
+
+private:
+    struct StreamedTexture
+    {
+        std::string path;
+        TextureClass texClass;
+        GpuResources::Texture tex;
+        unsigned int format = 0;
+        size_t residentBytes = 0;
+        std::vector<size_t> levelBytes;
+        int maxDimension = 0;
+        int tailLevel = -1;         //-1 until the cache has been read
+        int residentLevel = INT_MAX;
+        bool pending = false;
+        bool failed = false;
+        float screenSize = 0.0f;
+    };
+
+    struct Request
+    {
+        int handle;
+        int level;                  //-1 builds the cache if needed and loads the tail
+        float priority;
+        std::string path;
+        TextureClass texClass;
+        int tailSize;
+    };
+
+    struct Result
+    {
+        int handle;
+        int level;
+        bool failed;
+        unsigned int format;
+        std::vector<Level> levels;
+    };
+
+    TextureCompressor& compressor;
+    std::vector<StreamedTexture> textures;
+    Stats statistics;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<Request> queue;
+    std::vector<Result> results;
+    int busy = 0;
+    bool stopping = false;
+
+    void workerLoop();
+    static Result load(const Request& request);
+    static int tailLevelFor(const std::vector<Level>& levels, int tailSize);
+
+    int targetLevel(const StreamedTexture& texture) const;
+    float levelPriority(const StreamedTexture& texture, int level) const;
+    void applyResult(Result& result);
+    void uploadLevel(StreamedTexture& texture, int level, const Level& data);
+    void evictLevel(StreamedTexture& texture);
+    bool makeRoom(size_t bytes, float priority);
+};
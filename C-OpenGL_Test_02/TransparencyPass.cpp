@@ -0,0 +1,289 @@
+#include "TransparencyPass.h"
+#include<gtc/type_ptr.hpp>
+#include<qdebug.h>
+#include<algorithm>
+#include<chrono>
+#include<random>
+#include"AssetPack.h"
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::duration;
+
+void TransparencyPass::init(TextureStreamer& streamer)
+{
+    QOpenGLFunctions_4_5_Core::initializeOpenGLFunctions();
+
+    sortedShader.create();
+    AssetPack::addShader(sortedShader, QOpenGLShader::Vertex, "./shaders/transparentQuad.vert");
+    AssetPack::addShader(sortedShader, QOpenGLShader::Fragment, "./shaders/transparentSorted.frag");
+    sortedShader.link();
+
+    accumulateShader.create();
+    AssetPack::addShader(accumulateShader, QOpenGLShader::Vertex, "./shaders/transparentQuad.vert");
+    AssetPack::addShader(accumulateShader, QOpenGLShader::Fragment, "./shaders/transparentAccumulate.frag");
+    accumulateShader.link();
+
+    compositeShader.create();
+    AssetPack::addShader(compositeShader, QOpenGLShader::Vertex, "./shaders/fboOutput.vert");
+    AssetPack::addShader(compositeShader, QOpenGLShader::Fragment, "./shaders/transparentComposite.frag");
+    compositeShader.link();
+
+    //BC3 is picked for both since their alpha is used
+    textureStreams[0] = streamer.addTexture("./images/grass.png", TextureCompressor::TextureClass::Color);
+    textureStreams[1] = streamer.addTexture("./images/blending_transparent_window.png", TextureCompressor::TextureClass::Color);
+    for (int i = 0; i < 2; ++i)
+        textures[i] = streamer.texture(textureStreams[i]);
+
+    //the quad corners come from gl_VertexID, only the instances have attributes
+    vao = GpuResources::instance().createVertexArray("transparent quads");
+    glVertexArrayAttribFormat(vao.get(), 0, 4, GL_FLOAT, GL_FALSE, offsetof(Quad, positionScale));
+    glVertexArrayAttribFormat(vao.get(), 1, 4, GL_FLOAT, GL_FALSE, offsetof(Quad, params));
+    glVertexArrayAttribBinding(vao.get(), 0, 0);
+    glVertexArrayAttribBinding(vao.get(), 1, 0);
+    glVertexArrayBindingDivisor(vao.get(), 0, 1);
+    glEnableVertexArrayAttrib(vao.get(), 0);
+    glEnableVertexArrayAttrib(vao.get(), 1);
+
+    for (auto& i : frames)
+        glGenQueries(2, i.queries.data());
+}
+
+void TransparencyPass::resize(int w, int h, unsigned int sceneDepth)
+{
+    //premultiplied color and alpha weighted by depth need the range of half floats, revealage only a fraction
+    GpuResources& gpu = GpuResources::instance();
+    accumTex = gpu.createTexture2D(GL_RGBA16F, 1, w, h, "transparency accumulation");
+    revealageTex = gpu.createTexture2D(GL_R8, 1, w, h, "transparency revealage");
+    for (auto tex : { accumTex.get(), revealageTex.get() })
+    {
+        glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    accumFbo = gpu.createFramebuffer("transparency accumulation");
+    glNamedFramebufferTexture(accumFbo.get(), GL_COLOR_ATTACHMENT0, accumTex.get(), 0);
+    glNamedFramebufferTexture(accumFbo.get(), GL_COLOR_ATTACHMENT1, revealageTex.get(), 0);
+    glNamedFramebufferTexture(accumFbo.get(), GL_DEPTH_ATTACHMENT, sceneDepth, 0);
+    unsigned int drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glNamedFramebufferDrawBuffers(accumFbo.get(), 2, drawBuffers);
+    if (glCheckNamedFramebufferStatus(accumFbo.get(), GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        qWarning() << "transparency framebuffer is incomplete";
+}
+
+void TransparencyPass::setMode(Mode mode)
+{
+    passMode = mode;
+}
+
+TransparencyPass::Mode TransparencyPass::mode() const
+{
+    return passMode;
+}
+
+const char* TransparencyPass::modeName(Mode mode)
+{
+    switch (mode)
+    {
+    case Mode::Sorted:
+        return "sorted";
+    case Mode::WeightedBlended:
+        return "weighted blended";
+    default:
+        return "off";
+    }
+}
+
+void TransparencyPass::setQuadCount(int quadNum)
+{
+    std::default_random_engine dre(38);
+    std::uniform_real_distribution<float> horizontal(-2.9f, 2.9f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    quads.resize(static_cast<size_t>(std::max(quadNum, 0)));
+    for (auto& i : quads)
+    {
+        //standing on the plane, one in four is a window
+        float size = 0.15f + 0.2f * unit(dre);
+        i.positionScale = glm::vec4(horizontal(dre), -0.5f, horizontal(dre), size);
+        i.params = glm::vec4(unit(dre) * 3.1415927f, unit(dre) < 0.25f ? 1.0f : 0.0f, 0.7f + 0.3f * unit(dre), 0.0f);
+    }
+    sortedQuads.resize(quads.size());
+    sortKeys.resize(quads.size());
+
+    size_t bytes = std::max<size_t>(quads.size(), 1) * sizeof(Quad);
+    if (bytes > quadBytes)
+    {
+        quadBytes = bytes;
+        quadBuffer = GpuResources::instance().createBuffer(quadBytes, nullptr, 0, "transparent quads");
+        sortedBuffer = GpuResources::instance().createBuffer(quadBytes, nullptr, 0, "sorted transparent quads");
+    }
+    if (!quads.empty())
+        glNamedBufferSubData(quadBuffer.get(), 0, quads.size() * sizeof(Quad), quads.data());
+    statistics.quads = quadNum;
+}
+
+void TransparencyPass::requestTextureDetail(TextureStreamer& streamer, float screenSize)
+{
+    if (passMode == Mode::Off)
+        return;
+    for (int i : textureStreams)
+        streamer.requestDetail(i, screenSize);
+}
+
+void TransparencyPass::bindQuads(unsigned int buffer)
+{
+    glVertexArrayVertexBuffer(vao.get(), 0, buffer, 0, sizeof(Quad));
+    glBindVertexArray(vao.get());
+    glBindTextureUnit(0, textures[0]);
+    glBindTextureUnit(1, textures[1]);
+}
+
+void TransparencyPass::draw(const glm::mat4& viewProjection, const glm::vec3& viewPos, unsigned int sceneFbo, unsigned int screenVao)
+{
+    frameIndex = (frameIndex + 1) % queryLatency;
+    Frame& frame = frames[frameIndex];
+    if (frame.issued)
+        collect(frame);
+    if (passMode == Mode::Off || quads.empty())
+        return;
+
+    auto cpuBegin = steady_clock::now();
+    glQueryCounter(frame.queries[0], GL_TIMESTAMP);
+    //tested against the opaque depth but never written, and seen from both sides
+    glDepthMask(GL_FALSE);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+    GLsizei quadNum = static_cast<GLsizei>(quads.size());
+    if (passMode == Mode::Sorted)
+    {
+        //the baseline, farthest first by distance to the quad's foot
+        for (size_t i = 0; i < quads.size(); ++i)
+        {
+            glm::vec3 offset = glm::vec3(quads[i].positionScale) - viewPos;
+            sortKeys[i] = std::make_pair(-glm::dot(offset, offset), static_cast<unsigned int>(i));
+        }
+        std::sort(sortKeys.begin(), sortKeys.end());
+        for (size_t i = 0; i < sortKeys.size(); ++i)
+            sortedQuads[i] = quads[sortKeys[i].second];
+        glNamedBufferSubData(sortedBuffer.get(), 0, sortedQuads.size() * sizeof(Quad), sortedQuads.data());
+
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFbo);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        sortedShader.bind();
+        glUniformMatrix4fv(sortedShader.uniformLocation("VP"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+        bindQuads(sortedBuffer.get());
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, quadNum);
+    }
+    else
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, accumFbo.get());
+        float accumClear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        float revealageClear[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+        glClearBufferfv(GL_COLOR, 0, accumClear);
+        glClearBufferfv(GL_COLOR, 1, revealageClear);
+        //weighted color and alpha add up, revealage is the product of every (1 - alpha)
+        glBlendFunci(0, GL_ONE, GL_ONE);
+        glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+        accumulateShader.bind();
+        glUniformMatrix4fv(accumulateShader.uniformLocation("VP"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+        bindQuads(quadBuffer.get());
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, quadNum);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFbo);
+        glDisable(GL_DEPTH_TEST);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        compositeShader.bind();
+        glBindTextureUnit(0, accumTex.get());
+        glBindTextureUnit(1, revealageTex.get());
+        glBindVertexArray(screenVao);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        glEnable(GL_DEPTH_TEST);
+    }
+    glBindVertexArray(0);
+    glDisable(GL_BLEND);
+    glEnable(GL_CULL_FACE);
+    glDepthMask(GL_TRUE);
+    glQueryCounter(frame.queries[1], GL_TIMESTAMP);
+
+    frame.issued = true;
+    frame.mode = passMode;
+    frame.benchmarkStep = stepIndex;
+    frame.cpuMs = duration_cast<duration<float, std::milli>>(steady_clock::now() - cpuBegin).count();
+}
+
+const TransparencyPass::Stats& TransparencyPass::stats() const
+{
+    return statistics;
+}
+
+void TransparencyPass::toggleBenchmark()
+{
+    if (benchmarkRunning())
+    {
+        qDebug() << "transparency benchmark stopped";
+        stepIndex = -1;
+        setQuadCount(savedQuadNum);
+        setMode(savedMode);
+        return;
+    }
+    benchmarkSteps.clear();
+    for (int i : benchmarkCounts)
+    {
+        benchmarkSteps.push_back(Step{ i, Mode::Sorted, 0, 0.0, 0.0 });
+        benchmarkSteps.push_back(Step{ i, Mode::WeightedBlended, 0, 0.0, 0.0 });
+    }
+    savedQuadNum = static_cast<int>(quads.size());
+    savedMode = passMode;
+    stepIndex = 0;
+    setQuadCount(benchmarkSteps[0].quadNum);
+    setMode(benchmarkSteps[0].mode);
+    qDebug() << "transparency benchmark";
+}
+
+bool TransparencyPass::benchmarkRunning() const
+{
+    return stepIndex >= 0;
+}
+
+void TransparencyPass::collect(Frame& frame)
+{
+    //issued queryLatency frames ago, normally long available
+    GLuint64 begin = 0, end = 0;
+    glGetQueryObjectui64v(frame.queries[0], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(frame.queries[1], GL_QUERY_RESULT, &end);
+    frame.issued = false;
+    float gpuMs = (end - begin) / 1e6f;
+
+    int index = static_cast<int>(frame.mode);
+    auto average = [](float& value, float sample) {
+        value = value == 0.0f ? sample : value * 0.95f + sample * 0.05f;
+    };
+    average(statistics.cpuMs[index], frame.cpuMs);
+    average(statistics.gpuMs[index], gpuMs);
+
+    //results of an earlier step arriving late are not counted
+    if (stepIndex < 0 || frame.benchmarkStep != stepIndex)
+        return;
+    Step& step = benchmarkSteps[stepIndex];
+    step.cpuMs += frame.cpuMs;
+    step.gpuMs += gpuMs;
+    if (++step.frames == framesPerStep)
+        finishStep();
+}
+
+void TransparencyPass::finishStep()
+{
+    const Step& step = benchmarkSteps[stepIndex];
+    qDebug() << "  " << step.quadNum << "quads" << modeName(step.mode) << ": cpu" << step.cpuMs / step.frames << "ms, gpu" << step.gpuMs / step.frames << "ms";
+
+    if (++stepIndex == static_cast<int>(benchmarkSteps.size()))
+    {
+        qDebug() << "transparency benchmark done";
+        stepIndex = -1;
+        setQuadCount(savedQuadNum);
+        setMode(savedMode);
+        return;
+    }
+    setQuadCount(benchmarkSteps[stepIndex].quadNum);
+    setMode(benchmarkSteps[stepIndex].mode);
+}
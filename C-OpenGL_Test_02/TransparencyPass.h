@@ -0,0 +1,105 @@
+#pragma once
+#include<qopenglfunctions_4_5_core.h>
+#include<qopenglshaderprogram.h>
+#include<glm.hpp>
+#include<array>
+#include<vector>
+#include"GpuResources.h"
+#include"TextureStreamer.h"
+
+//grass and window quads drawn after the opaque scene, either sorted back to front every frame and blended
+//or in any order through weighted blended accumulation and revealage targets and a full-screen composite
+class TransparencyPass :protected QOpenGLFunctions_4_5_Core
+{
+public:
+    enum class Mode
+    {
+        Off, Sorted, WeightedBlended
+    };
+
+    struct Stats
+    {
+        int quads = 0;
+        //averaged per mode so switching keeps the numbers to compare
+        std::array<float, 3> cpuMs{};
+        std::array<float, 3> gpuMs{};
+    };
+
+    constexpr static int queryLatency = 3;
+    constexpr static int framesPerStep = 120;
+
+    void init(TextureStreamer& streamer);
+    //the accumulation targets share the scene depth, so they are rebuilt with it
+    void resize(int w, int h, unsigned int sceneDepth);
+    void setMode(Mode mode);
+    Mode mode() const;
+    static const char* modeName(Mode mode);
+    //quads are scattered over the plane with a fixed seed
+    void setQuadCount(int quadNum);
+    void requestTextureDetail(TextureStreamer& streamer, float screenSize);
+    //blends into sceneFbo, whose depth has the opaque scene, screenVao is the full-screen quad
+    void draw(const glm::mat4& viewProjection, const glm::vec3& viewPos, unsigned int sceneFbo, unsigned int screenVao);
+    const Stats& stats() const;
+
+    //steps through the quad counts in both modes and logs CPU and GPU time of every step
+    void toggleBenchmark();
+    bool benchmarkRunning() const;
+
+private:
+    //per instance attributes of transparentQuad.vert
+    struct Quad
+    {
+        glm::vec4 positionScale;
+        glm::vec4 params;   //yaw, texture, tint
+    };
+
+    struct Frame
+    {
+        std::array<unsigned int, 2> queries{};
+        bool issued = false;
+        Mode mode = Mode::Off;
+        float cpuMs = 0.0f;
+        int benchmarkStep = -1;
+    };
+
+    struct Step
+    {
+        int quadNum;
+        Mode mode;
+        int frames;
+        double cpuMs;
+        double gpuMs;
+    };
+
+    Mode passMode = Mode::Off;
+    QOpenGLShaderProgram sortedShader;
+    QOpenGLShaderProgram accumulateShader;
+    QOpenGLShaderProgram compositeShader;
+    std::array<int, 2> textureStreams{};
+    std::array<unsigned int, 2> textures{};
+
+    std::vector<Quad> quads;
+    std::vector<Quad> sortedQuads;
+    std::vector<std::pair<float, unsigned int>> sortKeys;
+    GpuResources::VertexArray vao;
+    //the unsorted quads never change, the sorted order is written to its own buffer every frame
+    GpuResources::Buffer quadBuffer, sortedBuffer;
+    size_t quadBytes = 0;
+
+    GpuResources::Framebuffer accumFbo;
+    GpuResources::Texture accumTex, revealageTex;
+
+    std::array<Frame, queryLatency> frames;
+    int frameIndex = 0;
+    Stats statistics;
+
+    std::vector<int> benchmarkCounts{ 1000, 4000, 16000, 64000 };
+    std::vector<Step> benchmarkSteps;
+    int stepIndex = -1;
+    int savedQuadNum = 0;
+    Mode savedMode = Mode::Off;
+
+    void bindQuads(unsigned int buffer);
+    void collect(Frame& frame);
+    void finishStep();
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include<array>
+#include<atomic>
+
+//single writer, single reader hand-off without locks: the writer fills the back slot and swaps it with the middle one,
+//the reader swaps its front slot with the middle one when something new has been published, nobody ever waits
+template<typename T>
+class TripleBuffer
+{
+public:
+    //only touched by the writer until publish()
+    T& writeBuffer()
+    {
+        return buffers[backIndex];
+    }
+
+    void publish()
+    {
+        unsigned int previous = middle.exchange(backIndex | freshBit, std::memory_order_acq_rel);
+        backIndex = previous & indexMask;
+    }
+
+    //true if a newer value was published since the last call, readBuffer() then refers to it
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & freshBit))
+            return false;
+        unsigned int previous = middle.exchange(frontIndex, std::memory_order_acq_rel);
+        frontIndex = previous & indexMask;
+        return true;
+    }
+
+    const T& readBuffer() const
+    {
+        return buffers[frontIndex];
+    }
+
+private:
+    constexpr static unsigned int freshBit = 4;
+    constexpr static unsigned int indexMask = 3;
+
+    std::array<T, 3> buffers{};
+    std::atomic<unsigned int> middle{ 1 };
+    unsigned int backIndex = 0;
+    unsigned int frontIndex = 2;
+};
@@ -0,0 +1,131 @@
+#include "VertexCostBenchmark.h"
+#include<gtc/matrix_transform.hpp>
+#include<qdebug.h>
+#include<algorithm>
+#include<chrono>
+#include<random>
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::duration;
+
+void VertexCostBenchmark::init()
+{
+    QOpenGLFunctions_4_5_Core::initializeOpenGLFunctions();
+    for (auto& i : frames)
+        glGenQueries(StampNum, i.queries.data());
+}
+
+void VertexCostBenchmark::toggle()
+{
+    if (active)
+    {
+        qDebug() << "vertex cost benchmark stopped";
+        active = false;
+        return;
+    }
+    //the buffer is only made once somebody runs the benchmark
+    if (!instances)
+        createInstances();
+    qDebug() << "vertex cost benchmark," << instanceNum << "boxes," << instanceNum * 36 << "vertices per draw";
+    measureCpu();
+    ++runIndex;
+    active = true;
+    measuredFrames = 0;
+    precomputedMs = 0.0;
+    perVertexMs = 0.0;
+}
+
+bool VertexCostBenchmark::running() const
+{
+    return active;
+}
+
+unsigned int VertexCostBenchmark::instanceBuffer() const
+{
+    return instances.get();
+}
+
+void VertexCostBenchmark::measure(const std::function<void(bool)>& draw)
+{
+    frameIndex = (frameIndex + 1) % queryLatency;
+    Frame& frame = frames[frameIndex];
+    if (frame.fence)
+        collect(frame);
+    if (!active)
+        return;
+
+    glQueryCounter(frame.queries[PrecomputedBegin], GL_TIMESTAMP);
+    draw(false);
+    glQueryCounter(frame.queries[PerVertexBegin], GL_TIMESTAMP);
+    draw(true);
+    glQueryCounter(frame.queries[PerVertexEnd], GL_TIMESTAMP);
+    frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame.run = runIndex;
+}
+
+void VertexCostBenchmark::createInstances()
+{
+    //spread around the scene so some are clipped, as in a real frame, scaled unevenly so the normal matrix matters
+    std::default_random_engine dre(40);
+    std::uniform_real_distribution<float> position(-6.0f, 6.0f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    models.resize(instanceNum);
+    for (auto& i : models)
+    {
+        i = glm::translate(glm::mat4(1.0f), glm::vec3(position(dre), position(dre) * 0.5f, position(dre)));
+        i = glm::rotate(i, unit(dre) * 6.2831853f, glm::normalize(glm::vec3(unit(dre), unit(dre), unit(dre)) + glm::vec3(0.01f)));
+        i = glm::scale(i, glm::vec3(0.05f + 0.1f * unit(dre), 0.05f + 0.1f * unit(dre), 0.05f + 0.1f * unit(dre)));
+    }
+    std::vector<InstanceTransform> transforms(models.size());
+    InstanceTransforms::compute(models.data(), transforms.data(), models.size());
+    instances = GpuResources::instance().createBuffer(transforms.size() * sizeof(InstanceTransform), transforms.data(), 0, "vertex cost instances");
+}
+
+void VertexCostBenchmark::measureCpu()
+{
+    //best of a few runs, the first one also pays for page faults
+    constexpr int runs = 8;
+    std::vector<InstanceTransform> transforms(models.size());
+    double batchMs = 1e9, scalarMs = 1e9;
+    for (int run = 0; run < runs; ++run)
+    {
+        auto begin = steady_clock::now();
+        InstanceTransforms::compute(models.data(), transforms.data(), models.size());
+        auto middle = steady_clock::now();
+        InstanceTransforms::computeScalar(models.data(), transforms.data(), models.size());
+        auto end = steady_clock::now();
+        batchMs = std::min(batchMs, duration_cast<duration<double, std::milli>>(middle - begin).count());
+        scalarMs = std::min(scalarMs, duration_cast<duration<double, std::milli>>(end - middle).count());
+    }
+    qDebug() << "  normal matrices on the cpu:" << models.size() << "in" << batchMs << "ms batched," << scalarMs << "ms through glm::inverse";
+}
+
+void VertexCostBenchmark::collect(Frame& frame)
+{
+    //written queryLatency frames ago, normally long done
+    glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    glDeleteSync(frame.fence);
+    frame.fence = nullptr;
+    if (!active || frame.run != runIndex)
+        return;
+
+    std::array<GLuint64, StampNum> times{};
+    for (int i = 0; i < StampNum; ++i)
+        glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &times[i]);
+    precomputedMs += (times[PerVertexBegin] - times[PrecomputedBegin]) / 1e6;
+    perVertexMs += (times[PerVertexEnd] - times[PerVertexBegin]) / 1e6;
+    if (++measuredFrames == framesPerStep)
+        finish();
+}
+
+void VertexCostBenchmark::finish()
+{
+    double precomputed = precomputedMs / measuredFrames;
+    double perVertex = perVertexMs / measuredFrames;
+    double vertices = static_cast<double>(instanceNum) * 36;
+    qDebug() << "  precomputed normal matrices" << precomputed << "ms (" << precomputed * 1e6 / vertices << "ns/vertex),"
+        << "inverse per vertex" << perVertex << "ms (" << perVertex * 1e6 / vertices << "ns/vertex)";
+    qDebug() << "vertex cost benchmark done";
+    active = false;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include<qopenglfunctions_4_5_core.h>
+#include<glm.hpp>
+#include<array>
+#include<functional>
+#include<vector>
+#include"GpuResources.h"
+#include"InstanceTransform.h"
+
+//times the vertex stage with normal matrices read per instance against inverting the model matrix per vertex,
+//both drawn into a single pixel so fragment work hardly counts, and times building the normal matrices on the CPU
+class VertexCostBenchmark :protected QOpenGLFunctions_4_5_Core
+{
+public:
+    constexpr static int instanceNum = 16384;
+    constexpr static int framesPerStep = 120;
+    constexpr static int queryLatency = 3;
+
+    void init();
+    //measures for framesPerStep frames and logs the result, a second call stops early
+    void toggle();
+    bool running() const;
+    //randomly placed, rotated and unevenly scaled instances to draw while measuring
+    unsigned int instanceBuffer() const;
+    //draw(perVertex) draws instanceNum instances, perVertex picks the old shader path
+    void measure(const std::function<void(bool)>& draw);
+
+private:
+    enum Stamp
+    {
+        PrecomputedBegin, PerVertexBegin, PerVertexEnd, StampNum
+    };
+
+    struct Frame
+    {
+        std::array<unsigned int, StampNum> queries{};
+        GLsync fence = nullptr;
+        int run = -1;
+    };
+
+    std::vector<glm::mat4> models;
+    GpuResources::Buffer instances;
+    std::array<Frame, queryLatency> frames;
+    int frameIndex = 0;
+    //results of an earlier run arriving late are not counted
+    int runIndex = 0;
+    bool active = false;
+    int measuredFrames = 0;
+    double precomputedMs = 0.0;
+    double perVertexMs = 0.0;
+
+    void createInstances();
+    void measureCpu();
+    void collect(Frame& frame);
+    void finish();
+};
@@ -1,10 +1,58 @@
 #include"MyGLWindow.h"
+#include"JobSystem.h"
+#include"EnvironmentLighting.h"
+#include"AssetPack.h"
 #include <QtWidgets/QApplication>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    if (QApplication::arguments().contains("--bench-jobs"))
+    {
+        JobSystem::benchmark();
+        return 0;
+    }
+    QStringList arguments = QApplication::arguments();
+    int buildArgument = arguments.indexOf("--build-pack");
+    if (buildArgument >= 0)
+    {
+        std::string packPath = buildArgument + 1 < arguments.size() ? arguments.at(buildArgument + 1).toStdString() : "assets.pack";
+        return AssetPack::build(packPath, { "shaders", "images", "models" }) ? 0 : 1;
+    }
+    //the pack next to the executable comes first so startup does not depend on the working directory
+    int packArgument = arguments.indexOf("--pack");
+    std::vector<std::string> packPaths{ (QApplication::applicationDirPath() + "/assets.pack").toStdString(), "assets.pack" };
+    if (packArgument >= 0 && packArgument + 1 < arguments.size())
+        packPaths = { arguments.at(packArgument + 1).toStdString() };
+    if (arguments.contains("--bench-assets"))
+    {
+        AssetPack::benchmark(packPaths.front());
+        return 0;
+    }
+    for (auto& i : packPaths)
+    {
+        if (AssetPack::instance().mount(i))
+        {
+            qDebug() << "assets from" << QString::fromStdString(i);
+            break;
+        }
+    }
+    int bvhArgument = arguments.indexOf("--bench-bvh");
+    if (bvhArgument >= 0)
+    {
+        std::string modelPath = bvhArgument + 1 < arguments.size() ? arguments.at(bvhArgument + 1).toStdString() : "./models/nanosuit/nanosuit.obj";
+        Model::benchmarkBvh(modelPath);
+        return 0;
+    }
+    if (arguments.contains("--bench-env"))
+    {
+        EnvironmentLighting::benchmark(EnvironmentLighting::skyboxFaces("./images/skybox"));
+        return 0;
+    }
     MyGLWindow w;
+    //a replay renders without ever putting the window on screen
+    if (QApplication::arguments().contains("--replay"))
+        w.setAttribute(Qt::WA_DontShowOnScreen);
     w.show();
     return a.exec();
 }
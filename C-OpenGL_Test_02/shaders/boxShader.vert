@@ -8,11 +8,13 @@ out vec3 FragPos;
 
 uniform mat4 MVP;
 uniform mat4 modelMat;
+//the inverse transpose of modelMat, set with it
+uniform mat3 normalMat;
 
 void main()
 {
     TexCoords = inTexCoords;
-    Normal = mat3(transpose(inverse(modelMat))) * inNormal;
+    Normal = normalMat * inNormal;
     FragPos = (modelMat * vec4(position, 1.0f)).xyz;
     gl_Position = MVP * vec4(position, 1.0f);
 }
\ No newline at end of file
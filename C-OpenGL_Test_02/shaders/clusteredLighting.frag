@@ -0,0 +1,92 @@
+#version 450 core
+//linked into every fragment shader that is lit by the clustered point lights
+
+struct PointLight
+{
+    vec4 positionRange;
+    vec4 color;
+};
+
+layout (std430, binding = 6) readonly buffer Lights { PointLight lights[]; };
+layout (std430, binding = 7) readonly buffer ClusterCounts { uint clusterCounts[]; };
+layout (std430, binding = 8) readonly buffer ClusterIndices { uint clusterIndices[]; };
+
+layout (std140, binding = 3) uniform ClusterData
+{
+    mat4 clusterView;
+    uvec4 clusterGrid;
+    uvec4 clusterLights;
+    vec4 clusterDepth;
+    vec4 clusterScreen;
+};
+
+//a light with a shadow keeps the index of its caster in color.w, see PointShadows
+struct ShadowCaster
+{
+    mat4 faceMats[6];
+    vec4 rect;      //corner and size of the tile in every face of the cube slot, in texture coordinates
+    vec4 params;    //cube slot, texel size of the tile in world units at distance 1, half a texel of the tile
+};
+
+layout (std430, binding = 10) readonly buffer ShadowCasters { ShadowCaster shadowCasters[]; };
+//the cube map array seen as six layers per cube, so a tile can be less than a whole face
+layout (binding = 8) uniform sampler2DArrayShadow pointShadowAtlas;
+
+float pointShadow(int caster, vec3 lightPos, vec3 fragPos, vec3 normal)
+{
+    ShadowCaster shadow = shadowCasters[caster];
+    //pushed off the surface by about a texel of the tile at this distance
+    vec3 fromLight = fragPos - lightPos;
+    vec3 offsetPos = fragPos + normal * (2.0 * shadow.params.y * length(fromLight));
+    fromLight = offsetPos - lightPos;
+    vec3 a = abs(fromLight);
+    int face = a.x >= a.y && a.x >= a.z ? (fromLight.x > 0.0 ? 0 : 1) : (a.y >= a.z ? (fromLight.y > 0.0 ? 2 : 3) : (fromLight.z > 0.0 ? 4 : 5));
+    vec4 clip = shadow.faceMats[face] * vec4(offsetPos, 1.0);
+    vec3 ndc = clip.xyz / clip.w;
+    //kept half a texel inside the tile, its neighbours belong to other lights
+    vec2 uv = clamp(ndc.xy * 0.5 + 0.5, vec2(shadow.params.z), vec2(1.0 - shadow.params.z));
+    return texture(pointShadowAtlas, vec4(shadow.rect.xy + uv * shadow.rect.zw, shadow.params.x * 6.0 + float(face), ndc.z * 0.5 + 0.5));
+}
+
+vec3 shadePointLight(PointLight light, vec3 fragPos, vec3 normal, vec3 viewDir, vec3 diffuseColor, vec3 specularColor, float shininess)
+{
+    vec3 toLight = light.positionRange.xyz - fragPos;
+    float distance = length(toLight);
+    //reaches exactly zero at the range, so skipping the lights of other clusters changes nothing
+    float window = clamp(1.0 - pow(distance / light.positionRange.w, 4.0), 0.0, 1.0);
+    float attenuation = window * window / (1.0 + distance * distance);
+    if(attenuation <= 0.0)
+        return vec3(0.0);
+    int caster = int(light.color.w);
+    if(caster >= 0)
+    {
+        attenuation *= pointShadow(caster, light.positionRange.xyz, fragPos, normal);
+        if(attenuation <= 0.0)
+            return vec3(0.0);
+    }
+
+    vec3 lightDir = toLight / distance;
+    float diff = max(dot(normal, lightDir), 0.0);
+    float spec = pow(max(dot(normal, normalize(lightDir + viewDir)), 0.0), shininess);
+    return light.color.rgb * attenuation * (diff * diffuseColor + spec * specularColor);
+}
+
+vec3 clusteredPointLights(vec3 fragPos, vec3 normal, vec3 viewDir, vec3 diffuseColor, vec3 specularColor, float shininess)
+{
+    vec3 result = vec3(0.0);
+    if(clusterLights.y == 0u)
+    {
+        for(uint i = 0u; i < clusterLights.x; ++i)
+            result += shadePointLight(lights[i], fragPos, normal, viewDir, diffuseColor, specularColor, shininess);
+        return result;
+    }
+
+    float viewDepth = -(clusterView * vec4(fragPos, 1.0)).z;
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / clusterScreen.xy * vec2(clusterGrid.xy)), clusterGrid.xy - 1u);
+    uint slice = uint(clamp(log(max(viewDepth, clusterDepth.x) / clusterDepth.x) * clusterDepth.z, 0.0, float(clusterGrid.z - 1u)));
+    uint cluster = tile.x + clusterGrid.x * (tile.y + clusterGrid.y * slice);
+    uint count = clusterCounts[cluster];
+    for(uint i = 0u; i < count; ++i)
+        result += shadePointLight(lights[clusterIndices[cluster * clusterGrid.w + i]], fragPos, normal, viewDir, diffuseColor, specularColor, shininess);
+    return result;
+}
\ No newline at end of file
@@ -0,0 +1,12 @@
+#version 450 core
+layout (location = 0) out vec4 Frag_Color;
+
+in vec3 Normal;
+in vec3 Color;
+
+void main()
+{
+    vec3 lightDir = normalize(vec3(2.0f, 4.0f, 1.0f));
+    float diff = max(dot(normalize(Normal), lightDir), 0.0f);
+    Frag_Color = vec4(Color * (0.2f + 0.8f * diff), 1.0f);
+}
\ No newline at end of file
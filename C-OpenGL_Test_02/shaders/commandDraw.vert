@@ -0,0 +1,22 @@
+#version 450 core
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 inNormal;
+
+//one range of the per draw buffer is bound here before every draw
+layout (std140, binding = 0) uniform DrawData
+{
+    mat4 modelMat;
+    vec4 color;
+};
+
+uniform mat4 VP;
+
+out vec3 Normal;
+out vec3 Color;
+
+void main()
+{
+    Normal = mat3(modelMat) * inNormal;
+    Color = color.rgb;
+    gl_Position = VP * modelMat * vec4(position, 1.0f);
+}
\ No newline at end of file
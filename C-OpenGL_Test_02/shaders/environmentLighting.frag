@@ -0,0 +1,34 @@
+#version 450 core
+//linked into the fragment shaders lit by the skybox, see EnvironmentLighting
+
+layout (std140, binding = 4) uniform EnvironmentData
+{
+    vec4 irradianceSH[9];       //irradiance over pi with the basis constants folded in
+    vec4 environmentParams;     //1 once the data is there and enabled, the mip of roughness 1
+};
+
+layout (binding = 9) uniform samplerCube prefilteredEnvironment;
+
+//the diffuse light arriving around normal, the flat fallback until the coefficients are uploaded
+vec3 environmentDiffuse(vec3 normal, vec3 fallback)
+{
+    vec3 n = normal;
+    vec3 irradiance = irradianceSH[0].rgb
+        + irradianceSH[1].rgb * n.y + irradianceSH[2].rgb * n.z + irradianceSH[3].rgb * n.x
+        + irradianceSH[4].rgb * (n.x * n.y) + irradianceSH[5].rgb * (n.y * n.z) + irradianceSH[6].rgb * (3.0 * n.z * n.z - 1.0)
+        + irradianceSH[7].rgb * (n.x * n.z) + irradianceSH[8].rgb * (n.x * n.x - n.y * n.y);
+    return mix(fallback, max(irradiance, vec3(0.0)), environmentParams.x);
+}
+
+//the reflection of the skybox through the mip prefiltered for roughness, weighted by a fresnel that rougher surfaces
+//see less of at grazing angles
+vec3 environmentSpecular(vec3 normal, vec3 viewDir, vec3 specularColor, float roughness)
+{
+    if(environmentParams.x == 0.0)
+        return vec3(0.0);
+    vec3 reflected = reflect(-viewDir, normal);
+    vec3 prefiltered = textureLod(prefilteredEnvironment, reflected, roughness * environmentParams.y).rgb;
+    float cosTheta = max(dot(normal, viewDir), 0.0);
+    vec3 fresnel = specularColor + (max(vec3(1.0 - roughness), specularColor) - specularColor) * pow(1.0 - cosTheta, 5.0);
+    return prefiltered * fresnel * environmentParams.x;
+}
\ No newline at end of file
@@ -4,8 +4,65 @@ layout (location = 0) out vec4 Frag_Color;
 in vec2 TexCoords;
 
 uniform sampler2D tex;
+//how tex is brought up to the output size when the scene is rendered smaller, 0 bilinear, 1 bicubic, 2 bicubic sharpened
+uniform int filterMode;
+uniform float sharpness;
+
+//Catmull-Rom from nine bilinear taps instead of sixteen point ones, the two middle weights of each axis share a tap
+vec4 sampleBicubic(vec2 uv)
+{
+    vec2 size = vec2(textureSize(tex, 0));
+    vec2 samplePos = uv * size;
+    vec2 texPos1 = floor(samplePos - 0.5) + 0.5;
+    vec2 f = samplePos - texPos1;
+
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+    vec2 w12 = w1 + w2;
+
+    vec2 texPos0 = (texPos1 - 1.0) / size;
+    vec2 texPos3 = (texPos1 + 2.0) / size;
+    vec2 texPos12 = (texPos1 + w2 / w12) / size;
+
+    vec4 result = vec4(0.0);
+    result += textureLod(tex, vec2(texPos0.x, texPos0.y), 0.0) * w0.x * w0.y;
+    result += textureLod(tex, vec2(texPos12.x, texPos0.y), 0.0) * w12.x * w0.y;
+    result += textureLod(tex, vec2(texPos3.x, texPos0.y), 0.0) * w3.x * w0.y;
+    result += textureLod(tex, vec2(texPos0.x, texPos12.y), 0.0) * w0.x * w12.y;
+    result += textureLod(tex, vec2(texPos12.x, texPos12.y), 0.0) * w12.x * w12.y;
+    result += textureLod(tex, vec2(texPos3.x, texPos12.y), 0.0) * w3.x * w12.y;
+    result += textureLod(tex, vec2(texPos0.x, texPos3.y), 0.0) * w0.x * w3.y;
+    result += textureLod(tex, vec2(texPos12.x, texPos3.y), 0.0) * w12.x * w3.y;
+    result += textureLod(tex, vec2(texPos3.x, texPos3.y), 0.0) * w3.x * w3.y;
+    //the negative lobes overshoot below zero next to bright edges
+    return max(result, vec4(0.0));
+}
+
+//contrast adaptive sharpening on top of the bicubic result, strong where the neighbourhood is flat
+//and backing off where it already spans a large range so hard edges do not ring
+vec4 sampleSharpened(vec2 uv)
+{
+    vec2 texel = 1.0 / vec2(textureSize(tex, 0));
+    vec4 center = sampleBicubic(uv);
+    vec3 north = textureLod(tex, uv + vec2(0.0, texel.y), 0.0).rgb;
+    vec3 south = textureLod(tex, uv - vec2(0.0, texel.y), 0.0).rgb;
+    vec3 east = textureLod(tex, uv + vec2(texel.x, 0.0), 0.0).rgb;
+    vec3 west = textureLod(tex, uv - vec2(texel.x, 0.0), 0.0).rgb;
+    vec3 low = min(center.rgb, min(min(north, south), min(east, west)));
+    vec3 high = max(center.rgb, max(max(north, south), max(east, west)));
+    vec3 amount = sqrt(clamp(min(low, 1.0 - high) / max(high, vec3(1e-4)), 0.0, 1.0)) * sharpness;
+    vec3 blur = (north + south + east + west) * 0.25;
+    return vec4(max(center.rgb + (center.rgb - blur) * amount, vec3(0.0)), center.a);
+}
 
 void main()
 {
-    Frag_Color = texture(tex, TexCoords);
+    if(filterMode == 1)
+        Frag_Color = sampleBicubic(TexCoords);
+    else if(filterMode == 2)
+        Frag_Color = sampleSharpened(TexCoords);
+    else
+        Frag_Color = texture(tex, TexCoords);
 }
\ No newline at end of file
@@ -3,6 +3,7 @@ layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inTexCoords;
 layout (location = 4) in mat4 modelMat;
+layout (location = 9) in mat4 nodeMat;
 
 out vec2 TexCoords;
 
@@ -10,6 +11,6 @@ uniform mat4 MV;
 
 void main()
 {
-    gl_Position = MV * modelMat * vec4(position, 1.0);
+    gl_Position = MV * modelMat * nodeMat * vec4(position, 1.0);
     TexCoords = inTexCoords;
 }
\ No newline at end of file
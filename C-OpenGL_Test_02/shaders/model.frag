@@ -20,19 +20,6 @@ struct DirLight
     vec3 specular;
 };
 
-struct PointLight
-{
-    vec3 position;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
 struct SpotLight
 {
     vec3 position;
@@ -52,9 +39,14 @@ struct SpotLight
 uniform Material material;
 uniform vec3 viewPos;
 uniform DirLight dirlight;
-uniform PointLight pointlights[4];
 uniform SpotLight spotlight;
 
+//clusteredLighting.frag
+vec3 clusteredPointLights(vec3 fragPos, vec3 normal, vec3 viewDir, vec3 diffuseColor, vec3 specularColor, float shininess);
+//environmentLighting.frag
+vec3 environmentDiffuse(vec3 normal, vec3 fallback);
+vec3 environmentSpecular(vec3 normal, vec3 viewDir, vec3 specularColor, float roughness);
+
 vec3 CalculateDirLight(DirLight light, vec3 normal, vec3 viewDir)
 {
     vec3 lightDir = normalize(-light.direction);
@@ -62,30 +54,12 @@ vec3 CalculateDirLight(DirLight light, vec3 normal, vec3 viewDir)
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0f), material.shininess);
 
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
+    vec3 ambient = environmentDiffuse(normal, light.ambient) * vec3(texture(material.texture_diffuse1, TexCoords));
     vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
     vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
     return (ambient + diffuse + specular);
 }
 
-vec3 CalculatePointLight(PointLight light, vec3 normal, vec3 viewDir)
-{
-    vec3 lightDir = normalize(light.position - FragPos);
-    float diff = max(dot(normal, lightDir), 0.0f);
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0f), material.shininess);
-    float distance    = length(light.position - FragPos);
-    float attenuation = 1.0f / (light.constant + light.linear * distance + 
-                 light.quadratic * (distance * distance));    
-    vec3 ambient  = light.ambient  * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse  = light.diffuse  * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
-    ambient  *= attenuation;
-    diffuse  *= attenuation;
-    specular *= attenuation;
-    return (ambient + diffuse + specular);
-}
-
 vec3 CalculateSpotLight(SpotLight light, vec3 normal, vec3 viewDir)
 {
     vec3 lightDir = normalize(light.position - FragPos);
@@ -118,11 +92,11 @@ void main()
     vec3 viewDir = normalize(viewPos - FragPos);
     vec3 normal = normalize(Normal);
     vec3 result = CalculateDirLight(dirlight, normal, viewDir);
-    for(int i = 0;i < 4;++i)
-    {
-        result += CalculatePointLight(pointlights[i], normal, viewDir);
-    }
+    result += clusteredPointLights(FragPos, normal, viewDir, vec3(texture(material.texture_diffuse1, TexCoords)),
+        vec3(texture(material.texture_specular1, TexCoords)), material.shininess);
     result += CalculateSpotLight(spotlight, normal, viewDir);
+    //the Blinn-Phong exponent as the roughness of the prefiltered mips
+    result += environmentSpecular(normal, viewDir, vec3(texture(material.texture_specular1, TexCoords)) * 0.5, sqrt(2.0 / (material.shininess + 2.0)));
 
     Frag_Color = vec4(result, 1.0f);
 }
\ No newline at end of file
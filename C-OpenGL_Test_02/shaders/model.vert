@@ -2,6 +2,9 @@
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inTexCoords;
+layout (location = 9) in mat4 nodeMat;
+//the inverse transpose of nodeMat, worked out on the CPU when the model is loaded
+layout (location = 13) in mat3x4 nodeNormalMat;
 
 out vec2 TexCoords;
 out vec3 Normal;
@@ -9,11 +12,21 @@ out vec3 FragPos;
 
 uniform mat4 MVP;
 uniform mat4 modelMat;
+//the inverse transpose of modelMat, the one of the product is the product of the two
+uniform mat3 modelNormalMat;
+//inverts the world matrix for every vertex as before, only to measure what that costs
+uniform bool perVertexNormalMatrix;
+//the depth prepass computes the same position in another program
+invariant gl_Position;
 
 void main()
 {
     TexCoords = inTexCoords;
-    Normal = mat3(transpose(inverse(modelMat))) * inNormal;
-    FragPos = (modelMat * vec4(position, 1.0f)).xyz;
-    gl_Position = MVP * vec4(position, 1.0f);
+    mat4 worldMat = modelMat * nodeMat;
+    if(perVertexNormalMatrix)
+        Normal = mat3(transpose(inverse(worldMat))) * inNormal;
+    else
+        Normal = modelNormalMat * (mat3(nodeNormalMat) * inNormal);
+    FragPos = (worldMat * vec4(position, 1.0f)).xyz;
+    gl_Position = MVP * nodeMat * vec4(position, 1.0f);
 }
\ No newline at end of file
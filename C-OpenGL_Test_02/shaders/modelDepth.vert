@@ -0,0 +1,13 @@
+#version 450 core
+layout (location = 0) in vec3 position;
+layout (location = 9) in mat4 nodeMat;
+
+uniform mat4 MVP;
+
+//the same expression as model.vert, the shading pass tests for exactly this depth
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = MVP * nodeMat * vec4(position, 1.0f);
+}
\ No newline at end of file
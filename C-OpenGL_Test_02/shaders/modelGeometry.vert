@@ -2,16 +2,18 @@
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 inTexCoords;
+layout (location = 9) in mat4 nodeMat;
 
 out VS_OUT
 {
     vec2 TexCoords;
+    vec3 WorldPos;
 }vs_out;
 
-uniform mat4 MVP;
+uniform mat4 modelMat;
 
 void main()
 {
-    gl_Position = MVP * vec4(position, 1.0f);
+    vs_out.WorldPos = (modelMat * nodeMat * vec4(position, 1.0f)).xyz;
     vs_out.TexCoords = inTexCoords;
 }
\ No newline at end of file
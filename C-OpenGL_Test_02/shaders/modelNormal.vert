@@ -2,14 +2,21 @@
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inTexCoords;
+layout (location = 9) in mat4 nodeMat;
+layout (location = 13) in mat3x4 nodeNormalMat;
 
-out vec3 Normal;
+//where the normal line of this vertex ends, in clip space
+out vec4 NormalEnd;
 
-uniform mat4 MVP;
-uniform mat3 normalMat;
+uniform mat4 VP;
+uniform mat4 modelMat;
+uniform mat3 modelNormalMat;
+uniform float normalLength;
 
 void main()
 {
-    gl_Position = MVP * vec4(position, 1.0f);
-    Normal = normalize(normalMat * inNormal);
+    vec4 world = modelMat * nodeMat * vec4(position, 1.0f);
+    gl_Position = VP * world;
+    vec3 normal = normalize(modelNormalMat * (mat3(nodeNormalMat) * inNormal));
+    NormalEnd = VP * vec4(world.xyz + normal * normalLength, 1.0f);
 }
\ No newline at end of file
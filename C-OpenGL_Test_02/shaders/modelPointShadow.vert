@@ -0,0 +1,25 @@
+#version 450 core
+#extension GL_ARB_shader_viewport_layer_array : enable
+layout (location = 0) in vec3 position;
+//advances every six instances, each instance of a node draws one cube face
+layout (location = 9) in mat4 nodeMat;
+
+uniform mat4 faceMats[6];
+uniform mat4 modelMat;
+uniform int cubeSlot;
+
+#ifndef GL_ARB_shader_viewport_layer_array
+//without the extension pointShadowLayer.geom writes the layer
+flat out int Layer;
+#endif
+
+void main()
+{
+    int face = gl_InstanceID % 6;
+    gl_Position = faceMats[face] * modelMat * nodeMat * vec4(position, 1.0);
+#ifdef GL_ARB_shader_viewport_layer_array
+    gl_Layer = cubeSlot * 6 + face;
+#else
+    Layer = cubeSlot * 6 + face;
+#endif
+}
\ No newline at end of file
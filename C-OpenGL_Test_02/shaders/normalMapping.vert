@@ -5,6 +5,7 @@ layout (location = 2) in vec2 inTexCoords;
 layout (location = 3) in mat4 modelMat;
 layout (location = 7) in vec3 inTangent;
 layout (location = 8) in vec3 inBitangent;
+layout (location = 13) in mat3x4 normalMat;
 
 uniform mat4 VP;
 uniform mat4 lightSpaceVO;
@@ -20,7 +21,7 @@ out VS_OUT
 void main()
 {
     gl_Position = VP * modelMat * vec4(position, 1.0f);
-    mat3 normalFixMat = transpose(inverse(mat3(modelMat)));
+    mat3 normalFixMat = mat3(normalMat);
     vec3 N = normalize(normalFixMat * inNormal);
     vec3 T = normalize(normalFixMat * inTangent);
     vec3 B = normalize(normalFixMat * inBitangent);
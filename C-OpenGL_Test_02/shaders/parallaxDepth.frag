@@ -0,0 +1,24 @@
+#version 450 core
+
+in VS_OUT
+{
+    vec3 FragPos;
+    vec2 TexCoords;
+    vec4 FragPosLightSpace;
+    mat3 TBN;
+    vec3 TangentFragPos;
+    vec3 TangentViewPos;
+    vec3 TangentLightPos;
+}fs_in;
+
+//parallaxSearch.frag
+vec2 parallaxMapping(vec2 texCoords, vec3 viewDir);
+
+//depth only, but the displaced coordinates decide which fragments exist, the same way as parallaxMapping.frag
+void main()
+{
+    vec3 viewDir = normalize(fs_in.TangentViewPos - fs_in.TangentFragPos);
+    vec2 texCoords = parallaxMapping(fs_in.TexCoords, viewDir);
+    if(texCoords.x > 1.0 || texCoords.y > 1.0 || texCoords.x < 0.0 || texCoords.y < 0.0)
+        discard;
+}
\ No newline at end of file
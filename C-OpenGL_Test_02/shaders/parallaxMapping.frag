@@ -15,8 +15,15 @@ in VS_OUT
 uniform sampler2D tex;
 uniform sampler2D shadowMap;
 uniform sampler2D normalMap;
-uniform sampler2D displacementMap;
-uniform float heightScale;
+uniform vec3 viewPos;
+
+//clusteredLighting.frag
+vec3 clusteredPointLights(vec3 fragPos, vec3 normal, vec3 viewDir, vec3 diffuseColor, vec3 specularColor, float shininess);
+//environmentLighting.frag
+vec3 environmentDiffuse(vec3 normal, vec3 fallback);
+vec3 environmentSpecular(vec3 normal, vec3 viewDir, vec3 specularColor, float roughness);
+//parallaxSearch.frag
+vec2 parallaxMapping(vec2 texCoords, vec3 viewDir);
 
 
 float shadowCaculation(vec4 lightSpaceFragPos)
@@ -43,36 +50,6 @@ float shadowCaculation(vec4 lightSpaceFragPos)
     return shadow;
 }
 
-vec2 parallaxMapping(vec2 texCoords, vec3 viewDir)
-{
-    const float minLayers = 8;
-    const float maxLayers = 32;
-    float numLayers = mix(minLayers, maxLayers, dot(vec3(0.0, 0.0, 1.0), viewDir));
-    float layerDepth = 1.0 / numLayers;
-    float currentLayerDepth = 0.0;
-    vec2 P = viewDir.xy * heightScale;
-    vec2 deltaTexCoords = P / numLayers;
-
-    vec2 currentTexCoords = texCoords;
-    float currentDepthMapValue = texture(displacementMap, currentTexCoords).r;
-
-    while(currentLayerDepth < currentDepthMapValue)
-    {
-        currentTexCoords -= deltaTexCoords;
-        currentDepthMapValue = texture(displacementMap, currentTexCoords).r;
-        currentLayerDepth += layerDepth;
-    }
-
-    vec2 prevTexCoords = currentTexCoords + deltaTexCoords;
-    float afterDepth = currentDepthMapValue - currentLayerDepth;
-    float beforeDepth = texture(displacementMap, prevTexCoords).r - currentLayerDepth + layerDepth;
-
-    float weight = afterDepth / (afterDepth - beforeDepth);
-    vec2 finalTexCoords = prevTexCoords * weight + currentTexCoords * (1.0 - weight);
-
-    return finalTexCoords;
-}
-
 void main()
 {
     vec3 viewDir = normalize(fs_in.TangentViewPos - fs_in.TangentFragPos);
@@ -81,11 +58,16 @@ void main()
         discard;
 
     vec3 color = texture(tex, texCoords).rgb;
-    vec3 normal = texture(normalMap, texCoords).rgb;
-    normal = normalize(normal * 2.0 - vec3(1.0));
+    //the normal map is BC5, only x and y are stored
+    vec3 normal;
+    normal.xy = texture(normalMap, texCoords).rg * 2.0 - vec2(1.0);
+    normal.z = sqrt(max(1.0 - dot(normal.xy, normal.xy), 0.0));
     vec3 lightColor = vec3(1.0f);
+    //the point lights and the skybox work in world space, TBN is orthonormal so its transpose takes the normal back
+    vec3 worldNormal = normalize(transpose(fs_in.TBN) * normal);
+    vec3 worldViewDir = normalize(viewPos - fs_in.FragPos);
 
-    vec3 ambientStrength= 0.15 * lightColor;
+    vec3 ambientStrength = environmentDiffuse(worldNormal, 0.15 * lightColor);
 
     vec3 lightDir = normalize(fs_in.TangentLightPos - fs_in.FragPos);
     float diff = max(dot(lightDir, normal), 0.0);
@@ -97,5 +79,7 @@ void main()
 
     float shadow = shadowCaculation(fs_in.FragPosLightSpace);
     vec3 result = (ambientStrength + (1.0 - shadow) * (diffuseStrength + specularStrength)) * color;
+    result += clusteredPointLights(fs_in.FragPos, worldNormal, worldViewDir, color, vec3(0.3), 64.0);
+    result += environmentSpecular(worldNormal, worldViewDir, vec3(0.04), 0.35);
     Frag_Color = vec4(result, 1.0);
 }
\ No newline at end of file
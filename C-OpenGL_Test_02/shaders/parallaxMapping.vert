@@ -5,12 +5,16 @@ layout (location = 2) in vec2 inTexCoords;
 layout (location = 3) in mat4 modelMat;
 layout (location = 7) in vec3 inTangent;
 layout (location = 8) in vec3 inBitangent;
+//the inverse transpose of modelMat, worked out on the CPU once per instance
+layout (location = 13) in mat3x4 normalMat;
 
 uniform mat4 VP;
 uniform mat4 lightSpaceVO;
 
 uniform vec3 lightPos;
 uniform vec3 viewPos;
+//inverts modelMat for every vertex as before, only to measure what that costs
+uniform bool perVertexNormalMatrix;
 
 out VS_OUT
 {
@@ -22,11 +26,13 @@ out VS_OUT
     vec3 TangentViewPos;
     vec3 TangentLightPos;
 }vs_out;
+//the depth prepass computes the same position in another program
+invariant gl_Position;
 
 void main()
 {
     gl_Position = VP * modelMat * vec4(position, 1.0f);
-    mat3 normalFixMat = transpose(inverse(mat3(modelMat)));
+    mat3 normalFixMat = perVertexNormalMatrix ? transpose(inverse(mat3(modelMat))) : mat3(normalMat);
     vec3 N = normalize(normalFixMat * inNormal);
     vec3 T = normalize(normalFixMat * inTangent);
     vec3 B = normalize(normalFixMat * inBitangent);
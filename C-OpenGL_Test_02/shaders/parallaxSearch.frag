@@ -0,0 +1,35 @@
+#version 450 core
+//linked into the parallax shading pass and its depth prepass, both have to discard the same fragments
+
+uniform sampler2D displacementMap;
+uniform float heightScale;
+
+vec2 parallaxMapping(vec2 texCoords, vec3 viewDir)
+{
+    const float minLayers = 8;
+    const float maxLayers = 32;
+    float numLayers = mix(minLayers, maxLayers, dot(vec3(0.0, 0.0, 1.0), viewDir));
+    float layerDepth = 1.0 / numLayers;
+    float currentLayerDepth = 0.0;
+    vec2 P = viewDir.xy * heightScale;
+    vec2 deltaTexCoords = P / numLayers;
+
+    vec2 currentTexCoords = texCoords;
+    float currentDepthMapValue = texture(displacementMap, currentTexCoords).r;
+
+    while(currentLayerDepth < currentDepthMapValue)
+    {
+        currentTexCoords -= deltaTexCoords;
+        currentDepthMapValue = texture(displacementMap, currentTexCoords).r;
+        currentLayerDepth += layerDepth;
+    }
+
+    vec2 prevTexCoords = currentTexCoords + deltaTexCoords;
+    float afterDepth = currentDepthMapValue - currentLayerDepth;
+    float beforeDepth = texture(displacementMap, prevTexCoords).r - currentLayerDepth + layerDepth;
+
+    float weight = afterDepth / (afterDepth - beforeDepth);
+    vec2 finalTexCoords = prevTexCoords * weight + currentTexCoords * (1.0 - weight);
+
+    return finalTexCoords;
+}
\ No newline at end of file
@@ -0,0 +1,14 @@
+#version 450 core
+layout (location = 0) out vec4 Frag_Color;
+
+in vec2 corner;
+in vec4 color;
+
+void main()
+{
+    //a round soft dot out of the quad, blended additively so the order does not matter
+    float falloff = 1.0 - dot(corner, corner);
+    if(falloff <= 0.0)
+        discard;
+    Frag_Color = vec4(color.rgb * color.a * falloff * 0.5, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#version 450 core
+//six vertices per live particle, a quad facing the camera around the particle the vertex finds in the live list
+
+struct Particle
+{
+    vec4 positionLife;
+    vec4 velocityLifetime;
+};
+
+layout (std430, binding = 14) readonly buffer Particles { Particle particles[]; };
+layout (std430, binding = 15) readonly buffer AliveLists { uint aliveLists[]; };
+
+out vec2 corner;
+out vec4 color;
+
+uniform mat4 VP;
+uniform vec3 cameraRight;
+uniform vec3 cameraUp;
+uniform uint aliveBase;
+uniform float particleSize;
+
+const vec2 corners[6] = vec2[](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0));
+
+void main()
+{
+    Particle particle = particles[aliveLists[aliveBase + uint(gl_VertexID / 6)]];
+    float age = 1.0 - particle.positionLife.w / particle.velocityLifetime.w;
+    corner = corners[gl_VertexID % 6];
+    //hot and bright at birth, cooling to blue as it fades out
+    color = vec4(mix(vec3(1.0, 0.7, 0.3), vec3(0.2, 0.4, 1.0), age), 1.0 - age);
+    vec3 position = particle.positionLife.xyz + (cameraRight * corner.x + cameraUp * corner.y) * particleSize;
+    gl_Position = VP * vec4(position, 1.0);
+}
\ No newline at end of file
@@ -1,14 +1,20 @@
 #version 450 core
 layout (location = 0) in vec3 position;
-layout (location = 1) in vec3 inColor;
+layout (location = 1) in vec3 inNormal;
+layout (location = 9) in mat4 nodeMat;
+layout (location = 13) in mat3x4 nodeNormalMat;
 
 out VS_OUT
 {
     vec3 color;
 }vs_out;
 
+uniform mat4 VP;
+uniform mat4 modelMat;
+uniform mat3 modelNormalMat;
+
 void main()
 {
-    vs_out.color = inColor;
-    gl_Position = vec4(position, 1.0f);
+    vs_out.color = normalize(modelNormalMat * (mat3(nodeNormalMat) * inNormal)) * 0.5 + 0.5;
+    gl_Position = VP * (modelMat * nodeMat * vec4(position, 1.0f));
 }
\ No newline at end of file
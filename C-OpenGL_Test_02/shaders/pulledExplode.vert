@@ -0,0 +1,32 @@
+#version 450 core
+//every vertex reads the whole triangle it belongs to, so it can move along the face normal like modelGeometry.geom
+
+//vertexPulling.vert
+struct Node
+{
+    mat4 modelMat;
+    mat3x4 normalMat;
+};
+vec3 pulledPosition(uint vertex);
+vec2 pulledTexCoords(uint vertex);
+uint pulledIndex(uint corner);
+Node pulledNode(int instance);
+
+out vec2 TexCoords;
+
+uniform mat4 VP;
+uniform mat4 modelMat;
+uniform float explodeConst;
+
+void main()
+{
+    uint first = uint(gl_VertexID / 3) * 3u;
+    mat4 worldMat = modelMat * pulledNode(gl_InstanceID).modelMat;
+    vec3 corners[3];
+    for(int i = 0; i < 3; ++i)
+        corners[i] = (worldMat * vec4(pulledPosition(pulledIndex(first + uint(i))), 1.0f)).xyz;
+    vec3 normal = normalize(cross(corners[0] - corners[1], corners[2] - corners[1]));
+    uint vertex = pulledIndex(uint(gl_VertexID));
+    TexCoords = pulledTexCoords(vertex);
+    gl_Position = VP * vec4(corners[gl_VertexID % 3] + explodeConst * normal, 1.0f);
+}
\ No newline at end of file
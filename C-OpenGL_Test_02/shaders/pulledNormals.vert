@@ -0,0 +1,28 @@
+#version 450 core
+//two vertices per triangle corner, the line modelNormal.geom emits for it
+
+//vertexPulling.vert
+struct Node
+{
+    mat4 modelMat;
+    mat3x4 normalMat;
+};
+vec3 pulledPosition(uint vertex);
+vec3 pulledNormal(uint vertex);
+uint pulledIndex(uint corner);
+Node pulledNode(int instance);
+
+uniform mat4 VP;
+uniform mat4 modelMat;
+uniform mat3 modelNormalMat;
+uniform float normalLength;
+
+void main()
+{
+    uint vertex = pulledIndex(uint(gl_VertexID >> 1));
+    Node node = pulledNode(gl_InstanceID);
+    vec4 world = modelMat * node.modelMat * vec4(pulledPosition(vertex), 1.0f);
+    if((gl_VertexID & 1) == 1)
+        world.xyz += normalize(modelNormalMat * (mat3(node.normalMat) * pulledNormal(vertex))) * normalLength;
+    gl_Position = VP * world;
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#version 450 core
+//nine vertices per model vertex, the three triangles of the strip pointsGeometry.geom emits for a point
+
+//vertexPulling.vert
+struct Node
+{
+    mat4 modelMat;
+    mat3x4 normalMat;
+};
+vec3 pulledPosition(uint vertex);
+vec3 pulledNormal(uint vertex);
+Node pulledNode(int instance);
+
+out vec3 color;
+
+uniform mat4 VP;
+uniform mat4 modelMat;
+uniform mat3 modelNormalMat;
+uniform float spriteSize;
+
+//strip corners of the triangles, the second one turned around to keep the winding
+const int stripCorners[9] = int[](0, 1, 2, 2, 1, 3, 2, 3, 4);
+const vec2 cornerOffsets[5] = vec2[](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(-1.0, 1.0), vec2(1.0, 1.0), vec2(0.0, 2.0));
+const float cornerShades[5] = float[](-0.1, -0.1, 0.0, 0.0, 0.1);
+
+void main()
+{
+    uint vertex = uint(gl_VertexID / 9);
+    int corner = stripCorners[gl_VertexID % 9];
+    Node node = pulledNode(gl_InstanceID);
+    vec4 center = VP * (modelMat * node.modelMat * vec4(pulledPosition(vertex), 1.0f));
+    vec3 normal = normalize(modelNormalMat * (mat3(node.normalMat) * pulledNormal(vertex)));
+    color = normal * 0.5 + 0.5 + vec3(cornerShades[corner]);
+    //the offsets are in normalized device units, so the sprites keep their size on screen
+    gl_Position = center + vec4(cornerOffsets[corner] * spriteSize * center.w, 0.0, 0.0);
+}
\ No newline at end of file
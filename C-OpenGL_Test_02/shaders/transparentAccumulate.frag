@@ -0,0 +1,26 @@
+#version 450 core
+layout (location = 0) out vec4 Frag_Color;
+layout (location = 1) out float Frag_Revealage;
+
+in vec2 TexCoords;
+flat in int TexIndex;
+in float Tint;
+in float ViewDepth;
+
+layout (binding = 0) uniform sampler2D grassTex;
+layout (binding = 1) uniform sampler2D windowTex;
+
+void main()
+{
+    vec4 grass = texture(grassTex, TexCoords);
+    vec4 window = texture(windowTex, TexCoords);
+    vec4 color = TexIndex == 0 ? grass : window;
+    if(color.a < 0.01)
+        discard;
+
+    //nearer and more opaque surfaces weigh more, so the blend approximates the sorted order without sorting,
+    //window depth is nearly constant past the near plane so the falloff is over view distance instead
+    float weight = color.a * clamp(10.0 / (1e-5 + pow(ViewDepth / 5.0, 2.0) + pow(ViewDepth / 200.0, 6.0)), 1e-2, 3e3);
+    Frag_Color = vec4(color.rgb * Tint * color.a, color.a) * weight;
+    Frag_Revealage = color.a;
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+#version 450 core
+layout (location = 0) out vec4 Frag_Color;
+
+in vec2 TexCoords;
+
+layout (binding = 0) uniform sampler2D accum;
+layout (binding = 1) uniform sampler2D revealage;
+
+void main()
+{
+    ivec2 coord = ivec2(gl_FragCoord.xy);
+    float reveal = texelFetch(revealage, coord, 0).r;
+    //nothing transparent covers this pixel
+    if(reveal >= 1.0)
+        discard;
+    //many close layers can still overflow half floats, inf over inf would be nan
+    vec4 sum = min(texelFetch(accum, coord, 0), vec4(6e4));
+    vec3 average = sum.rgb / max(sum.a, 1e-4);
+    Frag_Color = vec4(average, 1.0 - reveal);
+}
\ No newline at end of file
@@ -0,0 +1,24 @@
+#version 450 core
+layout (location = 0) in vec4 positionScale;
+layout (location = 1) in vec4 params;
+
+out vec2 TexCoords;
+flat out int TexIndex;
+out float Tint;
+//distance along the view direction, for the weighted blend
+out float ViewDepth;
+
+uniform mat4 VP;
+
+void main()
+{
+    //a quad standing on its foot, the corners come from the vertex index of a 4 vertex strip
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    vec3 right = vec3(cos(params.x), 0.0, sin(params.x));
+    vec3 worldPos = positionScale.xyz + (right * (corner.x - 0.5) + vec3(0.0, corner.y, 0.0)) * positionScale.w;
+    TexCoords = corner;
+    TexIndex = int(params.y);
+    Tint = params.z;
+    gl_Position = VP * vec4(worldPos, 1.0);
+    ViewDepth = gl_Position.w;
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+#version 450 core
+layout (location = 0) out vec4 Frag_Color;
+
+in vec2 TexCoords;
+flat in int TexIndex;
+in float Tint;
+
+layout (binding = 0) uniform sampler2D grassTex;
+layout (binding = 1) uniform sampler2D windowTex;
+
+void main()
+{
+    //both are sampled so the lookups stay in uniform control flow
+    vec4 grass = texture(grassTex, TexCoords);
+    vec4 window = texture(windowTex, TexCoords);
+    vec4 color = TexIndex == 0 ? grass : window;
+    if(color.a < 0.01)
+        discard;
+    Frag_Color = vec4(color.rgb * Tint, color.a);
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#version 450 core
+//linked into the vertex shaders that read the model themselves instead of through attributes,
+//the buffers of one mesh as Mesh stores them, a Vertex is eight floats
+
+struct Node
+{
+    mat4 modelMat;
+    mat3x4 normalMat;
+};
+
+layout (std430, binding = 11) readonly buffer Vertices { float vertexData[]; };
+layout (std430, binding = 12) readonly buffer Indices { uint indices[]; };
+layout (std430, binding = 13) readonly buffer Nodes { Node nodes[]; };
+
+vec3 pulledPosition(uint vertex)
+{
+    uint base = vertex * 8u;
+    return vec3(vertexData[base], vertexData[base + 1u], vertexData[base + 2u]);
+}
+
+vec3 pulledNormal(uint vertex)
+{
+    uint base = vertex * 8u + 3u;
+    return vec3(vertexData[base], vertexData[base + 1u], vertexData[base + 2u]);
+}
+
+vec2 pulledTexCoords(uint vertex)
+{
+    uint base = vertex * 8u + 6u;
+    return vec2(vertexData[base], vertexData[base + 1u]);
+}
+
+uint pulledIndex(uint corner)
+{
+    return indices[corner];
+}
+
+Node pulledNode(int instance)
+{
+    return nodes[instance];
+}
\ No newline at end of file